@@ -12,18 +12,29 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <syslog.h>
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <eb32tree.h>
 #include <eb64tree.h>
 #include <ebistree.h>
 #include <ebsttree.h>
 
+#include "logbin.h"
+
 #define SOURCE_FIELD 5
 #define ACCEPT_FIELD 6
 #define SERVER_FIELD 8
@@ -37,12 +48,15 @@
 #define URL_FIELD 18
 #define MAXLINE 16384
 #define QBITS 4
+#define MAXTHREADS 64
 
 #define SEP(c) ((unsigned char)(c) <= ' ')
 #define SKIP_CHAR(p,c) do { while (1) { int __c = (unsigned char)*p++; if (__c == c) break; if (__c <= ' ') { p--; break; } } } while (0)
 
-/* [0] = err/date, [1] = req, [2] = conn, [3] = resp, [4] = data */
-static struct eb_root timers[5] = {
+/* [0] = err/date, [1] = req, [2] = conn, [3] = resp, [4] = data. Each thread
+ * fills its own trees, which are merged into the main thread's at the end.
+ */
+static __thread struct eb_root timers[5] = {
 	EB_ROOT_UNIQUE, EB_ROOT_UNIQUE, EB_ROOT_UNIQUE,
 	EB_ROOT_UNIQUE, EB_ROOT_UNIQUE,
 };
@@ -118,12 +132,35 @@ struct url_stat {
 
 unsigned int filter = 0;
 unsigned int filter_invert = 0;
-const char *line;
-int linenum = 0;
-int parse_err = 0;
-int lines_out = 0;
 int lines_max = -1;
 
+/* per-thread parsing state */
+__thread const char *line;
+__thread int linenum = 0;
+__thread int parse_err = 0;
+__thread int lines_out = 0;
+
+/* input filters settings */
+static const char *filter_term_code_name = NULL;
+static int filter_time_resp = 0;
+static int filt_http_status_low = 0, filt_http_status_high = 0;
+static int skip_fields = 1;
+
+static void (*line_filter)(const char *accept_field, const char *time_field, struct timer **tptr) = NULL;
+static const char *(*read_line)(FILE *stream);
+static int bin_input = 0; /* read binary records from "option log-binary" */
+
+/* part of the mmapped input file processed by a thread */
+struct worker {
+	pthread_t thr;
+	const char *start, *end;
+	int linenum, parse_err, lines_out;
+};
+
+static __thread const char *mm_cur, *mm_end;
+static struct eb_root *main_timers;
+static pthread_mutex_t merge_lock = PTHREAD_MUTEX_INITIALIZER;
+
 const char *fgets2(FILE *stream);
 
 void filter_count_url(const char *accept_field, const char *time_field, struct timer **tptr);
@@ -135,6 +172,7 @@ void filter_count_status(const char *accept_field, const char *time_field, struc
 void filter_graphs(const char *accept_field, const char *time_field, struct timer **tptr);
 void filter_output_line(const char *accept_field, const char *time_field, struct timer **tptr);
 void filter_accept_holes(const char *accept_field, const char *time_field, struct timer **tptr);
+void filter_bin_record(struct logbin_rec *r, struct timer **tptr);
 
 void usage(FILE *output, const char *msg)
 {
@@ -144,7 +182,8 @@ void usage(FILE *output, const char *msg)
 		"       halog [-q] [-c] [-m <lines>]\n"
 		"       {-cc|-gt|-pct|-st|-tc|-srv|-u|-uc|-ue|-ua|-ut|-uao|-uto|-uba|-ubt|-ic}\n"
 		"       [-s <skip>] [-e|-E] [-H] [-rt|-RT <time>] [-ad <delay>] [-ac <count>]\n"
-		"       [-v] [-Q|-QS] [-tcn|-TCN <termcode>] [ -hs|-HS [min][:[max]] ] < log\n"
+		"       [-v] [-Q|-QS] [-tcn|-TCN <termcode>] [ -hs|-HS [min][:[max]] ] [-bin]\n"
+		"       [-j <threads>] < log\n"
 		"\n",
 		msg ? msg : ""
 		);
@@ -174,6 +213,8 @@ void help()
 	       " -v                      invert the input filtering condition\n"
 	       " -q                      don't report errors/warnings\n"
 	       " -m <lines>              limit output to the first <lines> lines\n"
+	       " -bin                    read binary records from \"option log-binary\"\n"
+	       " -j <threads>            process a regular input file using <threads> threads\n"
 	       "Output filters - only one may be used at a time\n"
 	       " -c    only report the number of lines that would have been printed\n"
 	       " -pct  output connect and response times percentiles\n"
@@ -238,6 +279,48 @@ const char *field_stop(const char *p)
  * contiguous spaces (or tabs) as one delimiter. May return pointer to
  * last char if field is not found. Equivalent to awk '{print $field}'.
  */
+#if defined(__SSE2__) && !defined(PREFER_ASM)
+/* This version checks 16 bytes at once. Fields start on a non-separator which
+ * follows a separator, so we build the bit mask of spaces and zeroes in each
+ * block and count the field starts using a few bit operations. Loads are
+ * aligned so that they never cross a page boundary, and the bytes before <p>
+ * are considered as separators.
+ */
+const char *field_start(const char *p, int field)
+{
+	const __m128i spc = _mm_set1_epi8(' ');
+	const __m128i nul = _mm_setzero_si128();
+	const char *blk = (const char *)((unsigned long)p & ~15UL);
+	unsigned int before = (1U << (p - blk)) - 1;
+	unsigned int prev = 1; /* previous char was a separator */
+	unsigned int sep, zero, starts;
+	int cnt;
+
+	while (1) {
+		__m128i v = _mm_load_si128((const __m128i *)blk);
+
+		zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nul)) & ~before;
+		sep  = _mm_movemask_epi8(_mm_cmpeq_epi8(v, spc)) | zero | before;
+		starts = ~sep & ((sep << 1) | prev) & 0xFFFF;
+		if (zero)
+			starts &= zero ^ (zero - 1); /* only before the first zero */
+
+		cnt = __builtin_popcount(starts);
+		if (cnt >= field) {
+			while (--field)
+				starts &= starts - 1;
+			return blk + __builtin_ctz(starts);
+		}
+		if (zero)
+			return blk + __builtin_ctz(zero);
+
+		field -= cnt;
+		prev = (sep >> 15) & 1;
+		before = 0;
+		blk += 16;
+	}
+}
+#else
 const char *field_start(const char *p, int field)
 {
 #ifndef PREFER_ASM
@@ -316,6 +399,7 @@ const char *field_start(const char *p, int field)
 	return p;
 #endif
 }
+#endif /* __SSE2__ */
 
 /* keep only the <bits> higher bits of <i> */
 static inline unsigned int quantify_u32(unsigned int i, int bits)
@@ -527,202 +611,49 @@ void truncated_line(int linenum, const char *line)
 		fprintf(stderr, "Truncated line %d: %s\n", linenum, line);
 }
 
-int main(int argc, char **argv)
+/* Reads the next line from the part of the mmapped input file assigned to
+ * the current thread. The line is copied to a buffer so that it can be zero-
+ * terminated and modified by the parsers. Returns NULL at the end.
+ */
+const char *mmap_gets(FILE *stream)
 {
-	const char *b, *e, *p, *time_field, *accept_field, *source_field;
-	const char *filter_term_code_name = NULL;
-	const char *output_file = NULL;
-	int f, last, err;
-	struct timer *t = NULL;
-	struct eb32_node *n;
-	struct url_stat *ustat = NULL;
-	int val, test;
-	int filter_acc_delay = 0, filter_acc_count = 0;
-	int filter_time_resp = 0;
-	int filt_http_status_low = 0, filt_http_status_high = 0;
-	int skip_fields = 1;
-
-	void (*line_filter)(const char *accept_field, const char *time_field, struct timer **tptr) = NULL;
-
-	argc--; argv++;
-	while (argc > 0) {
-		if (*argv[0] != '-')
-			break;
-
-		if (strcmp(argv[0], "-ad") == 0) {
-			if (argc < 2) die("missing option for -ad");
-			argc--; argv++;
-			filter |= FILT_ACC_DELAY;
-			filter_acc_delay = atol(*argv);
-		}
-		else if (strcmp(argv[0], "-ac") == 0) {
-			if (argc < 2) die("missing option for -ac");
-			argc--; argv++;
-			filter |= FILT_ACC_COUNT;
-			filter_acc_count = atol(*argv);
-		}
-		else if (strcmp(argv[0], "-rt") == 0) {
-			if (argc < 2) die("missing option for -rt");
-			argc--; argv++;
-			filter |= FILT_TIME_RESP;
-			filter_time_resp = atol(*argv);
-		}
-		else if (strcmp(argv[0], "-RT") == 0) {
-			if (argc < 2) die("missing option for -RT");
-			argc--; argv++;
-			filter |= FILT_TIME_RESP | FILT_INVERT_TIME_RESP;
-			filter_time_resp = atol(*argv);
-		}
-		else if (strcmp(argv[0], "-s") == 0) {
-			if (argc < 2) die("missing option for -s");
-			argc--; argv++;
-			skip_fields = atol(*argv);
-		}
-		else if (strcmp(argv[0], "-m") == 0) {
-			if (argc < 2) die("missing option for -m");
-			argc--; argv++;
-			lines_max = atol(*argv);
-		}
-		else if (strcmp(argv[0], "-e") == 0)
-			filter |= FILT_ERRORS_ONLY;
-		else if (strcmp(argv[0], "-E") == 0)
-			filter |= FILT_ERRORS_ONLY | FILT_INVERT_ERRORS;
-		else if (strcmp(argv[0], "-H") == 0)
-			filter |= FILT_HTTP_ONLY;
-		else if (strcmp(argv[0], "-Q") == 0)
-			filter |= FILT_QUEUE_ONLY;
-		else if (strcmp(argv[0], "-QS") == 0)
-			filter |= FILT_QUEUE_SRV_ONLY;
-		else if (strcmp(argv[0], "-c") == 0)
-			filter |= FILT_COUNT_ONLY;
-		else if (strcmp(argv[0], "-q") == 0)
-			filter |= FILT_QUIET;
-		else if (strcmp(argv[0], "-v") == 0)
-			filter_invert = !filter_invert;
-		else if (strcmp(argv[0], "-gt") == 0)
-			filter |= FILT_GRAPH_TIMERS;
-		else if (strcmp(argv[0], "-pct") == 0)
-			filter |= FILT_PERCENTILE;
-		else if (strcmp(argv[0], "-st") == 0)
-			filter |= FILT_COUNT_STATUS;
-		else if (strcmp(argv[0], "-srv") == 0)
-			filter |= FILT_COUNT_SRV_STATUS;
-		else if (strcmp(argv[0], "-cc") == 0)
-			filter |= FILT_COUNT_COOK_CODES;
-		else if (strcmp(argv[0], "-tc") == 0)
-			filter |= FILT_COUNT_TERM_CODES;
-		else if (strcmp(argv[0], "-tcn") == 0) {
-			if (argc < 2) die("missing option for -tcn");
-			argc--; argv++;
-			filter |= FILT_TERM_CODE_NAME;
-			filter_term_code_name = *argv;
-		}
-		else if (strcmp(argv[0], "-TCN") == 0) {
-			if (argc < 2) die("missing option for -TCN");
-			argc--; argv++;
-			filter |= FILT_TERM_CODE_NAME | FILT_INVERT_TERM_CODE_NAME;
-			filter_term_code_name = *argv;
-		}
-		else if (strcmp(argv[0], "-hs") == 0 || strcmp(argv[0], "-HS") == 0) {
-			char *sep, *str;
-
-			if (argc < 2) die("missing option for -hs/-HS ([min]:[max])");
-			filter |= FILT_HTTP_STATUS;
-			if (argv[0][1] == 'H')
-				filter |= FILT_INVERT_HTTP_STATUS;
-
-			argc--; argv++;
-			str = *argv;
-			sep = strchr(str, ':');  /* [min]:[max] */
-			if (!sep)
-				sep = str; /* make max point to min */
-			else
-				*sep++ = 0;
-			filt_http_status_low = *str ? atol(str) : 0;
-			filt_http_status_high = *sep ? atol(sep) : 65535;
-		}
-		else if (strcmp(argv[0], "-u") == 0)
-			filter |= FILT_COUNT_URL_ONLY;
-		else if (strcmp(argv[0], "-uc") == 0)
-			filter |= FILT_COUNT_URL_COUNT;
-		else if (strcmp(argv[0], "-ue") == 0)
-			filter |= FILT_COUNT_URL_ERR;
-		else if (strcmp(argv[0], "-ua") == 0)
-			filter |= FILT_COUNT_URL_TAVG;
-		else if (strcmp(argv[0], "-ut") == 0)
-			filter |= FILT_COUNT_URL_TTOT;
-		else if (strcmp(argv[0], "-uao") == 0)
-			filter |= FILT_COUNT_URL_TAVGO;
-		else if (strcmp(argv[0], "-uto") == 0)
-			filter |= FILT_COUNT_URL_TTOTO;
-		else if (strcmp(argv[0], "-uba") == 0)
-			filter |= FILT_COUNT_URL_BAVG;
-		else if (strcmp(argv[0], "-ubt") == 0)
-			filter |= FILT_COUNT_URL_BTOT;
-		else if (strcmp(argv[0], "-ic") == 0)
-			filter |= FILT_COUNT_IP_COUNT;
-		else if (strcmp(argv[0], "-o") == 0) {
-			if (output_file)
-				die("Fatal: output file name already specified.\n");
-			if (argc < 2)
-				die("Fatal: missing output file name.\n");
-			output_file = argv[1];
+	static __thread char *buf;
+	static __thread size_t size;
+	const char *eol;
+	size_t len;
+
+	if (mm_cur >= mm_end)
+		return NULL;
+
+	eol = memchr(mm_cur, '\n', mm_end - mm_cur);
+	if (!eol)
+		eol = mm_end;
+	len = eol - mm_cur;
+
+	/* keep some room for the 16-byte reads of field_start() */
+	if (len + 16 > size) {
+		size = (len + 16 + 4095) & -4096;
+		free(buf);
+		buf = malloc(size);
+		if (!buf) {
+			fprintf(stderr, "%s: not enough memory\n", __FUNCTION__);
+			exit(1);
 		}
-		else if (strcmp(argv[0], "-h") == 0 || strcmp(argv[0], "--help") == 0)
-			help();
-		argc--;
-		argv++;
 	}
+	memcpy(buf, mm_cur, len);
+	buf[len] = 0;
+	mm_cur = eol + 1;
+	return buf;
+}
 
-	if (!filter)
-		die("No action specified.\n");
-
-	if (filter & FILT_ACC_COUNT && !filter_acc_count)
-		filter_acc_count=1;
-
-	if (filter & FILT_ACC_DELAY && !filter_acc_delay)
-		filter_acc_delay = 1;
-
-
-	/* by default, all lines are printed */
-	line_filter = filter_output_line;
-	if (filter & (FILT_ACC_COUNT|FILT_ACC_DELAY))
-		line_filter = filter_accept_holes;
-	else if (filter & (FILT_GRAPH_TIMERS|FILT_PERCENTILE))
-		line_filter = filter_graphs;
-	else if (filter & FILT_COUNT_STATUS)
-		line_filter = filter_count_status;
-	else if (filter & FILT_COUNT_COOK_CODES)
-		line_filter = filter_count_cook_codes;
-	else if (filter & FILT_COUNT_TERM_CODES)
-		line_filter = filter_count_term_codes;
-	else if (filter & FILT_COUNT_SRV_STATUS)
-		line_filter = filter_count_srv_status;
-	else if (filter & FILT_COUNT_URL_ANY)
-		line_filter = filter_count_url;
-	else if (filter & FILT_COUNT_ONLY)
-		line_filter = NULL;
-
-#if defined(POSIX_FADV_SEQUENTIAL)
-	/* around 20% performance improvement is observed on Linux with this
-	 * on cold-cache. Surprizingly, WILLNEED is less performant. Don't
-	 * use NOREUSE as it flushes the cache and prevents easy data
-	 * manipulation on logs!
-	 */
-	posix_fadvise(0, 0, 0, POSIX_FADV_SEQUENTIAL);
-#endif
-
-	if (!line_filter && /* FILT_COUNT_ONLY ( see above), and no input filter (see below) */
-	    !(filter & (FILT_HTTP_ONLY|FILT_TIME_RESP|FILT_ERRORS_ONLY|FILT_HTTP_STATUS|FILT_QUEUE_ONLY|FILT_QUEUE_SRV_ONLY|FILT_TERM_CODE_NAME))) {
-		/* read the whole file at once first, ignore it if inverted output */
-		if (!filter_invert)
-			while ((lines_max < 0 || lines_out < lines_max) && fgets2(stdin) != NULL)
-				lines_out++;
-
-		goto skip_filters;
-	}
+/* Applies the input filters and the line filter to all input lines. */
+static void process_input()
+{
+	const char *b, *e, *p, *time_field, *accept_field, *source_field;
+	struct timer *t = NULL;
+	int f, err, val, test;
 
-	while ((line = fgets2(stdin)) != NULL) {
+	while ((line = read_line(stdin)) != NULL) {
 		linenum++;
 		time_field = NULL; accept_field = NULL;
 		source_field = NULL;
@@ -893,49 +824,469 @@ int main(int argc, char **argv)
 			break;
 	}
 
- skip_filters:
-	/*****************************************************
-	 * Here we've finished reading all input. Depending on the
-	 * filters, we may still have some analysis to run on the
-	 * collected data and to output data in a new format.
-	 *************************************************** */
-
 	if (t)
 		free(t);
+}
 
-	if (filter & FILT_COUNT_ONLY) {
-		printf("%d\n", lines_out);
-		exit(0);
-	}
+/* Same as process_input() for binary records. The input filters directly check
+ * the decoded fields, nothing is parsed.
+ */
+static void process_bin_input()
+{
+	struct logbin_rec r;
+	struct timer *t = NULL;
+	int val, test;
 
-	if (filter & (FILT_ACC_COUNT|FILT_ACC_DELAY)) {
-		/* sort and count all timers. Output will look like this :
-		 * <accept_date> <delta_ms from previous one> <nb entries>
-		 */
-		n = eb32_first(&timers[0]);
+	while (logbin_read(stdin, &r)) {
+		linenum++;
 
-		if (n)
-			last = n->key;
-		while (n) {
-			unsigned int d, h, m, s, ms;
+		if (unlikely(!r.valid)) {
+			parse_err++;
+			continue;
+		}
 
-			t = container_of(n, struct timer, node);
-			h = n->key;
-			d = h - last;
-			last = h;
+		test = 1;
 
-			if (d >= filter_acc_delay && t->count >= filter_acc_count) {
-				ms = h % 1000; h = h / 1000;
-				s = h % 60; h = h / 60;
-				m = h % 60; h = h / 60;
-				printf("%02d:%02d:%02d.%03d %d %d %d\n", h, m, s, ms, last, d, t->count);
-				lines_out++;
-				if (lines_max >= 0 && lines_out >= lines_max)
-					break;
+		if (filter & FILT_HTTP_ONLY)
+			test &= r.http;
+
+		if (filter & FILT_TIME_RESP) {
+			/* only report lines with response times larger than filter_time_resp */
+			if (unlikely(!r.http)) {
+				parse_err++;
+				continue;
 			}
-			n = eb32_next(n);
+			val = (r.timers[3] < 0) ? -1 : r.timers[3];
+			test &= (val >= filter_time_resp) ^ !!(filter & FILT_INVERT_TIME_RESP);
 		}
-	}
+
+		if (filter & (FILT_ERRORS_ONLY | FILT_HTTP_STATUS)) {
+			/* Check both error codes (-1, 5xx) and status code ranges */
+			val = r.status;
+			if (filter & FILT_ERRORS_ONLY)
+				test &= (val < 0 || (val >= 500 && val <= 599)) ^ !!(filter & FILT_INVERT_ERRORS);
+
+			if (filter & FILT_HTTP_STATUS)
+				test &= (val >= filt_http_status_low && val <= filt_http_status_high) ^ !!(filter & FILT_INVERT_HTTP_STATUS);
+		}
+
+		if (filter & (FILT_QUEUE_ONLY|FILT_QUEUE_SRV_ONLY)) {
+			/* Check if the server's queue is non-nul */
+			if (!r.srv_queue) {
+				if (filter & FILT_QUEUE_SRV_ONLY)
+					test = 0;
+				else
+					test &= (r.bck_queue > 0);
+			}
+		}
+
+		if (filter & FILT_TERM_CODE_NAME) {
+			/* only report corresponding termination code name */
+			test &= (r.termstate[0] == filter_term_code_name[0] && r.termstate[1] == filter_term_code_name[1]) ^ !!(filter & FILT_INVERT_TERM_CODE_NAME);
+		}
+
+		test ^= filter_invert;
+		if (!test)
+			continue;
+
+		if (line_filter)
+			filter_bin_record(&r, &t);
+		else
+			lines_out++; /* FILT_COUNT_ONLY was used, so we're just counting lines */
+		if (lines_max >= 0 && lines_out >= lines_max)
+			break;
+	}
+
+	if (t)
+		free(t);
+}
+
+/* Moves all the nodes of the trees filled by the current thread to the main
+ * thread's ones, merging those which are present in both.
+ */
+static void merge_timers()
+{
+	struct timer *t, *old;
+	struct eb32_node *n;
+	struct ebmb_node *srv_node, *srv_old;
+	struct srv_st *srv, *srv2;
+	struct ebpt_node *u, *u_old;
+	struct url_stat *ustat, *ustat_old;
+	int f;
+
+	if (line_filter == filter_count_srv_status) {
+		while ((srv_node = ebmb_first(&timers[0]))) {
+			ebmb_delete(srv_node);
+			srv = container_of(srv_node, struct srv_st, node);
+			srv_old = ebst_insert(&main_timers[0], srv_node);
+			if (srv_old == srv_node)
+				continue;
+			srv2 = container_of(srv_old, struct srv_st, node);
+			for (f = 0; f < 6; f++)
+				srv2->st_cnt[f] += srv->st_cnt[f];
+			srv2->nb_ct += srv->nb_ct;
+			srv2->nb_rt += srv->nb_rt;
+			srv2->nb_ok += srv->nb_ok;
+			srv2->cum_ct += srv->cum_ct;
+			srv2->cum_rt += srv->cum_rt;
+			free(srv);
+		}
+	}
+	else if (line_filter == filter_count_url || (filter & FILT_COUNT_IP_COUNT)) {
+		while ((u = ebpt_first(&timers[0]))) {
+			ebpt_delete(u);
+			ustat = container_of(u, struct url_stat, node.url);
+			u_old = ebis_insert(&main_timers[0], u);
+			if (u_old == u)
+				continue;
+			ustat_old = container_of(u_old, struct url_stat, node.url);
+			ustat_old->nb_req += ustat->nb_req;
+			ustat_old->nb_err += ustat->nb_err;
+			ustat_old->total_time += ustat->total_time;
+			ustat_old->total_time_ok += ustat->total_time_ok;
+			ustat_old->total_bytes_sent += ustat->total_bytes_sent;
+			free(ustat->url);
+			free(ustat);
+		}
+	}
+	else {
+		for (f = 0; f < 5; f++) {
+			while ((n = eb32_first(&timers[f]))) {
+				eb32_delete(n);
+				t = container_of(n, struct timer, node);
+				old = container_of(eb32i_insert(&main_timers[f], n), struct timer, node);
+				if (old == t)
+					continue;
+				old->count += t->count;
+				free(t);
+			}
+		}
+	}
+}
+
+/* thread entry point, processes the lines of worker <arg> */
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+
+	mm_cur = w->start;
+	mm_end = w->end;
+	process_input();
+
+	pthread_mutex_lock(&merge_lock);
+	merge_timers();
+	pthread_mutex_unlock(&merge_lock);
+
+	w->linenum = linenum;
+	w->parse_err = parse_err;
+	w->lines_out = lines_out;
+	return NULL;
+}
+
+/* Splits the mmapped input file between <nbthr> threads on line boundaries,
+ * runs them and collects their results.
+ */
+static void run_workers(int nbthr)
+{
+	struct worker workers[MAXTHREADS];
+	const char *start = mm_cur;
+	const char *end = mm_end;
+	const char *cut;
+	int i;
+
+	main_timers = timers;
+	for (i = 0; i < nbthr; i++) {
+		cut = (i == nbthr - 1) ? end : start + (end - start) / (nbthr - i);
+		if (cut < end) {
+			cut = memchr(cut, '\n', end - cut);
+			cut = cut ? cut + 1 : end;
+		}
+		workers[i].start = start;
+		workers[i].end = cut;
+		start = cut;
+		if (pthread_create(&workers[i].thr, NULL, worker_run, &workers[i]) != 0) {
+			fprintf(stderr, "Failed to start thread %d\n", i);
+			exit(1);
+		}
+	}
+
+	for (i = 0; i < nbthr; i++) {
+		pthread_join(workers[i].thr, NULL);
+		linenum += workers[i].linenum;
+		parse_err += workers[i].parse_err;
+		lines_out += workers[i].lines_out;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *output_file = NULL;
+	int f, last;
+	struct timer *t = NULL;
+	struct eb32_node *n;
+	struct url_stat *ustat = NULL;
+	int filter_acc_delay = 0, filter_acc_count = 0;
+	int nbthreads = 1;
+	struct stat st;
+	void *map = MAP_FAILED;
+
+	read_line = fgets2;
+
+	argc--; argv++;
+	while (argc > 0) {
+		if (*argv[0] != '-')
+			break;
+
+		if (strcmp(argv[0], "-ad") == 0) {
+			if (argc < 2) die("missing option for -ad");
+			argc--; argv++;
+			filter |= FILT_ACC_DELAY;
+			filter_acc_delay = atol(*argv);
+		}
+		else if (strcmp(argv[0], "-bin") == 0)
+			bin_input = 1;
+		else if (strcmp(argv[0], "-j") == 0) {
+			if (argc < 2) die("missing option for -j");
+			argc--; argv++;
+			nbthreads = atol(*argv);
+			if (nbthreads < 1 || nbthreads > MAXTHREADS)
+				die("invalid number of threads for -j\n");
+		}
+		else if (strcmp(argv[0], "-ac") == 0) {
+			if (argc < 2) die("missing option for -ac");
+			argc--; argv++;
+			filter |= FILT_ACC_COUNT;
+			filter_acc_count = atol(*argv);
+		}
+		else if (strcmp(argv[0], "-rt") == 0) {
+			if (argc < 2) die("missing option for -rt");
+			argc--; argv++;
+			filter |= FILT_TIME_RESP;
+			filter_time_resp = atol(*argv);
+		}
+		else if (strcmp(argv[0], "-RT") == 0) {
+			if (argc < 2) die("missing option for -RT");
+			argc--; argv++;
+			filter |= FILT_TIME_RESP | FILT_INVERT_TIME_RESP;
+			filter_time_resp = atol(*argv);
+		}
+		else if (strcmp(argv[0], "-s") == 0) {
+			if (argc < 2) die("missing option for -s");
+			argc--; argv++;
+			skip_fields = atol(*argv);
+		}
+		else if (strcmp(argv[0], "-m") == 0) {
+			if (argc < 2) die("missing option for -m");
+			argc--; argv++;
+			lines_max = atol(*argv);
+		}
+		else if (strcmp(argv[0], "-e") == 0)
+			filter |= FILT_ERRORS_ONLY;
+		else if (strcmp(argv[0], "-E") == 0)
+			filter |= FILT_ERRORS_ONLY | FILT_INVERT_ERRORS;
+		else if (strcmp(argv[0], "-H") == 0)
+			filter |= FILT_HTTP_ONLY;
+		else if (strcmp(argv[0], "-Q") == 0)
+			filter |= FILT_QUEUE_ONLY;
+		else if (strcmp(argv[0], "-QS") == 0)
+			filter |= FILT_QUEUE_SRV_ONLY;
+		else if (strcmp(argv[0], "-c") == 0)
+			filter |= FILT_COUNT_ONLY;
+		else if (strcmp(argv[0], "-q") == 0)
+			filter |= FILT_QUIET;
+		else if (strcmp(argv[0], "-v") == 0)
+			filter_invert = !filter_invert;
+		else if (strcmp(argv[0], "-gt") == 0)
+			filter |= FILT_GRAPH_TIMERS;
+		else if (strcmp(argv[0], "-pct") == 0)
+			filter |= FILT_PERCENTILE;
+		else if (strcmp(argv[0], "-st") == 0)
+			filter |= FILT_COUNT_STATUS;
+		else if (strcmp(argv[0], "-srv") == 0)
+			filter |= FILT_COUNT_SRV_STATUS;
+		else if (strcmp(argv[0], "-cc") == 0)
+			filter |= FILT_COUNT_COOK_CODES;
+		else if (strcmp(argv[0], "-tc") == 0)
+			filter |= FILT_COUNT_TERM_CODES;
+		else if (strcmp(argv[0], "-tcn") == 0) {
+			if (argc < 2) die("missing option for -tcn");
+			argc--; argv++;
+			filter |= FILT_TERM_CODE_NAME;
+			filter_term_code_name = *argv;
+		}
+		else if (strcmp(argv[0], "-TCN") == 0) {
+			if (argc < 2) die("missing option for -TCN");
+			argc--; argv++;
+			filter |= FILT_TERM_CODE_NAME | FILT_INVERT_TERM_CODE_NAME;
+			filter_term_code_name = *argv;
+		}
+		else if (strcmp(argv[0], "-hs") == 0 || strcmp(argv[0], "-HS") == 0) {
+			char *sep, *str;
+
+			if (argc < 2) die("missing option for -hs/-HS ([min]:[max])");
+			filter |= FILT_HTTP_STATUS;
+			if (argv[0][1] == 'H')
+				filter |= FILT_INVERT_HTTP_STATUS;
+
+			argc--; argv++;
+			str = *argv;
+			sep = strchr(str, ':');  /* [min]:[max] */
+			if (!sep)
+				sep = str; /* make max point to min */
+			else
+				*sep++ = 0;
+			filt_http_status_low = *str ? atol(str) : 0;
+			filt_http_status_high = *sep ? atol(sep) : 65535;
+		}
+		else if (strcmp(argv[0], "-u") == 0)
+			filter |= FILT_COUNT_URL_ONLY;
+		else if (strcmp(argv[0], "-uc") == 0)
+			filter |= FILT_COUNT_URL_COUNT;
+		else if (strcmp(argv[0], "-ue") == 0)
+			filter |= FILT_COUNT_URL_ERR;
+		else if (strcmp(argv[0], "-ua") == 0)
+			filter |= FILT_COUNT_URL_TAVG;
+		else if (strcmp(argv[0], "-ut") == 0)
+			filter |= FILT_COUNT_URL_TTOT;
+		else if (strcmp(argv[0], "-uao") == 0)
+			filter |= FILT_COUNT_URL_TAVGO;
+		else if (strcmp(argv[0], "-uto") == 0)
+			filter |= FILT_COUNT_URL_TTOTO;
+		else if (strcmp(argv[0], "-uba") == 0)
+			filter |= FILT_COUNT_URL_BAVG;
+		else if (strcmp(argv[0], "-ubt") == 0)
+			filter |= FILT_COUNT_URL_BTOT;
+		else if (strcmp(argv[0], "-ic") == 0)
+			filter |= FILT_COUNT_IP_COUNT;
+		else if (strcmp(argv[0], "-o") == 0) {
+			if (output_file)
+				die("Fatal: output file name already specified.\n");
+			if (argc < 2)
+				die("Fatal: missing output file name.\n");
+			output_file = argv[1];
+		}
+		else if (strcmp(argv[0], "-h") == 0 || strcmp(argv[0], "--help") == 0)
+			help();
+		argc--;
+		argv++;
+	}
+
+	if (!filter)
+		die("No action specified.\n");
+
+	if (filter & FILT_ACC_COUNT && !filter_acc_count)
+		filter_acc_count=1;
+
+	if (filter & FILT_ACC_DELAY && !filter_acc_delay)
+		filter_acc_delay = 1;
+
+
+	/* by default, all lines are printed */
+	line_filter = filter_output_line;
+	if (filter & (FILT_ACC_COUNT|FILT_ACC_DELAY))
+		line_filter = filter_accept_holes;
+	else if (filter & (FILT_GRAPH_TIMERS|FILT_PERCENTILE))
+		line_filter = filter_graphs;
+	else if (filter & FILT_COUNT_STATUS)
+		line_filter = filter_count_status;
+	else if (filter & FILT_COUNT_COOK_CODES)
+		line_filter = filter_count_cook_codes;
+	else if (filter & FILT_COUNT_TERM_CODES)
+		line_filter = filter_count_term_codes;
+	else if (filter & FILT_COUNT_SRV_STATUS)
+		line_filter = filter_count_srv_status;
+	else if (filter & FILT_COUNT_URL_ANY)
+		line_filter = filter_count_url;
+	else if (filter & FILT_COUNT_ONLY)
+		line_filter = NULL;
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+	/* around 20% performance improvement is observed on Linux with this
+	 * on cold-cache. Surprizingly, WILLNEED is less performant. Don't
+	 * use NOREUSE as it flushes the cache and prevents easy data
+	 * manipulation on logs!
+	 */
+	posix_fadvise(0, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	/* regular files are mapped into memory so that they can be split into
+	 * several parts processed by as many threads. This is only possible
+	 * when the output does not depend on the order of the lines.
+	 */
+	if (!bin_input && fstat(0, &st) == 0 && S_ISREG(st.st_mode) &&
+	    st.st_size > 0 && lseek(0, 0, SEEK_CUR) == 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			mm_cur = map;
+			mm_end = mm_cur + st.st_size;
+			read_line = mmap_gets;
+		}
+	}
+
+	if (read_line != mmap_gets || lines_max >= 0 ||
+	    (line_filter == filter_output_line && !(filter & FILT_COUNT_IP_COUNT)))
+		nbthreads = 1;
+
+	if (!line_filter && /* FILT_COUNT_ONLY ( see above), and no input filter (see below) */
+	    !(filter & (FILT_HTTP_ONLY|FILT_TIME_RESP|FILT_ERRORS_ONLY|FILT_HTTP_STATUS|FILT_QUEUE_ONLY|FILT_QUEUE_SRV_ONLY|FILT_TERM_CODE_NAME))) {
+		/* read the whole file at once first, ignore it if inverted output */
+		if (!filter_invert)
+			while ((lines_max < 0 || lines_out < lines_max) &&
+			       (bin_input ? logbin_read(stdin, NULL) : read_line(stdin) != NULL))
+				lines_out++;
+
+		goto skip_filters;
+	}
+
+	if (bin_input)
+		process_bin_input();
+	else if (nbthreads > 1)
+		run_workers(nbthreads);
+	else
+		process_input();
+
+
+ skip_filters:
+	/*****************************************************
+	 * Here we've finished reading all input. Depending on the
+	 * filters, we may still have some analysis to run on the
+	 * collected data and to output data in a new format.
+	 *************************************************** */
+
+	if (filter & FILT_COUNT_ONLY) {
+		printf("%d\n", lines_out);
+		exit(0);
+	}
+
+	if (filter & (FILT_ACC_COUNT|FILT_ACC_DELAY)) {
+		/* sort and count all timers. Output will look like this :
+		 * <accept_date> <delta_ms from previous one> <nb entries>
+		 */
+		n = eb32_first(&timers[0]);
+
+		if (n)
+			last = n->key;
+		while (n) {
+			unsigned int d, h, m, s, ms;
+
+			t = container_of(n, struct timer, node);
+			h = n->key;
+			d = h - last;
+			last = h;
+
+			if (d >= filter_acc_delay && t->count >= filter_acc_count) {
+				ms = h % 1000; h = h / 1000;
+				s = h % 60; h = h / 60;
+				m = h % 60; h = h / 60;
+				printf("%02d:%02d:%02d.%03d %d %d %d\n", h, m, s, ms, last, d, t->count);
+				lines_out++;
+				if (lines_max >= 0 && lines_out >= lines_max)
+					break;
+			}
+			n = eb32_next(n);
+		}
+	}
 	else if (filter & FILT_GRAPH_TIMERS) {
 		/* sort all timers */
 		for (f = 0; f < 5; f++) {
@@ -1209,27 +1560,71 @@ void filter_count_term_codes(const char *accept_field, const char *time_field, s
 	const char *b;
 	int val;
 
-	if (time_field)
-		b = field_start(time_field, TERM_CODES_FIELD - TIME_FIELD + 1);
-	else
-		b = field_start(accept_field, TERM_CODES_FIELD - ACCEPT_FIELD + 1);
+	if (time_field)
+		b = field_start(time_field, TERM_CODES_FIELD - TIME_FIELD + 1);
+	else
+		b = field_start(accept_field, TERM_CODES_FIELD - ACCEPT_FIELD + 1);
+
+	if (unlikely(!*b)) {
+		truncated_line(linenum, line);
+		return;
+	}
+
+	val = 256 * b[0] + b[1];
+
+	t2 = insert_value(&timers[0], tptr, val);
+	t2->count++;
+}
+
+/* Returns the stats of server <name> of <len> bytes, which are created if they
+ * do not exist yet.
+ */
+static struct srv_st *get_srv_stat(const char *name, int len)
+{
+	struct ebmb_node *srv_node;
+	struct srv_st *srv;
+
+	/* the chance that a server name already exists is extremely high,
+	 * so let's perform a normal lookup first.
+	 */
+	srv_node = ebst_lookup_len(&timers[0], name, len);
+	srv = container_of(srv_node, struct srv_st, node);
+
+	if (!srv_node) {
+		/* server not yet in the tree, let's create it */
+		srv = (void *)calloc(1, sizeof(struct srv_st) + len + 1);
+		srv_node = &srv->node;
+		memcpy(&srv_node->key, name, len);
+		srv_node->key[len] = '\0';
+		ebst_insert(&timers[0], srv_node);
+	}
+	return srv;
+}
+
+/* Accounts the 5 timers of <array> to server <srv>. <err> is non-zero if one
+ * of them was negative.
+ */
+static void update_srv_stat(struct srv_st *srv, const int *array, int err)
+{
+	/* we have our timers in array[2,3] */
+	if (!err)
+		srv->nb_ok++;
 
-	if (unlikely(!*b)) {
-		truncated_line(linenum, line);
-		return;
+	if (array[2] >= 0) {
+		srv->cum_ct += array[2];
+		srv->nb_ct++;
 	}
 
-	val = 256 * b[0] + b[1];
-
-	t2 = insert_value(&timers[0], tptr, val);
-	t2->count++;
+	if (array[3] >= 0) {
+		srv->cum_rt += array[3];
+		srv->nb_rt++;
+	}
 }
 
 void filter_count_srv_status(const char *accept_field, const char *time_field, struct timer **tptr)
 {
 	const char *b, *e, *p;
 	int f, err, array[5];
-	struct ebmb_node *srv_node;
 	struct srv_st *srv;
 	int val;
 
@@ -1243,21 +1638,7 @@ void filter_count_srv_status(const char *accept_field, const char *time_field, s
 	}
 
 	e = field_stop(b + 1);  /* we have the server name in [b]..[e-1] */
-
-	/* the chance that a server name already exists is extremely high,
-	 * so let's perform a normal lookup first.
-	 */
-	srv_node = ebst_lookup_len(&timers[0], b, e - b);
-	srv = container_of(srv_node, struct srv_st, node);
-
-	if (!srv_node) {
-		/* server not yet in the tree, let's create it */
-		srv = (void *)calloc(1, sizeof(struct srv_st) + e - b + 1);
-		srv_node = &srv->node;
-		memcpy(&srv_node->key, b, e - b);
-		srv_node->key[e - b] = '\0';
-		ebst_insert(&timers[0], srv_node);
-	}
+	srv = get_srv_stat(b, e - b);
 
 	/* let's collect the connect and response times */
 	if (!time_field) {
@@ -1290,19 +1671,7 @@ void filter_count_srv_status(const char *accept_field, const char *time_field, s
 		return;
 	}
 
-	/* OK we have our timers in array[2,3] */
-	if (!err)
-		srv->nb_ok++;
-
-	if (array[2] >= 0) {
-		srv->cum_ct += array[2];
-		srv->nb_ct++;
-	}
-
-	if (array[3] >= 0) {
-		srv->cum_rt += array[3];
-		srv->nb_rt++;
-	}
+	update_srv_stat(srv, array, err);
 
 	/* we're interested in the 5 HTTP status classes (1xx ... 5xx), and
 	 * the invalid ones which will be reported as 0.
@@ -1320,10 +1689,47 @@ void filter_count_srv_status(const char *accept_field, const char *time_field, s
 	srv->st_cnt[val]++;
 }
 
-void filter_count_url(const char *accept_field, const char *time_field, struct timer **tptr)
+/* Accounts one request to the stats of URL <key>, which are created if they do
+ * not exist yet. <err> is non-zero if the request reported an error. The same
+ * is used by the source address statistics.
+ */
+static void update_url_stat(char *key, int err, int total_time, int total_time_ok, int bytes)
 {
-	struct url_stat *ustat = NULL;
+	struct url_stat *ustat;
 	struct ebpt_node *ebpt_old;
+
+	ustat = calloc(1, sizeof(*ustat));
+	ustat->nb_err = err;
+	ustat->nb_req = 1;
+	ustat->total_time = total_time;
+	ustat->total_time_ok = total_time_ok;
+	ustat->total_bytes_sent = bytes;
+
+	/* now instead of copying the key for a simple lookup, we'll link
+	 * to it from the node we're trying to insert. If it returns a
+	 * different value, it was already there. Otherwise we just have
+	 * to dynamically realloc an entry using strdup().
+	 */
+	ustat->node.url.key = key;
+	ebpt_old = ebis_insert(&timers[0], &ustat->node.url);
+
+	if (ebpt_old != &ustat->node.url) {
+		struct url_stat *ustat_old;
+		/* node was already there, let's update previous one */
+		ustat_old = container_of(ebpt_old, struct url_stat, node.url);
+		ustat_old->nb_req ++;
+		ustat_old->nb_err += ustat->nb_err;
+		ustat_old->total_time += ustat->total_time;
+		ustat_old->total_time_ok += ustat->total_time_ok;
+		ustat_old->total_bytes_sent += ustat->total_bytes_sent;
+		free(ustat);
+	} else {
+		ustat->url = ustat->node.url.key = strdup(ustat->node.url.key);
+	}
+}
+
+void filter_count_url(const char *accept_field, const char *time_field, struct timer **tptr)
+{
 	const char *b, *e;
 	int f, err, array[5];
 	int val;
@@ -1358,21 +1764,10 @@ void filter_count_url(const char *accept_field, const char *time_field, struct t
 
 	/* OK we have our timers in array[3], and err is >0 if at
 	 * least one -1 was seen. <e> points to the first char of
-	 * the last timer. Let's prepare a new node with that.
+	 * the last timer.
 	 */
-	if (unlikely(!ustat))
-		ustat = calloc(1, sizeof(*ustat));
-
-	ustat->nb_err = err;
-	ustat->nb_req = 1;
-
-	/* use array[4] = total time in case of error */
-	ustat->total_time = (array[3] >= 0) ? array[3] : array[4];
-	ustat->total_time_ok = (array[3] >= 0) ? array[3] : 0;
-
 	e = field_start(e, BYTES_SENT_FIELD - TIME_FIELD + 1);
 	val = str2ic(e);
-	ustat->total_bytes_sent = val;
 
 	/* the line may be truncated because of a bad request or anything like this,
 	 * without a method. Also, if it does not begin with an quote, let's skip to
@@ -1406,33 +1801,14 @@ void filter_count_url(const char *accept_field, const char *time_field, struct t
 		e++;
 	} while (*e);
 
-	/* now instead of copying the URL for a simple lookup, we'll link
-	 * to it from the node we're trying to insert. If it returns a
-	 * different value, it was already there. Otherwise we just have
-	 * to dynamically realloc an entry using strdup().
-	 */
-	ustat->node.url.key = (char *)b;
-	ebpt_old = ebis_insert(&timers[0], &ustat->node.url);
-
-	if (ebpt_old != &ustat->node.url) {
-		struct url_stat *ustat_old;
-		/* node was already there, let's update previous one */
-		ustat_old = container_of(ebpt_old, struct url_stat, node.url);
-		ustat_old->nb_req ++;
-		ustat_old->nb_err += ustat->nb_err;
-		ustat_old->total_time += ustat->total_time;
-		ustat_old->total_time_ok += ustat->total_time_ok;
-		ustat_old->total_bytes_sent += ustat->total_bytes_sent;
-	} else {
-		ustat->url = ustat->node.url.key = strdup(ustat->node.url.key);
-		ustat = NULL; /* node was used */
-	}
+	/* use array[4] = total time in case of error */
+	update_url_stat((char *)b, err,
+	                (array[3] >= 0) ? array[3] : array[4],
+	                (array[3] >= 0) ? array[3] : 0, val);
 }
 
 void filter_count_ip(const char *source_field, const char *accept_field, const char *time_field, struct timer **tptr)
 {
-	struct url_stat *ustat = NULL;
-	struct ebpt_node *ebpt_old;
 	const char *b, *e;
 	int f, err, array[5];
 	int val;
@@ -1469,21 +1845,10 @@ void filter_count_ip(const char *source_field, const char *accept_field, const c
 
 	/* OK we have our timers in array[0], and err is >0 if at
 	 * least one -1 was seen. <e> points to the first char of
-	 * the last timer. Let's prepare a new node with that.
+	 * the last timer.
 	 */
-	if (unlikely(!ustat))
-		ustat = calloc(1, sizeof(*ustat));
-
-	ustat->nb_err = err;
-	ustat->nb_req = 1;
-
-	/* use array[4] = total time in case of error */
-	ustat->total_time = (array[0] >= 0) ? array[0] : array[4];
-	ustat->total_time_ok = (array[0] >= 0) ? array[0] : 0;
-
 	e = field_start(e, BYTES_SENT_FIELD - TIME_FIELD + 1);
 	val = str2ic(e);
-	ustat->total_bytes_sent = val;
 
 	/* the source might be IPv4 or IPv6, so we always strip the port by
 	 * removing the last colon.
@@ -1494,65 +1859,20 @@ void filter_count_ip(const char *source_field, const char *accept_field, const c
 		e--;
 	*(char *)(e - 1) = '\0';
 
-	/* now instead of copying the src for a simple lookup, we'll link
-	 * to it from the node we're trying to insert. If it returns a
-	 * different value, it was already there. Otherwise we just have
-	 * to dynamically realloc an entry using strdup(). We're using the
-	 * <url> field of the node to store the source address.
+	/* use array[4] = total time in case of error. The source address is
+	 * stored in the <url> field of the node.
 	 */
-	ustat->node.url.key = (char *)b;
-	ebpt_old = ebis_insert(&timers[0], &ustat->node.url);
-
-	if (ebpt_old != &ustat->node.url) {
-		struct url_stat *ustat_old;
-		/* node was already there, let's update previous one */
-		ustat_old = container_of(ebpt_old, struct url_stat, node.url);
-		ustat_old->nb_req ++;
-		ustat_old->nb_err += ustat->nb_err;
-		ustat_old->total_time += ustat->total_time;
-		ustat_old->total_time_ok += ustat->total_time_ok;
-		ustat_old->total_bytes_sent += ustat->total_bytes_sent;
-	} else {
-		ustat->url = ustat->node.url.key = strdup(ustat->node.url.key);
-		ustat = NULL; /* node was used */
-	}
+	update_url_stat((char *)b, err,
+	                (array[0] >= 0) ? array[0] : array[4],
+	                (array[0] >= 0) ? array[0] : 0, val);
 }
 
-void filter_graphs(const char *accept_field, const char *time_field, struct timer **tptr)
+/* Accounts the 5 timers of <array> to the graphs or percentiles. <err> is
+ * non-zero if one of them was negative.
+ */
+static void update_graphs(int *array, int err, struct timer **tptr)
 {
 	struct timer *t2;
-	const char *e, *p;
-	int f, err, array[5];
-
-	if (!time_field) {
-		time_field = field_start(accept_field, TIME_FIELD - ACCEPT_FIELD + 1);
-		if (unlikely(!*time_field)) {
-			truncated_line(linenum, line);
-			return;
-		}
-	}
-
-	e = field_stop(time_field + 1);
-	/* we have field TIME_FIELD in [time_field]..[e-1] */
-
-	p = time_field;
-	err = 0;
-	f = 0;
-	while (!SEP(*p)) {
-		array[f] = str2ic(p);
-		if (array[f] < 0) {
-			array[f] = -1;
-			err = 1;
-		}
-		if (++f == 5)
-			break;
-		SKIP_CHAR(p, '/');
-	}
-
-	if (unlikely(f < 5)) {
-		parse_err++;
-		return;
-	}
 
 	/* if we find at least one negative time, we count one error
 	 * with a time equal to the total session time. This will
@@ -1605,6 +1925,203 @@ void filter_graphs(const char *accept_field, const char *time_field, struct time
 	}
 }
 
+void filter_graphs(const char *accept_field, const char *time_field, struct timer **tptr)
+{
+	const char *e, *p;
+	int f, err, array[5];
+
+	if (!time_field) {
+		time_field = field_start(accept_field, TIME_FIELD - ACCEPT_FIELD + 1);
+		if (unlikely(!*time_field)) {
+			truncated_line(linenum, line);
+			return;
+		}
+	}
+
+	e = field_stop(time_field + 1);
+	/* we have field TIME_FIELD in [time_field]..[e-1] */
+
+	p = time_field;
+	err = 0;
+	f = 0;
+	while (!SEP(*p)) {
+		array[f] = str2ic(p);
+		if (array[f] < 0) {
+			array[f] = -1;
+			err = 1;
+		}
+		if (++f == 5)
+			break;
+		SKIP_CHAR(p, '/');
+	}
+
+	if (unlikely(f < 5)) {
+		parse_err++;
+		return;
+	}
+
+	update_graphs(array, err, tptr);
+}
+
+
+/* Applies the line filter to binary record <r>. The fields are directly taken
+ * from the record, which is only turned into a text line when it has to be
+ * printed.
+ */
+void filter_bin_record(struct logbin_rec *r, struct timer **tptr)
+{
+	static char key[65536 + 2];
+	static unsigned int last_sec;
+	static int day_ms = -1;
+	struct timer *t2;
+	struct srv_st *srv;
+	const char *b, *e, *p;
+	int f, err, array[5];
+	int val;
+
+	/* the timers are used by most filters */
+	err = 0;
+	for (f = 0; f < 5; f++) {
+		array[f] = r->timers[f];
+		if (array[f] < 0) {
+			array[f] = -1;
+			err = 1;
+		}
+	}
+
+	if (filter & FILT_COUNT_IP_COUNT) {
+		if (unlikely(!r->http)) {
+			parse_err++;
+			return;
+		}
+
+		if (r->src_af == AF_INET) {
+			/* much faster than inet_ntop() */
+			char *w = key;
+
+			for (f = 0; f < 4; f++) {
+				val = r->src[f];
+				if (val >= 100)
+					*w++ = '0' + val / 100;
+				if (val >= 10)
+					*w++ = '0' + val / 10 % 10;
+				*w++ = '0' + val % 10;
+				*w++ = '.';
+			}
+			w[-1] = '\0';
+		}
+		else if (r->src_af == AF_UNSPEC || !inet_ntop(r->src_af, r->src, key, sizeof(key)))
+			strcpy(key, "-");
+
+		/* use array[4] = total time in case of error */
+		update_url_stat(key, array[0] < 0 || array[4] < 0,
+		                (array[0] >= 0) ? array[0] : array[4],
+		                (array[0] >= 0) ? array[0] : 0, r->bytes);
+	}
+	else if (line_filter == filter_output_line) {
+		puts(logbin_line());
+		lines_out++;
+	}
+	else if (line_filter == filter_accept_holes) {
+		if (unlikely(!r->has_date)) {
+			parse_err++;
+			return;
+		}
+
+		/* only convert the date once per second */
+		if (r->accept_sec != last_sec || day_ms < 0) {
+			time_t sec = r->accept_sec;
+			struct tm tm;
+
+			localtime_r(&sec, &tm);
+			last_sec = r->accept_sec;
+			day_ms = ((tm.tm_hour * 60 + tm.tm_min) * 60 + tm.tm_sec) * 1000;
+		}
+
+		t2 = insert_value(&timers[0], tptr, day_ms + r->accept_usec / 1000);
+		t2->count++;
+	}
+	else if (line_filter == filter_count_status) {
+		t2 = insert_value(&timers[0], tptr, r->status);
+		t2->count++;
+	}
+	else if (line_filter == filter_count_cook_codes) {
+		t2 = insert_value(&timers[0], tptr, 256 * r->termstate[2] + r->termstate[3]);
+		t2->count++;
+	}
+	else if (line_filter == filter_count_term_codes) {
+		t2 = insert_value(&timers[0], tptr, 256 * r->termstate[0] + r->termstate[1]);
+		t2->count++;
+	}
+	else if (line_filter == filter_count_srv_status) {
+		/* servers are named "<backend>/<server>" */
+		val = 0;
+		if (r->backend) {
+			memcpy(key, r->backend, r->backend_len);
+			val = r->backend_len;
+		}
+		else
+			key[val++] = '-';
+		key[val++] = '/';
+		if (r->server) {
+			memcpy(key + val, r->server, r->server_len);
+			val += r->server_len;
+		}
+		else
+			key[val++] = '-';
+
+		srv = get_srv_stat(key, val);
+		if (unlikely(!r->http)) {
+			parse_err++;
+			return;
+		}
+
+		update_srv_stat(srv, array, err);
+
+		/* we're interested in the 5 HTTP status classes (1xx ... 5xx), and
+		 * the invalid ones which will be reported as 0.
+		 */
+		val = r->status;
+		while (val >= 10)
+			val /= 10;
+		if (val < 1 || val > 5)
+			val = 0;
+		srv->st_cnt[val]++;
+	}
+	else if (line_filter == filter_count_url) {
+		if (unlikely(!r->http || !r->req)) {
+			parse_err++;
+			return;
+		}
+
+		/* the URL follows the method, which is used if there's no URL */
+		b = r->req;
+		e = b + r->req_len;
+		for (p = b; p < e && *p != ' '; p++)
+			;
+		if (p + 1 < e)
+			b = p + 1;
+
+		/* stop at end of field or first ';' or '?' */
+		for (p = b; p < e && *p != ' ' && *p != '?' && *p != ';'; p++)
+			;
+		memcpy(key, b, p - b);
+		key[p - b] = 0;
+
+		/* use array[4] = total time in case of error */
+		update_url_stat(key, err,
+		                (array[3] >= 0) ? array[3] : array[4],
+		                (array[3] >= 0) ? array[3] : 0, r->bytes);
+	}
+	else if (line_filter == filter_graphs) {
+		if (unlikely(!r->http)) {
+			parse_err++;
+			return;
+		}
+		update_graphs(array, err, tptr);
+	}
+}
+
 
 /*
  * Local variables:
@@ -0,0 +1,511 @@
+/*
+ * binary log records reader for halog
+ *
+ * Copyright 2000-2014 Willy Tarreau <w@1wt.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * This reads the records produced by "option log-binary" (see the LOG_BIN_*
+ * definitions in types/log.h) and decodes the fields used by halog's filters
+ * into a struct logbin_rec, so that no text has to be produced nor parsed.
+ * When the records have to be printed, they are turned into the equivalent
+ * line of the default HTTP log format, or of the TCP log format when the
+ * record has no HTTP status, preceeded by a syslog-like header. Fields missing
+ * from the record are then reported as '-' or as zero, as haproxy would do.
+ *
+ * Records may either be read as they are sent over UDP (each one starts with
+ * its length on 2 bytes), or as they are sent to "stream@" loggers, where each
+ * of them is additionally preceeded by its length in ASCII digits and a space.
+ * The framing is detected on the first record. Regular files are mapped into
+ * memory, and other inputs are read by large blocks, so that records are
+ * decoded where they are, without being copied.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <types/log.h>
+
+#include "logbin.h"
+
+#define LOGBIN_MAXLEN 65536
+#define LOGBIN_BUFSIZE (4 * LOGBIN_MAXLEN)
+
+/* one decoded field */
+struct lb_field {
+	int enc;                  /* LOG_BIN_* with LOG_BIN_F_PLUS, -1 if absent */
+	const unsigned char *val; /* raw value */
+};
+
+static const unsigned char *rec; /* current record */
+static int rec_len;
+static const unsigned char *in_cur, *in_end; /* input not processed yet */
+static unsigned char *in_buf; /* input buffer, NULL if the input is mapped */
+static char out[LOGBIN_MAXLEN * 2];
+static char *outp;
+static struct lb_field fld[256];
+static int lb_octet_counting = -1; /* -1 = unknown yet, 0 = no, 1 = yes */
+
+static inline unsigned long long lb_getbe(const unsigned char *p, int len)
+{
+	unsigned long long v = 0;
+
+	while (len--)
+		v = (v << 8) + *p++;
+	return v;
+}
+
+/* appends <len> bytes from <str> to the output line */
+static void lb_puts(const char *str, int len)
+{
+	if (len > out + sizeof(out) - 1 - outp)
+		len = out + sizeof(out) - 1 - outp;
+	memcpy(outp, str, len);
+	outp += len;
+}
+
+static inline void lb_putc(char c)
+{
+	if (outp < out + sizeof(out) - 1)
+		*outp++ = c;
+}
+
+/* appends the integer field <type>, or '-' if it is missing */
+static void lb_put_int(int type)
+{
+	char tmp[24];
+
+	if ((fld[type].enc & LOG_BIN_ENC_MASK) != LOG_BIN_S64) {
+		lb_putc('-');
+		return;
+	}
+	if (fld[type].enc & LOG_BIN_F_PLUS)
+		lb_putc('+');
+	lb_puts(tmp, snprintf(tmp, sizeof(tmp), "%lld", (long long)lb_getbe(fld[type].val, 8)));
+}
+
+/* appends the string field <type>, or '-' if it is missing or empty */
+static void lb_put_str(int type)
+{
+	int len;
+
+	if (fld[type].enc != LOG_BIN_STR || !(len = lb_getbe(fld[type].val, 2))) {
+		lb_putc('-');
+		return;
+	}
+	lb_puts((const char *)fld[type].val + 2, len);
+}
+
+/* appends the address field <type>, or '-' if it is missing */
+static void lb_put_addr(int type)
+{
+	char tmp[INET6_ADDRSTRLEN];
+
+	if (fld[type].enc == LOG_BIN_IPV4)
+		inet_ntop(AF_INET, fld[type].val, tmp, sizeof(tmp));
+	else if (fld[type].enc == LOG_BIN_IPV6)
+		inet_ntop(AF_INET6, fld[type].val, tmp, sizeof(tmp));
+	else {
+		lb_putc('-');
+		return;
+	}
+	lb_puts(tmp, strlen(tmp));
+}
+
+/* appends the header captures field <type> between braces, if any */
+static void lb_put_caps(int type)
+{
+	const unsigned char *p;
+	int nb, len;
+
+	if (fld[type].enc != LOG_BIN_STRS)
+		return;
+
+	p = fld[type].val;
+	nb = *p++;
+	lb_puts(" {", 2);
+	while (nb--) {
+		len = lb_getbe(p, 2);
+		lb_puts((const char *)p + 2, len);
+		p += 2 + len;
+		if (nb)
+			lb_putc('|');
+	}
+	lb_putc('}');
+}
+
+/* Returns the size of the value of a field of encoding <enc> starting at <p>,
+ * or -1 if it goes beyond <end>.
+ */
+static inline int lb_val_len(int enc, const unsigned char *p, const unsigned char *end)
+{
+	int nb, len;
+	const unsigned char *s;
+
+	switch (enc & LOG_BIN_ENC_MASK) {
+	case LOG_BIN_NONE: return 0;
+	case LOG_BIN_S64:  return 8;
+	case LOG_BIN_IPV4: return 4;
+	case LOG_BIN_IPV6: return 16;
+	case LOG_BIN_DATE: return 8;
+	case LOG_BIN_STR:
+		if (end - p < 2)
+			return -1;
+		return 2 + lb_getbe(p, 2);
+	case LOG_BIN_STRS:
+		if (end - p < 1)
+			return -1;
+		s = p + 1;
+		for (nb = *p; nb; nb--) {
+			if (end - s < 2)
+				return -1;
+			len = lb_getbe(s, 2);
+			s += 2 + len;
+		}
+		return s - p;
+	}
+	return -1;
+}
+
+/* Prepares the input from <stream>, which is mapped into memory if it is a
+ * regular file, otherwise a buffer is allocated. Returns 0 on failure.
+ */
+static int lb_init_input(FILE *stream)
+{
+	struct stat st;
+	void *map;
+	int fd = fileno(stream);
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+	    lseek(fd, 0, SEEK_CUR) == 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			in_cur = map;
+			in_end = in_cur + st.st_size;
+			return 1;
+		}
+	}
+
+	in_buf = malloc(LOGBIN_BUFSIZE);
+	in_cur = in_end = in_buf;
+	return in_buf != NULL;
+}
+
+/* Makes sure that at least <len> bytes of input are available at <in_cur>,
+ * reading more from <stream> if the input is not mapped. Pointers to the data
+ * before <in_cur> are not valid anymore after this call. Returns 0 if there
+ * are not enough bytes left.
+ */
+static int lb_fill(FILE *stream, int len)
+{
+	size_t left = in_end - in_cur;
+
+	if (left >= len)
+		return 1;
+
+	if (!in_buf)
+		return 0;
+
+	memmove(in_buf, in_cur, left);
+	in_cur = in_buf;
+	in_end = in_buf + left;
+	in_end += fread(in_buf + left, 1, LOGBIN_BUFSIZE - left, stream);
+	return in_end - in_cur >= len;
+}
+
+/* Reads the next binary log record from <stream>, makes <rec> point to it and
+ * returns its length, or 0 at the end of the stream or on a framing error.
+ * When the records come from a "stream@" logger, the ASCII length which
+ * precedes each of them must match the record's own length.
+ */
+static int lb_read_record(FILE *stream)
+{
+	int len, i;
+
+	if (!in_cur && !lb_init_input(stream))
+		return 0;
+
+	if (!lb_fill(stream, 3))
+		return 0;
+
+	/* a raw record's third byte is always the version, which can never be
+	 * confused with the digits or the space of an octet count.
+	 */
+	if (lb_octet_counting < 0)
+		lb_octet_counting = isdigit(in_cur[0]) && (isdigit(in_cur[1]) || in_cur[1] == ' ') &&
+			in_cur[2] != LOG_BIN_VERSION;
+
+	if (lb_octet_counting) {
+		/* at most 5 digits followed by a space */
+		lb_fill(stream, 6);
+		len = 0;
+		for (i = 0; in_cur + i < in_end && in_cur[i] != ' '; i++) {
+			if (i == 5 || !isdigit(in_cur[i]))
+				return 0;
+			len = len * 10 + in_cur[i] - '0';
+		}
+		if (in_cur + i >= in_end)
+			return 0;
+		in_cur += i + 1;
+		if (len < LOG_BIN_HDR_LEN || !lb_fill(stream, len) ||
+		    lb_getbe(in_cur, 2) != len)
+			return 0;
+	}
+	else {
+		len = lb_getbe(in_cur, 2);
+		if (len < LOG_BIN_HDR_LEN || !lb_fill(stream, len))
+			return 0;
+	}
+
+	rec = in_cur;
+	in_cur += len;
+
+	/* records are walked one after the other, which the hardware does not
+	 * guess well across pages, so let's prefetch the next page ourselves.
+	 */
+	__builtin_prefetch(in_cur + 4096);
+	return len;
+}
+
+/* Reads the next binary log record from <stream> and decodes the fields used
+ * by the filters into <r>, unless it is NULL. Returns 0 at the end of the
+ * stream, otherwise 1. Records of an unknown version or which cannot be
+ * decoded have <r->valid> cleared so that they are counted as errors.
+ */
+int logbin_read(FILE *stream, struct logbin_rec *r)
+{
+	const unsigned char *p, *end;
+	int nb, vlen, type, enc, len;
+	long long v;
+
+	rec_len = lb_read_record(stream);
+	if (!rec_len)
+		return 0;
+
+	if (!r)
+		return 1;
+
+	memset(r, 0, sizeof(*r));
+	memset(r->termstate, '-', sizeof(r->termstate));
+	r->src_af = AF_UNSPEC;
+
+	if (rec[2] != LOG_BIN_VERSION)
+		return 1;
+
+	p = rec + LOG_BIN_HDR_LEN;
+	end = rec + rec_len;
+	for (nb = rec[4]; nb; nb--) {
+		if (end - p < 2)
+			return 1;
+		type = p[0];
+		enc = p[1];
+		p += 2;
+
+		/* integers are the most common fields */
+		v = 0;
+		if ((enc & LOG_BIN_ENC_MASK) == LOG_BIN_S64) {
+			vlen = 8;
+			if (end - p < 8)
+				return 1;
+			v = lb_getbe(p, 8);
+		}
+		else {
+			vlen = lb_val_len(enc, p, end);
+			if (vlen < 0 || vlen > end - p)
+				return 1;
+		}
+
+		switch (type) {
+		case LOG_FMT_TQ:
+		case LOG_FMT_TW:
+		case LOG_FMT_TC:
+		case LOG_FMT_TR:
+		case LOG_FMT_TT:
+			r->timers[type - LOG_FMT_TQ] = v;
+			break;
+		case LOG_FMT_STATUS:
+			r->http = 1;
+			r->status = v;
+			break;
+		case LOG_FMT_BYTES:
+			r->bytes = v;
+			break;
+		case LOG_FMT_SRVQUEUE:
+			r->srv_queue = v;
+			break;
+		case LOG_FMT_BCKQUEUE:
+			r->bck_queue = v;
+			break;
+		case LOG_FMT_TERMSTATE:
+		case LOG_FMT_TERMSTATE_CK:
+			if (enc == LOG_BIN_STR) {
+				len = lb_getbe(p, 2);
+				memcpy(r->termstate, p + 2, len < 4 ? len : 4);
+			}
+			break;
+		case LOG_FMT_DATE:
+		case LOG_FMT_DATEGMT:
+		case LOG_FMT_DATELOCAL:
+			if (enc == LOG_BIN_DATE && !r->has_date) {
+				r->has_date = 1;
+				r->accept_sec = lb_getbe(p, 4);
+				r->accept_usec = lb_getbe(p + 4, 4);
+			}
+			break;
+		case LOG_FMT_CLIENTIP:
+			if (enc == LOG_BIN_IPV4 || enc == LOG_BIN_IPV6) {
+				r->src_af = (enc == LOG_BIN_IPV4) ? AF_INET : AF_INET6;
+				r->src = p;
+			}
+			break;
+		case LOG_FMT_BACKEND:
+			if (enc == LOG_BIN_STR) {
+				r->backend_len = lb_getbe(p, 2);
+				r->backend = (const char *)p + 2;
+			}
+			break;
+		case LOG_FMT_SERVER:
+			if (enc == LOG_BIN_STR) {
+				r->server_len = lb_getbe(p, 2);
+				r->server = (const char *)p + 2;
+			}
+			break;
+		case LOG_FMT_REQ:
+			if (enc == LOG_BIN_STR) {
+				r->req_len = lb_getbe(p, 2);
+				r->req = (const char *)p + 2;
+			}
+			break;
+		}
+		p += vlen;
+	}
+
+	r->valid = 1;
+	return 1;
+}
+
+/* Returns the last record read by logbin_read() as a log line in a static
+ * buffer. Records of an unknown version are returned as empty lines.
+ */
+const char *logbin_line(void)
+{
+	static const char months[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	                                    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	const unsigned char *p, *end;
+	int nb, vlen, type, http;
+	time_t sec;
+	struct tm tm;
+	char tmp[64];
+
+	outp = out;
+	if (!rec_len || rec[2] != LOG_BIN_VERSION)
+		goto end;
+
+	for (type = 0; type < 256; type++)
+		fld[type].enc = -1;
+
+	p = rec + LOG_BIN_HDR_LEN;
+	end = rec + rec_len;
+	for (nb = rec[4]; nb && end - p >= 2; nb--) {
+		vlen = lb_val_len(p[1], p + 2, end);
+		if (vlen < 0 || vlen > end - p - 2)
+			break;
+		fld[p[0]].enc = p[1];
+		fld[p[0]].val = p + 2;
+		p += 2 + vlen;
+	}
+
+	/* the accept date is used both in the syslog header and in the log */
+	memset(&tm, 0, sizeof(tm));
+	nb = 0;
+	for (type = LOG_FMT_DATE; type <= LOG_FMT_DATELOCAL; type++) {
+		if (fld[type].enc == LOG_BIN_DATE) {
+			sec = lb_getbe(fld[type].val, 4);
+			nb = lb_getbe(fld[type].val + 4, 4) / 1000;
+			localtime_r(&sec, &tm);
+			break;
+		}
+	}
+
+	lb_puts(tmp, snprintf(tmp, sizeof(tmp), "%s %2d %02d:%02d:%02d - haproxy: ",
+	                      months[tm.tm_mon], tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec));
+
+	http = fld[LOG_FMT_STATUS].enc >= 0;
+
+	lb_put_addr(LOG_FMT_CLIENTIP);
+	lb_putc(':');
+	lb_put_int(LOG_FMT_CLIENTPORT);
+	lb_puts(tmp, snprintf(tmp, sizeof(tmp), " [%02d/%s/%04d:%02d:%02d:%02d.%03d] ",
+	                      tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900,
+	                      tm.tm_hour, tm.tm_min, tm.tm_sec, nb));
+	lb_put_str(fld[LOG_FMT_FRONTEND_XPRT].enc >= 0 ? LOG_FMT_FRONTEND_XPRT : LOG_FMT_FRONTEND);
+	lb_putc(' ');
+	lb_put_str(LOG_FMT_BACKEND);
+	lb_putc('/');
+	lb_put_str(LOG_FMT_SERVER);
+	lb_putc(' ');
+
+	if (http) {
+		lb_put_int(LOG_FMT_TQ);
+		lb_putc('/');
+	}
+	lb_put_int(LOG_FMT_TW);
+	lb_putc('/');
+	lb_put_int(LOG_FMT_TC);
+	lb_putc('/');
+	if (http) {
+		lb_put_int(LOG_FMT_TR);
+		lb_putc('/');
+	}
+	lb_put_int(LOG_FMT_TT);
+	lb_putc(' ');
+	if (http) {
+		lb_put_int(LOG_FMT_STATUS);
+		lb_putc(' ');
+	}
+	lb_put_int(LOG_FMT_BYTES);
+	lb_putc(' ');
+	if (http) {
+		lb_put_str(LOG_FMT_CCLIENT);
+		lb_putc(' ');
+		lb_put_str(LOG_FMT_CSERVER);
+		lb_putc(' ');
+	}
+	lb_put_str(fld[LOG_FMT_TERMSTATE_CK].enc >= 0 ? LOG_FMT_TERMSTATE_CK : LOG_FMT_TERMSTATE);
+	lb_putc(' ');
+	lb_put_int(LOG_FMT_ACTCONN);
+	lb_putc('/');
+	lb_put_int(LOG_FMT_FECONN);
+	lb_putc('/');
+	lb_put_int(LOG_FMT_BECONN);
+	lb_putc('/');
+	lb_put_int(LOG_FMT_SRVCONN);
+	lb_putc('/');
+	lb_put_int(LOG_FMT_RETRIES);
+	lb_putc(' ');
+	lb_put_int(LOG_FMT_SRVQUEUE);
+	lb_putc('/');
+	lb_put_int(LOG_FMT_BCKQUEUE);
+
+	if (http) {
+		lb_put_caps(fld[LOG_FMT_HDRREQUEST].enc >= 0 ? LOG_FMT_HDRREQUEST : LOG_FMT_HDRREQUESTLIST);
+		lb_put_caps(fld[LOG_FMT_HDRRESPONS].enc >= 0 ? LOG_FMT_HDRRESPONS : LOG_FMT_HDRRESPONSLIST);
+		lb_puts(" \"", 2);
+		lb_put_str(LOG_FMT_REQ);
+		lb_putc('"');
+	}
+ end:
+	*outp = 0;
+	return out;
+}
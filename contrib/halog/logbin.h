@@ -0,0 +1,49 @@
+/*
+ * binary log records reader for halog
+ *
+ * Copyright 2000-2014 Willy Tarreau <w@1wt.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#ifndef _HALOG_LOGBIN_H
+#define _HALOG_LOGBIN_H
+
+#include <stdio.h>
+
+/* The fields of a binary log record which are used by halog's filters, so that
+ * they can be applied without parsing any text. Strings point to the record
+ * and are not zero-terminated. Missing integers are reported as zero, and
+ * missing strings as NULL.
+ */
+struct logbin_rec {
+	int valid;                 /* 0 if the record could not be decoded */
+	int http;                  /* non-zero if the record has an HTTP status */
+	int timers[5];             /* Tq, Tw, Tc, Tr, Tt */
+	int status;                /* HTTP status */
+	long long bytes;           /* bytes sent to the client */
+	int srv_queue, bck_queue;  /* queue sizes */
+	char termstate[4];         /* termination and cookie codes, '-' if absent */
+	int has_date;              /* non-zero if the accept date is known */
+	unsigned int accept_sec, accept_usec;
+	int src_af;                /* AF_INET, AF_INET6 or AF_UNSPEC */
+	const unsigned char *src;  /* client address */
+	const char *backend, *server, *req;
+	int backend_len, server_len, req_len;
+};
+
+int logbin_read(FILE *stream, struct logbin_rec *r);
+const char *logbin_line(void);
+
+#endif /* _HALOG_LOGBIN_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
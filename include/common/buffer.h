@@ -145,6 +145,16 @@ static inline int bo_contig_data(const struct buffer *b)
 	return b->o;
 }
 
+/* Empties buffer <b> and resets its pointer to the beginning of the storage
+ * area. The size is left untouched.
+ */
+static inline void b_reset(struct buffer *b)
+{
+	b->o = 0;
+	b->i = 0;
+	b->p = b->data;
+}
+
 /* Return the buffer's length in bytes by summing the input and the output */
 static inline int buffer_len(const struct buffer *buf)
 {
@@ -159,16 +159,6 @@
 #define DEFAULT_MAXCONN SYSTEM_MAXCONN
 #endif
 
-/* Minimum check interval for spread health checks. Servers with intervals
- * greater than or equal to this value will have their checks spread apart
- * and will be considered when searching the minimal interval.
- * Others will be ignored for the minimal interval and will have their checks
- * scheduled on a different basis.
- */
-#ifndef SRV_CHK_INTER_THRES
-#define SRV_CHK_INTER_THRES 1000
-#endif
-
 /* Specifies the string used to report the version and release date on the
  * statistics page. May be defined to the empty string ("") to permanently
  * disable the feature.
@@ -194,6 +184,13 @@
 #define HCHK_DESC_LEN	128
 #endif
 
+/* Interval in milliseconds at which the processes not running the checks
+ * apply the check results shared by the other ones.
+ */
+#ifndef CHK_SYNC_INTERVAL
+#define CHK_SYNC_INTERVAL	100
+#endif
+
 /* ciphers used as defaults on connect */
 #ifndef CONNECT_DEFAULT_CIPHERS
 #define CONNECT_DEFAULT_CIPHERS NULL
@@ -209,9 +206,70 @@
 #define ECDHE_DEFAULT_CURVE "prime256v1"
 #endif
 
+/* Maximum number of log messages sent at once by the log ring task, and the
+ * delay in milliseconds before retrying after the log socket refused messages.
+ */
+#ifndef LOG_RING_BATCH
+#define LOG_RING_BATCH  64
+#endif
+
+#ifndef LOG_RING_RETRY
+#define LOG_RING_RETRY  10
+#endif
+
+/* Size of the buffer of pending messages of a stream logger, and the delay in
+ * milliseconds between two connection attempts to a stream logger.
+ */
+#ifndef LOG_STREAM_BUFSIZE
+#define LOG_STREAM_BUFSIZE 65536
+#endif
+
+#ifndef LOG_STREAM_RETRY
+#define LOG_STREAM_RETRY 1000
+#endif
+
+/* Number of priority classes of the queues, and class of requests for which
+ * none was set. Class 0 is served first.
+ */
+#ifndef QUEUE_CLASSES
+#define QUEUE_CLASSES 8
+#endif
+
+#ifndef QUEUE_CLASS_DEFAULT
+#define QUEUE_CLASS_DEFAULT 4
+#endif
+
 /* ssl cache size */
 #ifndef SSLCACHESIZE
 #define SSLCACHESIZE 20000
 #endif
 
+/* number of independently locked shards of the shared ssl cache */
+#ifndef SSLCACHESHARDS
+#define SSLCACHESHARDS 16
+#endif
+
+/* Size of the records sent at the beginning of each burst when dynamic record
+ * sizing is enabled. It must fit in a single TCP segment with the TLS record
+ * overhead (1448 bytes of payload over Ethernet with TCP timestamps).
+ */
+#ifndef SSL_DYN_RECORD_SIZE
+#define SSL_DYN_RECORD_SIZE 1419
+#endif
+
+/* Number of SSL sessions each server keeps for resumption, and maximum value
+ * of the "ssl-sess-cache" server keyword.
+ */
+#ifndef SRV_SSL_SESS_CACHE
+#define SRV_SSL_SESS_CACHE 4
+#endif
+#define SRV_SSL_SESS_CACHE_MAX 255
+
+/* Number of TLS session ticket keys kept for each "tls-ticket-keys" file. The
+ * newest one encrypts the new tickets, the other ones are only accepted.
+ */
+#ifndef TLS_TICKETS_NO
+#define TLS_TICKETS_NO 3
+#endif
+
 #endif /* _COMMON_DEFAULTS_H */
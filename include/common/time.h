@@ -335,6 +335,15 @@ REGPRM2 static inline unsigned long __tv_ms_elapsed(const struct timeval *tv1, c
 	return ret;
 }
 
+/*
+ * Returns the time in us elapsed between tv1 and tv2, assuming that tv1<=tv2.
+ * Must not be used when either argument is eternity.
+ */
+static inline unsigned long long tv_us_elapsed(const struct timeval *tv1, const struct timeval *tv2)
+{
+	return (unsigned long long)(tv2->tv_sec - tv1->tv_sec) * 1000000 + (tv2->tv_usec - tv1->tv_usec);
+}
+
 /*
  * returns the remaining time between tv1=now and event=tv2
  * if tv2 is passed, 0 is returned.
@@ -24,6 +24,8 @@
 
 #include <types/task.h>
 #include <common/config.h>
+#include <common/memory.h>
+#include <proto/outlier.h>
 
 const char *get_check_status_description(short check_status);
 const char *get_check_status_info(short check_status);
@@ -31,16 +33,26 @@ void set_server_down(struct check *check);
 void set_server_up(struct check *check);
 int start_checks();
 void __health_adjust(struct server *s, short status);
+int redistribute_pending(struct server *s);
+int check_for_pending(struct server *s);
+int start_check_sync();
 
 extern struct data_cb check_conn_cb;
+extern struct pool_head *pool2_check_buf;
+extern unsigned int nb_shared_checks;
+extern unsigned int nb_remote_checks;
 
 /* Use this one only. This inline version only ensures that we don't
- * call the function when the observe mode is disabled.
+ * call the function when the observe mode is disabled. The outlier
+ * detection is fed first when enabled.
  */
 static inline void health_adjust(struct server *s, short status)
 {
+	if (s->outlier)
+		outlier_observe(s, status);
+
 	/* return now if observing nor health check is not enabled */
-	if (!s->observe || !s->check.task)
+	if (!s->observe || (!s->check.task && !s->check.leader))
 		return;
 
 	return __health_adjust(s, status);
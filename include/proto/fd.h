@@ -35,6 +35,9 @@ extern unsigned int *fd_cache;      // FD events cache
 extern unsigned int *fd_updt;       // FD updates list
 extern int fd_cache_num;            // number of events in the cache
 extern int fd_nbupdt;               // number of updates in the list
+extern unsigned long long poll_spin_time;  // time spent busy polling (us)
+extern unsigned long long poll_sleep_time; // time spent waiting in the poller (us)
+extern unsigned int poll_spin_hits;        // number of busy polls which found events
 
 /* Deletes an FD from the fdsets, and recomputes the maxfd limit.
  * The file descriptor is also closed.
@@ -0,0 +1,41 @@
+/*
+ * include/proto/lb_maglev.h
+ * Maglev hash table load balancing algorithm.
+ *
+ * Copyright (C) 2000-2014 Willy Tarreau - w@1wt.eu
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _PROTO_LB_MAGLEV_H
+#define _PROTO_LB_MAGLEV_H
+
+#include <common/config.h>
+#include <types/proxy.h>
+#include <types/server.h>
+
+void maglev_recalc_table(struct proxy *p);
+struct server *maglev_get_server_hash(struct proxy *p, unsigned int hash);
+struct server *maglev_get_next_server(struct proxy *p, struct server *srvtoavoid);
+void maglev_init_server_table(struct proxy *p);
+
+#endif /* _PROTO_LB_MAGLEV_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -40,9 +40,21 @@ extern char default_tcp_log_format[];
 extern char default_http_log_format[];
 extern char clf_http_log_format[];
 
+extern unsigned int log_queued;
+extern unsigned int log_sent;
+extern unsigned int log_dropped;
+
 
 int build_logline(struct session *s, char *dst, size_t maxsize, struct list *list_format);
 
+/* (re)allocates the log line buffer to <len> bytes. Returns 0 on failure. */
+int alloc_log_line(int len);
+
+/*
+ * Builds a binary log record in <dst> based on <list_format>.
+ */
+int build_logbin(struct session *s, int level, char *dst, size_t maxsize, struct list *list_format);
+
 /*
  * send a log for the session when we have enough info about it.
  * Will not log if the frontend has no log defined.
@@ -106,6 +118,24 @@ void send_log(struct proxy *p, int level, const char *format, ...)
 
 void __send_log(struct proxy *p, int level, char *message, size_t size);
 
+/*
+ * This function sends a binary log record as-is to the log servers of a proxy,
+ * or to global log servers if the proxy is NULL.
+ */
+void __send_log_bin(struct proxy *p, int level, const char *rec, size_t size);
+
+/*
+ * Sends the messages still queued in the log rings and stream loggers before
+ * exiting, and releases the stream loggers.
+ */
+void deinit_log();
+
+/*
+ * Returns the stream logger for address <addr>, creating it if needed, with
+ * room for messages of <maxlen> bytes.
+ */
+struct log_stream *log_stream_get(const struct sockaddr_storage *addr, int maxlen);
+
 /*
  * returns log level for <lev> or -1 if not found.
  */
@@ -0,0 +1,41 @@
+/*
+ * include/proto/outlier.h
+ * Functions for passive outlier detection.
+ *
+ * Copyright (C) 2000-2014 Willy Tarreau - w@1wt.eu
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _PROTO_OUTLIER_H
+#define _PROTO_OUTLIER_H
+
+#include <common/config.h>
+#include <types/outlier.h>
+#include <types/proxy.h>
+#include <types/server.h>
+
+int start_outlier_detection();
+void outlier_observe(struct server *sv, short status);
+void outlier_observe_latency(struct server *sv, int ms);
+
+#endif /* _PROTO_OUTLIER_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -45,6 +45,18 @@ unsigned int srv_dynamic_maxconn(const struct server *s);
 
 
 
+/* Returns the first pending connection of the most urgent non-empty class in
+ * the array of class lists <lists>, or NULL if they are all empty.
+ */
+static inline struct pendconn *pendconn_first(const struct list *lists) {
+	int class;
+
+	for (class = 0; class < QUEUE_CLASSES; class++)
+		if (!LIST_ISEMPTY(&lists[class]))
+			return LIST_ELEM(lists[class].n, struct pendconn *, list);
+	return NULL;
+}
+
 /* Returns the first pending connection for server <s>, which may be NULL if
  * nothing is pending.
  */
@@ -52,7 +64,7 @@ static inline struct pendconn *pendconn_from_srv(const struct server *s) {
 	if (!s->nbpend)
 		return NULL;
 
-	return LIST_ELEM(s->pendconns.n, struct pendconn *, list);
+	return pendconn_first(s->pendconns);
 }
 
 /* Returns the first pending connection for proxy <px>, which may be NULL if
@@ -62,7 +74,7 @@ static inline struct pendconn *pendconn_from_px(const struct proxy *px) {
 	if (!px->nbpend)
 		return NULL;
 
-	return LIST_ELEM(px->pendconns.n, struct pendconn *, list);
+	return pendconn_first(px->pendconns);
 }
 
 /* Returns 0 if all slots are full on a server, or 1 if there are slots available. */
@@ -74,6 +74,16 @@ void srv_dump_kws(char **out);
  */
 void server_recalc_eweight(struct server *sv);
 
+/* Feeds the connect and response time averages of server <sv> with the time
+ * samples <ctime> and <rtime> in milliseconds. Negative samples are ignored.
+ */
+void srv_update_latency(struct server *sv, int ctime, int rtime);
+
+/* Returns the average <avg> of server <sv> decayed by the time elapsed since
+ * its last latency sample.
+ */
+unsigned int srv_ewma_now(const struct server *sv, unsigned int avg);
+
 /* returns the current server throttle rate between 0 and 100% */
 static inline unsigned int server_throttle_rate(struct server *sv)
 {
@@ -28,16 +28,28 @@
 #define SHCTX_APPNAME "haproxy"
 #endif
 
+/* Maximum number of independently locked shards of the cache */
+#ifndef SHCTX_MAX_SHARDS
+#define SHCTX_MAX_SHARDS 256
+#endif
+
 /* Allocate shared memory context.
  * <size> is the number of allocated blocks into cache (default 128 bytes)
  * A block is large enough to contain a classic session (without client cert)
  * If <size> is set less or equal to 0, ssl cache is disabled.
  * Set <use_shared_memory> to 1 to use a mapped shared memory instead
  * of private. (ignored if compiled with USE_PRIVATE_CACHE=1).
+ * The shared cache is split into <shards> independently locked parts.
  * Returns: -1 on alloc failure, <size> if it performs context alloc,
  * and 0 if cache is already allocated.
  */
-int shared_context_init(int size, int use_shared_memory);
+int shared_context_init(int size, int use_shared_memory, int shards);
+
+/* Returns the number of shards of the cache, and the number of lookups,
+ * misses and contended locks observed by the current process.
+ */
+int shared_context_stats(unsigned long long *lookups, unsigned long long *misses,
+                         unsigned long long *lock_waits);
 
 /* Set shared cache callbacks on an ssl context.
  * Set session cache mode to server and disable openssl internal cache.
@@ -24,6 +24,7 @@
 #include <openssl/ssl.h>
 
 #include <types/connection.h>
+#include <types/ssl_sock.h>
 #include <types/listener.h>
 #include <types/proxy.h>
 #include <types/stream_interface.h>
@@ -31,6 +32,8 @@
 extern struct xprt_ops ssl_sock;
 extern int sslconns;
 extern int totalsslconns;
+extern struct list tlskeys_reference;
+extern struct lazy_cert_stats lazy_certs;
 
 int ssl_sock_handshake(struct connection *conn, unsigned int flag);
 int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, SSL_CTX *ctx, struct proxy *proxy);
@@ -40,6 +43,11 @@ int ssl_sock_prepare_srv_ctx(struct server *srv, struct proxy *px);
 void ssl_sock_free_all_ctx(struct bind_conf *bind_conf);
 const char *ssl_sock_get_cipher_name(struct connection *conn);
 const char *ssl_sock_get_proto_version(struct connection *conn);
+struct tls_keys_ref *tlskeys_ref_lookup(const char *reference);
+int ssl_sock_update_tlskey(struct tls_keys_ref *ref, const char *b64, char **err);
+#if (defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB && !defined OPENSSL_NO_OCSP)
+int ssl_sock_update_ocsp_response(struct chunk *der, char **err);
+#endif
 
 #endif /* _PROTO_SSL_SOCK_H */
 
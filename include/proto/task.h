@@ -72,11 +72,31 @@
  *
  * The run queue works similarly to the wait queue except that the current date
  * is replaced by an insertion counter which can also wrap without any problem.
+ *
+ * Most timers are session timeouts which are set far away and rarely reached,
+ * yet they are moved every time they get closer. Such timers do not need to
+ * be sorted until they are about to expire, so by default, the wait queue is
+ * made of a hierarchical timer wheel in front of the tree. Each level of the
+ * wheel is an array of TIMER_WHEEL_SLOTS lists, and each slot of a level
+ * covers as much time as a whole lower level. Level 0 slots cover 2^RES ms.
+ * A task is appended to the slot of the lowest level which does not cover the
+ * current date, in O(1), and its node key is set to the beginning of that slot
+ * which is before its expiration date. When a slot begins, its tasks are moved
+ * to a lower level, or to the tree once they expire within the next two level
+ * 0 slots. The tree thus only holds the short and precise timers, the ones
+ * about to expire, and those too far away for the wheel (TIMER_WHEEL_LEVELS
+ * levels span 2^(RES + LEVELS * BITS) ms, about 6 days).
  */
 
 /* The farthest we can look back in a timer tree */
 #define TIMER_LOOK_BACK       (1U << 31)
 
+/* Timer wheel geometry, see above */
+#define TIMER_WHEEL_RES       4
+#define TIMER_WHEEL_BITS      5
+#define TIMER_WHEEL_SLOTS     (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS    5
+
 /* a few exported variables */
 extern unsigned int nb_tasks;     /* total number of tasks */
 extern unsigned int run_queue;    /* run queue size */
@@ -85,6 +105,8 @@ extern unsigned int nb_tasks_cur;
 extern unsigned int niced_tasks;  /* number of niced tasks in the run queue */
 extern struct pool_head *pool2_task;
 extern struct eb32_node *last_timer;   /* optimization: last queued timer */
+extern struct task_class_stats task_classes[TASK_CLASSES];
+extern const char *task_class_names[TASK_CLASSES];
 
 /* return 0 if task is in run queue, otherwise non-zero */
 static inline int task_in_rq(struct task *t)
@@ -95,7 +117,7 @@ static inline int task_in_rq(struct task *t)
 /* return 0 if task is in wait queue, otherwise non-zero */
 static inline int task_in_wq(struct task *t)
 {
-	return t->wq.node.leaf_p != NULL;
+	return t->wl.n != NULL || t->wq.node.leaf_p != NULL;
 }
 
 /* puts the task <t> in run queue with reason flags <f>, and returns <t> */
@@ -116,6 +138,12 @@ static inline struct task *task_wakeup(struct task *t, unsigned int f)
  */
 static inline struct task *__task_unlink_wq(struct task *t)
 {
+	if (likely(t->wl.n)) {
+		/* the slot is marked empty next time it is visited */
+		LIST_DEL(&t->wl);
+		t->wl.n = NULL;
+		return t;
+	}
 	eb32_delete(&t->wq);
 	if (last_timer == &t->wq)
 		last_timer = NULL;
@@ -171,9 +199,11 @@ static inline struct task *task_init(struct task *t)
 {
 	t->wq.node.leaf_p = NULL;
 	t->rq.node.leaf_p = NULL;
+	t->wl.n = NULL;
 	t->state = TASK_SLEEPING;
 	t->nice = 0;
 	t->calls = 0;
+	t->class = TASK_CL_OTHER;
 	return t;
 }
 
@@ -259,6 +289,12 @@ void wake_expired_tasks(int *next);
 /* Perform minimal initializations, report 0 in case of error, 1 if OK. */
 int init_task();
 
+/* Returns the task class matching <name>, or -1 if unknown. */
+int task_class_lookup(const char *name);
+
+/* Dumps the scheduling statistics of all task classes into the trash. */
+void dump_task_classes_to_trash();
+
 #endif /* _PROTO_TASK_H */
 
 /*
@@ -27,7 +27,9 @@
 #include <types/lb_fas.h>
 #include <types/lb_fwlc.h>
 #include <types/lb_fwrr.h>
+#include <types/lb_maglev.h>
 #include <types/lb_map.h>
+#include <types/lb_p2c.h>
 #include <types/server.h>
 
 /* Parameters for lbprm.algo */
@@ -54,6 +56,8 @@
 /* BE_LB_CB_* is used with BE_LB_KIND_CB */
 #define BE_LB_CB_LC     0x00000  /* least-connections */
 #define BE_LB_CB_FAS    0x00001  /* first available server (opposite of leastconn) */
+#define BE_LB_CB_LL     0x00002  /* least latency (peak-EWMA of response times) */
+#define BE_LB_CB_P2C    0x00003  /* least conns of two random servers */
 
 #define BE_LB_PARM      0x000FF  /* mask to get/clear the LB param */
 
@@ -79,6 +83,8 @@
 #define BE_LB_ALGO_RR   (BE_LB_KIND_RR | BE_LB_NEED_NONE)      /* round robin */
 #define BE_LB_ALGO_LC   (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_LC)    /* least connections */
 #define BE_LB_ALGO_FAS  (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_FAS)   /* first available server */
+#define BE_LB_ALGO_LL   (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_LL)    /* least latency */
+#define BE_LB_ALGO_P2C  (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_P2C)   /* power of two choices */
 #define BE_LB_ALGO_SRR  (BE_LB_KIND_RR | BE_LB_NEED_NONE | BE_LB_RR_STATIC) /* static round robin */
 #define BE_LB_ALGO_SH	(BE_LB_KIND_HI | BE_LB_NEED_ADDR | BE_LB_HASH_SRC) /* hash: source IP */
 #define BE_LB_ALGO_UH	(BE_LB_KIND_HI | BE_LB_NEED_HTTP | BE_LB_HASH_URI) /* hash: HTTP URI  */
@@ -97,6 +103,8 @@
 #define BE_LB_LKUP_LCTREE 0x30000  /* FWLC tree lookup */
 #define BE_LB_LKUP_CHTREE 0x40000  /* consistent hash  */
 #define BE_LB_LKUP_FSTREE 0x50000  /* FAS tree lookup */
+#define BE_LB_LKUP_P2CARR 0x60000  /* power of two choices array lookup */
+#define BE_LB_LKUP_MGLEV  0x70000  /* maglev table lookup */
 #define BE_LB_LKUP        0x70000  /* mask to get just the LKUP value */
 
 /* additional properties */
@@ -104,18 +112,19 @@
 
 /* hash types */
 #define BE_LB_HASH_MAP    0x000000 /* map-based hash (default) */
-#define BE_LB_HASH_CONS   0x100000 /* consistent hashbit to indicate a dynamic algorithm */
-#define BE_LB_HASH_TYPE   0x100000 /* get/clear hash types */
+#define BE_LB_HASH_CONS   0x100000 /* consistent hash */
+#define BE_LB_HASH_MAGLEV 0x200000 /* maglev lookup table */
+#define BE_LB_HASH_TYPE   0x300000 /* get/clear hash types */
 
 /* additional modifier on top of the hash function (only avalanche right now) */
-#define BE_LB_HMOD_AVAL   0x200000  /* avalanche modifier */
-#define BE_LB_HASH_MOD    0x200000  /* get/clear hash modifier */
+#define BE_LB_HMOD_AVAL   0x400000  /* avalanche modifier */
+#define BE_LB_HASH_MOD    0x400000  /* get/clear hash modifier */
 
 /* BE_LB_HFCN_* is the hash function, to be used with BE_LB_HASH_FUNC */
 #define BE_LB_HFCN_SDBM   0x000000 /* sdbm hash */
-#define BE_LB_HFCN_DJB2   0x400000 /* djb2 hash */
-#define BE_LB_HFCN_WT6    0x800000 /* wt6 hash */
-#define BE_LB_HASH_FUNC   0xC00000 /* get/clear hash function */
+#define BE_LB_HFCN_DJB2   0x800000 /* djb2 hash */
+#define BE_LB_HFCN_WT6    0x1000000 /* wt6 hash */
+#define BE_LB_HASH_FUNC   0x1800000 /* get/clear hash function */
 
 
 /* various constants */
@@ -139,17 +148,21 @@ struct lbprm {
 	int wmult;			/* ratio between user weight and effective weight */
 	int wdiv;			/* ratio between effective weight and user weight */
 	struct server *fbck;		/* first backup server when !PR_O_USE_ALL_BK, or NULL */
+	unsigned int hash_balance_factor; /* load limit in percent of the average for consistent hashing, 0=none */
 	struct lb_map map;		/* LB parameters for map-based algorithms */
 	struct lb_fwrr fwrr;
 	struct lb_fwlc fwlc;
 	struct lb_chash chash;
 	struct lb_fas fas;
+	struct lb_p2c p2c;
+	struct lb_maglev maglev;
 	/* Call backs for some actions. Any of them may be NULL (thus should be ignored). */
 	void (*update_server_eweight)(struct server *);  /* to be called after eweight change */
 	void (*set_server_status_up)(struct server *);   /* to be called after status changes to UP */
 	void (*set_server_status_down)(struct server *); /* to be called after status changes to DOWN */
 	void (*server_take_conn)(struct server *);       /* to be called when connection is assigned */
 	void (*server_drop_conn)(struct server *);       /* to be called when connection is dropped */
+	void (*server_update_latency)(struct server *);  /* to be called after latency averages change */
 };
 
 #endif /* _TYPES_BACKEND_H */
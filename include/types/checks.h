@@ -40,6 +40,7 @@ enum chk_result {
 #define CHK_ST_ENABLED          0x0004  /* this check is currently administratively enabled */
 #define CHK_ST_PAUSED           0x0008  /* checks are paused because of maintenance (health only) */
 #define CHK_ST_AGENT            0x0010  /* check is an agent check (otherwise it's a health check) */
+#define CHK_ST_REMOTE           0x0020  /* another process runs this check and shares its results */
 
 /* check status */
 enum {
@@ -144,6 +145,27 @@ struct check {
 	int rise, fall;				/* time in iterations */
 	int type;				/* Check type, one of PR_O2_*_CHK */
 	struct server *server;			/* back-pointer to server */
+	struct check *leader;			/* check running the probes for this one, or NULL */
+	struct check *shared_next;		/* next check following this one's probes, or NULL */
+};
+
+/* Result of a check as published in the shared memory area */
+struct check_shm_result {
+	long duration;				/* time in ms took to finish last health check */
+	short status, code;			/* check result, check code */
+	int health;				/* check health, see struct check */
+	char desc[HCHK_DESC_LEN];		/* health check description */
+};
+
+/* State of a server as published by the process running its checks for the
+ * other processes in "share-check-results" mode. <seq> is odd while the record
+ * is being updated, and changes each time it is updated.
+ */
+struct check_shm {
+	volatile unsigned int seq;		/* sequence number, odd during updates */
+	int state;				/* server's SRV_RUNNING and SRV_GOINGDOWN flags */
+	unsigned int uweight;			/* user weight, possibly set by the agent */
+	struct check_shm_result check, agent;	/* results of the health and agent checks */
 };
 
 struct check_status {
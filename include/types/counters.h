@@ -53,6 +53,7 @@ struct pxcounters {
 	long long srv_aborts;                   /* aborted responses during DATA phase caused by the server */
 	long long retries;                      /* retried and redispatched connections (BE only) */
 	long long redispatches;                 /* retried and redispatched connections (BE only) */
+	long long q_timeouts;                   /* requests which expired in the queue (BE only) */
 	long long intercepted_req;              /* number of monitoring or stats requests intercepted by the frontend */
 
 	union {
@@ -95,6 +96,8 @@ struct srvcounters {
 	long long cli_aborts, srv_aborts;	/* aborted responses during DATA phase due to client or server */
 	long long retries, redispatches;	/* retried and redispatched connections */
 	long long failed_secu;			/* blocked responses because of security concerns */
+	long long hash_spills;			/* hashed requests sent to another server because of hash-balance-factor */
+	long long q_timeouts;			/* requests which expired in this server's queue */
 
 	union {
 		struct {
@@ -104,6 +107,8 @@ struct srvcounters {
 
 	long long failed_checks, failed_hana;	/* failed health checks and health analyses */
 	long long down_trans;			/* up->down transitions */
+	long long ejections;			/* ejections by the outlier detection */
+	long long ssl_full, ssl_reused;		/* full and resumed SSL handshakes */
 };
 
 #endif /* _TYPES_COUNTERS_H */
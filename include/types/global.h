@@ -58,6 +58,9 @@
 /* platform-specific options */
 #define GTUNE_USE_SPLICE         (1<<4)
 #define GTUNE_USE_GAI            (1<<5)
+#define GTUNE_SHARE_CHECKS       (1<<6)
+#define GTUNE_SHARE_CHK_RESULTS  (1<<7)
+#define GTUNE_USE_TIMER_WHEEL    (1<<8)
 
 /* Access level for a stats socket */
 #define ACCESS_LVL_NONE     0
@@ -92,10 +95,12 @@ struct global {
 	struct freq_ctr ssl_per_sec;
 	struct freq_ctr comp_bps_in;	/* bytes per second, before http compression */
 	struct freq_ctr comp_bps_out;	/* bytes per second, after http compression */
+	struct freq_ctr chk_per_sec;	/* health checks started per second */
 	int cps_lim, cps_max;
 	int sps_lim, sps_max;
 	int ssl_lim, ssl_max;
 	int comp_rate_lim;           /* HTTP compression rate limit */
+	int chk_lim;                 /* health checks rate limit, 0 = unlimited */
 	int maxpipes;		/* max # of pipes */
 	int maxsock;		/* max # of sockets */
 	int rlimit_nofile;	/* default ulimit-n value : 0=unset */
@@ -111,6 +116,7 @@ struct global {
 	char *node, *desc;		/* node name & description */
 	char *log_tag;                  /* name for syslog */
 	struct list logsrvs;
+	int max_syslog_len;        /* largest "len" of all loggers */
 	char *log_send_hostname;   /* set hostname in syslog header */
 	struct {
 		int maxpollevents; /* max number of poll events at once */
@@ -129,15 +135,23 @@ struct global {
 		int cookie_len;    /* max length of cookie captures */
 #ifdef USE_OPENSSL
 		int sslcachesize;  /* SSL cache size in session, defaults to 20000 */
+		int ssl_cache_shards; /* number of independently locked parts of the SSL cache */
 		unsigned int ssllifetime;   /* SSL session lifetime in seconds */
 		unsigned int ssl_max_record; /* SSL max record size */
+		int ssl_hs_workers; /* number of SSL handshake worker threads, 0 = inline */
+		int ssl_lazy_certs; /* max number of resident lazily loaded certs, 0 = load all at boot */
+		unsigned int ssl_dyn_rec_threshold; /* bytes sent in small records in each burst, 0 = disabled */
 #endif
 #ifdef USE_ZLIB
 		int zlibmemlevel;    /* zlib memlevel */
 		int zlibwindowsize;  /* zlib window size */
 #endif
 		int comp_maxlevel;    /* max HTTP compression level */
+		int log_ring;         /* number of log messages queued per log socket, 0 = none */
 		unsigned short idle_timer; /* how long before an empty buffer is considered idle (ms) */
+		unsigned int busy_poll;    /* time spent polling without sleeping (us), 0 = disabled */
+		unsigned int sched_budget; /* time allowed to tasks per polling loop (us), 0 = no fair scheduling */
+		unsigned int sched_weight[TASK_CLASSES]; /* share of the budget of each task class */
 	} tune;
 	struct {
 		char *prefix;           /* path prefix of unix bind socket */
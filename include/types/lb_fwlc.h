@@ -28,6 +28,7 @@
 struct lb_fwlc {
 	struct eb_root act;	/* weighted least conns on the active servers */
 	struct eb_root bck;	/* weighted least conns on the backup servers */
+	int refresh;		/* date of the next latency decay (leastlatency) */
 };
 
 #endif /* _TYPES_LB_FWLC_H */
@@ -0,0 +1,62 @@
+/*
+ * include/types/lb_maglev.h
+ * Types for the Maglev hash table load balancing algorithm.
+ *
+ * Copyright (C) 2000-2014 Willy Tarreau - w@1wt.eu
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TYPES_LB_MAGLEV_H
+#define _TYPES_LB_MAGLEV_H
+
+#include <common/config.h>
+#include <types/server.h>
+
+/* values for maglev.state */
+#define LB_MAGLEV_RECALC  (1 << 0)
+
+/* The table has at least LB_MAGLEV_MIN_SIZE entries and about LB_MAGLEV_RATIO
+ * entries per server, which keeps the load difference between servers below
+ * about 1% of the load.
+ */
+#define LB_MAGLEV_MIN_SIZE  1021
+#define LB_MAGLEV_RATIO     100
+
+/* The Maglev lookup table is an array of a prime number of entries, each of
+ * them designating a server. Each server has its own permutation of the table
+ * positions, and servers take turns to fill the first free position of their
+ * permutation, a number of times proportional to their weight. This results
+ * in an almost even spread of the entries, and in few changes when a server
+ * is added or removed.
+ */
+struct lb_maglev {
+	struct server **table;	/* the lookup table, <size> entries */
+	unsigned int size;	/* number of entries, a prime number */
+	struct server **srv;	/* servers filling the table (work area) */
+	unsigned int *pos;	/* next position of each server in its permutation (work area) */
+	int *credit;		/* weight credit of each server (work area) */
+	unsigned int rr_idx;	/* next entry to be used in round robin mode */
+	int state;		/* LB_MAGLEV_RECALC */
+};
+
+#endif /* _TYPES_LB_MAGLEV_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -23,13 +23,30 @@
 #define _TYPES_LB_MAP_H
 
 #include <common/config.h>
+#include <eb32tree.h>
+#include <eb64tree.h>
 #include <types/server.h>
 
 /* values for map.state */
 #define LB_MAP_RECALC  (1 << 0)
 
+/* Per-server state used while building the map. The score is the number of
+ * times the server should have been picked so far given its weight, minus the
+ * number of times it was picked. It increases by one at known steps, which are
+ * queued in a tree so that only the servers whose score changes are visited.
+ */
+struct lb_map_build {
+	struct eb64_node by_score;	/* keyed on the score then on the reversed position */
+	struct eb32_node by_step;	/* keyed on the step at which the score increases */
+	struct server *srv;
+	unsigned int pos;		/* position of the server in the list */
+	unsigned int due;		/* number of times it was due since the beginning */
+	int score;			/* times due minus times picked */
+};
+
 struct lb_map {
 	struct server **srv;	/* the server map used to apply weights */
+	struct lb_map_build *build; /* one per server, to build the map */
 	int rr_idx;		/* next server to be elected in round robin mode */
 	int state;		/* LB_MAP_RECALC */
 };
@@ -0,0 +1,47 @@
+/*
+ * include/types/lb_p2c.h
+ * Types for the "power of two choices" load balancing algorithm.
+ *
+ * Copyright (C) 2000-2014 Willy Tarreau - w@1wt.eu
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TYPES_LB_P2C_H
+#define _TYPES_LB_P2C_H
+
+#include <common/config.h>
+#include <types/server.h>
+
+/* values for p2c.state */
+#define LB_P2C_RECALC  (1 << 0)
+
+/* The servers taking part in load balancing are stored in an array so that
+ * any of them may be drawn in constant time.
+ */
+struct lb_p2c {
+	struct server **srv;	/* servers currently used for LB */
+	int nbsrv;		/* number of valid entries in srv[] */
+	int state;		/* LB_P2C_RECALC */
+};
+
+#endif /* _TYPES_LB_P2C_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
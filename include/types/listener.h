@@ -40,6 +40,7 @@ struct protocol;
 struct xprt_ops;
 struct proxy;
 struct licounters;
+struct tls_keys_ref;
 
 /* listener state */
 enum li_state {
@@ -132,6 +133,7 @@ struct bind_conf {
 	int strict_sni;            /* refuse negotiation if sni doesn't match a certificate */
 	struct eb_root sni_ctx;    /* sni_ctx tree of all known certs full-names sorted by name */
 	struct eb_root sni_w_ctx;  /* sni_ctx tree of all known certs wildcards sorted by name */
+	struct tls_keys_ref *keys_ref; /* TLS ticket keys, or NULL to let OpenSSL pick them */
 #endif
 	int is_ssl;                /* SSL is required for these listeners */
 	struct {                   /* UNIX socket permissions */
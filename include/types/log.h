@@ -25,6 +25,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#include <common/chunk.h>
 #include <common/config.h>
 #include <common/mini-clist.h>
 
@@ -35,7 +36,9 @@
 #define UNIQUEID_LEN            128
 
 
-/* lists of fields that can be logged */
+/* lists of fields that can be logged. Their values are part of the binary log
+ * format, so new fields must only be appended at the end of the list.
+ */
 enum {
 
 	LOG_FMT_TEXT = 0, /* raw text */
@@ -97,6 +100,37 @@ enum {
 	LOG_FMT_SSL_VERSION,
 };
 
+/* Binary log records (option log-binary). A record starts with a header made
+ * of its total length on 2 bytes (big endian, header included), the format
+ * version, the syslog level and the number of fields, one byte each. Each
+ * field then starts with its LOG_FMT_* type and its LOG_BIN_* encoding on one
+ * byte each, followed by the value :
+ *   - LOG_BIN_NONE : no value (eg: unknown address or cookie)
+ *   - LOG_BIN_S64  : signed integer on 8 bytes, big endian
+ *   - LOG_BIN_STR  : length on 2 bytes, big endian, followed by the string
+ *   - LOG_BIN_IPV4 : IPv4 address on 4 bytes, network order
+ *   - LOG_BIN_IPV6 : IPv6 address on 16 bytes, network order
+ *   - LOG_BIN_DATE : seconds then microseconds, 4 bytes each, big endian
+ *   - LOG_BIN_STRS : number of strings on 1 byte, then as many LOG_BIN_STR
+ * LOG_BIN_F_PLUS may be set on the encoding to report a value which the text
+ * format prefixes with '+' (partial byte count or time, redispatch).
+ */
+#define LOG_BIN_VERSION         1
+#define LOG_BIN_HDR_LEN         5
+
+enum {
+	LOG_BIN_NONE = 0,
+	LOG_BIN_S64,
+	LOG_BIN_STR,
+	LOG_BIN_IPV4,
+	LOG_BIN_IPV6,
+	LOG_BIN_DATE,
+	LOG_BIN_STRS,
+};
+
+#define LOG_BIN_F_PLUS          0x80
+#define LOG_BIN_ENC_MASK        0x7F
+
 /* enum for parse_logformat_string */
 enum {
 	LF_INIT = 0,   // before first character
@@ -117,6 +151,7 @@ struct logformat_node {
 	int type;      // LOG_FMT_*
 	int options;   // LOG_OPT_*
 	char *arg;     // text for LOG_FMT_TEXT, arg for others
+	int arg_len;   // length of the text for LOG_FMT_TEXT
 	void *expr;    // for use with LOG_FMT_EXPR
 };
 
@@ -126,6 +161,7 @@ struct logformat_node {
 #define LOG_OPT_REQ_CAP         0x00000008
 #define LOG_OPT_RES_CAP         0x00000010
 #define LOG_OPT_HTTP            0x00000020
+#define LOG_OPT_SEPARATOR       0x00000040 /* text ending with a merged separator */
 
 
 /* Fields that need to be extracted from the incoming connection or request for
@@ -147,14 +183,53 @@ struct logformat_node {
 #define LW_FRTIP 	8192	/* frontend IP */
 #define LW_XPRT		16384	/* transport layer information (eg: SSL) */
 
+/* A stream connection to a syslog server (TCP or UNIX stream socket). Messages
+ * are framed using octet counting (RFC6587) and accumulated into <buf>, which
+ * is written when the socket is ready. It is shared by all loggers referencing
+ * the same address.
+ */
+struct log_stream {
+	struct list list;               /* list of all log streams */
+	struct sockaddr_storage addr;   /* syslog server's address */
+	int fd;                         /* socket, -1 when not connected */
+	int pid;                        /* pid of the process owning the socket */
+	struct task *task;              /* reconnection timer */
+	struct chunk buf;               /* pending frames */
+	int frame;                      /* offset of the first frame not fully sent */
+	int sent;                       /* number of bytes of <buf> already sent */
+};
+
 struct logsrv {
 	struct list list;
 	struct sockaddr_storage addr;
+	struct log_stream *stream;      /* NULL for datagram loggers */
+	int maxlen;                     /* max message length, including the header */
 	int facility;
 	int level;
 	int minlvl;
 };
 
+/* One log message waiting in a log ring, already prefixed with its syslog
+ * header for the destination <logsrv>.
+ */
+struct log_ring_entry {
+	const struct logsrv *logsrv;    /* destination of this message */
+	int len;                        /* message length, including the LF */
+	char *msg;                      /* message contents, global.max_syslog_len bytes */
+};
+
+/* Messages sent over one syslog socket. <entry> is only allocated when
+ * tune.log.ring is set, in which case messages are queued between <tail> and
+ * <head> (both free-running counters) and sent in batches by the log task.
+ */
+struct log_ring {
+	int fd;                         /* syslog socket, -1 until first use */
+	unsigned int size;              /* number of entries, 0 = send immediately */
+	unsigned int head;              /* next entry to fill */
+	unsigned int tail;              /* next entry to send */
+	struct log_ring_entry *entry;   /* <size> entries */
+};
+
 #endif /* _TYPES_LOG_H */
 
 /*
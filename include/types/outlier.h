@@ -0,0 +1,90 @@
+/*
+ * include/types/outlier.h
+ * This file defines everything related to passive outlier detection.
+ *
+ * Copyright (C) 2000-2014 Willy Tarreau - w@1wt.eu
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TYPES_OUTLIER_H
+#define _TYPES_OUTLIER_H
+
+#include <common/config.h>
+
+#include <types/task.h>
+
+/* The observation window is made of OUTLIER_SLOTS slots, each covering one
+ * analysis interval. The oldest slot is recycled at each interval.
+ */
+#define OUTLIER_SLOTS         4
+
+/* Latencies are stored in a log-linear histogram : each power of two of
+ * milliseconds is split into 1<<OUTLIER_LAT_SUB buckets, which bounds the
+ * error on a percentile to 25%. The last bucket collects everything above
+ * 2^(OUTLIER_LAT_BUCKETS>>OUTLIER_LAT_SUB) ms (about one minute).
+ */
+#define OUTLIER_LAT_SUB       2
+#define OUTLIER_LAT_BUCKETS   64
+
+/* Servers are only compared with each other when at least OUTLIER_MIN_SERVERS
+ * of them have been observed enough, and latencies below OUTLIER_LAT_FLOOR ms
+ * are never considered slow.
+ */
+#define OUTLIER_MIN_SERVERS   3
+#define OUTLIER_LAT_FLOOR     10
+
+/* Per-interval observations of a server */
+struct outlier_slot {
+	unsigned int ok, err;                   /* successful and failed requests */
+	unsigned int lat[OUTLIER_LAT_BUCKETS];  /* latency histogram */
+};
+
+/* Outlier detection state of a server, only allocated when the backend
+ * enables outlier detection.
+ */
+struct srv_outlier {
+	struct outlier_slot slot[OUTLIER_SLOTS];
+	unsigned int cur;                       /* index of the current slot */
+	unsigned int win_ok, win_err;           /* totals over the whole window */
+	unsigned int win_lat;                   /* number of latency samples in the window */
+	unsigned int ejections;                 /* consecutive ejections, for the backoff */
+	int expire;                             /* date of the end of the ejection */
+};
+
+/* Outlier detection settings of a backend */
+struct px_outlier {
+	int interval;                           /* analysis interval (ms), 0 = disabled */
+	int base_time;                          /* duration of the first ejection (ms) */
+	int max_time;                           /* maximum duration of an ejection (ms) */
+	int max_pct;                            /* max percentage of ejected servers */
+	int min_requests;                       /* min number of requests in the window to judge a server */
+	int error_pct;                          /* error ratio ejecting immediately (%), 0 = disabled */
+	int sr_factor;                          /* success rate deviation factor (1/100), 0 = disabled */
+	int lat_pctl;                           /* latency percentile compared between servers */
+	int lat_factor;                         /* latency ratio to the median (1/100), 0 = disabled */
+	int nb_ejected;                         /* number of currently ejected servers */
+	int next;                               /* date of the next analysis */
+	struct task *task;                      /* the analysis task */
+};
+
+#endif /* _TYPES_OUTLIER_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
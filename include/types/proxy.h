@@ -44,6 +44,7 @@
 #include <types/listener.h>
 #include <types/log.h>
 #include <types/obj_type.h>
+#include <types/outlier.h>
 #include <types/proto_http.h>
 #include <types/sample.h>
 #include <types/session.h>
@@ -143,7 +144,7 @@ enum pr_mode {
 #define PR_O2_SRC_ADDR	0x00100000	/* get the source ip and port for logs */
 
 #define PR_O2_FAKE_KA   0x00200000      /* pretend we do keep-alive with server eventhough we close */
-/* unused: 0x00400000 */
+#define PR_O2_LOGBIN	0x00400000      /* send binary log records instead of text lines */
 #define PR_O2_EXP_NONE  0x00000000      /* http-check : no expect rule */
 #define PR_O2_EXP_STS   0x00800000      /* http-check expect status */
 #define PR_O2_EXP_RSTS  0x01000000      /* http-check expect rstatus */
@@ -247,6 +248,7 @@ struct proxy {
 	struct server *srv, defsrv;		/* known servers; default server configuration */
 	int srv_act, srv_bck;			/* # of servers eligible for LB (UP|!checked) AND (enabled+weight!=0) */
 	struct lbprm lbprm;			/* load-balancing parameters */
+	struct px_outlier outlier;		/* outlier detection settings and state */
 	char *cookie_domain;			/* domain used to insert the cookie */
 	char *cookie_name;			/* name of the cookie to look for */
 	int  cookie_len;			/* strlen(cookie_name), computed only once */
@@ -286,8 +288,10 @@ struct proxy {
 		int tunnel;                     /* I/O timeout to use in tunnel mode (in ticks) */
 	} timeout;
 	char *id, *desc;			/* proxy id (name) and description */
-	struct list pendconns;			/* pending connections with no server assigned yet */
+	struct list pendconns[QUEUE_CLASSES];	/* pending connections with no server assigned yet, per class */
 	int nbpend;				/* number of pending connections with no server assigned yet */
+	unsigned int nbpend_class[QUEUE_CLASSES]; /* number of such pending connections per class */
+	int queue_class_timeout[QUEUE_CLASSES];	/* queue timeout per class (ticks), 0 = "timeout queue" */
 	int totpend;				/* total number of pending connections on this instance (for stats) */
 	int max_ka_queue;			/* 1+maximum requests in queue accepted for reusing a K-A conn (0=none) */
 	unsigned int feconn, beconn;		/* # of active frontend and backends sessions */
@@ -32,6 +32,7 @@ struct pendconn {
 	struct list list;		/* chaining ... */
 	struct session *sess;		/* the session waiting for a connection */
 	struct server *srv;		/* the server we are waiting for */
+	int class;			/* priority class of the queue it's in */
 };
 
 #endif /* _TYPES_QUEUE_H */
@@ -37,6 +37,7 @@
 #include <types/counters.h>
 #include <types/freq_ctr.h>
 #include <types/obj_type.h>
+#include <types/outlier.h>
 #include <types/proxy.h>
 #include <types/queue.h>
 #include <types/task.h>
@@ -47,8 +48,8 @@
 #define SRV_RUNNING	0x0001	/* the server is UP */
 #define SRV_BACKUP	0x0002	/* this server is a backup server */
 #define SRV_MAPPORTS	0x0004	/* this server uses mapped ports */
-/* unused: 0x0008 */
-/* unused: 0x0010 */
+#define SRV_ADAPTIVE	0x0008	/* the connection limit adapts to the response time */
+#define SRV_EJECTED	0x0010	/* this server was ejected by the outlier detection */
 #define SRV_GOINGDOWN	0x0020	/* this server says that it's going down (404) */
 #define SRV_WARMINGUP	0x0040	/* this server is warming up after a failure */
 #define SRV_MAINTAIN	0x0080	/* this server is in maintenance mode */
@@ -70,6 +71,23 @@
 #define SRV_EWGHT_RANGE (SRV_UWGHT_RANGE * BE_WEIGHT_SCALE)
 #define SRV_EWGHT_MAX   (SRV_UWGHT_MAX   * BE_WEIGHT_SCALE)
 
+/* Connect and response time averages are stored in 1/SRV_EWMA_SCALE ms units.
+ * A sample above the average replaces it immediately (peak), otherwise it only
+ * counts for 1/SRV_EWMA_DECAY in the new average. Averages are also halved
+ * every SRV_EWMA_HALFLIFE ms without any sample, so that a server which was
+ * avoided after a slow response is tried again.
+ */
+#define SRV_EWMA_SCALE     16
+#define SRV_EWMA_DECAY     8
+#define SRV_EWMA_HALFLIFE  1000
+
+/* The adaptive connection limit is stored in 1/SRV_ADAPT_SCALE connection
+ * units. It shrinks once the average response time exceeds the no-load one
+ * by more than SRV_ADAPT_TOLERANCE times.
+ */
+#define SRV_ADAPT_SCALE      256
+#define SRV_ADAPT_TOLERANCE  2
+
 #ifdef USE_OPENSSL
 /* server ssl options */
 #define SRV_SSL_O_NONE         0x0000
@@ -116,7 +134,8 @@ struct server {
 	struct freq_ctr sess_per_sec;		/* sessions per second on this server */
 	struct srvcounters counters;		/* statistics counters */
 
-	struct list pendconns;			/* pending connections */
+	struct list pendconns[QUEUE_CLASSES];	/* pending connections, one list per priority class */
+	unsigned int nbpend_class[QUEUE_CLASSES]; /* number of pending connections per class */
 	struct list actconns;			/* active connections */
 	struct task *warmup;                    /* the task dedicated to the warmup when slowstart is set */
 
@@ -145,6 +164,11 @@ struct server {
 	unsigned lb_nodes_tot;                  /* number of allocated lb_nodes (C-HASH) */
 	unsigned lb_nodes_now;                  /* number of lb_nodes placed in the tree (C-HASH) */
 	struct tree_occ *lb_nodes;              /* lb_nodes_tot * struct tree_occ */
+	unsigned int ewma_ctime, ewma_rtime;    /* peak-EWMA of connect and response times (SRV_EWMA_SCALE) */
+	unsigned int ewma_date;                 /* date of the last latency sample (now_ms) */
+	unsigned int min_rtime;                 /* no-load response time (SRV_EWMA_SCALE), 0 = unknown */
+	unsigned int adapt_limit;               /* adaptive connection limit (SRV_ADAPT_SCALE) */
+	struct srv_outlier *outlier;            /* outlier detection state, NULL if disabled */
 
 	/* warning, these structs are huge, keep them at the bottom */
 	struct sockaddr_storage addr;		/* the address to connect to */
@@ -163,12 +187,17 @@ struct server {
 
 	struct check check;                     /* health-check specific configuration */
 	struct check agent;                     /* agent specific configuration */
+	struct check_shm *chk_shm;              /* check results shared between processes, or NULL */
+	unsigned int chk_shm_seq;               /* last applied chk_shm->seq (remote checks) */
+	unsigned int chk_shm_uweight;           /* last applied chk_shm->uweight (remote checks) */
 
 #ifdef USE_OPENSSL
 	int use_ssl;				/* ssl enabled */
 	struct {
 		SSL_CTX *ctx;
-		SSL_SESSION *reused_sess;
+		SSL_SESSION **sess;		/* cache of sessions to resume */
+		int sess_nb;			/* number of entries in the session cache */
+		unsigned int sess_idx;		/* next entry of the session cache to offer */
 		char *ciphers;			/* cipher suite to use if non-null */
 		int options;			/* ssl options */
 		int verify;			/* verify method (set of SSL_VERIFY_* flags) */
@@ -130,6 +130,7 @@ struct session {
 	struct listener *listener;		/* the listener by which the request arrived */
 	struct server *srv_conn;		/* session already has a slot on a server and is not in queue */
 	struct pendconn *pend_pos;		/* if not NULL, points to the position in the pending queue */
+	int queue_class;			/* priority class when queued, 0 = highest */
 
 	struct http_txn txn;			/* current HTTP transaction being processed. Should become a list. */
 
@@ -23,13 +23,114 @@
 #define _TYPES_SSL_SOCK_H
 
 #include <openssl/ssl.h>
+#if (defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB && !defined OPENSSL_NO_OCSP)
+#include <openssl/ocsp.h>
+#endif
+#include <common/chunk.h>
+#include <common/config.h>
+#include <common/mini-clist.h>
 #include <ebmbtree.h>
 
+/* A certificate which was only indexed by its names at startup. Its SSL_CTX
+ * is only built upon the first handshake requesting one of these names, and
+ * may be released again when it becomes one of the least recently used ones.
+ */
+struct lazy_cert {
+	struct list lru;          /* position in the LRU of resident contexts */
+	SSL_CTX *ctx;             /* context when resident, otherwise NULL */
+	struct bind_conf *bind_conf; /* bind line the certificate was declared on */
+	int failed;               /* non-zero if the context could not be built */
+	char path[0];             /* path to the PEM file */
+};
+
+/* Certificate loading counters, reported on the CLI */
+struct lazy_cert_stats {
+	unsigned int load_time;   /* time spent loading certificates at boot (ms) */
+	unsigned int indexed;     /* lazily loaded certificates */
+	unsigned int resident;    /* lazily loaded certificates currently built */
+	unsigned int loads;       /* lazily loaded contexts built */
+	unsigned int evictions;   /* resident contexts released */
+	unsigned int failures;    /* lazily loaded certificates which failed */
+};
+
 struct sni_ctx {
 	SSL_CTX *ctx;             /* context associated to the certificate */
+	struct lazy_cert *lazy;   /* lazily loaded certificate, ctx is NULL then */
 	int order;                /* load order for the certificate */
 	int neg;                  /* reject if match */
 	struct ebmb_node name;    /* node holding the servername value */
 };
 
+#if (defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB && !defined OPENSSL_NO_OCSP)
+/* largest DER-encoded OCSP_CERTID we may index */
+#define OCSP_MAX_CERTID_ASN1_LENGTH 128
+
+/* clock skew tolerated on the validity dates of an OCSP response (seconds) */
+#define OCSP_MAX_RESPONSE_TIME_SKEW 300
+
+/* The OCSP response stapled for a certificate, indexed by the DER encoding
+ * of the certificate's OCSP_CERTID. A published response is never modified,
+ * an update publishes a new one and the previous one is only released upon
+ * the next update, since a handshake worker may still be copying it.
+ */
+struct certificate_ocsp {
+	struct ebmb_node key;
+	unsigned char key_data[OCSP_MAX_CERTID_ASN1_LENGTH];
+	struct chunk *response;   /* DER-encoded OCSP response */
+	long expire;              /* date after which the response is not stapled anymore, 0 = never */
+};
+#endif
+
+/* A TLS session ticket key, as found in a "tls-ticket-keys" file */
+struct tls_sess_key {
+	unsigned char name[16];   /* sent in clear in the ticket */
+	unsigned char aes_key[16];
+	unsigned char hmac_key[16];
+} __attribute__((packed));
+
+/* The keys loaded from one "tls-ticket-keys" file, shared by all the "bind"
+ * lines referencing it. The keys are stored in a ring whose newest entry
+ * is at <enc_index>. <seq> is odd while the ring is being updated, readers
+ * which may run in handshake workers retry when it changed under them.
+ */
+struct tls_keys_ref {
+	struct list list;         /* chaining of all references */
+	char *filename;           /* the file the keys were loaded from */
+	int unique_id;            /* identifier shown on the CLI */
+	volatile unsigned int seq; /* update counter, odd during an update */
+	int nb_keys;              /* number of valid keys in the ring */
+	int enc_index;            /* index of the key used to encrypt */
+	struct tls_sess_key keys[TLS_TICKETS_NO];
+};
+
+/* states of a handshake job passed to the worker threads */
+enum {
+	SSL_ASYNC_QUEUED = 0,     /* waiting in the work queue */
+	SSL_ASYNC_RUNNING,        /* being processed by a worker */
+	SSL_ASYNC_READY,          /* processed, waiting in the done queue */
+	SSL_ASYNC_DONE,           /* result collected by the main thread */
+};
+
+/* One handshake step performed by a worker thread on behalf of a connection.
+ * Only the main thread allocates and releases it, and the worker owns the SSL
+ * context while the job is in the RUNNING state.
+ */
+struct ssl_async_job {
+	struct list list;         /* work queue or done queue */
+	struct connection *conn;  /* connection the handshake belongs to */
+	SSL *ssl;                 /* its SSL context */
+	int state;                /* SSL_ASYNC_* */
+	int ret;                  /* return value of SSL_do_handshake() */
+	int err;                  /* result of SSL_get_error() */
+	int errnum;               /* errno as seen by the worker */
+};
+
+/* Dynamic record sizing state of a connection, attached to its SSL context
+ * on the first write when "tune.ssl.dyn-record-threshold" is set.
+ */
+struct ssl_dyn_record {
+	unsigned int sent;        /* bytes sent since the beginning of the burst */
+	unsigned int last;        /* date of the last successful write (ms) */
+};
+
 #endif /* _TYPES_SSL_SOCK_H */
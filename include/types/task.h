@@ -50,6 +50,25 @@
  */
 #define TASK_REASON_SHIFT 8
 
+/* Task classes, used to account the time spent in tasks and to share it
+ * between them when fair scheduling is enabled.
+ */
+enum {
+	TASK_CL_SESSION = 0,    /* sessions */
+	TASK_CL_APPLET,         /* sessions running an applet (stats, CLI) */
+	TASK_CL_CHECK,          /* health checks and related tasks */
+	TASK_CL_PEERS,          /* peers synchronization and sessions */
+	TASK_CL_OTHER,          /* all other tasks (proxies, tables, ...) */
+	TASK_CLASSES            /* must be last */
+};
+
+/* Scheduling statistics of a task class */
+struct task_class_stats {
+	unsigned long long calls;       /* number of ->process() calls */
+	unsigned long long cpu_ns;      /* time spent in ->process() (ns) */
+	unsigned long long deferred;    /* tasks postponed by the fair scheduler */
+};
+
 /* The base for all tasks */
 struct task {
 	struct eb32_node rq;		/* ebtree node used to hold the task in the run queue */
@@ -59,7 +78,9 @@ struct task {
 	struct task * (*process)(struct task *t);  /* the function which processes the task */
 	void *context;			/* the task's context */
 	struct eb32_node wq;		/* ebtree node used to hold the task in the wait queue */
+	struct list wl;			/* list node in the timer wheel, wl.n is NULL when not there */
 	int expire;			/* next expiration date for this task, in ticks */
+	unsigned char class;		/* the task's class, TASK_CL_* */
 };
 
 /*
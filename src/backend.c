@@ -38,7 +38,9 @@
 #include <proto/lb_fas.h>
 #include <proto/lb_fwlc.h>
 #include <proto/lb_fwrr.h>
+#include <proto/lb_maglev.h>
 #include <proto/lb_map.h>
+#include <proto/lb_p2c.h>
 #include <proto/obj_type.h>
 #include <proto/payload.h>
 #include <proto/protocol.h>
@@ -134,6 +136,21 @@ void update_backend_weight(struct proxy *px)
 	}
 }
 
+/* Returns the server designated by <hash> in backend <px>, using the lookup
+ * method corresponding to the backend's hash type.
+ */
+static inline struct server *get_server_hash(struct proxy *px, unsigned int hash)
+{
+	switch (px->lbprm.algo & BE_LB_LKUP) {
+	case BE_LB_LKUP_CHTREE:
+		return chash_get_server_hash(px, hash);
+	case BE_LB_LKUP_MGLEV:
+		return maglev_get_server_hash(px, hash);
+	default:
+		return map_get_server_hash(px, hash);
+	}
+}
+
 /*
  * This function tries to find a running server for the proxy <px> following
  * the source hash method. Depending on the number of active/backup servers,
@@ -161,10 +178,7 @@ struct server *get_server_sh(struct proxy *px, const char *addr, int len)
 	if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 		h = full_hash(h);
  hash_done:
-	if (px->lbprm.algo & BE_LB_LKUP_CHTREE)
-		return chash_get_server_hash(px, h);
-	else
-		return map_get_server_hash(px, h);
+	return get_server_hash(px, h);
 }
 
 /*
@@ -213,10 +227,7 @@ struct server *get_server_uh(struct proxy *px, char *uri, int uri_len)
 	if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 		hash = full_hash(hash);
  hash_done:
-	if (px->lbprm.algo & BE_LB_LKUP_CHTREE)
-		return chash_get_server_hash(px, hash);
-	else
-		return map_get_server_hash(px, hash);
+	return get_server_hash(px, hash);
 }
 
 /* 
@@ -270,10 +281,7 @@ struct server *get_server_ph(struct proxy *px, const char *uri, int uri_len)
 				if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 					hash = full_hash(hash);
 
-				if (px->lbprm.algo & BE_LB_LKUP_CHTREE)
-					return chash_get_server_hash(px, hash);
-				else
-					return map_get_server_hash(px, hash);
+				return get_server_hash(px, hash);
 			}
 		}
 		/* skip to next parameter */
@@ -341,10 +349,7 @@ struct server *get_server_ph_post(struct session *s)
 				if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 					hash = full_hash(hash);
 
-				if (px->lbprm.algo & BE_LB_LKUP_CHTREE)
-					return chash_get_server_hash(px, hash);
-				else
-					return map_get_server_hash(px, hash);
+				return get_server_hash(px, hash);
 			}
 		}
 		/* skip to next parameter */
@@ -433,10 +438,7 @@ struct server *get_server_hh(struct session *s)
 	if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 		hash = full_hash(hash);
  hash_done:
-	if (px->lbprm.algo & BE_LB_LKUP_CHTREE)
-		return chash_get_server_hash(px, hash);
-	else
-		return map_get_server_hash(px, hash);
+	return get_server_hash(px, hash);
 }
 
 /* RDP Cookie HASH.  */
@@ -477,10 +479,7 @@ struct server *get_server_rch(struct session *s)
 	if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 		hash = full_hash(hash);
  hash_done:
-	if (px->lbprm.algo & BE_LB_LKUP_CHTREE)
-		return chash_get_server_hash(px, hash);
-	else
-		return map_get_server_hash(px, hash);
+	return get_server_hash(px, hash);
 }
  
 /*
@@ -579,8 +578,13 @@ int assign_server(struct session *s)
 			srv = fwlc_get_next_server(s->be, prev_srv);
 			break;
 
+		case BE_LB_LKUP_P2CARR:
+			srv = p2c_get_next_server(s->be, prev_srv);
+			break;
+
 		case BE_LB_LKUP_CHTREE:
 		case BE_LB_LKUP_MAP:
+		case BE_LB_LKUP_MGLEV:
 			if ((s->be->lbprm.algo & BE_LB_KIND) == BE_LB_KIND_RR) {
 				if (s->be->lbprm.algo & BE_LB_LKUP_CHTREE)
 					srv = chash_get_next_server(s->be, prev_srv);
@@ -658,8 +662,10 @@ int assign_server(struct session *s)
 			 * back to round robin on the map.
 			 */
 			if (!srv) {
-				if (s->be->lbprm.algo & BE_LB_LKUP_CHTREE)
+				if ((s->be->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 					srv = chash_get_next_server(s->be, prev_srv);
+				else if ((s->be->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MGLEV)
+					srv = maglev_get_next_server(s->be, prev_srv);
 				else
 					srv = map_get_server_rr(s->be, prev_srv);
 			}
@@ -1162,7 +1168,11 @@ int srv_redispatch_connect(struct session *s)
 		return 1;
 
 	case SRV_STATUS_QUEUED:
-		s->req->cons->exp = tick_add_ifset(now_ms, s->be->timeout.queue);
+		/* a class-specific queue timeout supersedes "timeout queue" */
+		if (s->pend_pos && s->be->queue_class_timeout[s->pend_pos->class])
+			s->req->cons->exp = tick_add(now_ms, s->be->queue_class_timeout[s->pend_pos->class]);
+		else
+			s->req->cons->exp = tick_add_ifset(now_ms, s->be->timeout.queue);
 		s->req->cons->state = SI_ST_QUE;
 		/* do nothing else and do not wake any other session up */
 		return 1;
@@ -1278,6 +1288,10 @@ const char *backend_lb_algo_str(int algo) {
 		return "first";
 	else if (algo == BE_LB_ALGO_LC)
 		return "leastconn";
+	else if (algo == BE_LB_ALGO_LL)
+		return "leastlatency";
+	else if (algo == BE_LB_ALGO_P2C)
+		return "random";
 	else if (algo == BE_LB_ALGO_SH)
 		return "source";
 	else if (algo == BE_LB_ALGO_UH)
@@ -1324,6 +1338,14 @@ int backend_parse_balance(const char **args, char **err, struct proxy *curproxy)
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
 		curproxy->lbprm.algo |= BE_LB_ALGO_LC;
 	}
+	else if (!strcmp(args[0], "leastlatency")) {
+		curproxy->lbprm.algo &= ~BE_LB_ALGO;
+		curproxy->lbprm.algo |= BE_LB_ALGO_LL;
+	}
+	else if (!strcmp(args[0], "random")) {
+		curproxy->lbprm.algo &= ~BE_LB_ALGO;
+		curproxy->lbprm.algo |= BE_LB_ALGO_P2C;
+	}
 	else if (!strcmp(args[0], "source")) {
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
 		curproxy->lbprm.algo |= BE_LB_ALGO_SH;
@@ -1441,7 +1463,7 @@ int backend_parse_balance(const char **args, char **err, struct proxy *curproxy)
 		}
 	}
 	else {
-		memprintf(err, "only supports 'roundrobin', 'static-rr', 'leastconn', 'source', 'uri', 'url_param', 'hdr(name)' and 'rdp-cookie(name)' options.");
+		memprintf(err, "only supports 'roundrobin', 'static-rr', 'leastconn', 'leastlatency', 'random', 'source', 'uri', 'url_param', 'hdr(name)' and 'rdp-cookie(name)' options.");
 		return -1;
 	}
 	return 0;
@@ -51,7 +51,9 @@
 #include <proto/lb_fas.h>
 #include <proto/lb_fwlc.h>
 #include <proto/lb_fwrr.h>
+#include <proto/lb_maglev.h>
 #include <proto/lb_map.h>
+#include <proto/lb_p2c.h>
 #include <proto/listener.h>
 #include <proto/log.h>
 #include <proto/protocol.h>
@@ -172,6 +174,7 @@ static const struct cfg_opt cfg_opts2[] =
 	{ "accept-invalid-http-response", PR_O2_RSPBUG_OK, PR_CAP_BE, 0, PR_MODE_HTTP },
 	{ "dontlog-normal",               PR_O2_NOLOGNORM, PR_CAP_FE, 0, 0 },
 	{ "log-separate-errors",          PR_O2_LOGERRORS, PR_CAP_FE, 0, 0 },
+	{ "log-binary",                   PR_O2_LOGBIN,    PR_CAP_FE, 0, 0 },
 	{ "log-health-checks",            PR_O2_LOGHCHKS,  PR_CAP_BE, 0, 0 },
 	{ "socket-stats",                 PR_O2_SOCKSTAT,  PR_CAP_FE, 0, 0 },
 	{ "tcp-smart-accept",             PR_O2_SMARTACC,  PR_CAP_FE, 0, 0 },
@@ -550,9 +553,18 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 	else if (!strcmp(args[0], "nopoll")) {
 		global.tune.options &= ~GTUNE_USE_POLL;
 	}
+	else if (!strcmp(args[0], "notimerwheel")) {
+		global.tune.options &= ~GTUNE_USE_TIMER_WHEEL;
+	}
 	else if (!strcmp(args[0], "nosplice")) {
 		global.tune.options &= ~GTUNE_USE_SPLICE;
 	}
+	else if (!strcmp(args[0], "share-checks")) {
+		global.tune.options |= GTUNE_SHARE_CHECKS;
+	}
+	else if (!strcmp(args[0], "share-check-results")) {
+		global.tune.options |= GTUNE_SHARE_CHK_RESULTS;
+	}
 	else if (!strcmp(args[0], "nogetaddrinfo")) {
 		global.tune.options &= ~GTUNE_USE_GAI;
 	}
@@ -585,6 +597,19 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		}
 		global.tune.maxaccept = atol(args[1]);
 	}
+	else if (!strcmp(args[0], "tune.log.ring")) {
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.log_ring = atol(args[1]);
+		if (global.tune.log_ring < 0) {
+			Alert("parsing [%s:%d] : '%s' expects a positive integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (!strcmp(args[0], "tune.chksize")) {
 		if (*(args[1]) == 0) {
 			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
@@ -630,6 +655,59 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		}
 		global.tune.ssl_max_record = atol(args[1]);
 	}
+	else if (!strcmp(args[0], "tune.ssl.dyn-record-threshold")) {
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.ssl_dyn_rec_threshold = atol(args[1]);
+	}
+	else if (!strcmp(args[0], "tune.ssl.cache-shards")) {
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.ssl_cache_shards = atol(args[1]);
+		if (global.tune.ssl_cache_shards < 1 || global.tune.ssl_cache_shards > SHCTX_MAX_SHARDS) {
+			Alert("parsing [%s:%d] : '%s' expects a value between 1 and %d.\n",
+			      file, linenum, args[0], SHCTX_MAX_SHARDS);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (!strcmp(args[0], "tune.ssl.handshake-workers")) {
+#ifdef USE_PRIVATE_CACHE
+		Alert("parsing [%s:%d] : '%s' is not supported with a private SSL session cache (USE_PRIVATE_CACHE).\n", file, linenum, args[0]);
+		err_code |= ERR_ALERT | ERR_FATAL;
+		goto out;
+#endif
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.ssl_hs_workers = atol(args[1]);
+		if (global.tune.ssl_hs_workers < 0) {
+			Alert("parsing [%s:%d] : '%s' expects a positive integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (!strcmp(args[0], "tune.ssl.lazy-certs")) {
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.ssl_lazy_certs = atol(args[1]);
+		if (global.tune.ssl_lazy_certs < 0) {
+			Alert("parsing [%s:%d] : '%s' expects a positive integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 #endif
 	else if (!strcmp(args[0], "tune.bufsize")) {
 		if (*(args[1]) == 0) {
@@ -678,6 +756,75 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		}
 		global.tune.idle_timer = idle;
 	}
+	else if (!strcmp(args[0], "tune.busy-poll")) {
+		unsigned int spin;
+		const char *res;
+
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects a time value between 0 and 1000000 us.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		res = parse_time_err(args[1], &spin, TIME_UNIT_US);
+		if (res) {
+			Alert("parsing [%s:%d]: unexpected character '%c' in argument to <%s>.\n",
+			      file, linenum, *res, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		if (spin > 1000000) {
+			Alert("parsing [%s:%d] : '%s' expects a time value between 0 and 1000000 us.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.busy_poll = spin;
+	}
+	else if (!strcmp(args[0], "tune.sched.budget")) {
+		unsigned int budget;
+		const char *res;
+
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects a time value (in microseconds by default).\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		res = parse_time_err(args[1], &budget, TIME_UNIT_US);
+		if (res) {
+			Alert("parsing [%s:%d]: unexpected character '%c' in argument to <%s>.\n",
+			      file, linenum, *res, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.sched_budget = budget;
+	}
+	else if (!strcmp(args[0], "tune.sched.weight")) {
+		int cl, weight;
+
+		if (*(args[1]) == 0 || *(args[2]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects a task class and a weight.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		cl = task_class_lookup(args[1]);
+		if (cl < 0) {
+			Alert("parsing [%s:%d] : '%s' : unknown task class '%s', expects one of 'session', 'applet', 'check', 'peers' or 'other'.\n",
+			      file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		weight = atol(args[2]);
+		if (weight < 1 || weight > 1000) {
+			Alert("parsing [%s:%d] : '%s' expects a weight between 1 and 1000.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.sched_weight[cl] = weight;
+	}
 	else if (!strcmp(args[0], "tune.rcvbuf.client")) {
 		if (global.tune.client_rcvbuf != 0) {
 			Alert("parsing [%s:%d] : '%s' already specified. Continuing.\n", file, linenum, args[0]);
@@ -977,6 +1124,19 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		}
 		global.cps_lim = atol(args[1]);
 	}
+	else if (!strcmp(args[0], "maxcheckrate")) {
+		if (global.chk_lim != 0) {
+			Alert("parsing [%s:%d] : '%s' already specified. Continuing.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT;
+			goto out;
+		}
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.chk_lim = atol(args[1]);
+	}
 	else if (!strcmp(args[0], "maxsessrate")) {
 		if (global.sps_lim != 0) {
 			Alert("parsing [%s:%d] : '%s' already specified. Continuing.\n", file, linenum, args[0]);
@@ -1232,6 +1392,7 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		struct sockaddr_storage *sk;
 		int port1, port2;
 		struct logsrv *logsrv;
+		char *addr;
 
 		if (*(args[1]) == 0 || *(args[2]) == 0) {
 			Alert("parsing [%s:%d] : '%s' expects <address> and <facility> as arguments.\n", file, linenum, args[0]);
@@ -1241,6 +1402,36 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 
 		logsrv = calloc(1, sizeof(struct logsrv));
 
+		logsrv->maxlen = MAX_SYSLOG_LEN;
+		if (strcmp(args[2], "len") == 0) {
+			logsrv->maxlen = atoi(args[3]);
+			if (logsrv->maxlen < 80 || logsrv->maxlen > 65535) {
+				Alert("parsing [%s:%d] : '%s' : invalid length '%s', must be between 80 and 65535.\n",
+				      file, linenum, args[0], args[3]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				free(logsrv);
+				goto out;
+			}
+			/* skip "len <length>", the other arguments keep their position */
+			memmove(args + 2, args + 4, (MAX_LINE_ARGS - 3) * sizeof(*args));
+			if (*(args[2]) == 0) {
+				Alert("parsing [%s:%d] : '%s' expects <address> and <facility> as arguments.\n", file, linenum, args[0]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				free(logsrv);
+				goto out;
+			}
+		}
+
+		if (logsrv->maxlen > global.max_syslog_len) {
+			global.max_syslog_len = logsrv->maxlen;
+			if (!alloc_log_line(global.max_syslog_len)) {
+				Alert("parsing [%s:%d] : '%s' : out of memory.\n", file, linenum, args[0]);
+				err_code |= ERR_ALERT | ERR_ABORT;
+				free(logsrv);
+				goto out;
+			}
+		}
+
 		logsrv->facility = get_log_facility(args[2]);
 		if (logsrv->facility < 0) {
 			Alert("parsing [%s:%d] : unknown log facility '%s'\n", file, linenum, args[2]);
@@ -1268,7 +1459,11 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			}
 		}
 
-		sk = str2sa_range(args[1], &port1, &port2, &errmsg, NULL);
+		addr = args[1];
+		if (strncmp(addr, "stream@", 7) == 0)
+			addr += 7;
+
+		sk = str2sa_range(addr, &port1, &port2, &errmsg, NULL);
 		if (!sk) {
 			Alert("parsing [%s:%d] : '%s': %s\n", file, linenum, args[0], errmsg);
 			err_code |= ERR_ALERT | ERR_FATAL;
@@ -1291,6 +1486,24 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 				set_host_port(&logsrv->addr, SYSLOG_PORT);
 		}
 
+		if (addr != args[1]) {
+			if (sk->ss_family == AF_UNSPEC) {
+				Alert("parsing [%s:%d] : '%s' : file descriptors are not supported for stream loggers in '%s'\n",
+				      file, linenum, args[0], args[1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				free(logsrv);
+				goto out;
+			}
+
+			logsrv->stream = log_stream_get(&logsrv->addr, logsrv->maxlen);
+			if (!logsrv->stream) {
+				Alert("parsing [%s:%d] : '%s' : out of memory.\n", file, linenum, args[0]);
+				err_code |= ERR_ALERT | ERR_ABORT;
+				free(logsrv);
+				goto out;
+			}
+		}
+
 		LIST_ADDQ(&global.logsrvs, &logsrv->list);
 	}
 	else if (!strcmp(args[0], "log-send-hostname")) { /* set the hostname in syslog header */
@@ -1778,6 +1991,36 @@ out:
 	return err_code;
 }
 
+/* Parses a positive decimal number with up to two decimals such as "1.9" in
+ * <str>, and stores it in hundredths in <val>. Returns 0 if OK, or -1 if the
+ * number is invalid.
+ */
+static int parse_hundredths(const char *str, int *val)
+{
+	unsigned int v = 0;
+	int digits = -1;
+
+	if (!*str)
+		return -1;
+
+	for (; *str; str++) {
+		if (*str == '.' && digits < 0) {
+			digits = 0;
+			continue;
+		}
+		if (*str < '0' || *str > '9' || digits == 2 || v > 10000000)
+			return -1;
+		v = v * 10 + *str - '0';
+		if (digits >= 0)
+			digits++;
+	}
+
+	for (digits = MAX(digits, 0); digits < 2; digits++)
+		v *= 10;
+	*val = v;
+	return 0;
+}
+
 int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 {
 	static struct proxy *curproxy = NULL;
@@ -1895,6 +2138,8 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 		curproxy->no_options2 = defproxy.no_options2;
 		curproxy->bind_proc = defproxy.bind_proc;
 		curproxy->lbprm.algo = defproxy.lbprm.algo;
+		curproxy->lbprm.hash_balance_factor = defproxy.lbprm.hash_balance_factor;
+		curproxy->outlier = defproxy.outlier;
 		curproxy->except_net = defproxy.except_net;
 		curproxy->except_mask = defproxy.except_mask;
 		curproxy->except_to = defproxy.except_to;
@@ -2021,6 +2266,8 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 			curproxy->timeout.server = defproxy.timeout.server;
 			curproxy->timeout.check = defproxy.timeout.check;
 			curproxy->timeout.queue = defproxy.timeout.queue;
+			memcpy(curproxy->queue_class_timeout, defproxy.queue_class_timeout,
+			       sizeof(curproxy->queue_class_timeout));
 			curproxy->timeout.tarpit = defproxy.timeout.tarpit;
 			curproxy->timeout.httpreq = defproxy.timeout.httpreq;
 			curproxy->timeout.httpka = defproxy.timeout.httpka;
@@ -4538,12 +4785,168 @@ stats_error_parsing:
 			goto out;
 		}
 	}
+	else if (!strcmp(args[0], "hash-balance-factor")) {
+		char *err;
+		long factor;
+
+		if (warnifnotcap(curproxy, PR_CAP_BE, file, linenum, args[0], NULL))
+			err_code |= ERR_WARN;
+
+		if (!*args[1]) {
+			Alert("parsing [%s:%d] : '%s' expects a percentage as an argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		factor = strtol(args[1], &err, 10);
+		if (*err || factor < 0 || (factor > 0 && factor <= 100) || factor > 100000) {
+			Alert("parsing [%s:%d] : '%s' expects either 0 or a percentage between 101 and 100000, found '%s'.\n",
+			      file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		curproxy->lbprm.hash_balance_factor = factor;
+	}
+	else if (!strcmp(args[0], "queue-class-timeout")) {
+		const char *res;
+		char *err;
+		unsigned int timeout;
+		long class;
+
+		if (warnifnotcap(curproxy, PR_CAP_BE, file, linenum, args[0], NULL))
+			err_code |= ERR_WARN;
+
+		if (!*args[1] || !*args[2]) {
+			Alert("parsing [%s:%d] : '%s' expects a class and a timeout as arguments.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		class = strtol(args[1], &err, 10);
+		if (*err || class < 0 || class >= QUEUE_CLASSES) {
+			Alert("parsing [%s:%d] : '%s' expects a class between 0 and %d, found '%s'.\n",
+			      file, linenum, args[0], QUEUE_CLASSES - 1, args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		res = parse_time_err(args[2], &timeout, TIME_UNIT_MS);
+		if (res) {
+			Alert("parsing [%s:%d] : unexpected character '%c' in '%s'.\n",
+			      file, linenum, *res, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		curproxy->queue_class_timeout[class] = MS_TO_TICKS(timeout);
+	}
+	else if (!strcmp(args[0], "outlier-detection")) {
+		/* outlier-detection [interval <time>] [ejection-time <time>] ... */
+		struct px_outlier *po = &curproxy->outlier;
+		const char *res;
+		unsigned int val;
+		int cur_arg;
+
+		if (warnifnotcap(curproxy, PR_CAP_BE, file, linenum, args[0], NULL))
+			err_code |= ERR_WARN;
+
+		/* the keyword alone enables the detection with default settings */
+		memset(po, 0, sizeof(*po));
+		po->interval     = 1000;
+		po->base_time    = 10000;
+		po->max_time     = 300000;
+		po->max_pct      = 10;
+		po->min_requests = 20;
+		po->error_pct    = 50;
+		po->sr_factor    = 190;
+		po->lat_pctl     = 99;
+		po->lat_factor   = 300;
+
+		for (cur_arg = 1; *args[cur_arg]; cur_arg += 2) {
+			if (!*args[cur_arg + 1]) {
+				Alert("parsing [%s:%d] : '%s %s' expects an argument.\n",
+				      file, linenum, args[0], args[cur_arg]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+
+			if (!strcmp(args[cur_arg], "interval") ||
+			    !strcmp(args[cur_arg], "ejection-time") ||
+			    !strcmp(args[cur_arg], "max-ejection-time")) {
+				res = parse_time_err(args[cur_arg + 1], &val, TIME_UNIT_MS);
+				if (res) {
+					Alert("parsing [%s:%d] : unexpected character '%c' in '%s %s'.\n",
+					      file, linenum, *res, args[0], args[cur_arg]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				if (!strcmp(args[cur_arg], "interval"))
+					po->interval = val;
+				else if (!val) {
+					Alert("parsing [%s:%d] : '%s %s' expects a strictly positive time.\n",
+					      file, linenum, args[0], args[cur_arg]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				else if (!strcmp(args[cur_arg], "ejection-time"))
+					po->base_time = val;
+				else
+					po->max_time = val;
+			}
+			else if (!strcmp(args[cur_arg], "max-ejected") ||
+			         !strcmp(args[cur_arg], "error-limit") ||
+			         !strcmp(args[cur_arg], "latency-percentile")) {
+				val = atol(args[cur_arg + 1]);
+				if (val > 100) {
+					Alert("parsing [%s:%d] : '%s %s' expects a percentage between 0 and 100.\n",
+					      file, linenum, args[0], args[cur_arg]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				if (!strcmp(args[cur_arg], "max-ejected"))
+					po->max_pct = val;
+				else if (!strcmp(args[cur_arg], "error-limit"))
+					po->error_pct = val;
+				else
+					po->lat_pctl = val ? val : 1;
+			}
+			else if (!strcmp(args[cur_arg], "min-requests")) {
+				po->min_requests = atol(args[cur_arg + 1]);
+			}
+			else if (!strcmp(args[cur_arg], "success-deviation") ||
+			         !strcmp(args[cur_arg], "latency-factor")) {
+				int factor;
+
+				if (parse_hundredths(args[cur_arg + 1], &factor) < 0 ||
+				    (factor && factor < 100 && !strcmp(args[cur_arg], "latency-factor"))) {
+					Alert("parsing [%s:%d] : '%s %s' expects a positive number such as '1.9', found '%s'.\n",
+					      file, linenum, args[0], args[cur_arg], args[cur_arg + 1]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				if (!strcmp(args[cur_arg], "success-deviation"))
+					po->sr_factor = factor;
+				else
+					po->lat_factor = factor;
+			}
+			else {
+				Alert("parsing [%s:%d] : '%s' only supports 'interval', 'ejection-time', 'max-ejection-time', "
+				      "'max-ejected', 'min-requests', 'error-limit', 'success-deviation', 'latency-percentile' "
+				      "and 'latency-factor' (got '%s').\n",
+				      file, linenum, args[0], args[cur_arg]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+		}
+
+		if (po->max_time < po->base_time)
+			po->max_time = po->base_time;
+	}
 	else if (!strcmp(args[0], "hash-type")) { /* set hashing method */
 		/**
 		 * The syntax for hash-type config element is
-		 * hash-type {map-based|consistent} [[<algo>] avalanche]
+		 * hash-type {map-based|consistent|maglev} [[<algo>] avalanche]
 		 *
-		 * The default hash function is sdbm for map-based and sdbm+avalanche for consistent.
+		 * The default hash function is sdbm for map-based and sdbm+avalanche for consistent and maglev.
 		 */
 		curproxy->lbprm.algo &= ~(BE_LB_HASH_TYPE | BE_LB_HASH_FUNC | BE_LB_HASH_MOD);
 
@@ -4556,13 +4959,16 @@ stats_error_parsing:
 		else if (strcmp(args[1], "map-based") == 0) {	/* use map-based hashing */
 			curproxy->lbprm.algo |= BE_LB_HASH_MAP;
 		}
+		else if (strcmp(args[1], "maglev") == 0) {	/* use a maglev lookup table */
+			curproxy->lbprm.algo |= BE_LB_HASH_MAGLEV;
+		}
 		else if (strcmp(args[1], "avalanche") == 0) {
 			Alert("parsing [%s:%d] : experimental feature '%s %s' is not supported anymore, please use '%s map-based sdbm avalanche' instead.\n", file, linenum, args[0], args[1], args[0]);
 			err_code |= ERR_ALERT | ERR_FATAL;
 			goto out;
 		}
 		else {
-			Alert("parsing [%s:%d] : '%s' only supports 'consistent' and 'map-based'.\n", file, linenum, args[0]);
+			Alert("parsing [%s:%d] : '%s' only supports 'consistent', 'maglev' and 'map-based'.\n", file, linenum, args[0]);
 			err_code |= ERR_ALERT | ERR_FATAL;
 			goto out;
 		}
@@ -4572,8 +4978,8 @@ stats_error_parsing:
 			/* the default algo is sdbm */
 			curproxy->lbprm.algo |= BE_LB_HFCN_SDBM;
 
-			/* if consistent with no argument, then avalanche modifier is also applied */
-			if ((curproxy->lbprm.algo & BE_LB_HASH_TYPE) == BE_LB_HASH_CONS)
+			/* if consistent or maglev with no argument, then avalanche modifier is also applied */
+			if ((curproxy->lbprm.algo & BE_LB_HASH_TYPE) != BE_LB_HASH_MAP)
 				curproxy->lbprm.algo |= BE_LB_HMOD_AVAL;
 		} else {
 			/* set the hash function */
@@ -4693,9 +5099,38 @@ stats_error_parsing:
 		else if (*(args[1]) && *(args[2])) {
 			struct sockaddr_storage *sk;
 			int port1, port2;
+			char *addr;
 
 			logsrv = calloc(1, sizeof(struct logsrv));
 
+			logsrv->maxlen = MAX_SYSLOG_LEN;
+			if (strcmp(args[2], "len") == 0) {
+				logsrv->maxlen = atoi(args[3]);
+				if (logsrv->maxlen < 80 || logsrv->maxlen > 65535) {
+					Alert("parsing [%s:%d] : '%s' : invalid length '%s', must be between 80 and 65535.\n",
+					      file, linenum, args[0], args[3]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				/* skip "len <length>", the other arguments keep their position */
+				memmove(args + 2, args + 4, (MAX_LINE_ARGS - 3) * sizeof(*args));
+				if (*(args[2]) == 0) {
+					Alert("parsing [%s:%d] : 'log' expects either <address[:port]> and <facility> or 'global' as arguments.\n",
+					      file, linenum);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+			}
+
+			if (logsrv->maxlen > global.max_syslog_len) {
+				global.max_syslog_len = logsrv->maxlen;
+				if (!alloc_log_line(global.max_syslog_len)) {
+					Alert("parsing [%s:%d] : '%s' : out of memory.\n", file, linenum, args[0]);
+					err_code |= ERR_ALERT | ERR_ABORT;
+					goto out;
+				}
+			}
+
 			logsrv->facility = get_log_facility(args[2]);
 			if (logsrv->facility < 0) {
 				Alert("parsing [%s:%d] : unknown log facility '%s'\n", file, linenum, args[2]);
@@ -4726,7 +5161,11 @@ stats_error_parsing:
 				}
 			}
 
-			sk = str2sa_range(args[1], &port1, &port2, &errmsg, NULL);
+			addr = args[1];
+			if (strncmp(addr, "stream@", 7) == 0)
+				addr += 7;
+
+			sk = str2sa_range(addr, &port1, &port2, &errmsg, NULL);
 			if (!sk) {
 				Alert("parsing [%s:%d] : '%s': %s\n", file, linenum, args[0], errmsg);
 				err_code |= ERR_ALERT | ERR_FATAL;
@@ -4747,6 +5186,22 @@ stats_error_parsing:
 					set_host_port(&logsrv->addr, SYSLOG_PORT);
 			}
 
+			if (addr != args[1]) {
+				if (sk->ss_family == AF_UNSPEC) {
+					Alert("parsing [%s:%d] : '%s' : file descriptors are not supported for stream loggers in '%s'\n",
+					      file, linenum, args[0], args[1]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+
+				logsrv->stream = log_stream_get(&logsrv->addr, logsrv->maxlen);
+				if (!logsrv->stream) {
+					Alert("parsing [%s:%d] : '%s' : out of memory.\n", file, linenum, args[0]);
+					err_code |= ERR_ALERT | ERR_ABORT;
+					goto out;
+				}
+			}
+
 			LIST_ADDQ(&curproxy->logsrvs, &logsrv->list);
 		}
 		else {
@@ -6006,7 +6461,8 @@ int check_config_validity()
 			node = LIST_NEXT(&rule->be.expr, struct logformat_node *, list);
 
 			if (!LIST_ISEMPTY(&rule->be.expr)) {
-				if (node->type != LOG_FMT_TEXT || node->list.n != &rule->be.expr) {
+				if (node->type != LOG_FMT_TEXT || node->list.n != &rule->be.expr ||
+				    (node->options & LOG_OPT_SEPARATOR)) {
 					rule->dynamic = 1;
 					free(pxname);
 					continue;
@@ -6483,6 +6939,17 @@ out_uri_auth_compat:
 				newsrv->minconn = newsrv->maxconn;
 			}
 
+			if (newsrv->state & SRV_ADAPTIVE) {
+				if (!newsrv->maxconn) {
+					Warning("config : %s '%s' : ignoring 'adaptive-maxconn' for server '%s' which has no 'maxconn'.\n",
+					        proxy_type_str(curproxy), curproxy->id, newsrv->id);
+					newsrv->state &= ~SRV_ADAPTIVE;
+					err_code |= ERR_WARN;
+				}
+				else
+					newsrv->adapt_limit = newsrv->maxconn * SRV_ADAPT_SCALE;
+			}
+
 #ifdef USE_OPENSSL
 			if (newsrv->use_ssl || newsrv->check.use_ssl)
 				cfgerr += ssl_sock_prepare_srv_ctx(newsrv, curproxy);
@@ -6581,9 +7048,13 @@ out_uri_auth_compat:
 			break;
 
 		case BE_LB_KIND_CB:
-			if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_LC) {
+			if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_LC ||
+			    (curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_LL) {
 				curproxy->lbprm.algo |= BE_LB_LKUP_LCTREE | BE_LB_PROP_DYN;
 				fwlc_init_server_tree(curproxy);
+			} else if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_P2C) {
+				curproxy->lbprm.algo |= BE_LB_LKUP_P2CARR | BE_LB_PROP_DYN;
+				p2c_init_server_array(curproxy);
 			} else {
 				curproxy->lbprm.algo |= BE_LB_LKUP_FSTREE | BE_LB_PROP_DYN;
 				fas_init_server_tree(curproxy);
@@ -6594,6 +7065,9 @@ out_uri_auth_compat:
 			if ((curproxy->lbprm.algo & BE_LB_HASH_TYPE) == BE_LB_HASH_CONS) {
 				curproxy->lbprm.algo |= BE_LB_LKUP_CHTREE | BE_LB_PROP_DYN;
 				chash_init_server_tree(curproxy);
+			} else if ((curproxy->lbprm.algo & BE_LB_HASH_TYPE) == BE_LB_HASH_MAGLEV) {
+				curproxy->lbprm.algo |= BE_LB_LKUP_MGLEV | BE_LB_PROP_DYN;
+				maglev_init_server_table(curproxy);
 			} else {
 				curproxy->lbprm.algo |= BE_LB_LKUP_MAP;
 				init_server_map(curproxy);
@@ -6758,7 +7232,12 @@ out_uri_auth_compat:
 				continue;
 			}
 
-			if (shared_context_init(global.tune.sslcachesize, (global.nbproc > 1) ? 1 : 0) < 0) {
+			/* the cache must be locked as soon as several processes or
+			 * handshake workers may access it.
+			 */
+			if (shared_context_init(global.tune.sslcachesize,
+						(global.nbproc > 1 || global.tune.ssl_hs_workers) ? 1 : 0,
+						global.tune.ssl_cache_shards) < 0) {
 				Alert("Unable to allocate SSL session cache.\n");
 				cfgerr++;
 				continue;
@@ -7042,6 +7521,13 @@ out_uri_auth_compat:
 				    global.tune.max_http_hdr * sizeof(struct hdr_idx_elem),
 				    MEM_F_SHARED);
 
+#ifdef USE_OPENSSL
+	/* lazily loaded certificates are read after the chroot */
+	if (lazy_certs.indexed && global.chroot)
+		Warning("certificates loaded on first use with 'tune.ssl.lazy-certs' must be reachable from the chroot '%s'.\n",
+			global.chroot);
+#endif
+
 	if (cfgerr > 0)
 		err_code |= ERR_ALERT | ERR_FATAL;
  out:
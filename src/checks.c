@@ -20,6 +20,7 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -29,10 +30,13 @@
 #include <common/chunk.h>
 #include <common/compat.h>
 #include <common/config.h>
+#include <common/hash.h>
 #include <common/mini-clist.h>
 #include <common/standard.h>
 #include <common/time.h>
 
+#include <eb32tree.h>
+
 #include <types/global.h>
 
 #ifdef USE_OPENSSL
@@ -44,6 +48,7 @@
 #include <proto/checks.h>
 #include <proto/dumpstats.h>
 #include <proto/fd.h>
+#include <proto/freq_ctr.h>
 #include <proto/log.h>
 #include <proto/queue.h>
 #include <proto/port_range.h>
@@ -61,6 +66,10 @@ static int httpchk_expect(struct server *s, int done);
 static int tcpcheck_get_step_id(struct server *);
 static void tcpcheck_main(struct connection *);
 
+struct pool_head *pool2_check_buf;	/* check buffers, only held while a check runs */
+unsigned int nb_shared_checks;		/* number of checks following another one's probes */
+unsigned int nb_remote_checks;		/* number of servers checked by another process */
+
 static const struct check_status check_statuses[HCHK_STATUS_SIZE] = {
 	[HCHK_STATUS_UNKNOWN]	= { CHK_RES_UNKNOWN,  "UNK",     "Unknown" },
 	[HCHK_STATUS_INI]	= { CHK_RES_UNKNOWN,  "INI",     "Initializing" },
@@ -327,25 +336,28 @@ static void set_backend_down(struct proxy *be)
 /* Redistribute pending connections when a server goes down. The number of
  * connections redistributed is returned.
  */
-static int redistribute_pending(struct server *s)
+int redistribute_pending(struct server *s)
 {
 	struct pendconn *pc, *pc_bck, *pc_end;
 	int xferred = 0;
+	int class;
+
+	for (class = 0; class < QUEUE_CLASSES; class++) {
+		FOREACH_ITEM_SAFE(pc, pc_bck, &s->pendconns[class], pc_end, struct pendconn *, list) {
+			struct session *sess = pc->sess;
+			if ((sess->be->options & (PR_O_REDISP|PR_O_PERSIST)) == PR_O_REDISP &&
+			    !(sess->flags & SN_FORCE_PRST)) {
+				/* The REDISP option was specified. We will ignore
+				 * cookie and force to balance or use the dispatcher.
+				 */
 
-	FOREACH_ITEM_SAFE(pc, pc_bck, &s->pendconns, pc_end, struct pendconn *, list) {
-		struct session *sess = pc->sess;
-		if ((sess->be->options & (PR_O_REDISP|PR_O_PERSIST)) == PR_O_REDISP &&
-		    !(sess->flags & SN_FORCE_PRST)) {
-			/* The REDISP option was specified. We will ignore
-			 * cookie and force to balance or use the dispatcher.
-			 */
-
-			/* it's left to the dispatcher to choose a server */
-			sess->flags &= ~(SN_DIRECT | SN_ASSIGNED | SN_ADDR_SET);
+				/* it's left to the dispatcher to choose a server */
+				sess->flags &= ~(SN_DIRECT | SN_ASSIGNED | SN_ADDR_SET);
 
-			pendconn_free(pc);
-			task_wakeup(sess->task, TASK_WOKEN_RES);
-			xferred++;
+				pendconn_free(pc);
+				task_wakeup(sess->task, TASK_WOKEN_RES);
+				xferred++;
+			}
 		}
 	}
 	return xferred;
@@ -356,7 +368,7 @@ static int redistribute_pending(struct server *s)
  * connections it may not be able to handle. The total number of transferred
  * connections is returned.
  */
-static int check_for_pending(struct server *s)
+int check_for_pending(struct server *s)
 {
 	int xferred;
 
@@ -647,6 +659,152 @@ static void check_failed(struct check *check)
 		set_server_down(check);
 }
 
+/* Returns the relative number of the process which runs the checks of the
+ * servers of proxy <px> in "share-check-results" mode, which is the first
+ * process the proxy is bound to.
+ */
+static inline int check_owner_proc(const struct proxy *px)
+{
+	int proc;
+
+	if (!px->bind_proc)
+		return 1;
+	for (proc = 0; !(px->bind_proc & (1U << proc)); proc++)
+		;
+	return proc + 1;
+}
+
+static void check_shm_store(struct check_shm_result *res, const struct check *check)
+{
+	res->duration = check->duration;
+	res->status = check->status;
+	res->code = check->code;
+	res->health = check->health;
+	memcpy(res->desc, check->desc, sizeof(res->desc));
+}
+
+static void check_shm_load(struct check *check, const struct check_shm_result *res)
+{
+	check->duration = res->duration;
+	check->status = res->status;
+	check->code = res->code;
+	memcpy(check->desc, res->desc, sizeof(check->desc));
+}
+
+/* Publishes the state of server <s> and the results of its checks in the
+ * shared memory area for the other processes. Does nothing if the results are
+ * not shared or if another process runs the checks.
+ */
+static void check_publish(struct server *s)
+{
+	struct check_shm *shm = s->chk_shm;
+
+	if (!shm || (s->check.state & CHK_ST_REMOTE))
+		return;
+
+	shm->seq++;
+	__sync_synchronize();
+	shm->state = s->state & (SRV_RUNNING | SRV_GOINGDOWN);
+	shm->uweight = s->uweight;
+	check_shm_store(&shm->check, &s->check);
+	check_shm_store(&shm->agent, &s->agent);
+	__sync_synchronize();
+	shm->seq++;
+}
+
+/* Copies the record <shm> to <rec> and its sequence number to <seq>. The
+ * record may be updated by another process at the same time, in which case
+ * the copy is attempted again a few times. Returns 0 if no consistent copy
+ * could be made, otherwise 1.
+ */
+static int check_shm_read(const struct check_shm *shm, struct check_shm *rec, unsigned int *seq)
+{
+	int tries;
+
+	for (tries = 0; tries < 3; tries++) {
+		*seq = shm->seq;
+		__sync_synchronize();
+		if (*seq & 1)
+			continue;
+		memcpy(rec, (const void *)shm, sizeof(*rec));
+		__sync_synchronize();
+		if (shm->seq == *seq)
+			return 1;
+	}
+	return 0;
+}
+
+/* Applies to server <s> the state published by the process running its checks
+ * as if its own checks had drawn the same conclusions. Servers in maintenance
+ * in this process only get their check results updated.
+ */
+static void check_sync_apply(struct server *s, const struct check_shm *rec)
+{
+	check_shm_load(&s->check, &rec->check);
+	check_shm_load(&s->agent, &rec->agent);
+
+	if (rec->uweight != s->chk_shm_uweight) {
+		s->chk_shm_uweight = s->uweight = rec->uweight;
+		server_recalc_eweight(s);
+	}
+
+	if (!(s->state & SRV_MAINTAIN)) {
+		if ((rec->state ^ s->state) & SRV_RUNNING) {
+			/* set_server_up/down() expect the health at the threshold */
+			s->check.health = s->check.rise;
+			s->agent.health = s->agent.rise;
+			if (rec->state & SRV_RUNNING)
+				set_server_up(&s->check);
+			else
+				set_server_down(&s->check);
+		}
+
+		if ((s->state & SRV_RUNNING) && ((rec->state ^ s->state) & SRV_GOINGDOWN)) {
+			if (rec->state & SRV_GOINGDOWN)
+				set_server_disabled(&s->check);
+			else
+				set_server_enabled(&s->check);
+		}
+	}
+
+	s->check.health = rec->check.health;
+	s->agent.health = rec->agent.health;
+}
+
+/* This task applies the check results published by the other processes to
+ * the servers they check.
+ */
+static struct task *process_chk_sync(struct task *t)
+{
+	struct proxy *px;
+	struct server *s;
+	struct check_shm rec;
+	unsigned int seq;
+
+	for (px = proxy; px; px = px->next) {
+		if (px->state == PR_STSTOPPED)
+			continue;
+
+		for (s = px->srv; s; s = s->next) {
+			if (!s->chk_shm || !(s->check.state & CHK_ST_REMOTE))
+				continue;
+
+			if (s->chk_shm->seq == s->chk_shm_seq)
+				continue;
+
+			/* the record is being updated, let's come back later */
+			if (!check_shm_read(s->chk_shm, &rec, &seq))
+				continue;
+
+			s->chk_shm_seq = seq;
+			check_sync_apply(s, &rec);
+		}
+	}
+
+	t->expire = tick_add(now_ms, MS_TO_TICKS(CHK_SYNC_INTERVAL));
+	return t;
+}
+
 /* note: use health_adjust() only, which first checks that the observe mode is
  * enabled.
  */
@@ -722,13 +880,17 @@ void __health_adjust(struct server *s, short status)
 
 	s->consecutive_errors = 0;
 	s->counters.failed_hana++;
+	check_publish(s);
 
 	if (s->check.fastinter) {
+		/* a shared check is run by its leader's task */
+		struct task *t = s->check.leader ? s->check.leader->task : s->check.task;
+
 		expire = tick_add(now_ms, MS_TO_TICKS(s->check.fastinter));
-		if (s->check.task->expire > expire) {
-			s->check.task->expire = expire;
+		if (t->expire > expire) {
+			t->expire = expire;
 			/* requeue check task with new expire */
-			task_queue(s->check.task);
+			task_queue(t);
 		}
 	}
 }
@@ -1500,6 +1662,115 @@ static struct task *server_warmup(struct task *t)
 	return t;
 }
 
+/* Returns non-zero if check <check> is enabled, not paused, and its proxy is
+ * not stopped.
+ */
+static inline int check_is_active(const struct check *check)
+{
+	return (check->state & (CHK_ST_ENABLED | CHK_ST_PAUSED)) == CHK_ST_ENABLED &&
+	       check->server->proxy->state != PR_STSTOPPED;
+}
+
+/* Allocates the connection and the buffers needed by check <check> to run a
+ * probe. They are only held while the check is in progress so that idle checks
+ * do not waste memory. Returns 0 if some memory is missing, otherwise 1.
+ */
+static int check_alloc_resources(struct check *check)
+{
+	if (!check->conn) {
+		check->conn = pool_alloc2(pool2_connection);
+		if (!check->conn)
+			goto fail;
+		check->conn->t.sock.fd = -1;
+		check->conn->flags = CO_FL_NONE;
+	}
+
+	if (!check->bi) {
+		check->bi = pool_alloc2(pool2_check_buf);
+		if (!check->bi)
+			goto fail;
+		check->bi->size = global.tune.chksize;
+		b_reset(check->bi);
+	}
+
+	if (!check->bo) {
+		check->bo = pool_alloc2(pool2_check_buf);
+		if (!check->bo)
+			goto fail;
+		check->bo->size = global.tune.chksize;
+		b_reset(check->bo);
+	}
+	return 1;
+ fail:
+	pool_free2(pool2_check_buf, check->bi);
+	pool_free2(pool2_connection, check->conn);
+	check->bi = NULL;
+	check->conn = NULL;
+	return 0;
+}
+
+/* Releases the connection and the buffers of check <check> once its probe is
+ * complete. The connection is closed first if needed.
+ */
+static void check_release_resources(struct check *check)
+{
+	if (check->conn) {
+		conn_force_close(check->conn);
+		pool_free2(pool2_connection, check->conn);
+		check->conn = NULL;
+	}
+	pool_free2(pool2_check_buf, check->bi);
+	pool_free2(pool2_check_buf, check->bo);
+	check->bi = check->bo = NULL;
+}
+
+/* Updates the health of check <check> and its server's state according to the
+ * result of the last probe.
+ */
+static void check_apply_result(struct check *check)
+{
+	struct server *s = check->server;
+
+	if (check->result == CHK_RES_FAILED)  /* a failure or timeout detected */
+		check_failed(check);
+	else {  /* check was OK */
+		/* we may have to add/remove this server from the LB group */
+		if ((s->state & SRV_RUNNING) && (s->proxy->options & PR_O_DISABLE404)) {
+			if ((s->state & SRV_GOINGDOWN) && (check->result != CHK_RES_CONDPASS))
+				set_server_enabled(check);
+			else if (!(s->state & SRV_GOINGDOWN) && (check->result == CHK_RES_CONDPASS))
+				set_server_disabled(check);
+		}
+
+		if (!(s->state & SRV_MAINTAIN) &&
+		    check->health < check->rise + check->fall - 1) {
+			check->health++; /* was bad, stays for a while */
+			set_server_up(check);
+		}
+	}
+	check_publish(s);
+}
+
+/* Reports the result of the probe just completed by check <check> to all the
+ * active checks sharing its probes, as if they had run it themselves.
+ */
+static void check_share_result(struct check *check)
+{
+	struct check *shared;
+
+	for (shared = check->shared_next; shared; shared = shared->shared_next) {
+		if (!check_is_active(shared))
+			continue;
+
+		set_server_check_status(shared, HCHK_STATUS_START, NULL);
+		shared->result = check->result;
+		shared->code = check->code;
+		set_server_check_status(shared, check->status, check->desc);
+		shared->duration = check->duration;
+		check_apply_result(shared);
+	}
+}
+
 /*
  * manages a server health-check. Returns
  * the time the task accepts to wait, or TIME_ETERNITY for infinity.
@@ -1509,10 +1780,17 @@ static struct task *process_chk(struct task *t)
 	struct check *check = t->context;
 	struct server *s = check->server;
 	struct connection *conn = check->conn;
+	struct check *shared;
 	int rv;
 	int ret;
 	int expired = tick_is_expired(t->expire, now_ms);
 
+	/* another process runs this check and shares its results */
+	if (check->state & CHK_ST_REMOTE) {
+		t->expire = TICK_ETERNITY;
+		return t;
+	}
+
 	if (!(check->state & CHK_ST_INPROGRESS)) {
 		/* no check currently running */
 		if (!expired) /* woke up too early */
@@ -1520,20 +1798,37 @@ static struct task *process_chk(struct task *t)
 
 		/* we don't send any health-checks when the proxy is
 		 * stopped, the server should not be checked or the check
-		 * is disabled.
+		 * is disabled, unless another check relies on our probes.
+		 */
+		if (!check_is_active(check)) {
+			for (shared = check->shared_next; shared; shared = shared->shared_next)
+				if (check_is_active(shared))
+					break;
+			if (!shared)
+				goto reschedule;
+		}
+
+		/* postpone the check if the global checks rate is reached,
+		 * with some jitter so that delayed checks do not come back
+		 * all at once.
 		 */
-		if (((check->state & (CHK_ST_ENABLED | CHK_ST_PAUSED)) != CHK_ST_ENABLED) ||
-		    s->proxy->state == PR_STSTOPPED)
+		if (global.chk_lim && !freq_ctr_remain(&global.chk_per_sec, global.chk_lim, 0)) {
+			rv = next_event_delay(&global.chk_per_sec, global.chk_lim, 0);
+			t->expire = tick_add(now_ms, MS_TO_TICKS(rv + rand() % (rv + 1)));
+			return t;
+		}
+
+		if (!check_alloc_resources(check))
 			goto reschedule;
+		conn = check->conn;
+		update_freq_ctr(&global.chk_per_sec, 1);
 
 		/* we'll initiate a new check */
 		set_server_check_status(check, HCHK_STATUS_START, NULL);
 
 		check->state |= CHK_ST_INPROGRESS;
-		check->bi->p = check->bi->data;
-		check->bi->i = 0;
-		check->bo->p = check->bo->data;
-		check->bo->o = 0;
+		b_reset(check->bi);
+		b_reset(check->bo);
 
 		/* tcpcheck send/expect initialisation */
 		if (check->type == PR_O2_TCPCHK_CHK)
@@ -1648,7 +1943,12 @@ static struct task *process_chk(struct task *t)
 		/* here, we have seen a synchronous error, no fd was allocated */
 
 		check->state &= ~CHK_ST_INPROGRESS;
-		check_failed(check);
+		check_release_resources(check);
+		if (check_is_active(check) || !check->shared_next) {
+			check_failed(check);
+			check_publish(s);
+		}
+		check_share_result(check);
 
 		/* we allow up to min(inter, timeout.connect) for a connection
 		 * to establish but only when timeout.check is set
@@ -1694,24 +1994,11 @@ static struct task *process_chk(struct task *t)
 			conn_drain(conn);
 			conn_force_close(conn);
 		}
+		check_release_resources(check);
 
-		if (check->result == CHK_RES_FAILED)  /* a failure or timeout detected */
-			check_failed(check);
-		else {  /* check was OK */
-			/* we may have to add/remove this server from the LB group */
-			if ((s->state & SRV_RUNNING) && (s->proxy->options & PR_O_DISABLE404)) {
-				if ((s->state & SRV_GOINGDOWN) && (check->result != CHK_RES_CONDPASS))
-					set_server_enabled(check);
-				else if (!(s->state & SRV_GOINGDOWN) && (check->result == CHK_RES_CONDPASS))
-					set_server_disabled(check);
-			}
-
-			if (!(s->state & SRV_MAINTAIN) &&
-			    check->health < check->rise + check->fall - 1) {
-				check->health++; /* was bad, stays for a while */
-				set_server_up(check);
-			}
-		}
+		if (check_is_active(check) || !check->shared_next)
+			check_apply_result(check);
+		check_share_result(check);
 		check->state &= ~CHK_ST_INPROGRESS;
 
 		rv = 0;
@@ -1729,10 +2016,16 @@ static struct task *process_chk(struct task *t)
 	return t;
 }
 
-static int start_check_task(struct check *check, int mininter,
-			    int nbcheck, int srvpos)
+/* Creates the task of check <check> and schedules its first run at a random
+ * date within its interval, bounded by "max-spread-checks" if set, so that the
+ * checks of all servers are evenly spread whatever their number and intervals.
+ * Returns 0 if memory is missing, otherwise 1.
+ */
+static int start_check_task(struct check *check)
 {
 	struct task *t;
+	int inter;
+
 	/* task for the check */
 	if ((t = task_new()) == NULL) {
 		Alert("Starting [%s:%s] check: out of memory.\n",
@@ -1743,21 +2036,314 @@ static int start_check_task(struct check *check, int mininter,
 	check->task = t;
 	t->process = process_chk;
 	t->context = check;
+	t->class = TASK_CL_CHECK;
 
-	if (mininter < srv_getinter(check))
-		mininter = srv_getinter(check);
-
-	if (global.max_spread_checks && mininter > global.max_spread_checks)
-		mininter = global.max_spread_checks;
+	inter = srv_getinter(check);
+	if (global.max_spread_checks && inter > global.max_spread_checks)
+		inter = global.max_spread_checks;
 
-	/* check this every ms */
-	t->expire = tick_add(now_ms, MS_TO_TICKS(mininter * srvpos / nbcheck));
+	t->expire = tick_add(now_ms, MS_TO_TICKS(rand() % MAX(inter, 1)));
 	check->start = now;
 	task_queue(t);
 
 	return 1;
 }
 
+/* Fills <addr> with the address and port the primary check of server <s>
+ * connects to.
+ */
+static void check_get_addr(struct server *s, struct sockaddr_storage *addr)
+{
+	if (is_addr(&s->check_common.addr))
+		*addr = s->check_common.addr;
+	else
+		*addr = s->addr;
+
+	if (s->check.port)
+		set_host_port(addr, s->check.port);
+}
+
+/* Returns the source settings used by connections to server <s> */
+static const struct conn_src *check_get_src(const struct server *s)
+{
+	if (s->conn_src.opts & CO_SRC_BIND)
+		return &s->conn_src;
+	return &s->proxy->conn_src;
+}
+
+/* Returns a hash of the address and port in <addr>, or 0 if the family cannot
+ * be shared (eg: UNIX sockets).
+ */
+static unsigned int check_addr_hash(const struct sockaddr_storage *addr)
+{
+	unsigned int hash;
+
+	switch (addr->ss_family) {
+	case AF_INET:
+		hash = hash_djb2((const char *)&((struct sockaddr_in *)addr)->sin_addr, 4);
+		break;
+	case AF_INET6:
+		hash = hash_djb2((const char *)&((struct sockaddr_in6 *)addr)->sin6_addr, 16);
+		break;
+	default:
+		return 0;
+	}
+	return full_hash(hash + get_host_port((struct sockaddr_storage *)addr)) | 1;
+}
+
+/* Returns non-zero if strings <a> and <b> are both NULL or equal. */
+static inline int check_str_equal(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
+/* Returns non-zero if the connections of the checks of servers <a> and <b>
+ * are set up exactly the same way : same source settings, which may come from
+ * the server or from its backend, and same SSL settings.
+ */
+static int check_same_conn_settings(const struct server *a, const struct server *b)
+{
+	const struct conn_src *sa, *sb;
+
+	sa = check_get_src(a);
+	sb = check_get_src(b);
+	if (sa->opts != sb->opts || sa->sport_range || sb->sport_range ||
+	    (sa->iface_name || sb->iface_name) ||
+	    ((sa->opts & CO_SRC_BIND) && memcmp(&sa->source_addr, &sb->source_addr, sizeof(sa->source_addr)) != 0))
+		return 0;
+#if defined(CONFIG_HAP_CTTPROXY) || defined(CONFIG_HAP_TRANSPARENT)
+	if ((sa->opts & CO_SRC_TPROXY_MASK) &&
+	    ((sa->opts & CO_SRC_TPROXY_MASK) != CO_SRC_TPROXY_ADDR ||
+	     memcmp(&sa->tproxy_addr, &sb->tproxy_addr, sizeof(sa->tproxy_addr)) != 0))
+		return 0;
+#endif
+
+#ifdef USE_OPENSSL
+	if (a->check.use_ssl &&
+	    (a->ssl_ctx.options != b->ssl_ctx.options ||
+	     a->ssl_ctx.verify != b->ssl_ctx.verify ||
+	     !check_str_equal(a->ssl_ctx.ciphers, b->ssl_ctx.ciphers) ||
+	     !check_str_equal(a->ssl_ctx.verify_host, b->ssl_ctx.verify_host) ||
+	     !check_str_equal(a->ssl_ctx.ca_file, b->ssl_ctx.ca_file) ||
+	     !check_str_equal(a->ssl_ctx.crl_file, b->ssl_ctx.crl_file) ||
+	     !check_str_equal(a->ssl_ctx.client_crt, b->ssl_ctx.client_crt)))
+		return 0;
+#endif
+	return 1;
+}
+
+/* Returns non-zero if the primary checks of servers <a> and <b> would send
+ * exactly the same probes to the same address and draw the same conclusions
+ * from them, so that they may share them.
+ */
+static int check_may_share(struct server *a, struct server *b)
+{
+	const struct proxy *pa = a->proxy, *pb = b->proxy;
+	struct sockaddr_storage aa, ab;
+
+	if (a->check.type != b->check.type ||
+	    a->check.use_ssl != b->check.use_ssl ||
+	    a->check.send_proxy != b->check.send_proxy ||
+	    a->check.inter != b->check.inter ||
+	    a->check.fastinter != b->check.fastinter ||
+	    a->check.downinter != b->check.downinter ||
+	    a->check.rise != b->check.rise ||
+	    a->check.fall != b->check.fall ||
+	    a->check_common.proto != b->check_common.proto ||
+	    a->check_common.xprt != b->check_common.xprt)
+		return 0;
+
+	check_get_addr(a, &aa);
+	check_get_addr(b, &ab);
+	if (aa.ss_family != ab.ss_family ||
+	    get_host_port(&aa) != get_host_port(&ab))
+		return 0;
+	if (aa.ss_family == AF_INET &&
+	    ((struct sockaddr_in *)&aa)->sin_addr.s_addr != ((struct sockaddr_in *)&ab)->sin_addr.s_addr)
+		return 0;
+	if (aa.ss_family == AF_INET6 &&
+	    memcmp(&((struct sockaddr_in6 *)&aa)->sin6_addr, &((struct sockaddr_in6 *)&ab)->sin6_addr, 16) != 0)
+		return 0;
+
+	/* server-level settings must be checked even within a same backend */
+	if (!check_same_conn_settings(a, b))
+		return 0;
+
+	/* the remaining settings are all set at the backend level */
+	if (pa == pb)
+		return 1;
+
+	/* the shared probes must be run by the process publishing the results */
+	if ((global.tune.options & GTUNE_SHARE_CHK_RESULTS) &&
+	    check_owner_proc(pa) != check_owner_proc(pb))
+		return 0;
+
+	if ((pa->options & PR_O_DISABLE404) != (pb->options & PR_O_DISABLE404) ||
+	    (pa->options2 & (PR_O2_EXP_TYPE | PR_O2_EXP_INV)) != (pb->options2 & (PR_O2_EXP_TYPE | PR_O2_EXP_INV)) ||
+	    pa->timeout.check != pb->timeout.check ||
+	    pa->timeout.connect != pb->timeout.connect ||
+	    pa->check_len != pb->check_len ||
+	    (pa->check_len && memcmp(pa->check_req, pb->check_req, pa->check_len) != 0))
+		return 0;
+
+	/* regex matches cannot be compared, only strings can */
+	if (pa->options2 & PR_O2_EXP_TYPE) {
+		if (!pa->expect_str || !pb->expect_str || strcmp(pa->expect_str, pb->expect_str) != 0)
+			return 0;
+		if ((pa->options2 & PR_O2_EXP_TYPE) == PR_O2_EXP_RSTS ||
+		    (pa->options2 & PR_O2_EXP_TYPE) == PR_O2_EXP_RSTR)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* node used to index the checks by address while looking for shareable ones */
+struct check_share_node {
+	struct eb32_node node;
+	struct server *srv;
+};
+
+/* Looks for servers whose primary checks may share their probes with those of
+ * another server, and attaches them to it. Only the first of such servers
+ * then runs the probes, and reports their results to the other ones. Checks
+ * using tcp-check rules or reporting the server's state are never shared.
+ * <nbcheck> is the number of configured checks. Returns 0 if memory is
+ * missing, otherwise 1.
+ */
+static int share_checks(int nbcheck)
+{
+	struct eb_root root = EB_ROOT;
+	struct check_share_node *nodes, *leader;
+	struct eb32_node *node;
+	struct proxy *px;
+	struct server *s;
+	int nb = 0;
+
+	nodes = calloc(nbcheck, sizeof(*nodes));
+	if (!nodes)
+		return 0;
+
+	for (px = proxy; px; px = px->next) {
+		for (s = px->srv; s; s = s->next) {
+			struct sockaddr_storage addr;
+			unsigned int hash;
+
+			if (!(s->check.state & CHK_ST_CONFIGURED) ||
+			    s->check.type == PR_O2_TCPCHK_CHK ||
+			    (px->options2 & PR_O2_CHK_SNDST))
+				continue;
+
+			check_get_addr(s, &addr);
+			hash = check_addr_hash(&addr);
+			if (!hash)
+				continue;
+
+			leader = NULL;
+			for (node = eb32_lookup(&root, hash); node && node->key == hash; node = eb32_next(node)) {
+				if (check_may_share(eb32_entry(node, struct check_share_node, node)->srv, s)) {
+					leader = eb32_entry(node, struct check_share_node, node);
+					break;
+				}
+			}
+
+			if (leader) {
+				s->check.leader = &leader->srv->check;
+				s->check.shared_next = leader->srv->check.shared_next;
+				leader->srv->check.shared_next = &s->check;
+				nb_shared_checks++;
+				continue;
+			}
+
+			nodes[nb].srv = s;
+			nodes[nb].node.key = hash;
+			eb32_insert(&root, &nodes[nb].node);
+			nb++;
+		}
+	}
+	free(nodes);
+	return 1;
+}
+
+/* Allocates the memory area shared between processes where the state of each
+ * checked server is published in "share-check-results" mode, and publishes the
+ * initial states. It must be called before the fork. Returns 0 if some memory
+ * is missing, otherwise 1.
+ */
+static int check_shm_init()
+{
+	struct proxy *px;
+	struct server *s;
+	struct check_shm *area;
+	int nbsrv = 0;
+
+	for (px = proxy; px; px = px->next)
+		for (s = px->srv; s; s = s->next)
+			if ((s->check.state | s->agent.state) & CHK_ST_CONFIGURED)
+				nbsrv++;
+
+	if (!nbsrv)
+		return 1;
+
+	area = mmap(NULL, nbsrv * sizeof(*area), PROT_READ | PROT_WRITE,
+	            MAP_SHARED | MAP_ANON, -1, 0);
+	if (area == MAP_FAILED)
+		return 0;
+
+	for (px = proxy; px; px = px->next) {
+		for (s = px->srv; s; s = s->next) {
+			if (!((s->check.state | s->agent.state) & CHK_ST_CONFIGURED))
+				continue;
+			s->chk_shm = area++;
+			check_publish(s);
+			s->chk_shm_seq = s->chk_shm->seq;
+			s->chk_shm_uweight = s->uweight;
+		}
+	}
+	return 1;
+}
+
+/* Called by each process after the fork in "share-check-results" mode. The
+ * checks of the backends which another process checks become remote checks
+ * which do not send any probe, and a task applies the results published by
+ * the other process instead. Returns 0 if OK, or -1 in case of error.
+ */
+int start_check_sync()
+{
+	struct proxy *px;
+	struct server *s;
+	struct task *t;
+
+	for (px = proxy; px; px = px->next) {
+		if (check_owner_proc(px) == relative_pid)
+			continue;
+
+		for (s = px->srv; s; s = s->next) {
+			if (!s->chk_shm)
+				continue;
+			s->check.state |= CHK_ST_REMOTE;
+			s->agent.state |= CHK_ST_REMOTE;
+			nb_remote_checks++;
+		}
+	}
+
+	if (!nb_remote_checks)
+		return 0;
+
+	if ((t = task_new()) == NULL) {
+		Alert("Starting check results synchronization: out of memory.\n");
+		return -1;
+	}
+	t->process = process_chk_sync;
+	t->context = NULL;
+	t->class = TASK_CL_CHECK;
+	t->expire = tick_add(now_ms, MS_TO_TICKS(CHK_SYNC_INTERVAL));
+	task_queue(t);
+	return 0;
+}
+
 /*
  * Start health-check.
  * Returns 0 if OK, -1 if error, and prints the error in this case.
@@ -1767,15 +2353,9 @@ int start_checks() {
 	struct proxy *px;
 	struct server *s;
 	struct task *t;
-	int nbcheck=0, mininter=0, srvpos=0;
-
-	/* 1- count the checkers to run simultaneously.
-	 * We also determine the minimum interval among all of those which
-	 * have an interval larger than SRV_CHK_INTER_THRES. This interval
-	 * will be used to spread their start-up date. Those which have
-	 * a shorter interval will start independently and will not dictate
-	 * too short an interval for all others.
-	 */
+	int nbcheck = 0;
+
+	/* 1- count the checkers and create the warmup tasks */
 	for (px = proxy; px; px = px->next) {
 		for (s = px->srv; s; s = s->next) {
 			if (s->slowstart) {
@@ -1789,22 +2369,15 @@ int start_checks() {
 				s->warmup = t;
 				t->process = server_warmup;
 				t->context = s;
+				t->class = TASK_CL_CHECK;
 				t->expire = TICK_ETERNITY;
 			}
 
-			if (s->check.state & CHK_ST_CONFIGURED) {
+			if (s->check.state & CHK_ST_CONFIGURED)
 				nbcheck++;
-				if ((srv_getinter(&s->check) >= SRV_CHK_INTER_THRES) &&
-				    (!mininter || mininter > srv_getinter(&s->check)))
-					mininter = srv_getinter(&s->check);
-			}
 
-			if (s->agent.state & CHK_ST_CONFIGURED) {
+			if (s->agent.state & CHK_ST_CONFIGURED)
 				nbcheck++;
-				if ((srv_getinter(&s->agent) >= SRV_CHK_INTER_THRES) &&
-				    (!mininter || mininter > srv_getinter(&s->agent)))
-					mininter = srv_getinter(&s->agent);
-			}
 		}
 	}
 
@@ -1813,26 +2386,38 @@ int start_checks() {
 
 	srand((unsigned)time(NULL));
 
-	/*
-	 * 2- start them as far as possible from each others. For this, we will
-	 * start them after their interval set to the min interval divided by
-	 * the number of servers, weighted by the server's position in the list.
-	 */
+	/* the check buffers are allocated from this pool when a check starts */
+	pool2_check_buf = create_pool("chkbuf", sizeof(struct buffer) + global.tune.chksize, MEM_F_SHARED);
+	if (!pool2_check_buf) {
+		Alert("Starting checks: out of memory.\n");
+		return -1;
+	}
+
+	/* 2- attach the checks which may share another one's probes */
+	if ((global.tune.options & GTUNE_SHARE_CHECKS) && !share_checks(nbcheck)) {
+		Alert("Starting checks: out of memory.\n");
+		return -1;
+	}
+
+	/* 3- share their results with the other processes */
+	if ((global.tune.options & GTUNE_SHARE_CHK_RESULTS) && global.nbproc > 1 && !check_shm_init()) {
+		Alert("Starting checks: cannot allocate the shared results area.\n");
+		return -1;
+	}
+
+	/* 4- start them at random dates within their interval */
 	for (px = proxy; px; px = px->next) {
 		for (s = px->srv; s; s = s->next) {
-			/* A task for the main check */
-			if (s->check.state & CHK_ST_CONFIGURED) {
-				if (!start_check_task(&s->check, mininter, nbcheck, srvpos))
+			/* A task for the main check, unless it relies on another one */
+			if ((s->check.state & CHK_ST_CONFIGURED) && !s->check.leader) {
+				if (!start_check_task(&s->check))
 					return -1;
-				srvpos++;
 			}
 
 			/* A task for a auxiliary agent check */
 			if (s->agent.state & CHK_ST_CONFIGURED) {
-				if (!start_check_task(&s->agent, mininter, nbcheck, srvpos)) {
+				if (!start_check_task(&s->agent))
 					return -1;
-				}
-				srvpos++;
 			}
 		}
 	}
@@ -2011,10 +2596,8 @@ static void tcpcheck_main(struct connection *conn)
 	/* no step means first step
 	 * initialisation */
 	if (check->current_step == NULL) {
-		check->bo->p = check->bo->data;
-		check->bo->o = 0;
-		check->bi->p = check->bi->data;
-		check->bi->i = 0;
+		b_reset(check->bo);
+		b_reset(check->bi);
 		cur = check->current_step = LIST_ELEM(head->n, struct tcpcheck_rule *, list);
 		t->expire = tick_add(now_ms, MS_TO_TICKS(check->inter));
 		if (s->proxy->timeout.check)
@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <common/base64.h>
 #include <common/cfgparse.h>
 #include <common/compat.h>
 #include <common/config.h>
@@ -61,6 +62,7 @@
 #include <proto/task.h>
 
 #ifdef USE_OPENSSL
+#include <proto/shctx.h>
 #include <proto/ssl_sock.h>
 #endif
 
@@ -84,10 +86,12 @@ enum {
 	STAT_CLI_O_PAT,      /* list all entries of a pattern */
 	STAT_CLI_O_MLOOK,    /* lookup a map entry */
 	STAT_CLI_O_POOLS,    /* dump memory pools */
+	STAT_CLI_O_TASKS,    /* dump task classes */
 };
 
 static int stats_dump_info_to_buffer(struct stream_interface *si);
 static int stats_dump_pools_to_buffer(struct stream_interface *si);
+static int stats_dump_tasks_to_buffer(struct stream_interface *si);
 static int stats_dump_full_sess_to_buffer(struct stream_interface *si, struct session *sess);
 static int stats_dump_sess_to_buffer(struct stream_interface *si);
 static int stats_dump_errors_to_buffer(struct stream_interface *si);
@@ -141,6 +145,7 @@ static const char stats_sock_usage_msg[] =
 	"  show errors    : report last request and response errors for each proxy\n"
 	"  show sess [id] : report the list of current sessions or dump this session\n"
 	"  show table [id]: report table usage stats or dump this table's contents\n"
+	"  show tasks     : report the time spent in each class of tasks\n"
 	"  get weight     : report a server's current weight\n"
 	"  set weight     : change a server's weight\n"
 	"  set table [id] : update or create a table entry's data\n"
@@ -161,6 +166,11 @@ static const char stats_sock_usage_msg[] =
 	"  add map        : add map entry\n"
 	"  del map        : delete map entry\n"
 	"  clear map <id> : clear the content of this map\n"
+#ifdef USE_OPENSSL
+	"  show tls-keys  : report the TLS ticket keys files\n"
+	"  set ssl tls-key: rotate a new TLS ticket key in\n"
+	"  set ssl ocsp-response: update the OCSP response stapled for a certificate\n"
+#endif
 	"";
 
 static const char stats_permission_denied_msg[] =
@@ -457,6 +467,7 @@ static void stats_dump_csv_header()
 	              "req_rate,req_rate_max,req_tot,"
 	              "cli_abrt,srv_abrt,"
 	              "comp_in,comp_out,comp_byp,comp_rsp,lastsess,"
+	              "ctime,rtime,hspill,qclass,qtimeout,alimit,eject,sslfull,sslreuse,"
 	              "\n");
 }
 
@@ -1094,6 +1105,23 @@ static int stats_sock_parse_request(struct stream_interface *si, char *line)
 			appctx->st2 = STAT_ST_INIT;
 			appctx->st0 = STAT_CLI_O_POOLS; // stats_dump_pools_to_buffer
 		}
+		else if (strcmp(args[1], "tasks") == 0) {
+			appctx->st2 = STAT_ST_INIT;
+			appctx->st0 = STAT_CLI_O_TASKS; // stats_dump_tasks_to_buffer
+		}
+#ifdef USE_OPENSSL
+		else if (strcmp(args[1], "tls-keys") == 0) {
+			struct tls_keys_ref *ref;
+
+			/* the keys themselves are never dumped */
+			chunk_reset(&trash);
+			chunk_appendf(&trash, "# id (file) keys\n");
+			list_for_each_entry(ref, &tlskeys_reference, list)
+				chunk_appendf(&trash, "%d (%s) %d\n", ref->unique_id, ref->filename, ref->nb_keys);
+			bi_putchk(si->ib, &trash);
+			return 1;
+		}
+#endif
 		else if (strcmp(args[1], "sess") == 0) {
 			appctx->st2 = STAT_ST_INIT;
 			if (s->listener->bind_conf->level < ACCESS_LVL_OPER) {
@@ -1615,6 +1643,77 @@ static int stats_sock_parse_request(struct stream_interface *si, char *line)
 		else if (strcmp(args[1], "table") == 0) {
 			stats_sock_table_request(si, args, STAT_CLI_O_SET);
 		}
+#ifdef USE_OPENSSL
+		else if (strcmp(args[1], "ssl") == 0 && strcmp(args[2], "tls-key") == 0) {
+			struct tls_keys_ref *ref;
+			char *err = NULL;
+
+			if (s->listener->bind_conf->level < ACCESS_LVL_ADMIN) {
+				appctx->ctx.cli.msg = stats_permission_denied_msg;
+				appctx->st0 = STAT_CLI_PRINT;
+				return 1;
+			}
+
+			if (!*args[3] || !*args[4]) {
+				appctx->ctx.cli.msg = "'set ssl tls-key' expects a keys file identifier and a base64-encoded key.\n";
+				appctx->st0 = STAT_CLI_PRINT;
+				return 1;
+			}
+
+			ref = tlskeys_ref_lookup(args[3]);
+			if (!ref) {
+				appctx->ctx.cli.msg = "Unknown TLS keys file identifier. Please use #<id> or <file>.\n";
+				appctx->st0 = STAT_CLI_PRINT;
+				return 1;
+			}
+
+			if (ssl_sock_update_tlskey(ref, args[4], &err)) {
+				memprintf(&err, "%s.\n", err);
+				appctx->ctx.cli.err = err;
+				appctx->st0 = STAT_CLI_PRINT_FREE;
+				return 1;
+			}
+
+			appctx->ctx.cli.msg = "TLS ticket key updated.\n";
+			appctx->st0 = STAT_CLI_PRINT;
+			return 1;
+		}
+#if (defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB && !defined OPENSSL_NO_OCSP)
+		else if (strcmp(args[1], "ssl") == 0 && strcmp(args[2], "ocsp-response") == 0) {
+			char *err = NULL;
+
+			if (s->listener->bind_conf->level < ACCESS_LVL_ADMIN) {
+				appctx->ctx.cli.msg = stats_permission_denied_msg;
+				appctx->st0 = STAT_CLI_PRINT;
+				return 1;
+			}
+
+			if (!*args[3]) {
+				appctx->ctx.cli.msg = "'set ssl ocsp-response' expects a base64-encoded DER OCSP response.\n";
+				appctx->st0 = STAT_CLI_PRINT;
+				return 1;
+			}
+
+			trash.len = base64dec(args[3], strlen(args[3]), trash.str, trash.size);
+			if (trash.len <= 0) {
+				appctx->ctx.cli.msg = "'set ssl ocsp-response' received invalid base64 encoded response.\n";
+				appctx->st0 = STAT_CLI_PRINT;
+				return 1;
+			}
+
+			if (ssl_sock_update_ocsp_response(&trash, &err)) {
+				memprintf(&err, "%s.\n", err);
+				appctx->ctx.cli.err = err;
+				appctx->st0 = STAT_CLI_PRINT_FREE;
+				return 1;
+			}
+
+			appctx->ctx.cli.msg = "OCSP Response updated!\n";
+			appctx->st0 = STAT_CLI_PRINT;
+			return 1;
+		}
+#endif
+#endif
 		else if (strcmp(args[1], "map") == 0) {
 			char *err;
 
@@ -2241,6 +2340,10 @@ static void cli_io_handler(struct stream_interface *si)
 				if (stats_dump_pools_to_buffer(si))
 					appctx->st0 = STAT_CLI_PROMPT;
 				break;
+			case STAT_CLI_O_TASKS:
+				if (stats_dump_tasks_to_buffer(si))
+					appctx->st0 = STAT_CLI_PROMPT;
+				break;
 			default: /* abnormal state */
 				appctx->st0 = STAT_CLI_PROMPT;
 				break;
@@ -2318,6 +2421,19 @@ static void cli_io_handler(struct stream_interface *si)
 static int stats_dump_info_to_buffer(struct stream_interface *si)
 {
 	unsigned int up = (now.tv_sec - start_date.tv_sec);
+	unsigned long long task_cpu_ns = 0, task_deferred = 0;
+	int cl;
+#ifdef USE_OPENSSL
+	unsigned long long cache_lookups, cache_misses, cache_waits;
+	int cache_shards;
+
+	cache_shards = shared_context_stats(&cache_lookups, &cache_misses, &cache_waits);
+#endif
+
+	for (cl = 0; cl < TASK_CLASSES; cl++) {
+		task_cpu_ns += task_classes[cl].cpu_ns;
+		task_deferred += task_classes[cl].deferred;
+	}
 
 	chunk_printf(&trash,
 	             "Name: " PRODUCT_NAME "\n"
@@ -2354,7 +2470,21 @@ static int stats_dump_info_to_buffer(struct stream_interface *si)
 	             "SslRate: %d\n"
 	             "SslRateLimit: %d\n"
 	             "MaxSslRate: %d\n"
+	             "SslCacheShards: %d\n"
+	             "SslCacheLookups: %llu\n"
+	             "SslCacheMisses: %llu\n"
+	             "SslCacheLockWaits: %llu\n"
+	             "SslCertLoadTime: %u\n"
+	             "SslLazyCerts: %u\n"
+	             "SslLazyResident: %u\n"
+	             "SslLazyLoads: %u\n"
+	             "SslLazyEvictions: %u\n"
+	             "SslLazyFailures: %u\n"
 #endif
+	             "CheckRate: %d\n"
+	             "CheckRateLimit: %d\n"
+	             "SharedChecks: %u\n"
+	             "RemoteChecks: %u\n"
 	             "CompressBpsIn: %u\n"
 	             "CompressBpsOut: %u\n"
 	             "CompressBpsRateLim: %u\n"
@@ -2362,9 +2492,17 @@ static int stats_dump_info_to_buffer(struct stream_interface *si)
 	             "ZlibMemUsage: %ld\n"
 	             "MaxZlibMemUsage: %ld\n"
 #endif
+	             "LogQueued: %u\n"
+	             "LogSent: %u\n"
+	             "LogDropped: %u\n"
 	             "Tasks: %d\n"
 	             "Run_queue: %d\n"
+	             "Tasks_time_ms: %llu\n"
+	             "Tasks_deferred: %llu\n"
 	             "Idle_pct: %d\n"
+	             "Poll_spin_ms: %llu\n"
+	             "Poll_spin_hits: %u\n"
+	             "Poll_sleep_ms: %llu\n"
 	             "node: %s\n"
 	             "description: %s\n"
 	             "",
@@ -2385,13 +2523,19 @@ static int stats_dump_info_to_buffer(struct stream_interface *si)
 	             read_freq_ctr(&global.sess_per_sec), global.sps_lim, global.sps_max,
 #ifdef USE_OPENSSL
 	             read_freq_ctr(&global.ssl_per_sec), global.ssl_lim, global.ssl_max,
+	             cache_shards, cache_lookups, cache_misses, cache_waits,
+	             lazy_certs.load_time, lazy_certs.indexed, lazy_certs.resident,
+	             lazy_certs.loads, lazy_certs.evictions, lazy_certs.failures,
 #endif
+	             read_freq_ctr(&global.chk_per_sec), global.chk_lim, nb_shared_checks, nb_remote_checks,
 	             read_freq_ctr(&global.comp_bps_in), read_freq_ctr(&global.comp_bps_out),
 	             global.comp_rate_lim,
 #ifdef USE_ZLIB
 	             zlib_used_memory, global.maxzlibmem,
 #endif
-	             nb_tasks_cur, run_queue_cur, idle_pct,
+	             log_queued, log_sent, log_dropped,
+	             nb_tasks_cur, run_queue_cur, task_cpu_ns / 1000000, task_deferred, idle_pct,
+	             poll_spin_time / 1000, poll_spin_hits, poll_sleep_time / 1000,
 	             global.node, global.desc ? global.desc : ""
 	             );
 
@@ -2413,6 +2557,31 @@ static int stats_dump_pools_to_buffer(struct stream_interface *si)
 	return 1;
 }
 
+/* This function dumps the scheduling statistics of task classes onto the
+ * stream interface's read buffer. It returns 0 as long as it does not
+ * complete, non-zero upon completion. No state is used.
+ */
+static int stats_dump_tasks_to_buffer(struct stream_interface *si)
+{
+	dump_task_classes_to_trash();
+	if (bi_putchk(si->ib, &trash) == -1)
+		return 0;
+	return 1;
+}
+
+/* Appends to the trash the CSV "qclass" field made of the numbers of pending
+ * connections per priority class found in <nbpend_class>, separated with
+ * slashes and starting with class 0, followed by the field separator.
+ */
+static void stats_dump_qclass(const unsigned int *nbpend_class)
+{
+	int class;
+
+	for (class = 0; class < QUEUE_CLASSES; class++)
+		chunk_appendf(&trash, "%s%u", class ? "/" : "", nbpend_class[class]);
+	chunk_appendf(&trash, ",");
+}
+
 /* Dumps a frontend's line to the trash for the current proxy <px> and uses
  * the state from stream interface <si>. The caller is responsible for clearing
  * the trash if needed. Returns non-zero if it emits anything, zero otherwise.
@@ -2623,6 +2792,24 @@ static int stats_dump_fe_stats(struct stream_interface *si, struct proxy *px)
 		/* lastsess */
 		chunk_appendf(&trash, ",");
 
+		/* latency: ctime, rtime */
+		chunk_appendf(&trash, ",,");
+
+		/* hspill */
+		chunk_appendf(&trash, ",");
+
+		/* queue: qclass, qtimeout */
+		chunk_appendf(&trash, ",,");
+
+		/* alimit */
+		chunk_appendf(&trash, ",");
+
+		/* eject */
+		chunk_appendf(&trash, ",");
+
+		/* ssl handshakes: sslfull, sslreuse */
+		chunk_appendf(&trash, ",,");
+
 		/* finish with EOL */
 		chunk_appendf(&trash, "\n");
 	}
@@ -2746,6 +2933,18 @@ static int stats_dump_li_stats(struct stream_interface *si, struct proxy *px, st
 		              ",,,,"
 			      /* lastsess */
 			      ","
+		              /* latency: ctime, rtime */
+		              ",,"
+		              /* hspill */
+		              ","
+		              /* queue: qclass, qtimeout */
+		              ",,"
+		              /* alimit */
+		              ","
+		              /* eject */
+		              ","
+		              /* ssl handshakes: sslfull, sslreuse */
+		              ",,"
 		              "\n",
 		              px->id, l->name,
 		              l->nbconn, l->counters->conn_max,
@@ -2859,10 +3058,21 @@ static int stats_dump_sv_stats(struct stream_interface *si, struct proxy *px, in
 		              "<td>%s</td><td>%s</td><td>%s</td>"
 		              "<td><u>%s<div class=tips><table class=det>"
 		              "<tr><th>Cum. sessions:</th><td>%s</td></tr>"
+		              "<tr><th>Avg. connect time:</th><td>%u ms</td></tr>"
+		              "<tr><th>Avg. response time:</th><td>%u ms</td></tr>"
 		              "",
 		              U2H(sv->cur_sess), U2H(sv->counters.cur_sess_max), LIM2A(sv->maxconn, "-"),
 		              U2H(sv->counters.cum_sess),
-		              U2H(sv->counters.cum_sess));
+		              U2H(sv->counters.cum_sess),
+		              srv_ewma_now(sv, sv->ewma_ctime) / SRV_EWMA_SCALE,
+		              srv_ewma_now(sv, sv->ewma_rtime) / SRV_EWMA_SCALE);
+
+#ifdef USE_OPENSSL
+		if (sv->use_ssl)
+			chunk_appendf(&trash,
+				      "<tr><th>SSL handshakes:</th><td>%s full, %s resumed</td></tr>",
+				      U2H(sv->counters.ssl_full), U2H(sv->counters.ssl_reused));
+#endif
 
 		/* http response (via hover): 1xx, 2xx, 3xx, 4xx, 5xx, other */
 		if (px->mode == PR_MODE_HTTP) {
@@ -2926,6 +3136,8 @@ static int stats_dump_sv_stats(struct stream_interface *si, struct proxy *px, in
 			chunk_appendf(&trash, "%s ", human_time(now.tv_sec - ref->last_change, 1));
 			chunk_appendf(&trash, "MAINT(via)");
 		}
+		else if ((sv->state & (SRV_EJECTED | SRV_RUNNING)) == (SRV_EJECTED | SRV_RUNNING))
+			chunk_appendf(&trash, "EJECTED");
 		else if (ref->check.state & CHK_ST_ENABLED) {
 			chunk_appendf(&trash, "%s ", human_time(now.tv_sec - ref->last_change, 1));
 			chunk_appendf(&trash,
@@ -3043,6 +3255,8 @@ static int stats_dump_sv_stats(struct stream_interface *si, struct proxy *px, in
 			chunk_appendf(&trash, "MAINT,");
 		else if (ref != sv && ref->state & SRV_MAINTAIN)
 			chunk_appendf(&trash, "MAINT(via),");
+		else if ((sv->state & (SRV_EJECTED | SRV_RUNNING)) == (SRV_EJECTED | SRV_RUNNING))
+			chunk_appendf(&trash, "EJECTED,");
 		else
 			chunk_appendf(&trash,
 			              srv_hlt_st[state],
@@ -3141,6 +3355,38 @@ static int stats_dump_sv_stats(struct stream_interface *si, struct proxy *px, in
 		/* lastsess */
 		chunk_appendf(&trash, "%d,", srv_lastsession(sv));
 
+		/* latency: ctime, rtime */
+		chunk_appendf(&trash, "%u,%u,",
+		              srv_ewma_now(sv, sv->ewma_ctime) / SRV_EWMA_SCALE,
+		              srv_ewma_now(sv, sv->ewma_rtime) / SRV_EWMA_SCALE);
+
+		/* hspill */
+		chunk_appendf(&trash, "%lld,", sv->counters.hash_spills);
+
+		/* queue: qclass, qtimeout */
+		stats_dump_qclass(sv->nbpend_class);
+		chunk_appendf(&trash, "%lld,", sv->counters.q_timeouts);
+
+		/* alimit */
+		if (sv->state & SRV_ADAPTIVE)
+			chunk_appendf(&trash, "%u,", sv->adapt_limit / SRV_ADAPT_SCALE);
+		else
+			chunk_appendf(&trash, ",");
+
+		/* eject */
+		if (sv->outlier)
+			chunk_appendf(&trash, "%lld,", sv->counters.ejections);
+		else
+			chunk_appendf(&trash, ",");
+
+		/* ssl handshakes: sslfull, sslreuse */
+#ifdef USE_OPENSSL
+		if (sv->use_ssl)
+			chunk_appendf(&trash, "%lld,%lld,", sv->counters.ssl_full, sv->counters.ssl_reused);
+		else
+#endif
+			chunk_appendf(&trash, ",,");
+
 		/* finish with EOL */
 		chunk_appendf(&trash, "\n");
 	}
@@ -3374,6 +3620,25 @@ static int stats_dump_be_stats(struct stream_interface *si, struct proxy *px, in
 		/* lastsess */
 		chunk_appendf(&trash, "%d,", be_lastsession(px));
 
+		/* latency: ctime, rtime */
+		chunk_appendf(&trash, ",,");
+
+		/* hspill */
+		chunk_appendf(&trash, ",");
+
+		/* queue: qclass, qtimeout */
+		stats_dump_qclass(px->nbpend_class);
+		chunk_appendf(&trash, "%lld,", px->be_counters.q_timeouts);
+
+		/* alimit */
+		chunk_appendf(&trash, ",");
+
+		/* eject */
+		chunk_appendf(&trash, ",");
+
+		/* ssl handshakes: sslfull, sslreuse */
+		chunk_appendf(&trash, ",,");
+
 		/* finish with EOL */
 		chunk_appendf(&trash, "\n");
 	}
@@ -3856,7 +4121,7 @@ static void stats_dump_html_info(struct stream_interface *si, struct uri_auth *u
 	              "</tr><tr>\n"
 	              "<td class=\"active7\"></td><td class=\"noborder\" colspan=\"3\">active or backup SOFT STOPPED for maintenance &nbsp;</td>"
 	              "</tr></table>\n"
-	              "Note: \"NOLB\"/\"DRAIN\" = UP with load-balancing disabled."
+	              "Note: \"NOLB\"/\"DRAIN\"/\"EJECTED\" = UP with load-balancing disabled."
 	              "</td>"
 	              "<td align=\"left\" valign=\"top\" nowrap width=\"1%%\">"
 	              "<b>Display option:</b><ul style=\"margin-top: 0.25em;\">"
@@ -45,6 +45,26 @@ static struct epoll_event ev;
 #define EPOLLRDHUP 0x2000
 #endif
 
+/* Returns the number of microseconds to spend busy polling before sleeping
+ * for up to <wait_time> milliseconds. The configured budget is entirely used
+ * as long as the process is at least half busy, and it shrinks to zero as the
+ * process gets idle, since spinning would then mostly burn CPU for nothing.
+ */
+static inline unsigned int busy_poll_budget(int wait_time)
+{
+	unsigned int budget = global.tune.busy_poll;
+
+	if (!budget || !wait_time)
+		return 0;
+
+	if (idle_pct > 50)
+		budget = budget * (100 - idle_pct) / 50;
+
+	if (budget > (unsigned int)wait_time * 1000)
+		budget = wait_time * 1000;
+	return budget;
+}
+
 /*
  * Linux epoll() poller
  */
@@ -54,7 +74,9 @@ REGPRM2 static void _do_poll(struct poller *p, int exp)
 	int fd, opcode;
 	int count;
 	int updt_idx;
-	int wait_time;
+	int wait_time, sleep_time;
+	unsigned int spin;
+	struct timeval spin_end, sleep_start;
 
 	/* first, scan the update list to find changes */
 	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
@@ -123,11 +145,39 @@ REGPRM2 static void _do_poll(struct poller *p, int exp)
 		}
 	}
 
-	/* now let's wait for polled events */
+	/* now let's wait for polled events. In busy polling mode, we first check
+	 * for events without sleeping for a while, which saves the scheduler's
+	 * wake up latency. The time spent spinning is accounted as idle time.
+	 */
 
 	gettimeofday(&before_poll, NULL);
-	status = epoll_wait(epoll_fd, epoll_events, global.tune.maxpollevents, wait_time);
+	sleep_start = before_poll;
+	sleep_time = wait_time;
+	status = 0;
+
+	spin = busy_poll_budget(wait_time);
+	if (spin) {
+		spin_end.tv_sec  = before_poll.tv_sec + (before_poll.tv_usec + spin) / 1000000;
+		spin_end.tv_usec = (before_poll.tv_usec + spin) % 1000000;
+		do {
+			status = epoll_wait(epoll_fd, epoll_events, global.tune.maxpollevents, 0);
+			gettimeofday(&sleep_start, NULL);
+		} while (!status && __tv_islt(&sleep_start, &spin_end));
+
+		poll_spin_time += tv_us_elapsed(&before_poll, &sleep_start);
+		if (status > 0)
+			poll_spin_hits++;
+		else {
+			sleep_time -= tv_ms_elapsed(&before_poll, &sleep_start);
+			if (sleep_time < 0)
+				sleep_time = 0;
+		}
+	}
+
+	if (!status)
+		status = epoll_wait(epoll_fd, epoll_events, global.tune.maxpollevents, sleep_time);
 	tv_update_date(wait_time, status);
+	poll_sleep_time += tv_us_elapsed(&sleep_start, &date);
 	measure_idle();
 
 	/* process polled events */
@@ -172,6 +172,10 @@ unsigned int *fd_updt = NULL;  // FD updates list
 int fd_cache_num = 0;          // number of events in the cache
 int fd_nbupdt = 0;             // number of updates in the list
 
+unsigned long long poll_spin_time = 0;  // time spent busy polling (us)
+unsigned long long poll_sleep_time = 0; // time spent waiting in the poller (us)
+unsigned int poll_spin_hits = 0;        // number of busy polls which found events
+
 /* Deletes an FD from the fdsets, and recomputes the maxfd limit.
  * The file descriptor is also closed.
  */
@@ -84,6 +84,7 @@
 #include <proto/backend.h>
 #include <proto/channel.h>
 #include <proto/checks.h>
+#include <proto/outlier.h>
 #include <proto/connection.h>
 #include <proto/fd.h>
 #include <proto/hdr_idx.h>
@@ -123,6 +124,7 @@ struct global global = {
 	.nbproc = 1,
 	.req_count = 0,
 	.logsrvs = LIST_HEAD_INIT(global.logsrvs),
+	.max_syslog_len = MAX_SYSLOG_LEN,
 #ifdef DEFAULT_MAXZLIBMEM
 	.maxzlibmem = DEFAULT_MAXZLIBMEM * 1024U * 1024U,
 #else
@@ -143,6 +145,7 @@ struct global global = {
 		.chksize = BUFSIZE,
 #ifdef USE_OPENSSL
 		.sslcachesize = SSLCACHESIZE,
+		.ssl_cache_shards = SSLCACHESHARDS,
 #ifdef DEFAULT_SSL_MAX_RECORD
 		.ssl_max_record = DEFAULT_SSL_MAX_RECORD,
 #endif
@@ -157,6 +160,13 @@ struct global global = {
 #else
 		.idle_timer = 1000, /* 1 second */
 #endif
+		.sched_weight = {
+			[TASK_CL_SESSION] = 100,
+			[TASK_CL_APPLET]  = 25,
+			[TASK_CL_CHECK]   = 25,
+			[TASK_CL_PEERS]   = 25,
+			[TASK_CL_OTHER]   = 25,
+		},
 	},
 #ifdef USE_OPENSSL
 #ifdef DEFAULT_MAXSSLCONN
@@ -391,6 +401,7 @@ void usage(char *name)
 #if defined(USE_GETADDRINFO)
 		"        -dG disables getaddrinfo() usage\n"
 #endif
+		"        -dT disables the timer wheel\n"
 		"        -dV disables SSL verify on servers side\n"
 		"        -sf/-st [pid ]* finishes/terminates old pids. Must be last arguments.\n"
 		"\n",
@@ -506,6 +517,7 @@ void init(int argc, char **argv)
 
 	chunk_init(&trash, malloc(global.tune.bufsize), global.tune.bufsize);
 	alloc_trash_buffers(global.tune.bufsize);
+	alloc_log_line(global.max_syslog_len);
 
 	/* NB: POSIX does not make it mandatory for gethostname() to NULL-terminate
 	 * the string in case of truncation, and at least FreeBSD appears not to do
@@ -562,6 +574,7 @@ void init(int argc, char **argv)
 #if defined(USE_GETADDRINFO)
 	global.tune.options |= GTUNE_USE_GAI;
 #endif
+	global.tune.options |= GTUNE_USE_TIMER_WHEEL;
 
 	pid = getpid();
 	progname = *argv;
@@ -605,6 +618,8 @@ void init(int argc, char **argv)
 			else if (*flag == 'd' && flag[1] == 'G')
 				global.tune.options &= ~GTUNE_USE_GAI;
 #endif
+			else if (*flag == 'd' && flag[1] == 'T')
+				global.tune.options &= ~GTUNE_USE_TIMER_WHEEL;
 			else if (*flag == 'd' && flag[1] == 'V')
 				global.ssl_server_verify = SSL_SERVER_VERIFY_NONE;
 			else if (*flag == 'V')
@@ -756,6 +771,9 @@ void init(int argc, char **argv)
 	if (start_checks() < 0)
 		exit(1);
 
+	if (start_outlier_detection() < 0)
+		exit(1);
+
 	if (cfg_maxconn > 0)
 		global.maxconn = cfg_maxconn;
 
@@ -983,6 +1001,9 @@ void deinit(void)
 	struct bind_conf *bind_conf, *bind_back;
 	int i;
 
+	/* must be done before the loggers are released */
+	deinit_log();
+
 	deinit_signals();
 	while (p) {
 		free(p->conf.file);
@@ -1003,6 +1024,7 @@ void deinit(void)
 		free(p->conf.uniqueid_format_string);
 		free(p->conf.uif_file);
 		free(p->lbprm.map.srv);
+		free(p->lbprm.map.build);
 
 		for (i = 0; i < HTTP_ERR_SIZE; i++)
 			chunk_destroy(&p->errmsg[i]);
@@ -1163,12 +1185,10 @@ void deinit(void)
 				task_free(s->warmup);
 			}
 
+			free(s->outlier);
+
 			free(s->id);
 			free(s->cookie);
-			free(s->check.bi);
-			free(s->check.bo);
-			free(s->agent.bi);
-			free(s->agent.bo);
 			free(s);
 			s = s_next;
 		}/* end while(s) */
@@ -1204,6 +1224,11 @@ void deinit(void)
 		free_http_req_rules(&p->http_req_rules);
 		free(p->task);
 
+		if (p->outlier.task) {
+			task_delete(p->outlier.task);
+			task_free(p->outlier.task);
+		}
+
 		pool_destroy2(p->req_cap_pool);
 		pool_destroy2(p->rsp_cap_pool);
 		pool_destroy2(p->table.pool);
@@ -1261,6 +1286,7 @@ void deinit(void)
 	pool_destroy2(pool2_capture);
 	pool_destroy2(pool2_appsess);
 	pool_destroy2(pool2_pendconn);
+	pool_destroy2(pool2_check_buf);
 	pool_destroy2(pool2_sig_handlers);
 	pool_destroy2(pool2_hdr_idx);
     
@@ -1610,6 +1636,10 @@ int main(int argc, char **argv)
 			exit(0); /* parent must leave */
 		}
 
+		/* only one process runs the checks of each backend */
+		if ((global.tune.options & GTUNE_SHARE_CHK_RESULTS) && start_check_sync() < 0)
+			exit(1);
+
 		/* if we're NOT in QUIET mode, we should now close the 3 first FDs to ensure
 		 * that we can detach from the TTY. We MUST NOT do it in other cases since
 		 * it would have already be done, and 0-2 would have been affected to listening
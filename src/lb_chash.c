@@ -248,12 +248,28 @@ static void chash_update_server_weight(struct server *srv)
 	srv->prev_eweight = srv->eweight;
 }
 
+/* Returns non-zero if server <s> may be assigned one more connection when
+ * "hash-balance-factor" is set, which is when its number of connections per
+ * unit of weight remains below the factor times the average of the backend.
+ * The backend's connections include the one being balanced, so that at least
+ * one server is always eligible.
+ */
+static inline int chash_server_is_eligible(struct server *s)
+{
+	struct proxy *p = s->proxy;
+
+	return (unsigned long long)s->served * p->lbprm.tot_weight * 100 <
+	       (unsigned long long)p->beconn * p->lbprm.hash_balance_factor * s->eweight;
+}
+
 /*
  * This function returns the running server from the CHASH tree, which is at
  * the closest distance from the value of <hash>. Doing so ensures that even
  * with a well imbalanced hash, if some servers are close to each other, they
- * will still both receive traffic. If any server is found, it will be returned.
- * If no valid server is found, NULL is returned.
+ * will still both receive traffic. When "hash-balance-factor" is set and this
+ * server is too loaded, the next eligible server on the ring is returned
+ * instead. If any server is found, it will be returned. If no valid server is
+ * found, NULL is returned.
  */
 struct server *chash_get_server_hash(struct proxy *p, unsigned int hash)
 {
@@ -284,8 +300,6 @@ struct server *chash_get_server_hash(struct proxy *p, unsigned int hash)
 
 	nsrv = eb32_entry(next, struct tree_occ, node)->server;
 	psrv = eb32_entry(prev, struct tree_occ, node)->server;
-	if (nsrv == psrv)
-		return nsrv;
 
 	/* OK we're located between two distinct servers, let's
 	 * compare distances between hash and the two servers
@@ -294,7 +308,32 @@ struct server *chash_get_server_hash(struct proxy *p, unsigned int hash)
 	dp = hash - prev->key;
 	dn = next->key - hash;
 
-	return (dp <= dn) ? psrv : nsrv;
+	if (nsrv != psrv && dp <= dn) {
+		next = prev;
+		nsrv = psrv;
+	}
+
+	if (!p->lbprm.hash_balance_factor || chash_server_is_eligible(nsrv))
+		return nsrv;
+
+	/* The server is too loaded, walk the ring forward to find the first
+	 * one which is not. There is always one since the factor is above
+	 * 100%, but we never loop more than once over the ring anyway.
+	 */
+	psrv = nsrv;
+	prev = next;
+	while (1) {
+		next = eb32_next(next);
+		if (!next)
+			next = eb32_first(root);
+		if (next == prev)
+			return psrv;
+		nsrv = eb32_entry(next, struct tree_occ, node)->server;
+		if (nsrv != psrv && chash_server_is_eligible(nsrv))
+			break;
+	}
+	psrv->counters.hash_spills++;
+	return nsrv;
 }
 
 /* Return next server from the CHASH tree in backend <p>. If the tree is empty,
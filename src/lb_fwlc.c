@@ -13,6 +13,8 @@
 #include <common/compat.h>
 #include <common/config.h>
 #include <common/debug.h>
+#include <common/ticks.h>
+#include <common/time.h>
 #include <eb32tree.h>
 
 #include <types/global.h>
@@ -20,6 +22,7 @@
 
 #include <proto/backend.h>
 #include <proto/queue.h>
+#include <proto/server.h>
 
 
 /* Remove a server from a tree. It must have previously been dequeued. This
@@ -39,11 +42,25 @@ static inline void fwlc_dequeue_srv(struct server *s)
 
 /* Queue a server in its associated tree, assuming the weight is >0.
  * Servers are sorted by #conns/weight. To ensure maximum accuracy,
- * we use #conns*SRV_EWGHT_MAX/eweight as the sorting key.
+ * we use #conns*SRV_EWGHT_MAX/eweight as the sorting key. With the
+ * "leastlatency" algorithm, servers are sorted by the expected time
+ * to serve one more request, which is the number of requests they
+ * will have to serve times the average time they take to process one.
+ * A small constant is added to the average so that a fast server still
+ * sees its connections count. The averages are decayed to the current date.
  */
 static inline void fwlc_queue_srv(struct server *s)
 {
-	s->lb_node.key = s->served * SRV_EWGHT_MAX / s->eweight;
+	if ((s->proxy->lbprm.algo & BE_LB_ALGO) == BE_LB_ALGO_LL) {
+		unsigned int avg = srv_ewma_now(s, s->ewma_ctime) + srv_ewma_now(s, s->ewma_rtime);
+		unsigned long long key;
+
+		key = (unsigned long long)(s->served + 1) * (avg + SRV_EWMA_SCALE) *
+			SRV_EWGHT_MAX / s->eweight / SRV_EWMA_SCALE;
+		s->lb_node.key = key > ~0U ? ~0U : key;
+	}
+	else
+		s->lb_node.key = s->served * SRV_EWGHT_MAX / s->eweight;
 	eb32_insert(s->lb_tree, &s->lb_node);
 }
 
@@ -59,6 +76,25 @@ static void fwlc_srv_reposition(struct server *s)
 	fwlc_queue_srv(s);
 }
 
+/* With the "leastlatency" algorithm, the averages of servers which do not
+ * receive any traffic only decay with time, so their position in the trees
+ * of proxy <p> must be refreshed. This is done every 1/16 of the half-life,
+ * which is the granularity of the decay.
+ */
+static void fwlc_refresh_latency(struct proxy *p)
+{
+	struct server *srv;
+
+	if (!tick_is_expired(p->lbprm.fwlc.refresh, now_ms))
+		return;
+
+	p->lbprm.fwlc.refresh = tick_add(now_ms, SRV_EWMA_HALFLIFE / 16);
+	for (srv = p->srv; srv; srv = srv->next) {
+		if (srv->ewma_ctime || srv->ewma_rtime)
+			fwlc_srv_reposition(srv);
+	}
+}
+
 /* This function updates the server trees according to server <srv>'s new
  * state. It should be called when server <srv>'s status changes to down.
  * It is not important whether the server was already down or not. It is not
@@ -228,8 +264,8 @@ static void fwlc_update_server_weight(struct server *srv)
 }
 
 /* This function is responsible for building the trees in case of fast
- * weighted least-conns. It also sets p->lbprm.wdiv to the eweight to
- * uweight ratio. Both active and backup groups are initialized.
+ * weighted least-conns or least latency. It also sets p->lbprm.wdiv to the
+ * eweight to uweight ratio. Both active and backup groups are initialized.
  */
 void fwlc_init_server_tree(struct proxy *p)
 {
@@ -241,6 +277,8 @@ void fwlc_init_server_tree(struct proxy *p)
 	p->lbprm.update_server_eweight  = fwlc_update_server_weight;
 	p->lbprm.server_take_conn = fwlc_srv_reposition;
 	p->lbprm.server_drop_conn = fwlc_srv_reposition;
+	if ((p->lbprm.algo & BE_LB_ALGO) == BE_LB_ALGO_LL)
+		p->lbprm.server_update_latency = fwlc_srv_reposition;
 
 	p->lbprm.wdiv = BE_WEIGHT_SCALE;
 	for (srv = p->srv; srv; srv = srv->next) {
@@ -254,6 +292,7 @@ void fwlc_init_server_tree(struct proxy *p)
 
 	p->lbprm.fwlc.act = init_head;
 	p->lbprm.fwlc.bck = init_head;
+	p->lbprm.fwlc.refresh = tick_add(now_ms, SRV_EWMA_HALFLIFE / 16);
 
 	/* queue active and backup servers in two distinct groups */
 	for (srv = p->srv; srv; srv = srv->next) {
@@ -274,6 +313,9 @@ struct server *fwlc_get_next_server(struct proxy *p, struct server *srvtoavoid)
 
 	srv = avoided = NULL;
 
+	if ((p->lbprm.algo & BE_LB_ALGO) == BE_LB_ALGO_LL)
+		fwlc_refresh_latency(p);
+
 	if (p->srv_act)
 		node = eb32_first(&p->lbprm.fwlc.act);
 	else if (p->lbprm.fbck)
@@ -0,0 +1,245 @@
+/*
+ * Maglev hash table load balancing algorithm.
+ *
+ * Copyright 2000-2014 Willy Tarreau <w@1wt.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * This implements the lookup table used by Google's Maglev network load
+ * balancer. Each server
+ * derives an offset and a skip from its ID, which define its own permutation
+ * of the table's positions. Servers then take turns to claim the next free
+ * position in their permutation until the table is full. Since the table size
+ * is prime, each permutation covers the whole table. Lookups only cost one
+ * modulo, and when a server goes up or down, most other entries are kept.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/compat.h>
+#include <common/config.h>
+#include <common/debug.h>
+#include <common/standard.h>
+
+#include <types/global.h>
+#include <types/server.h>
+
+#include <proto/backend.h>
+#include <proto/lb_maglev.h>
+#include <proto/queue.h>
+
+/* This function is called after any change of server <srv>'s state or
+ * effective weight. It only updates the backend's counters and marks the
+ * table for a recalculation, which will be performed upon next lookup.
+ */
+static void maglev_update_server(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	if (srv->state == srv->prev_state &&
+	    srv->eweight == srv->prev_eweight)
+		return;
+
+	recount_servers(p);
+	update_backend_weight(p);
+	p->lbprm.maglev.state |= LB_MAGLEV_RECALC;
+
+	srv->prev_state = srv->state;
+	srv->prev_eweight = srv->eweight;
+}
+
+/* Returns non-zero if <n> is a prime number */
+static int maglev_is_prime(unsigned int n)
+{
+	unsigned int d;
+
+	if (n < 2)
+		return 0;
+	for (d = 2; d * d <= n; d++)
+		if (n % d == 0)
+			return 0;
+	return 1;
+}
+
+/* This function rebuilds the lookup table of proxy <p>. It relies on the
+ * counters set by recount_servers(), and uses the active servers when there
+ * are some, otherwise the first backup server, or all backup servers if
+ * "option allbackups" is set. Each server claims one entry per round for
+ * each multiple of the largest weight accumulated in its credit, so that it
+ * gets a number of entries proportional to its weight.
+ */
+void maglev_recalc_table(struct proxy *p)
+{
+	struct lb_maglev *mg = &p->lbprm.maglev;
+	struct server *srv;
+	unsigned int size = mg->size;
+	unsigned int filled;
+	int nb, i, flag, wmax;
+
+	mg->state &= ~LB_MAGLEV_RECALC;
+
+	nb = wmax = 0;
+	if (!p->srv_act && p->lbprm.fbck) {
+		mg->srv[nb++] = p->lbprm.fbck;
+		wmax = p->lbprm.fbck->eweight;
+	}
+	else {
+		flag = p->srv_act ? 0 : SRV_BACKUP;
+		for (srv = p->srv; srv; srv = srv->next) {
+			if ((srv->state & SRV_BACKUP) != flag ||
+			    !srv_is_usable(srv->state, srv->eweight))
+				continue;
+			mg->srv[nb++] = srv;
+			if (srv->eweight > wmax)
+				wmax = srv->eweight;
+		}
+	}
+
+	if (nb <= 1) {
+		srv = nb ? mg->srv[0] : NULL;
+		for (filled = 0; filled < size; filled++)
+			mg->table[filled] = srv;
+		return;
+	}
+
+	memset(mg->table, 0, size * sizeof(*mg->table));
+	for (i = 0; i < nb; i++) {
+		mg->pos[i] = full_hash(mg->srv[i]->puid) % size;
+		mg->credit[i] = 0;
+	}
+
+	filled = 0;
+	while (1) {
+		for (i = 0; i < nb; i++) {
+			unsigned int skip;
+
+			mg->credit[i] += mg->srv[i]->eweight;
+			if (mg->credit[i] < wmax)
+				continue;
+			mg->credit[i] -= wmax;
+
+			/* the skip is not stored since it's cheap to compute */
+			skip = full_hash(full_hash(mg->srv[i]->puid)) % (size - 1) + 1;
+			while (mg->table[mg->pos[i]]) {
+				mg->pos[i] += skip;
+				if (mg->pos[i] >= size)
+					mg->pos[i] -= size;
+			}
+			mg->table[mg->pos[i]] = mg->srv[i];
+			if (++filled == size)
+				return;
+		}
+	}
+}
+
+/* This function returns the server from the lookup table for <hash>. The
+ * table may be recomputed if required before being looked up. If no valid
+ * server is found, NULL is returned.
+ */
+struct server *maglev_get_server_hash(struct proxy *p, unsigned int hash)
+{
+	if (p->lbprm.tot_weight == 0)
+		return NULL;
+
+	if (p->lbprm.maglev.state & LB_MAGLEV_RECALC)
+		maglev_recalc_table(p);
+
+	return p->lbprm.maglev.table[hash % p->lbprm.maglev.size];
+}
+
+/* This function is used when the hash input is not available. It scans the
+ * table in round robin order, which respects the servers' weights, and
+ * returns the first server with free connection slots which is not
+ * <srvtoavoid>. If none is found, <srvtoavoid> is returned if it was seen,
+ * otherwise NULL.
+ */
+struct server *maglev_get_next_server(struct proxy *p, struct server *srvtoavoid)
+{
+	struct lb_maglev *mg = &p->lbprm.maglev;
+	struct server *srv, *avoided;
+	unsigned int idx;
+
+	if (p->lbprm.tot_weight == 0)
+		return NULL;
+
+	if (mg->state & LB_MAGLEV_RECALC)
+		maglev_recalc_table(p);
+
+	if (mg->rr_idx >= mg->size)
+		mg->rr_idx = 0;
+	idx = mg->rr_idx;
+
+	avoided = NULL;
+	do {
+		srv = mg->table[idx++];
+		if (idx == mg->size)
+			idx = 0;
+		if (!srv->maxconn || (!srv->nbpend && srv->served < srv_dynamic_maxconn(srv))) {
+			if (srv != srvtoavoid) {
+				mg->rr_idx = idx;
+				return srv;
+			}
+			avoided = srv;
+		}
+	} while (idx != mg->rr_idx);
+
+	return avoided;
+}
+
+/* This function allocates the lookup table for proxy <p> and fills it. The
+ * table size is the first prime number above LB_MAGLEV_RATIO times the number
+ * of servers, and at least LB_MAGLEV_MIN_SIZE. It also sets p->lbprm.wdiv to
+ * the eweight to uweight ratio. It should be called only once per proxy, at
+ * config time.
+ */
+void maglev_init_server_table(struct proxy *p)
+{
+	struct lb_maglev *mg = &p->lbprm.maglev;
+	struct server *srv;
+	unsigned int size;
+	int nb;
+
+	p->lbprm.set_server_status_up   = maglev_update_server;
+	p->lbprm.set_server_status_down = maglev_update_server;
+	p->lbprm.update_server_eweight  = maglev_update_server;
+
+	p->lbprm.wdiv = BE_WEIGHT_SCALE;
+	nb = 0;
+	for (srv = p->srv; srv; srv = srv->next) {
+		srv->eweight = (srv->uweight * p->lbprm.wdiv + p->lbprm.wmult - 1) / p->lbprm.wmult;
+		srv->prev_eweight = srv->eweight;
+		srv->prev_state = srv->state;
+		nb++;
+	}
+
+	size = nb * LB_MAGLEV_RATIO;
+	if (size < LB_MAGLEV_MIN_SIZE)
+		size = LB_MAGLEV_MIN_SIZE;
+	while (!maglev_is_prime(size))
+		size++;
+
+	if (!nb)
+		nb = 1;
+
+	mg->size = size;
+	mg->table = (struct server **)calloc(size, sizeof(struct server *));
+	mg->srv = (struct server **)calloc(nb, sizeof(struct server *));
+	mg->pos = (unsigned int *)calloc(nb, sizeof(unsigned int));
+	mg->credit = (int *)calloc(nb, sizeof(int));
+
+	recount_servers(p);
+	update_backend_weight(p);
+	maglev_recalc_table(p);
+}
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
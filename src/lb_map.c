@@ -14,6 +14,7 @@
 #include <common/config.h>
 #include <common/debug.h>
 #include <eb32tree.h>
+#include <eb64tree.h>
 
 #include <types/global.h>
 #include <types/server.h>
@@ -65,15 +66,56 @@ static void map_set_server_status_up(struct server *srv)
 	srv->prev_eweight = srv->eweight;
 }
 
+/* Inserts map build entry <b> into the scores tree <root>. The key makes the
+ * highest score come last, and the first declared server among equal scores.
+ */
+static inline void map_queue_score(struct eb_root *root, struct lb_map_build *b)
+{
+	b->by_score.key = ((unsigned long long)((unsigned int)b->score + 0x80000000U) << 32) + ~b->pos;
+	eb64_insert(root, &b->by_score);
+}
+
+/* Queues map build entry <b> into the steps tree <root> at the step where its
+ * score will increase next, which is the first step <o> where (o+1)*w/tot
+ * reaches one more than the number of times the server was due. Nothing is
+ * queued once the server was due <w> times, which happens at the last step.
+ */
+static inline void map_queue_step(struct eb_root *root, struct lb_map_build *b, int tot)
+{
+	unsigned int w = b->srv->eweight;
+
+	if (b->due >= w)
+		return;
+	b->by_step.key = ((unsigned long long)(b->due + 1) * tot + w - 1) / w - 1;
+	eb32_insert(root, &b->by_step);
+}
+
 /* This function recomputes the server map for proxy px. It relies on
  * px->lbprm.tot_wact, tot_wbck, tot_used, tot_weight, so it must be
  * called after recount_servers(). It also expects px->lbprm.map.srv
- * to be allocated with the largest size needed. It updates tot_weight.
+ * and px->lbprm.map.build to be allocated with the largest size needed.
+ *
+ * At each step, each server gets its weight added to its score, and the one
+ * with the highest score is picked and gets the total weight deducted. This
+ * gives priority to the first server, which means that it will respect the
+ * declaration order for equivalent weights, and that whatever the weights,
+ * the first server called will always be the first declared. Since only the
+ * integral part of the score divided by the total weight is compared, a
+ * server's score only changes <weight> times over the whole map, at steps
+ * which are known in advance. Servers are thus kept in a tree ordered by
+ * score, and the steps where scores change are kept in another tree, which
+ * builds the map in O(tot_weight*log(servers)) instead of visiting all
+ * servers at each step. The resulting map is the same, which matters for
+ * hashing since all load balancers must agree on it.
  */
 void recalc_server_map(struct proxy *px)
 {
-	int o, tot, flag;
-	struct server *cur, *best;
+	struct eb_root scores = EB_ROOT;
+	struct eb_root steps = EB_ROOT;
+	struct lb_map_build *b;
+	struct eb32_node *node;
+	struct server *cur;
+	int o, tot, flag, nb;
 
 	switch (px->lbprm.tot_used) {
 	case 0:	/* no server */
@@ -84,50 +126,49 @@ void recalc_server_map(struct proxy *px)
 		break;
 	}
 
-	/* here we *know* that we have some servers */
+	/* here we *know* that we have some servers. Only the first backup
+	 * server is used when there is no active server unless all backup
+	 * servers have to be used.
+	 */
 	if (px->srv_act)
 		flag = SRV_RUNNING;
 	else
 		flag = SRV_RUNNING | SRV_BACKUP;
 
-	/* this algorithm gives priority to the first server, which means that
-	 * it will respect the declaration order for equivalent weights, and
-	 * that whatever the weights, the first server called will always be
-	 * the first declared. This is an important asumption for the backup
-	 * case, where we want the first server only.
-	 */
-	for (cur = px->srv; cur; cur = cur->next)
-		cur->wscore = 0;
+	nb = 0;
+	for (cur = px->srv; cur; cur = cur->next) {
+		if (!cur->eweight ||
+		    flag != (cur->state & (SRV_RUNNING | SRV_GOINGDOWN | SRV_BACKUP)))
+			continue;
+		if (!px->srv_act && px->lbprm.fbck && cur != px->lbprm.fbck)
+			continue;
+
+		b = &px->lbprm.map.build[nb];
+		b->srv = cur;
+		b->pos = nb++;
+		b->due = 0;
+		b->score = 0;
+		map_queue_score(&scores, b);
+		map_queue_step(&steps, b, tot);
+	}
 
 	for (o = 0; o < tot; o++) {
-		int max = 0;
-		best = NULL;
-		for (cur = px->srv; cur; cur = cur->next) {
-			if (cur->eweight &&
-			    flag == (cur->state &
-				     (SRV_RUNNING | SRV_GOINGDOWN | SRV_BACKUP))) {
-				int v;
-
-				/* If we are forced to return only one server, we don't want to
-				 * go further, because we would return the wrong one due to
-				 * divide overflow.
-				 */
-				if (tot == 1) {
-					best = cur;
-					/* note that best->wscore will be wrong but we don't care */
-					break;
-				}
-
-				cur->wscore += cur->eweight;
-				v = (cur->wscore + tot) / tot; /* result between 0 and 3 */
-				if (best == NULL || v > max) {
-					max = v;
-					best = cur;
-				}
-			}
+		/* raise the scores of the servers which are due once more */
+		while ((node = eb32_first(&steps)) && node->key <= o) {
+			b = container_of(node, struct lb_map_build, by_step);
+			eb32_delete(&b->by_step);
+			eb64_delete(&b->by_score);
+			b->due++;
+			b->score++;
+			map_queue_score(&scores, b);
+			map_queue_step(&steps, b, tot);
 		}
-		px->lbprm.map.srv[o] = best;
-		best->wscore -= tot;
+
+		b = container_of(eb64_last(&scores), struct lb_map_build, by_score);
+		px->lbprm.map.srv[o] = b->srv;
+		eb64_delete(&b->by_score);
+		b->score--;
+		map_queue_score(&scores, b);
 	}
 	px->lbprm.map.state &= ~LB_MAP_RECALC;
 }
@@ -141,7 +182,7 @@ void init_server_map(struct proxy *p)
 {
 	struct server *srv;
 	int pgcd;
-	int act, bck;
+	int act, bck, nb;
 
 	p->lbprm.set_server_status_up   = map_set_server_status_up;
 	p->lbprm.set_server_status_down = map_set_server_status_down;
@@ -197,6 +238,12 @@ void init_server_map(struct proxy *p)
 		act = 1;
 
 	p->lbprm.map.srv = (struct server **)calloc(act, sizeof(struct server *));
+
+	/* the map is built using one entry per server */
+	nb = 0;
+	for (srv = p->srv; srv; srv = srv->next)
+		nb++;
+	p->lbprm.map.build = (struct lb_map_build *)calloc(nb ? nb : 1, sizeof(struct lb_map_build));
 	/* recounts servers and their weights */
 	p->lbprm.map.state = LB_MAP_RECALC;
 	recount_servers(p);
@@ -0,0 +1,218 @@
+/*
+ * "Power of two choices" load balancing algorithm.
+ *
+ * Copyright 2000-2014 Willy Tarreau <w@1wt.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Two different servers are drawn at random and the one with the fewest
+ * connections per unit of weight is used. Contrary to leastconn, nothing has
+ * to be updated when a connection is taken or released, so a pick only costs
+ * two random indexes and two loads to compare, which is cheaper than the tree
+ * operations of leastconn (see tests/test-p2c.c). Since the decision does not
+ * rely on an exact view of the servers' load, it also avoids sending all new
+ * connections to the same server when it is shared between several processes
+ * or load balancers.
+ */
+
+#include <stdlib.h>
+
+#include <common/compat.h>
+#include <common/config.h>
+#include <common/debug.h>
+
+#include <types/global.h>
+#include <types/server.h>
+
+#include <proto/backend.h>
+#include <proto/lb_p2c.h>
+#include <proto/queue.h>
+
+/* state of the pseudo-random generator used to draw servers, never zero */
+static unsigned long long p2c_rnd;
+
+/* Returns 64 pseudo-random bits using Marsaglia's xorshift64. It is much
+ * cheaper than random() which takes a lock, and good enough to draw servers.
+ */
+static inline unsigned long long p2c_random(void)
+{
+	p2c_rnd ^= p2c_rnd << 13;
+	p2c_rnd ^= p2c_rnd >> 7;
+	p2c_rnd ^= p2c_rnd << 17;
+	return p2c_rnd;
+}
+
+/* Returns a number between 0 and <nb>-1 from the 32 random bits <r> */
+static inline int p2c_index(unsigned int r, int nb)
+{
+	return ((unsigned long long)r * nb) >> 32;
+}
+
+/* This function is called after any change of server <srv>'s state or
+ * effective weight. It only updates the backend's counters and marks the
+ * server array for a recalculation, which will be performed upon next
+ * lookup, so that multiple changes in a row only cost one recalculation.
+ */
+static void p2c_update_server(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	if (srv->state == srv->prev_state &&
+	    srv->eweight == srv->prev_eweight)
+		return;
+
+	recount_servers(p);
+	update_backend_weight(p);
+	p->lbprm.p2c.state |= LB_P2C_RECALC;
+
+	srv->prev_state = srv->state;
+	srv->prev_eweight = srv->eweight;
+}
+
+/* This function rebuilds the array of servers used for LB for proxy <p>. It
+ * relies on the counters set by recount_servers(), and follows the same rules
+ * as the other algorithms : active servers are used when there are some, then
+ * the first backup server only unless "option allbackups" is set. The array
+ * must already have been allocated with room for all servers.
+ */
+void p2c_recalc_server_array(struct proxy *p)
+{
+	struct server *srv;
+	int nb = 0;
+	int flag;
+
+	p->lbprm.p2c.state &= ~LB_P2C_RECALC;
+
+	if (!p->srv_act && p->lbprm.fbck) {
+		p->lbprm.p2c.srv[0] = p->lbprm.fbck;
+		p->lbprm.p2c.nbsrv = 1;
+		return;
+	}
+
+	/* here we know that we want either all active or all backup servers */
+	flag = p->srv_act ? 0 : SRV_BACKUP;
+	for (srv = p->srv; srv; srv = srv->next) {
+		if ((srv->state & SRV_BACKUP) != flag ||
+		    !srv_is_usable(srv->state, srv->eweight))
+			continue;
+		p->lbprm.p2c.srv[nb++] = srv;
+	}
+	p->lbprm.p2c.nbsrv = nb;
+}
+
+/* returns non-zero if server <s> may accept one more connection */
+static inline int p2c_srv_has_room(const struct server *s)
+{
+	return !s->maxconn || (!s->nbpend && s->served < srv_dynamic_maxconn(s));
+}
+
+/* Returns non-zero if server <a> has less connections per unit of weight than
+ * server <b>. Loads are cross-multiplied by the weights to avoid divisions.
+ */
+static inline int p2c_srv_less_loaded(const struct server *a, const struct server *b)
+{
+	return (unsigned long long)(a->served + a->nbpend + 1) * b->eweight <
+	       (unsigned long long)(b->served + b->nbpend + 1) * a->eweight;
+}
+
+/* Return the next server to use for backend <p>, or NULL if there is none.
+ * Two different servers are drawn uniformly from a single random number, and
+ * the least loaded one is returned, unless it is saturated or equal to
+ * <srvtoavoid>. If none of them is usable, all servers
+ * are scanned from a random place so that the first non-saturated one is
+ * returned, and <srvtoavoid> is only returned as a last resort.
+ */
+struct server *p2c_get_next_server(struct proxy *p, struct server *srvtoavoid)
+{
+	struct server *s1, *s2, *avoided;
+	unsigned long long r;
+	int nb, idx;
+
+	if (p->lbprm.p2c.state & LB_P2C_RECALC)
+		p2c_recalc_server_array(p);
+
+	nb = p->lbprm.p2c.nbsrv;
+	if (!nb)
+		return NULL;
+
+	/* the second index skips the first one so that both servers differ */
+	r = p2c_random();
+	idx = p2c_index(r, nb);
+	s1 = s2 = p->lbprm.p2c.srv[idx];
+	if (nb > 1) {
+		int idx2 = p2c_index(r >> 32, nb - 1);
+
+		s2 = p->lbprm.p2c.srv[idx2 + (idx2 >= idx)];
+	}
+
+	if (!p2c_srv_has_room(s1) || s1 == srvtoavoid ||
+	    (s2 != srvtoavoid && p2c_srv_has_room(s2) &&
+	     p2c_srv_less_loaded(s2, s1)))
+		s1 = s2;
+
+	if (s1 != srvtoavoid && p2c_srv_has_room(s1))
+		return s1;
+
+	/* both choices are saturated or must be avoided */
+	avoided = NULL;
+	idx = p2c_index(p2c_random(), nb);
+	while (nb--) {
+		s1 = p->lbprm.p2c.srv[idx];
+		if (p2c_srv_has_room(s1)) {
+			if (s1 != srvtoavoid)
+				return s1;
+			avoided = s1;
+		}
+		if (++idx == p->lbprm.p2c.nbsrv)
+			idx = 0;
+	}
+	return avoided;
+}
+
+/* This function is responsible for allocating the server array for the power
+ * of two choices algorithm and for filling it. It also sets p->lbprm.wdiv to
+ * the eweight to uweight ratio, and seeds the random generator. It should be called only once per proxy, at
+ * config time.
+ */
+void p2c_init_server_array(struct proxy *p)
+{
+	struct server *srv;
+	int nb;
+
+	p->lbprm.set_server_status_up   = p2c_update_server;
+	p->lbprm.set_server_status_down = p2c_update_server;
+	p->lbprm.update_server_eweight  = p2c_update_server;
+
+	p->lbprm.wdiv = BE_WEIGHT_SCALE;
+	nb = 0;
+	for (srv = p->srv; srv; srv = srv->next) {
+		srv->eweight = (srv->uweight * p->lbprm.wdiv + p->lbprm.wmult - 1) / p->lbprm.wmult;
+		srv->prev_eweight = srv->eweight;
+		srv->prev_state = srv->state;
+		nb++;
+	}
+
+	if (!nb)
+		nb = 1;
+
+	p->lbprm.p2c.srv = (struct server **)calloc(nb, sizeof(struct server *));
+
+	/* seeded from random() which haproxy initializes at boot */
+	while (!p2c_rnd)
+		p2c_rnd = ((unsigned long long)random() << 32) ^ random();
+
+	recount_servers(p);
+	update_backend_weight(p);
+	p2c_recalc_server_array(p);
+}
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -10,6 +10,7 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <ctype.h>
 #include <fcntl.h>
 #include <stdarg.h>
@@ -21,7 +22,9 @@
 #include <unistd.h>
 #include <errno.h>
 
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #include <common/config.h>
 #include <common/compat.h>
@@ -31,10 +34,12 @@
 #include <types/global.h>
 #include <types/log.h>
 
+#include <proto/fd.h>
 #include <proto/frontend.h>
 #include <proto/log.h>
 #include <proto/sample.h>
 #include <proto/stream_interface.h>
+#include <proto/task.h>
 #ifdef USE_OPENSSL
 #include <proto/ssl_sock.h>
 #endif
@@ -144,9 +149,28 @@ char default_tcp_log_format[] = "%ci:%cp [%t] %ft %b/%s %Tw/%Tc/%Tt %B %ts %ac/%
 char *log_format = NULL;
 
 /* This is a global syslog line, common to all outgoing messages. It begins
- * with the syslog tag and the date that are updated by update_log_hdr().
+ * with the syslog tag and the date that are updated by update_log_hdr(). Its
+ * size is global.max_syslog_len, the largest length of all loggers.
  */
-static char logline[MAX_SYSLOG_LEN];
+static char *logline = NULL;
+static char *logline_hdr_end = NULL; /* end of the header, NULL if not built */
+
+/* Binary records are built in their own buffer of the same size so that they
+ * never overwrite the cached header of the syslog line above.
+ */
+static char *logbin = NULL;
+
+/* (re)allocates the log line and binary record buffers to <len> bytes.
+ * Returns 0 in case of failure. It is possible to call this function multiple
+ * times if the size changes.
+ */
+int alloc_log_line(int len)
+{
+	logline = (char *)realloc(logline, len);
+	logbin = (char *)realloc(logbin, len);
+	logline_hdr_end = NULL;
+	return logline != NULL && logbin != NULL;
+}
 
 struct logformat_var_args {
 	char *name;
@@ -318,16 +342,55 @@ void add_to_logformat_list(char *start, char *end, int type, struct list *list_f
 {
 	char *str;
 
+	struct logformat_node *node, *last = NULL;
+
+	/* Literal texts and the separators which follow them are merged into
+	 * a single text node so that they are emitted at once. A separator
+	 * following a text always results in a space, even if the text ends
+	 * with a space, and consecutive separators result in a single space.
+	 * LOG_OPT_SEPARATOR tells whether the text ends with a separator.
+	 */
+	if (!LIST_ISEMPTY(list_format)) {
+		last = LIST_PREV(list_format, struct logformat_node *, list);
+		if (last->type != LOG_FMT_TEXT)
+			last = NULL;
+	}
+
 	if (type == LF_TEXT) { /* type text */
-		struct logformat_node *node = calloc(1, sizeof(struct logformat_node));
+		if (last) {
+			str = realloc(last->arg, last->arg_len + (end - start) + 1);
+			if (str) {
+				memcpy(str + last->arg_len, start, end - start);
+				last->arg_len += end - start;
+				str[last->arg_len] = '\0';
+				last->arg = str;
+				last->options &= ~LOG_OPT_SEPARATOR;
+				return;
+			}
+		}
+		node = calloc(1, sizeof(struct logformat_node));
 		str = calloc(end - start + 1, 1);
 		strncpy(str, start, end - start);
 		str[end - start] = '\0';
 		node->arg = str;
+		node->arg_len = end - start;
 		node->type = LOG_FMT_TEXT; // type string
 		LIST_ADDQ(list_format, &node->list);
 	} else if (type == LF_SEPARATOR) {
-		struct logformat_node *node = calloc(1, sizeof(struct logformat_node));
+		if (last) {
+			/* consecutive separators are emitted only once */
+			if (last->options & LOG_OPT_SEPARATOR)
+				return;
+			str = realloc(last->arg, last->arg_len + 2);
+			if (str) {
+				str[last->arg_len++] = ' ';
+				str[last->arg_len] = '\0';
+				last->arg = str;
+				last->options |= LOG_OPT_SEPARATOR;
+				return;
+			}
+		}
+		node = calloc(1, sizeof(struct logformat_node));
 		node->type = LOG_FMT_SEPARATOR;
 		LIST_ADDQ(list_format, &node->list);
 	}
@@ -688,6 +751,11 @@ char *lf_ip(char *dst, struct sockaddr *sockaddr, size_t size, struct logformat_
 		if (iret < 0 || iret > size)
 			return NULL;
 		ret += iret;
+	} else if (sockaddr->sa_family == AF_INET) {
+		iret = ipv4_to_str(&((struct sockaddr_in *)sockaddr)->sin_addr, pn) - pn;
+		ret = lf_text_len(dst, pn, iret, size, node);
+		if (ret == NULL)
+			return NULL;
 	} else {
 		addr_to_str((struct sockaddr_storage *)sockaddr, pn, sizeof(pn));
 		ret = lf_text(dst, pn, size, node);
@@ -720,15 +788,82 @@ char *lf_port(char *dst, struct sockaddr *sockaddr, size_t size, struct logforma
 	return ret;
 }
 
+/* The dates emitted in logs are cached and only rebuilt when the second
+ * changes, because converting a date is expensive (localtime_r() takes a lock
+ * and checks the timezone). <sec> is the date of the last conversion, and <str>
+ * holds the date's representation, which is <len> characters long.
+ */
+struct lf_date_cache {
+	time_t sec;
+	int len;
+	char str[32];
+};
+
+static struct lf_date_cache lf_date_local; /* %t, without milliseconds */
+static struct lf_date_cache lf_date_gmt;   /* %T */
+static struct lf_date_cache lf_date_tz;    /* %Tl */
+
+/* Writes the date <tv> into <dst> of size <size> in the format corresponding to
+ * log variable type <type> (LOG_FMT_DATE, LOG_FMT_DATEGMT or LOG_FMT_DATELOCAL).
+ * Returns a pointer to the trailing zero, or NULL if there is not enough space.
+ */
+static char *lf_date(char *dst, int type, const struct timeval *tv, size_t size)
+{
+	struct lf_date_cache *cache;
+	struct tm tm;
+	char *ret;
+
+	switch (type) {
+	case LOG_FMT_DATE:      cache = &lf_date_local; break;
+	case LOG_FMT_DATEGMT:   cache = &lf_date_gmt; break;
+	default:                cache = &lf_date_tz; break;
+	}
+
+	if (unlikely(cache->sec != tv->tv_sec || !cache->len)) {
+		switch (type) {
+		case LOG_FMT_DATE:
+			get_localtime(tv->tv_sec, &tm);
+			ret = date2str_log(cache->str, &tm, (struct timeval *)tv, sizeof(cache->str));
+			if (ret)
+				ret -= 4; /* strip milliseconds */
+			break;
+		case LOG_FMT_DATEGMT:
+			get_gmtime(tv->tv_sec, &tm);
+			ret = gmt2str_log(cache->str, &tm, sizeof(cache->str));
+			break;
+		default:
+			get_localtime(tv->tv_sec, &tm);
+			ret = localdate2str_log(cache->str, &tm, sizeof(cache->str));
+			break;
+		}
+		if (!ret)
+			return NULL;
+		cache->sec = tv->tv_sec;
+		cache->len = ret - cache->str;
+	}
+
+	if (cache->len + (type == LOG_FMT_DATE ? 4 : 0) >= size)
+		return NULL;
+
+	memcpy(dst, cache->str, cache->len);
+	dst += cache->len;
+	if (type == LOG_FMT_DATE) {
+		*dst++ = '.';
+		utoa_pad((unsigned int)(tv->tv_usec / 1000), dst, 4);
+		dst += 3;
+	}
+	*dst = '\0';
+	return dst;
+}
+
 /* Re-generate the syslog header at the beginning of logline once a second and
  * return the pointer to the first character after the header.
  */
 static char *update_log_hdr()
 {
 	static long tvsec;
-	static char *dataptr = NULL; /* backup of last end of header, NULL first time */
 
-	if (unlikely(date.tv_sec != tvsec || dataptr == NULL)) {
+	if (unlikely(date.tv_sec != tvsec || logline_hdr_end == NULL)) {
 		/* this string is rebuild only once a second */
 		struct tm tm;
 		int hdr_len;
@@ -736,7 +871,7 @@ static char *update_log_hdr()
 		tvsec = date.tv_sec;
 		get_localtime(tvsec, &tm);
 
-		hdr_len = snprintf(logline, MAX_SYSLOG_LEN,
+		hdr_len = snprintf(logline, global.max_syslog_len,
 				   "<<<<>%s %2d %02d:%02d:%02d %s%s[%d]: ",
 				   monthname[tm.tm_mon],
 				   tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
@@ -746,13 +881,13 @@ static char *update_log_hdr()
 		 * either -1 or the number of bytes that would be needed to store
 		 * the total message. In both cases, we must adjust it.
 		 */
-		if (hdr_len < 0 || hdr_len > MAX_SYSLOG_LEN)
-			hdr_len = MAX_SYSLOG_LEN;
+		if (hdr_len < 0 || hdr_len > global.max_syslog_len)
+			hdr_len = global.max_syslog_len;
 
-		dataptr = logline + hdr_len;
+		logline_hdr_end = logline + hdr_len;
 	}
 
-	return dataptr;
+	return logline_hdr_end;
 }
 
 /*
@@ -765,38 +900,424 @@ void send_log(struct proxy *p, int level, const char *format, ...)
 	char *dataptr;
 	int  data_len;
 
-	if (level < 0 || format == NULL)
+	if (level < 0 || format == NULL || logline == NULL)
 		return;
 
 	dataptr = update_log_hdr(); /* update log header and skip it */
 	data_len = dataptr - logline;
 
 	va_start(argp, format);
-	data_len += vsnprintf(dataptr, logline + sizeof(logline) - dataptr, format, argp);
-	if (data_len < 0 || data_len > MAX_SYSLOG_LEN)
-		data_len =  MAX_SYSLOG_LEN;
+	data_len += vsnprintf(dataptr, logline + global.max_syslog_len - dataptr, format, argp);
+	if (data_len < 0 || data_len > global.max_syslog_len)
+		data_len =  global.max_syslog_len;
 	va_end(argp);
 
 	__send_log(p, level, logline, data_len);
 }
 
-/*
- * This function sends a syslog message.
- * It doesn't care about errors nor does it report them.
- * It overrides the last byte (message[size-1]) with an LF character.
+/* Syslog sockets, one per protocol family, lazily created on first use. When
+ * tune.log.ring is set, messages are queued in them and sent by log_ring_task.
  */
-void __send_log(struct proxy *p, int level, char *message, size_t size)
+static struct log_ring log_ring_unix = { .fd = -1 };
+static struct log_ring log_ring_inet = { .fd = -1 };
+static struct task *log_ring_task = NULL;
+
+unsigned int log_queued;   /* messages queued into log rings */
+unsigned int log_sent;     /* messages successfully sent */
+unsigned int log_dropped;  /* messages lost (ring full or send error) */
+
+/* Sends the <count> messages of ring <ring> starting at entry <first>, which
+ * must not wrap. Returns the number of messages the system accepted, or -1 if
+ * none was accepted, with errno set.
+ */
+static int log_ring_send(struct log_ring *ring, unsigned int first, int count)
+{
+	struct log_ring_entry *e = &ring->entry[first];
+#ifdef USE_SENDMMSG
+	static struct mmsghdr mmsg[LOG_RING_BATCH];
+	static struct iovec iov[LOG_RING_BATCH];
+	int i;
+
+	if (count > LOG_RING_BATCH)
+		count = LOG_RING_BATCH;
+
+	for (i = 0; i < count; i++, e++) {
+		iov[i].iov_base = e->msg;
+		iov[i].iov_len  = e->len;
+		memset(&mmsg[i].msg_hdr, 0, sizeof(mmsg[i].msg_hdr));
+		mmsg[i].msg_hdr.msg_name    = (void *)&e->logsrv->addr;
+		mmsg[i].msg_hdr.msg_namelen = get_addr_len(&e->logsrv->addr);
+		mmsg[i].msg_hdr.msg_iov     = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen  = 1;
+	}
+	return sendmmsg(ring->fd, mmsg, count, MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+	int done;
+
+	for (done = 0; done < count; done++, e++) {
+		if (sendto(ring->fd, e->msg, e->len, MSG_DONTWAIT | MSG_NOSIGNAL,
+			   (struct sockaddr *)&e->logsrv->addr, get_addr_len(&e->logsrv->addr)) < 0)
+			break;
+	}
+	return done ? done : -1;
+#endif
+}
+
+/* Sends as many queued messages as possible from ring <ring>. Returns non-zero
+ * if the socket is saturated and some messages remain queued.
+ */
+static int log_ring_flush(struct log_ring *ring)
+{
+	while (ring->head != ring->tail) {
+		unsigned int first = ring->tail % ring->size;
+		int count = ring->head - ring->tail;
+		int sent;
+
+		if (count > ring->size - first)
+			count = ring->size - first;
+
+		sent = log_ring_send(ring, first, count);
+		if (sent < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+				return 1;
+			Alert("sendmsg to logger failed: %s (errno=%d)\n", strerror(errno), errno);
+			/* this message will never pass, skip it */
+			sent = 1;
+			log_dropped++;
+		}
+		else
+			log_sent += sent;
+		ring->tail += sent;
+	}
+	return 0;
+}
+
+/* Task sending the messages queued in the log rings. If a socket does not
+ * accept everything, it tries again LOG_RING_RETRY milliseconds later.
+ */
+static struct task *process_log_ring(struct task *t)
+{
+	int busy = 0;
+
+	if (log_ring_unix.entry)
+		busy |= log_ring_flush(&log_ring_unix);
+	if (log_ring_inet.entry)
+		busy |= log_ring_flush(&log_ring_inet);
+
+	t->expire = busy ? tick_add(now_ms, MS_TO_TICKS(LOG_RING_RETRY)) : TICK_ETERNITY;
+	return t;
+}
+
+/* list of all stream loggers */
+static struct list log_streams = LIST_HEAD_INIT(log_streams);
+
+/* Returns the length of the frame starting at offset <ofs> in <ls>'s buffer,
+ * including its header. The frame must be complete.
+ */
+static int log_stream_frame_len(const struct log_stream *ls, int ofs)
+{
+	const char *p = ls->buf.str + ofs;
+	int len = 0;
+
+	while (*p != ' ')
+		len = len * 10 + *p++ - '0';
+	return p + 1 - (ls->buf.str + ofs) + len;
+}
+
+/* Accounts for the frames of <ls> which were completely sent, and resets the
+ * buffer once everything was sent.
+ */
+static void log_stream_update_sent(struct log_stream *ls)
+{
+	while (ls->frame < ls->buf.len) {
+		int end = ls->frame + log_stream_frame_len(ls, ls->frame);
+
+		if (end > ls->sent)
+			break;
+		ls->frame = end;
+		log_sent++;
+	}
+
+	if (ls->sent == ls->buf.len)
+		ls->buf.len = ls->frame = ls->sent = 0;
+}
+
+/* Closes the connection of stream logger <ls> and schedules a reconnection.
+ * The partially sent frame, if any, cannot be resent and is dropped.
+ */
+static void log_stream_close(struct log_stream *ls)
+{
+	if (ls->fd >= 0) {
+		fd_delete(ls->fd);
+		ls->fd = -1;
+	}
+
+	if (ls->sent > ls->frame) {
+		ls->sent = ls->frame = ls->frame + log_stream_frame_len(ls, ls->frame);
+		log_dropped++;
+		log_stream_update_sent(ls);
+	}
+
+	ls->task->expire = tick_add(now_ms, MS_TO_TICKS(LOG_STREAM_RETRY));
+	task_queue(ls->task);
+}
+
+/* I/O callback of stream loggers' sockets. Pending frames are written in as
+ * few calls as possible. Anything received is discarded, and a shutdown or an
+ * error closes the connection.
+ */
+static int log_stream_io_cb(int fd)
+{
+	struct log_stream *ls = fdtab[fd].owner;
+	int ret;
+
+	if (fdtab[fd].ev & (FD_POLL_IN | FD_POLL_HUP | FD_POLL_ERR)) {
+		ret = recv(fd, trash.str, trash.size, MSG_DONTWAIT);
+		if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR)) {
+			log_stream_close(ls);
+			return 0;
+		}
+		if (ret < 0)
+			fd_cant_recv(fd);
+	}
+
+	if (!(fdtab[fd].ev & FD_POLL_OUT))
+		return 0;
+
+	while (ls->sent < ls->buf.len) {
+		ret = send(fd, ls->buf.str + ls->sent, ls->buf.len - ls->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret > 0) {
+			ls->sent += ret;
+			continue;
+		}
+		if (ret < 0 && (errno == EAGAIN || errno == ENOTCONN)) {
+			/* ENOTCONN : connection still in progress */
+			fd_cant_send(fd);
+			break;
+		}
+		if (ret < 0 && errno == EINTR)
+			continue;
+		log_stream_close(ls);
+		return 0;
+	}
+
+	log_stream_update_sent(ls);
+	if (!ls->buf.len)
+		fd_stop_send(fd);
+	return 0;
+}
+
+/* Starts a non-blocking connection for stream logger <ls>. Returns 0 on
+ * success, or -1 on error in which case a new attempt is scheduled.
+ */
+static int log_stream_connect(struct log_stream *ls)
+{
+	int fd;
+
+	fd = socket(ls->addr.ss_family, SOCK_STREAM, 0);
+	if (fd < 0)
+		goto fail;
+
+	if (fd >= global.maxsock ||
+	    fcntl(fd, F_SETFL, O_NONBLOCK) == -1 ||
+	    (connect(fd, (struct sockaddr *)&ls->addr, get_addr_len(&ls->addr)) < 0 &&
+	     errno != EINPROGRESS)) {
+		close(fd);
+		goto fail;
+	}
+
+	ls->fd = fd;
+	ls->pid = pid;
+	fd_insert(fd);
+	fdtab[fd].owner = ls;
+	fdtab[fd].iocb = log_stream_io_cb;
+	fd_want_recv(fd);
+	fd_want_send(fd);
+	return 0;
+ fail:
+	ls->task->expire = tick_add(now_ms, MS_TO_TICKS(LOG_STREAM_RETRY));
+	task_queue(ls->task);
+	return -1;
+}
+
+/* Reconnection timer of stream loggers */
+static struct task *process_log_stream(struct task *t)
+{
+	struct log_stream *ls = t->context;
+
+	t->expire = TICK_ETERNITY;
+	if (ls->fd < 0 && ls->buf.len)
+		log_stream_connect(ls);
+	return t;
+}
+
+/* Returns the stream logger for address <addr>, which is created if needed.
+ * Its buffer is large enough for at least one message of <maxlen> bytes.
+ * Returns NULL on memory allocation error. This must only be called while
+ * parsing the configuration.
+ */
+struct log_stream *log_stream_get(const struct sockaddr_storage *addr, int maxlen)
+{
+	struct log_stream *ls;
+	int size = MAX(LOG_STREAM_BUFSIZE, maxlen + 12);
+	char *str;
+
+	list_for_each_entry(ls, &log_streams, list) {
+		if (memcmp(&ls->addr, addr, sizeof(*addr)) == 0) {
+			if (ls->buf.size < size) {
+				str = realloc(ls->buf.str, size);
+				if (!str)
+					return NULL;
+				ls->buf.str = str;
+				ls->buf.size = size;
+			}
+			return ls;
+		}
+	}
+
+	ls = calloc(1, sizeof(*ls));
+	if (!ls)
+		return NULL;
+
+	ls->buf.str = malloc(size);
+	ls->task = task_new();
+	if (!ls->buf.str || !ls->task) {
+		if (ls->task)
+			task_free(ls->task);
+		free(ls->buf.str);
+		free(ls);
+		return NULL;
+	}
+
+	ls->addr = *addr;
+	ls->fd = -1;
+	ls->pid = pid;
+	ls->buf.size = size;
+	ls->task->process = process_log_stream;
+	ls->task->context = ls;
+	ls->task->expire = TICK_ETERNITY;
+	LIST_ADDQ(&log_streams, &ls->list);
+	global.maxsock++;
+	return ls;
+}
+
+/* Appends message <msg> of length <len> to stream logger <ls>, and enables
+ * sending. The message is dropped if the buffer is full.
+ */
+static void log_stream_append(struct log_stream *ls, const char *msg, int len)
+{
+	int ret;
+
+	if (unlikely(ls->pid != pid)) {
+		/* inherited from the parent process, only the first process
+		 * keeps the messages emitted before forking.
+		 */
+		if (ls->fd >= 0) {
+			fd_delete(ls->fd);
+			ls->fd = -1;
+		}
+		if (relative_pid > 1)
+			ls->buf.len = ls->frame = ls->sent = 0;
+		ls->pid = pid;
+	}
+
+	if (ls->buf.size - ls->buf.len < len + 12 && ls->frame) {
+		/* make room by removing what was already sent */
+		memmove(ls->buf.str, ls->buf.str + ls->frame, ls->buf.len - ls->frame);
+		ls->buf.len -= ls->frame;
+		ls->sent -= ls->frame;
+		ls->frame = 0;
+	}
+
+	if (ls->buf.size - ls->buf.len < len + 12) {
+		log_dropped++;
+		return;
+	}
+
+	ret = snprintf(ls->buf.str + ls->buf.len, 12, "%d ", len);
+	memcpy(ls->buf.str + ls->buf.len + ret, msg, len);
+	ls->buf.len += ret + len;
+	log_queued++;
+
+	if (ls->fd >= 0)
+		fd_want_send(ls->fd);
+	else if (!task_in_wq(ls->task))
+		log_stream_connect(ls);
+}
+
+/* Synchronously sends whatever remains in the log rings and stream loggers,
+ * typically before exiting. Messages that cannot be sent immediately are lost.
+ */
+void deinit_log()
+{
+	struct log_stream *ls, *back;
+
+	if (log_ring_unix.entry)
+		log_ring_flush(&log_ring_unix);
+	if (log_ring_inet.entry)
+		log_ring_flush(&log_ring_inet);
+
+	list_for_each_entry_safe(ls, back, &log_streams, list) {
+		if (ls->fd >= 0 && ls->pid == pid && ls->sent < ls->buf.len)
+			send(ls->fd, ls->buf.str + ls->sent, ls->buf.len - ls->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+		LIST_DEL(&ls->list);
+		task_delete(ls->task);
+		task_free(ls->task);
+		free(ls->buf.str);
+		free(ls);
+	}
+}
+
+/* Creates the syslog socket of ring <ring> for family <family>. If
+ * tune.log.ring is set, the ring entries and the log task are allocated as
+ * well, otherwise or if memory is missing, messages will be sent immediately.
+ * Returns 0 on success, -1 on error.
+ */
+static int log_ring_open(struct log_ring *ring, int family)
+{
+	ring->fd = socket(family, SOCK_DGRAM, family == AF_UNIX ? 0 : IPPROTO_UDP);
+	if (ring->fd < 0)
+		return -1;
+
+	/* we don't want to receive anything on this socket */
+	setsockopt(ring->fd, SOL_SOCKET, SO_RCVBUF, &zero, sizeof(zero));
+	/* does nothing under Linux, maybe needed for others */
+	shutdown(ring->fd, SHUT_RD);
+
+	if (global.tune.log_ring <= 0)
+		return 0;
+
+	if (!log_ring_task) {
+		log_ring_task = task_new();
+		if (!log_ring_task)
+			return 0;
+		log_ring_task->process = process_log_ring;
+		log_ring_task->context = NULL;
+		log_ring_task->expire = TICK_ETERNITY;
+	}
+
+	ring->entry = calloc(global.tune.log_ring, sizeof(*ring->entry) + global.max_syslog_len);
+	if (ring->entry) {
+		char *msg = (char *)(ring->entry + global.tune.log_ring);
+		int i;
+
+		for (i = 0; i < global.tune.log_ring; i++)
+			ring->entry[i].msg = msg + i * global.max_syslog_len;
+		ring->size = global.tune.log_ring;
+	}
+	return 0;
+}
+
+/* Returns the list of loggers of proxy <p>, or the global ones if <p> is NULL,
+ * or NULL if there is no logger. The datagram sockets they need are created
+ * if they do not exist yet. NULL is returned as well if a socket cannot be
+ * created.
+ */
+static struct list *log_get_loggers(struct proxy *p)
 {
-	static int logfdunix = -1;	/* syslog to AF_UNIX socket */
-	static int logfdinet = -1;	/* syslog to AF_INET socket */
-	static char *dataptr = NULL;
-	int fac_level;
 	struct list *logsrvs = NULL;
 	struct logsrv *tmp = NULL;
 	int nblogger;
-	char *log_ptr;
-
-	dataptr = message;
 
 	if (p == NULL) {
 		if (!LIST_ISEMPTY(&global.logsrvs)) {
@@ -809,48 +1330,100 @@ void __send_log(struct proxy *p, int level, char *message, size_t size)
 	}
 
 	if (!logsrvs)
-		return;
-
-	message[size - 1] = '\n';
+		return NULL;
 
 	/* Lazily set up syslog sockets for protocol families of configured
 	 * syslog servers. */
 	nblogger = 0;
 	list_for_each_entry(tmp, logsrvs, list) {
 		const struct logsrv *logsrv = tmp;
-		int proto, *plogfd;
-
-		if (logsrv->addr.ss_family == AF_UNIX) {
-			proto = 0;
-			plogfd = &logfdunix;
-		} else {
-			proto = IPPROTO_UDP;
-			plogfd = &logfdinet;
-		}
-		if (*plogfd >= 0) {
+		struct log_ring *ring;
+
+		if (logsrv->stream)
+			continue;
+
+		ring = logsrv->addr.ss_family == AF_UNIX ? &log_ring_unix : &log_ring_inet;
+		if (ring->fd >= 0) {
 			/* socket already created. */
 			continue;
 		}
-		if ((*plogfd = socket(logsrv->addr.ss_family, SOCK_DGRAM,
-				proto)) < 0) {
+		if (log_ring_open(ring, logsrv->addr.ss_family) < 0) {
 			Alert("socket for logger #%d failed: %s (errno=%d)\n",
 				nblogger + 1, strerror(errno), errno);
-			return;
+			return NULL;
 		}
-		/* we don't want to receive anything on this socket */
-		setsockopt(*plogfd, SOL_SOCKET, SO_RCVBUF, &zero, sizeof(zero));
-		/* does nothing under Linux, maybe needed for others */
-		shutdown(*plogfd, SHUT_RD);
 		nblogger++;
 	}
+	return logsrvs;
+}
+
+/* Sends message <msg> of <len> bytes to datagram logger <logsrv>, or queues it
+ * into the log ring if it is enabled. Returns non-zero if the message was
+ * queued and the log task needs to be woken up.
+ */
+static int log_send_dgram(const struct logsrv *logsrv, const char *msg, int len, int nblogger)
+{
+	struct log_ring *ring = logsrv->addr.ss_family == AF_UNIX ?
+		&log_ring_unix : &log_ring_inet;
+	int sent;
+
+	if (ring->entry) {
+		struct log_ring_entry *e;
+
+		if (ring->head - ring->tail >= ring->size) {
+			log_dropped++;
+			return 0;
+		}
+		e = &ring->entry[ring->head++ % ring->size];
+		e->logsrv = logsrv;
+		e->len = len;
+		memcpy(e->msg, msg, len);
+		log_queued++;
+		return 1;
+	}
+
+	sent = sendto(ring->fd, msg, len, MSG_DONTWAIT | MSG_NOSIGNAL,
+		      (struct sockaddr *)&logsrv->addr, get_addr_len(&logsrv->addr));
+	if (sent < 0) {
+		Alert("sendto logger #%d failed: %s (errno=%d)\n",
+			nblogger, strerror(errno), errno);
+		log_dropped++;
+	}
+	else
+		log_sent++;
+	return 0;
+}
+
+/*
+ * This function sends a syslog message.
+ * It doesn't care about errors nor does it report them.
+ * It overrides the last byte (message[size-1]) with an LF character.
+ */
+void __send_log(struct proxy *p, int level, char *message, size_t size)
+{
+	static char *dataptr = NULL;
+	int fac_level;
+	struct list *logsrvs = NULL;
+	struct logsrv *tmp = NULL;
+	int nblogger;
+	int queued;
+	char *log_ptr;
+	int len;
+	char last;
+
+	dataptr = message;
+
+	logsrvs = log_get_loggers(p);
+	if (!logsrvs)
+		return;
+
+	message[size - 1] = '\n';
 
 	/* Send log messages to syslog server. */
 	nblogger = 0;
+	queued = 0;
 	list_for_each_entry(tmp, logsrvs, list) {
 		const struct logsrv *logsrv = tmp;
-		int *plogfd = logsrv->addr.ss_family == AF_UNIX ?
-			&logfdunix : &logfdinet;
-		int sent;
 
 		/* we can filter the level of the messages that are sent to each logger */
 		if (level > logsrv->level)
@@ -872,15 +1445,67 @@ void __send_log(struct proxy *p, int level, char *message, size_t size)
 		} while (fac_level && log_ptr > dataptr);
 		*log_ptr = '<';
 
-		sent = sendto(*plogfd, log_ptr, size - (log_ptr - dataptr),
-			      MSG_DONTWAIT | MSG_NOSIGNAL,
-			      (struct sockaddr *)&logsrv->addr, get_addr_len(&logsrv->addr));
-		if (sent < 0) {
-			Alert("sendto logger #%d failed: %s (errno=%d)\n",
-				nblogger, strerror(errno), errno);
+		/* The message is truncated to the logger's length, and must
+		 * still end with an LF then. The byte it replaces is restored
+		 * for the next loggers once the message is sent or copied.
+		 */
+		len = size - (log_ptr - dataptr);
+		if (len > logsrv->maxlen)
+			len = logsrv->maxlen;
+		last = log_ptr[len - 1];
+		log_ptr[len - 1] = '\n';
+
+		if (logsrv->stream) {
+			/* the trailing LF is useless with octet counting */
+			log_stream_append(logsrv->stream, log_ptr, len - 1);
+		}
+		else {
+			queued |= log_send_dgram(logsrv, log_ptr, len, nblogger);
+			nblogger++;
+		}
+		log_ptr[len - 1] = last;
+	}
+
+	if (queued)
+		task_wakeup(log_ring_task, TASK_WOKEN_MSG);
+}
+
+/*
+ * This function sends the binary log record <rec> of <size> bytes as-is, with
+ * no syslog header, to the loggers of proxy <p> accepting level <level>.
+ */
+void __send_log_bin(struct proxy *p, int level, const char *rec, size_t size)
+{
+	struct list *logsrvs;
+	struct logsrv *tmp;
+	int nblogger = 0;
+	int queued = 0;
+
+	logsrvs = log_get_loggers(p);
+	if (!logsrvs)
+		return;
+
+	list_for_each_entry(tmp, logsrvs, list) {
+		if (level > tmp->level)
+			continue;
+
+		/* a truncated record would be unreadable */
+		if (size > tmp->maxlen) {
+			log_dropped++;
+			continue;
+		}
+
+		if (tmp->stream) {
+			log_stream_append(tmp->stream, rec, size);
+			continue;
 		}
+
+		queued |= log_send_dgram(tmp, rec, size, nblogger);
 		nblogger++;
 	}
+
+	if (queued)
+		task_wakeup(log_ring_task, TASK_WOKEN_MSG);
 }
 
 extern fd_set hdr_encode_map[];
@@ -951,13 +1576,16 @@ int build_logline(struct session *s, char *dst, size_t maxsize, struct list *lis
 				}
 				break;
 
-			case LOG_FMT_TEXT: // text
-				src = tmp->arg;
-				iret = strlcpy2(tmplog, src, dst + maxsize - tmplog);
-				if (iret == 0)
+			case LOG_FMT_TEXT: // text, possibly merged with a trailing separator
+				/* copy as much as possible like separate nodes would */
+				iret = tmp->arg_len;
+				if (iret > dst + maxsize - tmplog - 1)
+					iret = dst + maxsize - tmplog - 1;
+				if (iret <= 0)
 					goto out;
+				memcpy(tmplog, tmp->arg, iret);
 				tmplog += iret;
-				last_isspace = 0;
+				last_isspace = !!(tmp->options & LOG_OPT_SEPARATOR);
 				break;
 
 			case LOG_FMT_EXPR: // sample expression, may be request or response
@@ -1094,27 +1722,9 @@ int build_logline(struct session *s, char *dst, size_t maxsize, struct list *lis
 				break;
 
 			case LOG_FMT_DATE: // %t
-				get_localtime(s->logs.accept_date.tv_sec, &tm);
-				ret = date2str_log(tmplog, &tm, &(s->logs.accept_date),
-						   dst + maxsize - tmplog);
-				if (ret == NULL)
-					goto out;
-				tmplog = ret;
-				last_isspace = 0;
-				break;
-
 			case LOG_FMT_DATEGMT: // %T
-				get_gmtime(s->logs.accept_date.tv_sec, &tm);
-				ret = gmt2str_log(tmplog, &tm, dst + maxsize - tmplog);
-				if (ret == NULL)
-					goto out;
-				tmplog = ret;
-				last_isspace = 0;
-				break;
-
 			case LOG_FMT_DATELOCAL: // %Tl
-				get_localtime(s->logs.accept_date.tv_sec, &tm);
-				ret = localdate2str_log(tmplog, &tm, dst + maxsize - tmplog);
+				ret = lf_date(tmplog, tmp->type, &s->logs.accept_date, dst + maxsize - tmplog);
 				if (ret == NULL)
 					goto out;
 				tmplog = ret;
@@ -1576,6 +2186,399 @@ out:
 
 }
 
+/* Writes the type and encoding bytes of a binary log field to <dst>, checking
+ * that <len> more bytes fit before <end>. Returns a pointer to the location of
+ * the value, or NULL if there is not enough room.
+ */
+static inline char *lb_field(char *dst, const char *end, int type, int enc, int len)
+{
+	if (end - dst < 2 + len)
+		return NULL;
+	*dst++ = type;
+	*dst++ = enc;
+	return dst;
+}
+
+/* Writes <len> bytes of value <v> in big endian to <dst> and returns the
+ * pointer past them.
+ */
+static inline char *lb_putbe(char *dst, unsigned long long v, int len)
+{
+	int i;
+
+	for (i = len - 1; i >= 0; i--) {
+		dst[i] = v;
+		v >>= 8;
+	}
+	return dst + len;
+}
+
+/* Writes signed integer field <type> of value <v> to <dst>. <plus> sets
+ * LOG_BIN_F_PLUS. Returns the pointer past the field or NULL if it does not
+ * fit before <end>.
+ */
+static char *lb_int(char *dst, const char *end, int type, long long v, int plus)
+{
+	dst = lb_field(dst, end, type, LOG_BIN_S64 | (plus ? LOG_BIN_F_PLUS : 0), 8);
+	if (!dst)
+		return NULL;
+	return lb_putbe(dst, v, 8);
+}
+
+/* Writes string field <type> of <len> bytes from <str> to <dst>, or an empty
+ * field if <str> is NULL. Returns the pointer past the field or NULL if it does
+ * not fit before <end>.
+ */
+static char *lb_str(char *dst, const char *end, int type, const char *str, int len)
+{
+	if (!str)
+		return lb_field(dst, end, type, LOG_BIN_NONE, 0);
+
+	if (len > 65535)
+		len = 65535;
+	dst = lb_field(dst, end, type, LOG_BIN_STR, 2 + len);
+	if (!dst)
+		return NULL;
+	dst = lb_putbe(dst, len, 2);
+	memcpy(dst, str, len);
+	return dst + len;
+}
+
+/* Writes address field <type> from <addr> to <dst>, or an empty field if it is
+ * neither IPv4 nor IPv6. Returns the pointer past the field or NULL if it does
+ * not fit before <end>.
+ */
+static char *lb_addr(char *dst, const char *end, int type, const struct sockaddr_storage *addr)
+{
+	switch (addr->ss_family) {
+	case AF_INET:
+		dst = lb_field(dst, end, type, LOG_BIN_IPV4, 4);
+		if (dst) {
+			memcpy(dst, &((struct sockaddr_in *)addr)->sin_addr, 4);
+			dst += 4;
+		}
+		return dst;
+	case AF_INET6:
+		dst = lb_field(dst, end, type, LOG_BIN_IPV6, 16);
+		if (dst) {
+			memcpy(dst, &((struct sockaddr_in6 *)addr)->sin6_addr, 16);
+			dst += 16;
+		}
+		return dst;
+	default:
+		return lb_field(dst, end, type, LOG_BIN_NONE, 0);
+	}
+}
+
+/* Writes header captures field <type> made of the <nb> strings of <cap> to
+ * <dst>, or an empty field if there is no capture. Returns the pointer past
+ * the field or NULL if it does not fit before <end>.
+ */
+static char *lb_caps(char *dst, const char *end, int type, char **cap, int nb)
+{
+	int hdr, len;
+
+	if (!nb || !cap)
+		return lb_field(dst, end, type, LOG_BIN_NONE, 0);
+
+	if (nb > 255)
+		nb = 255;
+	dst = lb_field(dst, end, type, LOG_BIN_STRS, 1);
+	if (!dst)
+		return NULL;
+	*dst++ = nb;
+	for (hdr = 0; hdr < nb; hdr++) {
+		len = cap[hdr] ? strlen(cap[hdr]) : 0;
+		if (end - dst < 2 + len)
+			return NULL;
+		dst = lb_putbe(dst, len, 2);
+		memcpy(dst, cap[hdr], len);
+		dst += len;
+	}
+	return dst;
+}
+
+/* Builds a binary log record in <dst> based on <list_format> for a message of
+ * level <level>, and stops before reaching <maxsize> bytes. The record only
+ * contains the variable fields of the format, text and separators are not
+ * needed to decode it. The fields which do not fit are not reported. Returns
+ * the size of the record, or zero if there is not even room for the header.
+ * See the LOG_BIN_* definitions for the format.
+ */
+int build_logbin(struct session *s, int level, char *dst, size_t maxsize, struct list *list_format)
+{
+	struct proxy *fe = s->fe;
+	struct proxy *be = s->be;
+	struct http_txn *txn = &s->txn;
+	const char *end = dst + maxsize;
+	struct logformat_node *tmp;
+	int t_request;
+	int fields = 0;
+	char *pos, *ret;
+
+	if (maxsize < LOG_BIN_HDR_LEN || LIST_ISEMPTY(list_format))
+		return 0;
+
+	t_request = -1;
+	if (tv_isge(&s->logs.tv_request, &s->logs.tv_accept))
+		t_request = tv_ms_elapsed(&s->logs.tv_accept, &s->logs.tv_request);
+
+	pos = dst + LOG_BIN_HDR_LEN;
+
+	list_for_each_entry(tmp, list_format, list) {
+		struct connection *conn;
+		struct sample *key;
+		const char *src;
+		char state[4];
+
+		if (fields == 255)
+			break;
+
+		switch (tmp->type) {
+		case LOG_FMT_EXPR:
+			key = NULL;
+			if (tmp->options & LOG_OPT_REQ_CAP)
+				key = sample_fetch_string(be, s, txn, SMP_OPT_DIR_REQ|SMP_OPT_FINAL, tmp->expr);
+			if (!key && (tmp->options & LOG_OPT_RES_CAP))
+				key = sample_fetch_string(be, s, txn, SMP_OPT_DIR_RES|SMP_OPT_FINAL, tmp->expr);
+			ret = lb_str(pos, end, tmp->type, key ? key->data.str.str : NULL, key ? key->data.str.len : 0);
+			break;
+
+		case LOG_FMT_CLIENTIP:
+		case LOG_FMT_FRONTENDIP:
+		case LOG_FMT_BACKENDIP:
+		case LOG_FMT_SERVERIP:
+		case LOG_FMT_CLIENTPORT:
+		case LOG_FMT_FRONTENDPORT:
+		case LOG_FMT_BACKENDPORT:
+		case LOG_FMT_SERVERPORT: {
+			const struct sockaddr_storage *addr;
+
+			if (tmp->type == LOG_FMT_CLIENTIP || tmp->type == LOG_FMT_CLIENTPORT ||
+			    tmp->type == LOG_FMT_FRONTENDIP || tmp->type == LOG_FMT_FRONTENDPORT)
+				conn = objt_conn(s->req->prod->end);
+			else
+				conn = objt_conn(s->req->cons->end);
+
+			if (!conn) {
+				ret = lb_field(pos, end, tmp->type, LOG_BIN_NONE, 0);
+				break;
+			}
+
+			if (tmp->type == LOG_FMT_FRONTENDIP || tmp->type == LOG_FMT_FRONTENDPORT)
+				conn_get_to_addr(conn);
+
+			if (tmp->type == LOG_FMT_CLIENTIP || tmp->type == LOG_FMT_CLIENTPORT ||
+			    tmp->type == LOG_FMT_BACKENDIP || tmp->type == LOG_FMT_BACKENDPORT)
+				addr = &conn->addr.from;
+			else
+				addr = &conn->addr.to;
+
+			if (tmp->type == LOG_FMT_CLIENTIP || tmp->type == LOG_FMT_FRONTENDIP ||
+			    tmp->type == LOG_FMT_BACKENDIP || tmp->type == LOG_FMT_SERVERIP)
+				ret = lb_addr(pos, end, tmp->type, addr);
+			else if (addr->ss_family == AF_UNIX &&
+			         (tmp->type == LOG_FMT_CLIENTPORT || tmp->type == LOG_FMT_FRONTENDPORT))
+				ret = lb_int(pos, end, tmp->type, s->listener->luid, 0);
+			else
+				ret = lb_int(pos, end, tmp->type, get_host_port((struct sockaddr_storage *)addr), 0);
+			break;
+		}
+
+		case LOG_FMT_DATE:
+		case LOG_FMT_DATEGMT:
+		case LOG_FMT_DATELOCAL:
+			ret = lb_field(pos, end, tmp->type, LOG_BIN_DATE, 8);
+			if (ret) {
+				ret = lb_putbe(ret, s->logs.accept_date.tv_sec, 4);
+				ret = lb_putbe(ret, s->logs.accept_date.tv_usec, 4);
+			}
+			break;
+
+		case LOG_FMT_TS:
+			ret = lb_int(pos, end, tmp->type, s->logs.accept_date.tv_sec, 0);
+			break;
+
+		case LOG_FMT_MS:
+			ret = lb_int(pos, end, tmp->type, s->logs.accept_date.tv_usec / 1000, 0);
+			break;
+
+		case LOG_FMT_FRONTEND:
+			ret = lb_str(pos, end, tmp->type, fe->id, strlen(fe->id));
+			break;
+
+		case LOG_FMT_FRONTEND_XPRT:
+			ret = lb_str(pos, end, tmp->type, fe->id, strlen(fe->id));
+#ifdef USE_OPENSSL
+			/* append the '~' of SSL frontends to the string */
+			if (ret && s->listener->xprt == &ssl_sock && ret < end) {
+				lb_putbe(pos + 2, ret - pos - 4 + 1, 2);
+				*ret++ = '~';
+			}
+#endif
+			break;
+#ifdef USE_OPENSSL
+		case LOG_FMT_SSL_CIPHER:
+		case LOG_FMT_SSL_VERSION:
+			src = NULL;
+			conn = objt_conn(s->si[0].end);
+			if (conn && s->listener->xprt == &ssl_sock)
+				src = (tmp->type == LOG_FMT_SSL_CIPHER) ?
+					ssl_sock_get_cipher_name(conn) :
+					ssl_sock_get_proto_version(conn);
+			ret = lb_str(pos, end, tmp->type, src, src ? strlen(src) : 0);
+			break;
+#endif
+		case LOG_FMT_BACKEND:
+			ret = lb_str(pos, end, tmp->type, be->id, strlen(be->id));
+			break;
+
+		case LOG_FMT_SERVER:
+			switch (obj_type(s->target)) {
+			case OBJ_TYPE_SERVER:
+				src = objt_server(s->target)->id;
+				break;
+			case OBJ_TYPE_APPLET:
+				src = objt_applet(s->target)->name;
+				break;
+			default:
+				src = "<NOSRV>";
+				break;
+			}
+			ret = lb_str(pos, end, tmp->type, src, strlen(src));
+			break;
+
+		case LOG_FMT_TQ:
+			ret = lb_int(pos, end, tmp->type, t_request, 0);
+			break;
+
+		case LOG_FMT_TW:
+			ret = lb_int(pos, end, tmp->type, (s->logs.t_queue >= 0) ? s->logs.t_queue - t_request : -1, 0);
+			break;
+
+		case LOG_FMT_TC:
+			ret = lb_int(pos, end, tmp->type, (s->logs.t_connect >= 0) ? s->logs.t_connect - s->logs.t_queue : -1, 0);
+			break;
+
+		case LOG_FMT_TR:
+			ret = lb_int(pos, end, tmp->type, (s->logs.t_data >= 0) ? s->logs.t_data - s->logs.t_connect : -1, 0);
+			break;
+
+		case LOG_FMT_TT:
+			ret = lb_int(pos, end, tmp->type, s->logs.t_close, !(fe->to_log & LW_BYTES));
+			break;
+
+		case LOG_FMT_STATUS:
+			ret = lb_int(pos, end, tmp->type, txn->status, 0);
+			break;
+
+		case LOG_FMT_BYTES:
+			ret = lb_int(pos, end, tmp->type, s->logs.bytes_out, !(fe->to_log & LW_BYTES));
+			break;
+
+		case LOG_FMT_BYTES_UP:
+			ret = lb_int(pos, end, tmp->type, s->logs.bytes_in, 0);
+			break;
+
+		case LOG_FMT_CCLIENT:
+			src = txn->cli_cookie;
+			ret = lb_str(pos, end, tmp->type, src, src ? strlen(src) : 0);
+			break;
+
+		case LOG_FMT_CSERVER:
+			src = txn->srv_cookie;
+			ret = lb_str(pos, end, tmp->type, src, src ? strlen(src) : 0);
+			break;
+
+		case LOG_FMT_TERMSTATE:
+		case LOG_FMT_TERMSTATE_CK:
+			state[0] = sess_term_cond[(s->flags & SN_ERR_MASK) >> SN_ERR_SHIFT];
+			state[1] = sess_fin_state[(s->flags & SN_FINST_MASK) >> SN_FINST_SHIFT];
+			state[2] = (be->ck_opts & PR_CK_ANY) ? sess_cookie[(txn->flags & TX_CK_MASK) >> TX_CK_SHIFT] : '-';
+			state[3] = (be->ck_opts & PR_CK_ANY) ? sess_set_cookie[(txn->flags & TX_SCK_MASK) >> TX_SCK_SHIFT] : '-';
+			ret = lb_str(pos, end, tmp->type, state, (tmp->type == LOG_FMT_TERMSTATE) ? 2 : 4);
+			break;
+
+		case LOG_FMT_ACTCONN:
+			ret = lb_int(pos, end, tmp->type, actconn, 0);
+			break;
+
+		case LOG_FMT_FECONN:
+			ret = lb_int(pos, end, tmp->type, fe->feconn, 0);
+			break;
+
+		case LOG_FMT_BECONN:
+			ret = lb_int(pos, end, tmp->type, be->beconn, 0);
+			break;
+
+		case LOG_FMT_SRVCONN:
+			ret = lb_int(pos, end, tmp->type, objt_server(s->target) ? objt_server(s->target)->cur_sess : 0, 0);
+			break;
+
+		case LOG_FMT_RETRIES:
+			ret = lb_int(pos, end, tmp->type,
+			             (s->req->cons->conn_retries > 0) ?
+			             (be->conn_retries - s->req->cons->conn_retries) :
+			             be->conn_retries, s->flags & SN_REDISP);
+			break;
+
+		case LOG_FMT_SRVQUEUE:
+			ret = lb_int(pos, end, tmp->type, s->logs.srv_queue_size, 0);
+			break;
+
+		case LOG_FMT_BCKQUEUE:
+			ret = lb_int(pos, end, tmp->type, s->logs.prx_queue_size, 0);
+			break;
+
+		case LOG_FMT_HDRREQUEST:
+		case LOG_FMT_HDRREQUESTLIST:
+			ret = lb_caps(pos, end, tmp->type, txn->req.cap, fe->nb_req_cap);
+			break;
+
+		case LOG_FMT_HDRRESPONS:
+		case LOG_FMT_HDRRESPONSLIST:
+			ret = lb_caps(pos, end, tmp->type, txn->rsp.cap, fe->nb_rsp_cap);
+			break;
+
+		case LOG_FMT_REQ:
+			src = txn->uri ? txn->uri : "<BADREQ>";
+			ret = lb_str(pos, end, tmp->type, src, strlen(src));
+			break;
+
+		case LOG_FMT_COUNTER:
+			ret = lb_int(pos, end, tmp->type, s->uniq_id, 0);
+			break;
+
+		case LOG_FMT_HOSTNAME:
+			ret = lb_str(pos, end, tmp->type, hostname, strlen(hostname));
+			break;
+
+		case LOG_FMT_PID:
+			ret = lb_int(pos, end, tmp->type, pid, 0);
+			break;
+
+		case LOG_FMT_UNIQUEID:
+			src = s->unique_id;
+			ret = lb_str(pos, end, tmp->type, src, src ? strlen(src) : 0);
+			break;
+
+		default: /* text, separators */
+			continue;
+		}
+
+		if (!ret)
+			break;
+		pos = ret;
+		fields++;
+	}
+
+	lb_putbe(dst, pos - dst, 2);
+	dst[2] = LOG_BIN_VERSION;
+	dst[3] = level;
+	dst[4] = fields;
+	return pos - dst;
+}
+
 /*
  * send a log for the session when we have enough info about it.
  * Will not log if the frontend has no log defined.
@@ -1617,9 +2620,20 @@ void sess_log(struct session *s)
 			build_logline(s, s->unique_id, UNIQUEID_LEN, &s->fe->format_unique_id);
 	}
 
+	if (s->fe->options2 & PR_O2_LOGBIN) {
+		if (!logbin)
+			return;
+		size = build_logbin(s, level, logbin, global.max_syslog_len, &s->fe->logformat);
+		if (size > 0) {
+			__send_log_bin(s->fe, level, logbin, size);
+			s->logs.logwait = 0;
+		}
+		return;
+	}
+
 	tmplog = update_log_hdr();
 	size = tmplog - logline;
-	size += build_logline(s, tmplog, sizeof(logline) - size, &s->fe->logformat);
+	size += build_logline(s, tmplog, global.max_syslog_len - size, &s->fe->logformat);
 	if (size > 0) {
 		__send_log(s->fe, level, logline, size + 1);
 		s->logs.logwait = 0;
@@ -0,0 +1,460 @@
+/*
+ * Passive outlier detection.
+ *
+ * Copyright 2000-2014 Willy Tarreau <w@1wt.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Each server of a backend running "outlier-detection" keeps a sliding window
+ * of the outcome and the latency of the requests it served. A server whose
+ * error ratio over the window reaches the configured limit is ejected as soon
+ * as the error is observed. A task then compares the servers with each other
+ * at every interval, and ejects those whose success rate is too far below the
+ * others' or whose latency percentile is too far above the median one. An
+ * ejected server gets a null effective weight for a duration which grows with
+ * consecutive ejections, then comes back by itself without waiting for the
+ * health checks. A share of the servers may never be ejected at once.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/config.h>
+#include <common/standard.h>
+#include <common/ticks.h>
+#include <common/time.h>
+
+#include <types/global.h>
+
+#include <proto/backend.h>
+#include <proto/checks.h>
+#include <proto/log.h>
+#include <proto/outlier.h>
+#include <proto/proxy.h>
+#include <proto/server.h>
+#include <proto/task.h>
+
+/* Returns the histogram bucket of a latency of <ms> milliseconds. Values below
+ * 1<<OUTLIER_LAT_SUB are stored as is, above which each power of two is split
+ * into 1<<OUTLIER_LAT_SUB buckets.
+ */
+static inline unsigned int outlier_lat_bucket(unsigned int ms)
+{
+	unsigned int bit = OUTLIER_LAT_SUB;
+	unsigned int bucket;
+
+	if (ms < (1 << OUTLIER_LAT_SUB))
+		return ms;
+
+	while (ms >> (bit + 1))
+		bit++;
+
+	bucket = ((bit - OUTLIER_LAT_SUB + 1) << OUTLIER_LAT_SUB) +
+		((ms >> (bit - OUTLIER_LAT_SUB)) & ((1 << OUTLIER_LAT_SUB) - 1));
+	if (bucket >= OUTLIER_LAT_BUCKETS)
+		bucket = OUTLIER_LAT_BUCKETS - 1;
+	return bucket;
+}
+
+/* Returns the upper bound in milliseconds of the latencies stored in histogram
+ * bucket <bucket>.
+ */
+static inline unsigned int outlier_lat_value(unsigned int bucket)
+{
+	unsigned int bit;
+
+	if (bucket < (1 << OUTLIER_LAT_SUB))
+		return bucket + 1;
+
+	bit = (bucket >> OUTLIER_LAT_SUB) + OUTLIER_LAT_SUB - 1;
+	return ((1 << OUTLIER_LAT_SUB) + (bucket & ((1 << OUTLIER_LAT_SUB) - 1)) + 1)
+		<< (bit - OUTLIER_LAT_SUB);
+}
+
+/* Returns the duration in milliseconds of the <n>th consecutive ejection of a
+ * server of proxy <px>.
+ */
+static int outlier_eject_time(const struct proxy *px, unsigned int n)
+{
+	if (n > (unsigned int)(px->outlier.max_time / px->outlier.base_time))
+		return px->outlier.max_time;
+	return px->outlier.base_time * n;
+}
+
+/* Forgets everything that was observed for the server. */
+static void outlier_reset(struct srv_outlier *o)
+{
+	memset(o->slot, 0, sizeof(o->slot));
+	o->win_ok = o->win_err = o->win_lat = 0;
+}
+
+/* Moves the window of <o> forward by one interval, forgetting the oldest
+ * observations.
+ */
+static void outlier_rotate(struct srv_outlier *o)
+{
+	struct outlier_slot *slot;
+	int i;
+
+	o->cur = (o->cur + 1) % OUTLIER_SLOTS;
+	slot = &o->slot[o->cur];
+
+	o->win_ok -= slot->ok;
+	o->win_err -= slot->err;
+	for (i = 0; i < OUTLIER_LAT_BUCKETS; i++)
+		o->win_lat -= slot->lat[i];
+	memset(slot, 0, sizeof(*slot));
+}
+
+/* Ejects server <sv> for the reason described in <reason>, unless this would
+ * leave its backend without any usable server or exceed the percentage of
+ * ejected servers allowed. Returns non-zero if the server was ejected.
+ */
+static int outlier_eject(struct server *sv, const char *reason)
+{
+	struct proxy *px = sv->proxy;
+	struct srv_outlier *o = sv->outlier;
+	struct server *srv;
+	int running = 0, usable = 0;
+	int xferred, duration;
+
+	if (!(sv->state & SRV_RUNNING) || (sv->state & SRV_MAINTAIN))
+		return 0;
+
+	for (srv = px->srv; srv; srv = srv->next) {
+		if (!(srv->state & SRV_RUNNING) || (srv->state & SRV_MAINTAIN))
+			continue;
+		running++;
+		if (srv != sv && (srv->state & SRV_BACKUP) == (sv->state & SRV_BACKUP) &&
+		    srv_is_usable(srv->state, srv->eweight))
+			usable++;
+	}
+
+	if (!usable)
+		return 0;
+
+	if (px->outlier.nb_ejected >= MAX(1, running * px->outlier.max_pct / 100))
+		return 0;
+
+	if (o->ejections < 1000)
+		o->ejections++;
+	duration = outlier_eject_time(px, o->ejections);
+	o->expire = tick_add(now_ms, MS_TO_TICKS(duration));
+
+	sv->state |= SRV_EJECTED;
+	sv->counters.ejections++;
+	px->outlier.nb_ejected++;
+	server_recalc_eweight(sv);
+	xferred = redistribute_pending(sv);
+
+	/* the server will be judged on fresh observations once back */
+	outlier_reset(o);
+
+	chunk_printf(&trash,
+	             "%sServer %s/%s is ejected for %dms, reason: %s."
+	             " %d active and %d backup servers online. %d sessions requeued",
+	             sv->state & SRV_BACKUP ? "Backup " : "",
+	             px->id, sv->id, duration, reason,
+	             px->srv_act, px->srv_bck, xferred);
+	Warning("%s.\n", trash.str);
+	send_log(px, LOG_NOTICE, "%s.\n", trash.str);
+
+	task_schedule(px->outlier.task, o->expire);
+	return 1;
+}
+
+/* Brings server <sv> back into the load balancing at the end of its
+ * ejection.
+ */
+static void outlier_restore(struct server *sv)
+{
+	struct proxy *px = sv->proxy;
+	int xferred;
+
+	sv->state &= ~SRV_EJECTED;
+	px->outlier.nb_ejected--;
+	server_recalc_eweight(sv);
+	xferred = srv_is_usable(sv->state, sv->eweight) ? check_for_pending(sv) : 0;
+
+	chunk_printf(&trash,
+	             "%sServer %s/%s is back from ejection."
+	             " %d active and %d backup servers online. %d sessions requeued",
+	             sv->state & SRV_BACKUP ? "Backup " : "",
+	             px->id, sv->id, px->srv_act, px->srv_bck, xferred);
+	Warning("%s.\n", trash.str);
+	send_log(px, LOG_NOTICE, "%s.\n", trash.str);
+}
+
+/* Returns non-zero if server <sv> has been observed enough to be compared with
+ * the other ones.
+ */
+static inline int outlier_eligible(const struct server *sv, unsigned int samples)
+{
+	return (sv->state & SRV_RUNNING) &&
+		!(sv->state & (SRV_MAINTAIN | SRV_EJECTED)) &&
+		samples && samples >= sv->proxy->outlier.min_requests;
+}
+
+/* Returns the histogram bucket holding the configured latency percentile over
+ * the whole window of <o>.
+ */
+static unsigned int outlier_lat_pctl(const struct srv_outlier *o, int pctl)
+{
+	unsigned long long target;
+	unsigned int bucket, slot, seen = 0;
+
+	target = ((unsigned long long)o->win_lat * pctl + 99) / 100;
+	for (bucket = 0; bucket < OUTLIER_LAT_BUCKETS - 1; bucket++) {
+		for (slot = 0; slot < OUTLIER_SLOTS; slot++)
+			seen += o->slot[slot].lat[bucket];
+		if (seen >= target)
+			break;
+	}
+	return bucket;
+}
+
+/* Compares the servers of proxy <px> with each other and ejects the outliers :
+ *   - those whose success rate is below the other servers' average by more
+ *     than sr_factor times their standard deviation (which is never
+ *     considered below 1%) ;
+ *   - those whose latency percentile is above lat_factor times the median of
+ *     all servers' percentiles (which is never considered below
+ *     OUTLIER_LAT_FLOOR ms).
+ * At least OUTLIER_MIN_SERVERS servers need to have been observed enough for
+ * a comparison to be meaningful.
+ */
+static void outlier_analyse(struct proxy *px)
+{
+	struct px_outlier *po = &px->outlier;
+	struct server *sv;
+	unsigned int count[OUTLIER_LAT_BUCKETS];
+	unsigned long long sum, sumsq, var, dev;
+	unsigned int n, sr, mean, median, limit;
+	char reason[64];
+
+	if (po->sr_factor) {
+		n = 0; sum = sumsq = 0;
+		for (sv = px->srv; sv; sv = sv->next) {
+			if (!outlier_eligible(sv, sv->outlier->win_ok + sv->outlier->win_err))
+				continue;
+			sr = (unsigned long long)sv->outlier->win_ok * 10000 /
+				(sv->outlier->win_ok + sv->outlier->win_err);
+			sum += sr;
+			sumsq += (unsigned long long)sr * sr;
+			n++;
+		}
+
+		if (n >= OUTLIER_MIN_SERVERS) {
+			for (sv = px->srv; sv; sv = sv->next) {
+				if (!outlier_eligible(sv, sv->outlier->win_ok + sv->outlier->win_err))
+					continue;
+				sr = (unsigned long long)sv->outlier->win_ok * 10000 /
+					(sv->outlier->win_ok + sv->outlier->win_err);
+
+				/* the server is compared with the other ones only,
+				 * otherwise it would widen the deviation it is
+				 * compared with, and could never stand out among
+				 * few servers.
+				 */
+				mean = (sum - sr) / (n - 1);
+				var = (sumsq - (unsigned long long)sr * sr) / (n - 1);
+				var = (var > (unsigned long long)mean * mean) ? var - (unsigned long long)mean * mean : 0;
+				if (var < 100 * 100)
+					var = 100 * 100;
+
+				if (sr >= mean)
+					continue;
+				dev = mean - sr;
+				if (dev * dev * 10000 <= (unsigned long long)po->sr_factor * po->sr_factor * var)
+					continue;
+				snprintf(reason, sizeof(reason), "success rate %u.%02u%% vs %u.%02u%% for the others",
+				         sr / 100, sr % 100, mean / 100, mean % 100);
+				outlier_eject(sv, reason);
+			}
+		}
+	}
+
+	if (po->lat_factor) {
+		n = 0;
+		memset(count, 0, sizeof(count));
+		for (sv = px->srv; sv; sv = sv->next) {
+			if (!outlier_eligible(sv, sv->outlier->win_lat))
+				continue;
+			count[outlier_lat_pctl(sv->outlier, po->lat_pctl)]++;
+			n++;
+		}
+
+		if (n >= OUTLIER_MIN_SERVERS) {
+			unsigned int seen = 0;
+
+			for (median = 0; median < OUTLIER_LAT_BUCKETS - 1; median++) {
+				seen += count[median];
+				if (seen * 2 >= n)
+					break;
+			}
+			median = MAX(outlier_lat_value(median), OUTLIER_LAT_FLOOR);
+			limit = (unsigned long long)median * po->lat_factor / 100;
+
+			for (sv = px->srv; sv; sv = sv->next) {
+				unsigned int lat;
+
+				if (!outlier_eligible(sv, sv->outlier->win_lat))
+					continue;
+				lat = outlier_lat_value(outlier_lat_pctl(sv->outlier, po->lat_pctl));
+				if (lat <= limit)
+					continue;
+				snprintf(reason, sizeof(reason), "%dth percentile latency %ums vs %ums median",
+				         po->lat_pctl, lat, median);
+				outlier_eject(sv, reason);
+			}
+		}
+	}
+}
+
+/* This task brings back the servers whose ejection is over, and at each
+ * interval, looks for outliers among the servers of its proxy then moves the
+ * observation windows forward.
+ */
+static struct task *outlier_process(struct task *t)
+{
+	struct proxy *px = t->context;
+	struct px_outlier *po = &px->outlier;
+	struct server *sv;
+
+	for (sv = px->srv; sv; sv = sv->next) {
+		if ((sv->state & SRV_EJECTED) && tick_is_expired(sv->outlier->expire, now_ms))
+			outlier_restore(sv);
+	}
+
+	if (tick_is_expired(po->next, now_ms)) {
+		outlier_analyse(px);
+
+		for (sv = px->srv; sv; sv = sv->next) {
+			struct srv_outlier *o = sv->outlier;
+
+			outlier_rotate(o);
+
+			/* the backoff steps down each time the server stays in
+			 * service as long as its last ejection lasted.
+			 */
+			if (!(sv->state & SRV_EJECTED) && o->ejections &&
+			    tick_is_expired(tick_add(o->expire, MS_TO_TICKS(outlier_eject_time(px, o->ejections))), now_ms)) {
+				o->ejections--;
+				o->expire = now_ms;
+			}
+		}
+		po->next = tick_add(now_ms, MS_TO_TICKS(po->interval));
+	}
+
+	t->expire = po->next;
+	for (sv = px->srv; sv; sv = sv->next) {
+		if (sv->state & SRV_EJECTED)
+			t->expire = tick_first(t->expire, sv->outlier->expire);
+	}
+	return t;
+}
+
+/* Accounts for the outcome <status> (one of HANA_STATUS_*) of a request sent
+ * to server <sv>, and ejects the server if its error ratio reaches the limit.
+ * In HTTP mode, only the responses matter.
+ */
+void outlier_observe(struct server *sv, short status)
+{
+	struct srv_outlier *o = sv->outlier;
+	struct px_outlier *po = &sv->proxy->outlier;
+	unsigned int total;
+	char reason[64];
+
+	switch (status) {
+	case HANA_STATUS_L4_OK:
+		if (sv->proxy->mode == PR_MODE_HTTP)
+			return;
+		/* fall through */
+	case HANA_STATUS_HTTP_OK:
+		o->slot[o->cur].ok++;
+		o->win_ok++;
+		return;
+
+	case HANA_STATUS_L4_ERR:
+	case HANA_STATUS_HTTP_STS:
+	case HANA_STATUS_HTTP_HDRRSP:
+	case HANA_STATUS_HTTP_RSP:
+	case HANA_STATUS_HTTP_READ_ERROR:
+	case HANA_STATUS_HTTP_READ_TIMEOUT:
+	case HANA_STATUS_HTTP_BROKEN_PIPE:
+		o->slot[o->cur].err++;
+		o->win_err++;
+		break;
+
+	default:
+		return;
+	}
+
+	if (!po->error_pct || (sv->state & SRV_EJECTED))
+		return;
+
+	total = o->win_ok + o->win_err;
+	if (total < po->min_requests || (unsigned long long)o->win_err * 100 < (unsigned long long)po->error_pct * total)
+		return;
+
+	snprintf(reason, sizeof(reason), "%u errors out of %u requests", o->win_err, total);
+	outlier_eject(sv, reason);
+}
+
+/* Accounts for a request of server <sv> which took <ms> milliseconds. */
+void outlier_observe_latency(struct server *sv, int ms)
+{
+	struct srv_outlier *o = sv->outlier;
+
+	o->slot[o->cur].lat[outlier_lat_bucket(ms)]++;
+	o->win_lat++;
+}
+
+/* Allocates the observation windows of the servers of all proxies running
+ * outlier detection, and starts their analysis tasks. Returns 0 if OK, or -1
+ * in case of error, in which case an alert has already been emitted.
+ */
+int start_outlier_detection()
+{
+	struct proxy *px;
+	struct server *sv;
+	struct task *t;
+
+	for (px = proxy; px; px = px->next) {
+		if (!px->outlier.interval || !(px->cap & PR_CAP_BE) || px->state == PR_STSTOPPED)
+			continue;
+
+		for (sv = px->srv; sv; sv = sv->next) {
+			sv->outlier = calloc(1, sizeof(*sv->outlier));
+			if (!sv->outlier) {
+				Alert("Starting [%s:%s] outlier detection: out of memory.\n", px->id, sv->id);
+				return -1;
+			}
+			sv->outlier->expire = TICK_ETERNITY;
+		}
+
+		if ((t = task_new()) == NULL) {
+			Alert("Starting [%s] outlier detection: out of memory.\n", px->id);
+			return -1;
+		}
+
+		px->outlier.task = t;
+		t->process = outlier_process;
+		t->context = px;
+		t->class = TASK_CL_CHECK;
+		px->outlier.next = tick_add(now_ms, MS_TO_TICKS(px->outlier.interval));
+		t->expire = px->outlier.next;
+		task_queue(t);
+	}
+	return 0;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
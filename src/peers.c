@@ -1094,6 +1094,7 @@ static void peer_session_forceshutdown(struct session * session)
 int peer_accept(struct session *s)
 {
 	s->target = &peer_applet.obj_type;
+	s->task->class = TASK_CL_PEERS;
 	/* no need to initialize the applet, it will start with st0=st1 = 0 */
 
 	tv_zero(&s->logs.tv_request);
@@ -1151,6 +1152,7 @@ static struct session *peer_session_create(struct peer *peer, struct peer_sessio
 	t->process = l->handler;
 	t->context = s;
 	t->nice = l->nice;
+	t->class = TASK_CL_PEERS;
 
 	s->task = t;
 	s->listener = l;
@@ -1198,6 +1200,7 @@ static struct session *peer_session_create(struct peer *peer, struct peer_sessio
 
 	session_init_srv_conn(s);
 	s->pend_pos = NULL;
+	s->queue_class = QUEUE_CLASS_DEFAULT;
 
 	/* init store persistence */
 	s->store_count = 0;
@@ -1514,6 +1517,7 @@ void peers_register_table(struct peers *peers, struct stktable *table)
 		listener->maxconn = peers->peers_fe->maxconn;
 	st->sync_task = task_new();
 	st->sync_task->process = process_peer_sync;
+	st->sync_task->class = TASK_CL_PEERS;
 	st->sync_task->expire = TICK_ETERNITY;
 	st->sync_task->context = (void *)st;
 	table->sync_task =st->sync_task;
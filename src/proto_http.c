@@ -3265,6 +3265,25 @@ http_req_get_intercept_rule(struct proxy *px, struct list *rules, struct session
 			s->logs.level = rule->arg.loglevel;
 			break;
 
+		case HTTP_REQ_ACT_SET_PRIO: {
+			struct sample *smp;
+			int class = rule->arg.prio.value;
+
+			if (rule->arg.prio.expr) {
+				smp = sample_process(px, s, txn, SMP_OPT_DIR_REQ|SMP_OPT_FINAL, rule->arg.prio.expr, NULL);
+				if (!smp || !sample_convert(smp, SMP_T_SINT))
+					break;
+				class = smp->data.sint;
+			}
+
+			if (class < 0)
+				class = 0;
+			else if (class >= QUEUE_CLASSES)
+				class = QUEUE_CLASSES - 1;
+			s->queue_class = class;
+			break;
+		}
+
 		case HTTP_REQ_ACT_DEL_HDR:
 		case HTTP_REQ_ACT_SET_HDR:
 			ctx.idx = 0;
@@ -5997,6 +6016,8 @@ skip_content_length:
 
 	/* we want to have the response time before we start processing it */
 	s->logs.t_data = tv_ms_elapsed(&s->logs.tv_accept, &now);
+	if (objt_server(s->target) && s->logs.t_connect >= 0)
+		srv_update_latency(objt_server(s->target), -1, s->logs.t_data - s->logs.t_connect);
 
 	/* end of job, return OK */
 	rep->analysers &= ~an_bit;
@@ -8627,6 +8648,7 @@ void http_reset_txn(struct session *s)
 	s->uniq_id = global.req_count++;
 
 	s->pend_pos = NULL;
+	s->queue_class = QUEUE_CLASS_DEFAULT;
 
 	s->req->flags |= CF_READ_DONTWAIT; /* one read is usually enough */
 
@@ -8717,6 +8739,46 @@ struct http_req_rule *parse_http_req_cond(const char **args, const char *file, i
 		else if (rule->arg.nice > 1024)
 			rule->arg.nice = 1024;
 		cur_arg++;
+	} else if (!strcmp(args[0], "set-priority-class")) {
+		char *err;
+
+		rule->action = HTTP_REQ_ACT_SET_PRIO;
+		cur_arg = 1;
+
+		if (!*args[cur_arg] ||
+		    (*args[cur_arg + 1] && strcmp(args[cur_arg + 1], "if") != 0 && strcmp(args[cur_arg + 1], "unless") != 0)) {
+			Alert("parsing [%s:%d]: 'http-request %s' expects exactly 1 argument (integer value or sample expression).\n",
+			      file, linenum, args[0]);
+			goto out_err;
+		}
+
+		rule->arg.prio.value = strtol(args[cur_arg], &err, 10);
+		if (*err) {
+			struct sample_expr *expr;
+			char *errmsg = NULL;
+
+			proxy->conf.args.ctx = ARGC_HRQ;
+			expr = sample_parse_expr((char **)args, &cur_arg, file, linenum, &errmsg, &proxy->conf.args);
+			if (!expr) {
+				Alert("parsing [%s:%d]: 'http-request %s' : %s.\n",
+				      file, linenum, args[0], errmsg);
+				free(errmsg);
+				goto out_err;
+			}
+
+			if (!(expr->fetch->val & ((proxy->cap & PR_CAP_FE) ? SMP_VAL_FE_HRQ_HDR : SMP_VAL_BE_HRQ_HDR))) {
+				Alert("parsing [%s:%d]: 'http-request %s' : fetch method '%s' extracts information from '%s', none of which is available here.\n",
+				      file, linenum, args[0], args[cur_arg - 1], sample_src_names(expr->fetch->use));
+				free(expr);
+				goto out_err;
+			}
+
+			/* check if we need to allocate an hdr_idx struct for HTTP parsing */
+			proxy->http_needed |= !!(expr->fetch->use & SMP_USE_HTTP_ANY);
+			rule->arg.prio.expr = expr;
+		}
+		else
+			cur_arg++;
 	} else if (!strcmp(args[0], "set-tos")) {
 #ifdef IP_TOS
 		char *err;
@@ -8971,7 +9033,7 @@ struct http_req_rule *parse_http_req_cond(const char **args, const char *file, i
 			goto out_err;
 		}
 	} else {
-		Alert("parsing [%s:%d]: 'http-request' expects 'allow', 'deny', 'auth', 'redirect', 'tarpit', 'add-header', 'set-header', 'set-nice', 'set-tos', 'set-mark', 'set-log-level', 'add-acl', 'del-acl', 'del-map', 'set-map', but got '%s'%s.\n",
+		Alert("parsing [%s:%d]: 'http-request' expects 'allow', 'deny', 'auth', 'redirect', 'tarpit', 'add-header', 'set-header', 'set-nice', 'set-tos', 'set-mark', 'set-log-level', 'set-priority-class', 'add-acl', 'del-acl', 'del-map', 'set-map', but got '%s'%s.\n",
 		      file, linenum, args[0], *args[0] ? "" : " (missing argument)");
 		goto out_err;
 	}
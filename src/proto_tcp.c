@@ -846,6 +846,18 @@ int tcp_bind_listener(struct listener *listener, char *errmsg, int errlen)
 		}
 	}
 #endif
+#if defined(SO_BUSY_POLL)
+	if (global.tune.busy_poll) {
+		/* Note: this might fail if not CAP_NET_ADMIN. Accepted sockets
+		 * inherit the setting.
+		 */
+		int spin = global.tune.busy_poll;
+		if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &spin, sizeof(spin)) == -1) {
+			msg = "cannot enable SO_BUSY_POLL";
+			err |= ERR_WARN;
+		}
+	}
+#endif
 #if defined(IPV6_V6ONLY)
 	if (listener->options & LI_O_V6ONLY)
                 setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one));
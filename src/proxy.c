@@ -508,9 +508,12 @@ int proxy_cfg_ensure_no_http(struct proxy *curproxy)
  */
 void init_new_proxy(struct proxy *p)
 {
+	int i;
+
 	memset(p, 0, sizeof(struct proxy));
 	p->obj_type = OBJ_TYPE_PROXY;
-	LIST_INIT(&p->pendconns);
+	for (i = 0; i < QUEUE_CLASSES; i++)
+		LIST_INIT(&p->pendconns[i]);
 	LIST_INIT(&p->acl);
 	LIST_INIT(&p->http_req_rules);
 	LIST_INIT(&p->http_res_rules);
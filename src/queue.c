@@ -35,7 +35,7 @@ int init_pendconn()
  * expected that 0 < s->minconn <= s->maxconn when this is called. If the
  * server is currently warming up, the slowstart is also applied to the
  * resulting value, which can be lower than minconn in this case, but never
- * less than 1.
+ * less than 1. The server's adaptive limit, if enabled, applies likewise.
  */
 unsigned int srv_dynamic_maxconn(const struct server *s)
 {
@@ -50,6 +50,9 @@ unsigned int srv_dynamic_maxconn(const struct server *s)
 	else max = MAX(s->minconn,
 		       s->proxy->beconn * s->maxconn / s->proxy->fullconn);
 
+	if ((s->state & SRV_ADAPTIVE) && max > s->adapt_limit / SRV_ADAPT_SCALE)
+		max = MAX(1, s->adapt_limit / SRV_ADAPT_SCALE);
+
 	if ((s->state & SRV_WARMINGUP) &&
 	    now.tv_sec < s->last_change + s->slowstart &&
 	    now.tv_sec >= s->last_change) {
@@ -86,8 +89,10 @@ void process_srv_queue(struct server *s)
 /* Detaches the next pending connection from either a server or a proxy, and
  * returns its associated session. If no pending connection is found, NULL is
  * returned. Note that neither <srv> nor <px> may be NULL.
- * Priority is given to the oldest request in the queue if both <srv> and <px>
- * have pending requests. This ensures that no request will be left unserved.
+ * Priority is given to the request of the most urgent class, then to the
+ * oldest one if both <srv> and <px> have pending requests of the same class.
+ * This ensures that no request will be left unserved as long as the more
+ * urgent classes are not permanently loaded.
  * The <px> queue is not considered if the server (or a tracked server) is not
  * RUNNING, is disabled, or has a null weight (server going down). The <srv>
  * queue is still considered in this case, because if some connections remain
@@ -114,7 +119,9 @@ struct session *pendconn_get_next_sess(struct server *srv, struct proxy *px)
 			return NULL;
 	} else {
 		/* pendconn exists in the proxy queue */
-		if (!ps || tv_islt(&pp->sess->logs.tv_request, &ps->sess->logs.tv_request))
+		if (!ps || pp->class < ps->class ||
+		    (pp->class == ps->class &&
+		     tv_islt(&pp->sess->logs.tv_request, &ps->sess->logs.tv_request)))
 			ps = pp;
 	}
 	sess = ps->sess;
@@ -132,7 +139,8 @@ struct session *pendconn_get_next_sess(struct server *srv, struct proxy *px)
 }
 
 /* Adds the session <sess> to the pending connection list of server <sess>->srv
- * or to the one of <sess>->proxy if srv is NULL. All counters and back pointers
+ * or to the one of <sess>->proxy if srv is NULL, at the end of the list of its
+ * priority class <sess>->queue_class. All counters and back pointers
  * are updated accordingly. Returns NULL if no memory is available, otherwise the
  * pendconn itself. If the session was already marked as served, its flag is
  * cleared. It is illegal to call this function with a non-NULL sess->srv_conn.
@@ -149,15 +157,22 @@ struct pendconn *pendconn_add(struct session *sess)
 	sess->pend_pos = p;
 	p->sess = sess;
 	p->srv = srv = objt_server(sess->target);
+	p->class = sess->queue_class;
+	if (p->class < 0)
+		p->class = 0;
+	else if (p->class >= QUEUE_CLASSES)
+		p->class = QUEUE_CLASSES - 1;
 
 	if (sess->flags & SN_ASSIGNED && srv) {
-		LIST_ADDQ(&srv->pendconns, &p->list);
+		LIST_ADDQ(&srv->pendconns[p->class], &p->list);
+		srv->nbpend_class[p->class]++;
 		srv->nbpend++;
 		sess->logs.srv_queue_size += srv->nbpend;
 		if (srv->nbpend > srv->counters.nbpend_max)
 			srv->counters.nbpend_max = srv->nbpend;
 	} else {
-		LIST_ADDQ(&sess->be->pendconns, &p->list);
+		LIST_ADDQ(&sess->be->pendconns[p->class], &p->list);
+		sess->be->nbpend_class[p->class]++;
 		sess->be->nbpend++;
 		sess->logs.prx_queue_size += sess->be->nbpend;
 		if (sess->be->nbpend > sess->be->be_counters.nbpend_max)
@@ -176,10 +191,14 @@ void pendconn_free(struct pendconn *p)
 {
 	LIST_DEL(&p->list);
 	p->sess->pend_pos = NULL;
-	if (p->srv)
+	if (p->srv) {
+		p->srv->nbpend_class[p->class]--;
 		p->srv->nbpend--;
-	else
+	}
+	else {
+		p->sess->be->nbpend_class[p->class]--;
 		p->sess->be->nbpend--;
+	}
 	p->sess->be->totpend--;
 	pool_free2(pool2_pendconn, p);
 }
@@ -20,6 +20,7 @@
 
 #include <types/global.h>
 
+#include <proto/outlier.h>
 #include <proto/port_range.h>
 #include <proto/protocol.h>
 #include <proto/raw_sock.h>
@@ -198,6 +199,10 @@ void server_recalc_eweight(struct server *sv)
 
 	sv->eweight = (sv->uweight * w + px->lbprm.wmult - 1) / px->lbprm.wmult;
 
+	/* an ejected server must not receive any new traffic */
+	if (sv->state & SRV_EJECTED)
+		sv->eweight = 0;
+
 	/* now propagate the status change to any LB algorithms */
 	if (px->lbprm.update_server_eweight)
 		px->lbprm.update_server_eweight(sv);
@@ -211,6 +216,141 @@ void server_recalc_eweight(struct server *sv)
 	}
 }
 
+/* 2^(-i/16) in 1/65536 units, used to decay the averages by 1/16 half-lives */
+static const unsigned int srv_ewma_halflife_tab[16] = {
+	65536, 62757, 60097, 57549, 55109, 52773, 50535, 48393,
+	46341, 44376, 42495, 40693, 38968, 37316, 35734, 34219
+};
+
+/* Returns the average <avg> of server <sv> multiplied by exp(-t/tau), where t
+ * is the time elapsed since its last latency sample and tau is such that the
+ * average is halved every SRV_EWMA_HALFLIFE ms. The decay progresses by steps
+ * of 1/16 of the half-life.
+ */
+unsigned int srv_ewma_now(const struct server *sv, unsigned int avg)
+{
+	unsigned int steps = (unsigned int)(now_ms - sv->ewma_date) / (SRV_EWMA_HALFLIFE / 16);
+
+	if (steps >= 32 * 16)
+		return 0;
+	return ((unsigned long long)avg * srv_ewma_halflife_tab[steps % 16] >> 16) >> (steps / 16);
+}
+
+/* Updates the peak-EWMA <avg> with the time sample <ms> in milliseconds. */
+static inline unsigned int srv_ewma(unsigned int avg, int ms)
+{
+	unsigned int val = ms * SRV_EWMA_SCALE;
+
+	if (val >= avg)
+		return val;
+	return avg - (avg - val + SRV_EWMA_DECAY - 1) / SRV_EWMA_DECAY;
+}
+
+/* Returns the integer square root of <n> */
+static unsigned int srv_isqrt(unsigned int n)
+{
+	unsigned int root = 0, bit = 1U << 30;
+
+	while (bit > n)
+		bit >>= 2;
+
+	while (bit) {
+		if (n >= root + bit) {
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+		bit >>= 2;
+	}
+	return root;
+}
+
+/* Adjusts the adaptive connection limit of server <sv> after a response time
+ * sample of <rtime> milliseconds. This is a gradient method : as long as the
+ * average response time remains close to the no-load one (the lowest one seen
+ * recently), the server does not queue requests internally and the limit may
+ * grow by its square root. Once the average gets more than SRV_ADAPT_TOLERANCE
+ * times slower, the limit is scaled down by the ratio of both times, which is
+ * never less than half. The result is smoothed like the response time, and
+ * bounded by 1 and the server's maxconn.
+ */
+static void srv_adapt_limit(struct server *sv, int rtime)
+{
+	unsigned int sample = rtime * SRV_EWMA_SCALE;
+	unsigned int noload, cur, grad, limit, max;
+	int diff;
+
+	/* the no-load time follows faster samples immediately. Slower ones are
+	 * only considered when the request was alone on the server, so that a
+	 * permanent slowdown may be tracked without being fooled by the load.
+	 */
+	if (!sv->min_rtime || sample < sv->min_rtime)
+		sv->min_rtime = sample;
+	else if (sv->served <= 1)
+		sv->min_rtime += (sample - sv->min_rtime + SRV_EWMA_DECAY - 1) / SRV_EWMA_DECAY;
+
+	/* 1ms is added to both times so that sub-millisecond variations
+	 * cannot make the ratio go wild.
+	 */
+	noload = sv->min_rtime + SRV_EWMA_SCALE;
+	cur = sv->ewma_rtime + SRV_EWMA_SCALE;
+	grad = (unsigned long long)SRV_ADAPT_SCALE * SRV_ADAPT_TOLERANCE * noload / cur;
+	if (grad > SRV_ADAPT_SCALE)
+		grad = SRV_ADAPT_SCALE;
+	else if (grad < SRV_ADAPT_SCALE / 2)
+		grad = SRV_ADAPT_SCALE / 2;
+
+	limit = (unsigned long long)sv->adapt_limit * grad / SRV_ADAPT_SCALE +
+		srv_isqrt(sv->adapt_limit / SRV_ADAPT_SCALE) * SRV_ADAPT_SCALE;
+
+	diff = (int)(limit - sv->adapt_limit) / SRV_EWMA_DECAY;
+	limit = sv->adapt_limit + diff;
+
+	max = sv->maxconn * SRV_ADAPT_SCALE;
+	if ((int)limit < SRV_ADAPT_SCALE)
+		limit = SRV_ADAPT_SCALE;
+	else if (limit > max)
+		limit = max;
+	sv->adapt_limit = limit;
+}
+
+/* Feeds the connect and response time averages of server <sv> with the time
+ * samples <ctime> and <rtime> in milliseconds. Negative samples are ignored.
+ * The adaptive connection limit and the outlier detection are updated if
+ * enabled, and the LB algorithm is notified if it relies on these averages.
+ */
+void srv_update_latency(struct server *sv, int ctime, int rtime)
+{
+	struct proxy *px = sv->proxy;
+
+	/* both averages are brought to the current date before being fed */
+	sv->ewma_ctime = srv_ewma_now(sv, sv->ewma_ctime);
+	sv->ewma_rtime = srv_ewma_now(sv, sv->ewma_rtime);
+	sv->ewma_date = now_ms;
+
+	if (ctime >= 0)
+		sv->ewma_ctime = srv_ewma(sv->ewma_ctime, ctime);
+	if (rtime >= 0) {
+		sv->ewma_rtime = srv_ewma(sv->ewma_rtime, rtime);
+		if (sv->state & SRV_ADAPTIVE)
+			srv_adapt_limit(sv, rtime);
+	}
+
+	/* the outlier detection compares response times in HTTP mode and
+	 * connect times otherwise.
+	 */
+	if (sv->outlier) {
+		int ms = (px->mode == PR_MODE_HTTP) ? rtime : ctime;
+
+		if (ms >= 0)
+			outlier_observe_latency(sv, ms);
+	}
+
+	if (px->lbprm.server_update_latency)
+		px->lbprm.server_update_latency(sv);
+}
+
 /*
  * Parses weight_str and configures sv accordingly.
  * Returns NULL on success, error message string otherwise.
@@ -257,32 +397,10 @@ const char *server_parse_weight_change_request(struct server *sv,
 	return NULL;
 }
 
+/* The connection and buffers of the check are only allocated when it runs */
 static int init_check(struct check *check, int type, const char * file, int linenum)
 {
 	check->type = type;
-
-	/* Allocate buffer for requests... */
-	if ((check->bi = calloc(sizeof(struct buffer) + global.tune.chksize, sizeof(char))) == NULL) {
-		Alert("parsing [%s:%d] : out of memory while allocating check buffer.\n", file, linenum);
-		return ERR_ALERT | ERR_ABORT;
-	}
-	check->bi->size = global.tune.chksize;
-
-	/* Allocate buffer for responses... */
-	if ((check->bo = calloc(sizeof(struct buffer) + global.tune.chksize, sizeof(char))) == NULL) {
-		Alert("parsing [%s:%d] : out of memory while allocating check buffer.\n", file, linenum);
-		return ERR_ALERT | ERR_ABORT;
-	}
-	check->bo->size = global.tune.chksize;
-
-	/* Allocate buffer for partial results... */
-	if ((check->conn = calloc(1, sizeof(struct connection))) == NULL) {
-		Alert("parsing [%s:%d] : out of memory while allocating check connection.\n", file, linenum);
-		return ERR_ALERT | ERR_ABORT;
-	}
-
-	check->conn->t.sock.fd = -1; /* no agent in progress yet */
-
 	return 0;
 }
 
@@ -298,6 +416,7 @@ int parse_server(const char *file, int linenum, char **args, struct proxy *curpr
 		int cur_arg;
 		short realport = 0;
 		int do_agent = 0, do_check = 0, defsrv = (*args[0] == 'd');
+		int i;
 
 		if (!defsrv && curproxy == defproxy) {
 			Alert("parsing [%s:%d] : '%s' not allowed in 'defaults' section.\n", file, linenum, args[0]);
@@ -342,7 +461,8 @@ int parse_server(const char *file, int linenum, char **args, struct proxy *curpr
 
 			newsrv->obj_type = OBJ_TYPE_SERVER;
 			LIST_INIT(&newsrv->actconns);
-			LIST_INIT(&newsrv->pendconns);
+			for (i = 0; i < QUEUE_CLASSES; i++)
+				LIST_INIT(&newsrv->pendconns[i]);
 			do_check = 0;
 			do_agent = 0;
 			newsrv->state = SRV_RUNNING; /* early server setup */
@@ -607,6 +727,10 @@ int parse_server(const char *file, int linenum, char **args, struct proxy *curpr
 				newsrv->state |= SRV_BACKUP;
 				cur_arg ++;
 			}
+			else if (!defsrv && !strcmp(args[cur_arg], "adaptive-maxconn")) {
+				newsrv->state |= SRV_ADAPTIVE;
+				cur_arg ++;
+			}
 			else if (!defsrv && !strcmp(args[cur_arg], "non-stick")) {
 				newsrv->state |= SRV_NON_STICK;
 				cur_arg ++;
@@ -187,6 +187,7 @@ int session_accept(struct listener *l, int cfd, struct sockaddr_storage *addr)
 
 	t->context = s;
 	t->nice = l->nice;
+	t->class = TASK_CL_SESSION;
 	s->task = t;
 
 	/* Finish setting the callbacks. Right now the transport layer is present
@@ -461,6 +462,7 @@ int session_complete(struct session *s)
 	session_init_srv_conn(s);
 	s->target = NULL;
 	s->pend_pos = NULL;
+	s->queue_class = QUEUE_CLASS_DEFAULT;
 
 	/* init store persistence */
 	s->store_count = 0;
@@ -914,8 +916,11 @@ static void sess_establish(struct session *s, struct stream_interface *si)
 	s->logs.t_connect = tv_ms_elapsed(&s->logs.tv_accept, &now);
 	si->exp      = TICK_ETERNITY;
 
-	if (objt_server(s->target))
+	if (objt_server(s->target)) {
 		health_adjust(objt_server(s->target), HANA_STATUS_L4_OK);
+		if (s->logs.t_queue >= 0)
+			srv_update_latency(objt_server(s->target), s->logs.t_connect - s->logs.t_queue, -1);
+	}
 
 	if (s->be->mode == PR_MODE_TCP) { /* let's allow immediate data connection in this case */
 		/* if the user wants to log as soon as possible, without counting
@@ -1046,9 +1051,12 @@ static void sess_update_stream_int(struct session *s, struct stream_interface *s
 			/* ... and timeout expired */
 			si->exp = TICK_ETERNITY;
 			s->logs.t_queue = tv_ms_elapsed(&s->logs.tv_accept, &now);
-			if (srv)
+			if (srv) {
 				srv->counters.failed_conns++;
+				srv->counters.q_timeouts++;
+			}
 			s->be->be_counters.failed_conns++;
+			s->be->be_counters.q_timeouts++;
 			si_shutr(si);
 			si_shutw(si);
 			si->ob->flags |= CF_WRITE_TIMEOUT;
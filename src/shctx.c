@@ -26,6 +26,7 @@
 #endif
 #include <arpa/inet.h>
 #include "ebmbtree.h"
+#include "common/hash.h"
 #include "proto/shctx.h"
 
 struct shsess_packet_hdr {
@@ -58,6 +59,11 @@ struct shared_block {
 	struct shared_block *n;
 };
 
+/* The cache is split into shards selected by a hash of the session id, each
+ * with its own lock, LRU list and tree, so that processes and handshake
+ * workers storing or looking up different sessions do not wait for each
+ * other.
+ */
 struct shared_context {
 #ifndef USE_PRIVATE_CACHE
 #ifdef USE_SYSCALL_FUTEX
@@ -66,6 +72,7 @@ struct shared_context {
 	pthread_mutex_t mutex;
 #endif
 #endif
+	int id;                     /* shard number, indexes shctx_stats[] */
 	struct shsess_packet_hdr upd;
 	unsigned char data[SHSESS_MAX_DATA_LEN];
 	short int data_len;
@@ -73,8 +80,19 @@ struct shared_context {
 	struct shared_block free;
 };
 
-/* Static shared context */
-static struct shared_context *shctx = NULL;
+/* Shards of the shared context. The pointers are set before the processes
+ * are forked and are thus valid in all of them.
+ */
+static struct shared_context *shctx_shard[SHCTX_MAX_SHARDS];
+static int shctx_nb_shards = 0;
+
+/* Per-process counters of each shard, only updated with the shard locked */
+static struct {
+	unsigned long long lookups;   /* sessions looked up */
+	unsigned long long misses;    /* sessions not found */
+	unsigned long long lock_waits; /* lock found held by someone else */
+} shctx_stats[SHCTX_MAX_SHARDS];
+
 #ifndef USE_PRIVATE_CACHE
 static int use_shared_mem = 0;
 #endif
@@ -136,7 +154,7 @@ static inline unsigned char atomic_dec(unsigned int *ptr)
 
 #endif
 
-static inline void _shared_context_lock(void)
+static inline void _shared_context_lock(struct shared_context *shctx)
 {
 	unsigned int x;
 
@@ -149,10 +167,11 @@ static inline void _shared_context_lock(void)
 			syscall(SYS_futex, &shctx->waiters, FUTEX_WAIT, 2, NULL, 0, 0);
 			x = xchg(&shctx->waiters, 2);
 		}
+		shctx_stats[shctx->id].lock_waits++;
 	}
 }
 
-static inline void _shared_context_unlock(void)
+static inline void _shared_context_unlock(struct shared_context *shctx)
 {
 	if (atomic_dec(&shctx->waiters)) {
 		shctx->waiters = 0;
@@ -160,13 +179,21 @@ static inline void _shared_context_unlock(void)
 	}
 }
 
-#define shared_context_lock()   if (use_shared_mem) _shared_context_lock()
+#define shared_context_lock()   if (use_shared_mem) _shared_context_lock(shctx)
 
-#define shared_context_unlock() if (use_shared_mem) _shared_context_unlock()
+#define shared_context_unlock() if (use_shared_mem) _shared_context_unlock(shctx)
 
 #else /* USE_SYSCALL_FUTEX */
 
-#define shared_context_lock()   if (use_shared_mem) pthread_mutex_lock(&shctx->mutex)
+static inline void _shared_context_lock(struct shared_context *shctx)
+{
+	if (pthread_mutex_trylock(&shctx->mutex) != 0) {
+		pthread_mutex_lock(&shctx->mutex);
+		shctx_stats[shctx->id].lock_waits++;
+	}
+}
+
+#define shared_context_lock()   if (use_shared_mem) _shared_context_lock(shctx)
 
 #define shared_context_unlock() if (use_shared_mem) pthread_mutex_unlock(&shctx->mutex)
 
@@ -204,8 +231,16 @@ static inline void _shared_context_unlock(void)
 
 /* shared session functions */
 
-/* Free session blocks, returns number of freed blocks */
-static int shsess_free(struct shared_session *shsess)
+/* Returns the shard in charge of the zero-padded session id <key> */
+static inline struct shared_context *shctx_get_shard(const unsigned char *key)
+{
+	if (shctx_nb_shards == 1)
+		return shctx_shard[0];
+	return shctx_shard[hash_djb2((const char *)key, SSL_MAX_SSL_SESSION_ID_LENGTH) % shctx_nb_shards];
+}
+
+/* Free session blocks of shard <shctx>, returns number of freed blocks */
+static int shsess_free(struct shared_context *shctx, struct shared_session *shsess)
 {
 	struct shared_block *block;
 	int ret = 1;
@@ -237,7 +272,7 @@ static int shsess_free(struct shared_session *shsess)
  * Returns a ptr on a free block if it succeeds, or NULL if there are not
  * enough blocks to store that session.
  */
-static struct shared_session *shsess_get_next(int data_len)
+static struct shared_session *shsess_get_next(struct shared_context *shctx, int data_len)
 {
 	int head = 0;
 	struct shared_block *b;
@@ -259,7 +294,7 @@ static struct shared_session *shsess_get_next(int data_len)
 		int freed;
 
 		shsess_tree_delete(&b->data.session);
-		freed = shsess_free(&b->data.session);
+		freed = shsess_free(shctx, &b->data.session);
 		if (!head)
 			data_len -= sizeof(b->data.session.data) + (freed-1)*sizeof(b->data.data);
 		else
@@ -271,17 +306,17 @@ static struct shared_session *shsess_get_next(int data_len)
 	return NULL;
 }
 
-/* store a session into the cache
+/* store a session into the cache shard <shctx>
  * s_id : session id padded with zero to SSL_MAX_SSL_SESSION_ID_LENGTH
  * data: asn1 encoded session
  * data_len: asn1 encoded session length
  * Returns 1 id session was stored (else 0)
  */
-static int shsess_store(unsigned char *s_id, unsigned char *data, int data_len)
+static int shsess_store(struct shared_context *shctx, unsigned char *s_id, unsigned char *data, int data_len)
 {
 	struct shared_session *shsess, *oldshsess;
 
-	shsess = shsess_get_next(data_len);
+	shsess = shsess_get_next(shctx, data_len);
 	if (!shsess) {
 		/* Could not retrieve enough free blocks to store that session */
 		return 0;
@@ -295,7 +330,7 @@ static int shsess_store(unsigned char *s_id, unsigned char *data, int data_len)
 	oldshsess = shsess_tree_insert(shsess);
 	if (oldshsess != shsess) {
 		/* free all blocks used by old node */
-		shsess_free(oldshsess);
+		shsess_free(shctx, oldshsess);
 		shsess = oldshsess;
 	}
 
@@ -349,6 +384,7 @@ int shctx_new_cb(SSL *ssl, SSL_SESSION *sess)
 {
 	unsigned char encsess[sizeof(struct shsess_packet)+SHSESS_MAX_DATA_LEN];
 	struct shsess_packet *packet = (struct shsess_packet *)encsess;
+	struct shared_context *shctx;
 	unsigned char *p;
 	int data_len, sid_length, sid_ctx_length;
 
@@ -374,10 +410,11 @@ int shctx_new_cb(SSL *ssl, SSL_SESSION *sess)
 	if (sid_length < SSL_MAX_SSL_SESSION_ID_LENGTH)
 		memset(&packet->hdr.id[sid_length], 0, SSL_MAX_SSL_SESSION_ID_LENGTH-sid_length);
 
+	shctx = shctx_get_shard(packet->hdr.id);
 	shared_context_lock();
 
 	/* store to cache */
-	shsess_store(packet->hdr.id, packet->data, data_len);
+	shsess_store(shctx, packet->hdr.id, packet->data, data_len);
 
 	shared_context_unlock();
 
@@ -392,6 +429,7 @@ err:
 /* SSL callback used on lookup an existing session cause none found in internal cache */
 SSL_SESSION *shctx_get_cb(SSL *ssl, unsigned char *key, int key_len, int *do_copy)
 {
+	struct shared_context *shctx;
 	struct shared_session *shsess;
 	unsigned char data[SHSESS_MAX_DATA_LEN], *p;
 	unsigned char tmpkey[SSL_MAX_SSL_SESSION_ID_LENGTH];
@@ -409,12 +447,15 @@ SSL_SESSION *shctx_get_cb(SSL *ssl, unsigned char *key, int key_len, int *do_cop
 	}
 
 	/* lock cache */
+	shctx = shctx_get_shard(key);
 	shared_context_lock();
+	shctx_stats[shctx->id].lookups++;
 
 	/* lookup for session */
 	shsess = shsess_tree_lookup(key);
 	if (!shsess) {
 		/* no session found: unlock cache and exit */
+		shctx_stats[shctx->id].misses++;
 		shared_context_unlock();
 		return NULL;
 	}
@@ -472,6 +513,7 @@ SSL_SESSION *shctx_get_cb(SSL *ssl, unsigned char *key, int key_len, int *do_cop
 /* SSL callback used to signal session is no more used in internal cache */
 void shctx_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
 {
+	struct shared_context *shctx;
 	struct shared_session *shsess;
 	unsigned char tmpkey[SSL_MAX_SSL_SESSION_ID_LENGTH];
 	unsigned char *key = sess->session_id;
@@ -484,6 +526,7 @@ void shctx_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
 		key = tmpkey;
 	}
 
+	shctx = shctx_get_shard(key);
 	shared_context_lock();
 
 	/* lookup for session */
@@ -491,7 +534,7 @@ void shctx_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
 	if (shsess) {
 		/* free session */
 		shsess_tree_delete(shsess);
-		shsess_free(shsess);
+		shsess_free(shctx, shsess);
 	}
 
 	/* unlock cache */
@@ -501,79 +544,121 @@ void shctx_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
 /* Allocate shared memory context.
  * <size> is maximum cached sessions.
  * If <size> is set to less or equal to 0, ssl cache is disabled.
+ * The cache is split into <shards> independently locked shards, each with
+ * an equal share of the blocks. A private cache always uses a single shard.
  * Returns: -1 on alloc failure, <size> if it performs context alloc,
  * and 0 if cache is already allocated.
  */
-int shared_context_init(int size, int shared)
+int shared_context_init(int size, int shared, int shards)
 {
-	int i;
+	int i, s, blocks;
 #ifndef USE_PRIVATE_CACHE
 #ifndef USE_SYSCALL_FUTEX
 	pthread_mutexattr_t attr;
 #endif /* USE_SYSCALL_FUTEX */
 #endif
-	struct shared_block *prev,*cur;
+	struct shared_context *shctx;
+	struct shared_block *blk, *cur;
+	size_t shard_size;
+	char *area;
 	int maptype = MAP_PRIVATE;
 
-	if (shctx)
+	if (shctx_nb_shards)
 		return 0;
 
 	if (size<=0)
 		return 0;
 
-	/* Increate size by one to reserve one node for lookup */
-	size++;
 #ifndef USE_PRIVATE_CACHE
 	if (shared)
 		maptype = MAP_SHARED;
+	else
 #endif
+		shards = 1;
 
-	shctx = (struct shared_context *)mmap(NULL, sizeof(struct shared_context)+(size*sizeof(struct shared_block)),
-	                                      PROT_READ | PROT_WRITE, maptype | MAP_ANON, -1, 0);
-	if (!shctx || shctx == MAP_FAILED) {
-		shctx = NULL;
+	if (shards > SHCTX_MAX_SHARDS)
+		shards = SHCTX_MAX_SHARDS;
+	if (shards > size)
+		shards = size;
+	if (shards < 1)
+		shards = 1;
+
+	/* Increate size by one to reserve one node for lookup */
+	blocks = (size + shards - 1) / shards + 1;
+	shard_size = sizeof(struct shared_context) + blocks * sizeof(struct shared_block);
+
+	area = mmap(NULL, shards * shard_size,
+	            PROT_READ | PROT_WRITE, maptype | MAP_ANON, -1, 0);
+	if (!area || area == MAP_FAILED)
 		return -1;
-	}
+
+#ifndef USE_PRIVATE_CACHE
+	if (maptype == MAP_SHARED)
+		use_shared_mem = 1;
+#endif
+
+	for (s = 0; s < shards; s++) {
+		shctx = (struct shared_context *)(area + s * shard_size);
+		shctx_shard[s] = shctx;
+		shctx->id = s;
 
 #ifndef USE_PRIVATE_CACHE
 #ifdef USE_SYSCALL_FUTEX
-	shctx->waiters = 0;
+		shctx->waiters = 0;
 #else
-	pthread_mutexattr_init(&attr);
-	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
-	pthread_mutex_init(&shctx->mutex, &attr);
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutex_init(&shctx->mutex, &attr);
 #endif
-	if (maptype == MAP_SHARED)
-		use_shared_mem = 1;
 #endif
 
-	memset(&shctx->active.data.session.key, 0, sizeof(struct ebmb_node));
-	memset(&shctx->free.data.session.key, 0, sizeof(struct ebmb_node));
+		memset(&shctx->active.data.session.key, 0, sizeof(struct ebmb_node));
+		memset(&shctx->free.data.session.key, 0, sizeof(struct ebmb_node));
 
-	/* No duplicate authorized in tree: */
-	shctx->active.data.session.key.node.branches = EB_ROOT_UNIQUE;
+		/* No duplicate authorized in tree: */
+		shctx->active.data.session.key.node.branches = EB_ROOT_UNIQUE;
 
-	/* Init remote update cache */
-	shctx->upd.eol = 0;
-	shctx->upd.seq = 0;
-	shctx->data_len = 0;
+		/* Init remote update cache */
+		shctx->upd.eol = 0;
+		shctx->upd.seq = 0;
+		shctx->data_len = 0;
 
-	cur = &shctx->active;
-	cur->n = cur->p = cur;
+		cur = &shctx->active;
+		cur->n = cur->p = cur;
 
-	cur = &shctx->free;
-	for (i = 0 ; i < size ; i++) {
-		prev = cur;
-		cur = (struct shared_block *)((char *)prev + sizeof(struct shared_block));
-		prev->n = cur;
-		cur->p = prev;
+		/* the blocks immediately follow their shard */
+		cur = &shctx->free;
+		blk = (struct shared_block *)(shctx + 1);
+		for (i = 0 ; i < blocks ; i++) {
+			blk[i].p = cur;
+			cur->n = &blk[i];
+			cur = &blk[i];
+		}
+		cur->n = &shctx->free;
+		shctx->free.p = cur;
 	}
-	cur->n = &shctx->free;
-	shctx->free.p = cur;
 
+	shctx_nb_shards = shards;
 	return size;
 }
 
+/* Reports the number of shards of the cache and sums the counters of all of
+ * them for the current process into <lookups>, <misses> and <lock_waits>.
+ */
+int shared_context_stats(unsigned long long *lookups, unsigned long long *misses,
+                         unsigned long long *lock_waits)
+{
+	int s;
+
+	*lookups = *misses = *lock_waits = 0;
+	for (s = 0; s < shctx_nb_shards; s++) {
+		*lookups    += shctx_stats[s].lookups;
+		*misses     += shctx_stats[s].misses;
+		*lock_waits += shctx_stats[s].lock_waits;
+	}
+	return shctx_nb_shards;
+}
+
 
 /* Set session cache mode to server and disable openssl internal cache.
  * Set shared cache callbacks on an ssl context.
@@ -582,7 +667,7 @@ void shared_context_set_cache(SSL_CTX *ctx)
 {
 	SSL_CTX_set_session_id_context(ctx, (const unsigned char *)SHCTX_APPNAME, strlen(SHCTX_APPNAME));
 
-	if (!shctx) {
+	if (!shctx_nb_shards) {
 		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
 		return;
 	}
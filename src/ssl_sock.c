@@ -27,6 +27,8 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -43,13 +45,18 @@
 #include <openssl/x509v3.h>
 #include <openssl/x509.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/rand.h>
 
+#include <common/base64.h>
 #include <common/buffer.h>
 #include <common/compat.h>
 #include <common/config.h>
 #include <common/debug.h>
 #include <common/errors.h>
+#include <common/memory.h>
+#include <common/mini-clist.h>
 #include <common/standard.h>
 #include <common/ticks.h>
 #include <common/time.h>
@@ -79,6 +86,11 @@
 #define SSL_SOCK_ST_FL_16K_WBFSIZE  0x00000002
 #define SSL_SOCK_SEND_UNLIMITED     0x00000004
 #define SSL_SOCK_RECV_HEARTBEAT     0x00000008
+#define SSL_SOCK_SEND_BLOCKED       0x00000010
+
+/* bits 0x0000FF00 store the server session cache entry offered plus one */
+#define SSL_SOCK_SESS_SLOT_TO_ST(s) ((((s) + 1) & 255) << 8)
+#define SSL_SOCK_ST_TO_SESS_SLOT(s) ((((s) >> 8) & 255) - 1)
 
 /* bits 0xFFFF0000 are reserved to store verify errors */
 
@@ -102,6 +114,63 @@ enum {
 int sslconns = 0;
 int totalsslconns = 0;
 
+/* Handshake worker threads, started on first use in each process when
+ * "tune.ssl.handshake-workers" is set. <started> is 1 once they are running
+ * and -1 if they could not be started, in which case handshakes are
+ * performed inline.
+ *
+ * The main thread never touches a connection while its job is running, but
+ * all the callbacks which may be called from SSL_do_handshake() also run in
+ * the workers, concurrently with the main thread and with each other. None of
+ * them may use the trash or any other global scratch area. Here is what they
+ * access :
+ *   - infocbk, msgcbk, verify, NPN and ALPN callbacks : only the connection
+ *     and the bind_conf, which is never modified after the configuration ;
+ *   - servername callback : the SNI trees, which are never modified after
+ *     the configuration. The lazy certificates are built without any lock
+ *     and installed under <lazy_certs_lock>, see ssl_sock_switch_lazy_ctx().
+ *     Their OCSP entry is inserted under <cert_ocsp_lock>, which the CLI
+ *     takes too ;
+ *   - ticket key callback : the keys ring of the bind_conf, which is read
+ *     under a sequence counter, see ssl_sock_get_tlskey() ;
+ *   - OCSP stapling callback : the current response of the certificate,
+ *     which is copied under <cert_ocsp_lock> ;
+ *   - shared session cache callbacks : the cache is always locked when
+ *     workers are configured, even with a single process.
+ */
+static struct {
+	int started;
+	int pipe[2];              /* wakes the main thread up, [0] is polled */
+	pthread_mutex_t lock;     /* protects the queues and the jobs' states */
+	pthread_cond_t work;      /* signaled when a job is queued */
+	pthread_cond_t idle;      /* signaled when a job leaves the RUNNING state */
+	struct list queue;        /* jobs waiting for a worker */
+	struct list done;         /* jobs waiting for the main thread */
+} ssl_async = {
+	.lock  = PTHREAD_MUTEX_INITIALIZER,
+	.work  = PTHREAD_COND_INITIALIZER,
+	.idle  = PTHREAD_COND_INITIALIZER,
+	.queue = LIST_HEAD_INIT(ssl_async.queue),
+	.done  = LIST_HEAD_INIT(ssl_async.done),
+};
+
+/* list of all the "tls-ticket-keys" files, for the CLI */
+struct list tlskeys_reference = LIST_HEAD_INIT(tlskeys_reference);
+
+static int ssl_async_idx = -1;          /* SSL ex_data index of the pending job */
+static struct pool_head *pool2_ssl_async = NULL;
+
+static int ssl_dyn_rec_idx = -1;        /* SSL ex_data index of the record sizing state */
+static struct pool_head *pool2_ssl_dyn_rec = NULL;
+
+/* Lazily loaded certificates ("tune.ssl.lazy-certs"). The LRU holds the
+ * resident ones, most recently used first. The lock is needed because the
+ * servername callback may run in handshake worker threads.
+ */
+struct lazy_cert_stats lazy_certs;
+static struct list lazy_certs_lru = LIST_HEAD_INIT(lazy_certs_lru);
+static pthread_mutex_t lazy_certs_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void ssl_sock_infocbk(const SSL *ssl, int where, int ret)
 {
 	struct connection *conn = (struct connection *)SSL_get_app_data(ssl);
@@ -258,16 +327,203 @@ static int ssl_sock_advertise_alpn_protos(SSL *s, const unsigned char **out,
 }
 #endif
 
+#ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
+/* Copies into <key> the newest key of <ref> if <name> is NULL, otherwise the
+ * key called <name>. Returns the age of the key (0 for the newest one), or -1
+ * if it is not known. This may run in handshake workers while the CLI updates
+ * the ring, so the copy is retried until no update happened during it.
+ */
+static int ssl_sock_get_tlskey(struct tls_keys_ref *ref, const unsigned char *name, struct tls_sess_key *key)
+{
+	unsigned int seq;
+	int head, i;
+
+	do {
+		seq = ref->seq;
+		__sync_synchronize();
+		head = ref->enc_index;
+		for (i = 0; i < ref->nb_keys; i++) {
+			/* walk from the newest key to the oldest one */
+			if (!name || memcmp(name, ref->keys[(head + TLS_TICKETS_NO - i) % TLS_TICKETS_NO].name, 16) == 0)
+				break;
+		}
+		if (i < ref->nb_keys)
+			memcpy(key, &ref->keys[(head + TLS_TICKETS_NO - i) % TLS_TICKETS_NO], sizeof(*key));
+		__sync_synchronize();
+	} while ((seq & 1) || seq != ref->seq);
+
+	return i < ref->nb_keys ? i : -1;
+}
+
+/* This callback encrypts and decrypts the session tickets with the keys of
+ * the "tls-ticket-keys" file of the bind line. New tickets are always
+ * encrypted with the newest key, and tickets encrypted with an older key
+ * which is still known are accepted but renewed. Since no session state is
+ * kept, resumption works across all the machines sharing the keys.
+ */
+static int ssl_tlsext_ticket_key_cb(SSL *s, unsigned char key_name[16], unsigned char *iv,
+                                    EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc)
+{
+	struct connection *conn = (struct connection *)SSL_get_app_data(s);
+	struct tls_keys_ref *ref = objt_listener(conn->target)->bind_conf->keys_ref;
+	struct tls_sess_key key;
+	int i;
+
+	if (enc) {
+		ssl_sock_get_tlskey(ref, NULL, &key);
+		memcpy(key_name, key.name, 16);
+		if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) <= 0)
+			return -1;
+		if (!EVP_EncryptInit_ex(ectx, EVP_aes_128_cbc(), NULL, key.aes_key, iv))
+			return -1;
+		HMAC_Init_ex(hctx, key.hmac_key, 16, EVP_sha256(), NULL);
+		return 1;
+	}
+
+	i = ssl_sock_get_tlskey(ref, key_name, &key);
+	if (i < 0)
+		return 0; /* unknown key, perform a full handshake */
+
+	HMAC_Init_ex(hctx, key.hmac_key, 16, EVP_sha256(), NULL);
+	if (!EVP_DecryptInit_ex(ectx, EVP_aes_128_cbc(), NULL, key.aes_key, iv))
+		return -1;
+
+	/* 2 asks for a new ticket encrypted with the newest key */
+	return i ? 2 : 1;
+}
+#endif
+
+/* Decodes the base64-encoded TLS ticket key <b64> and makes it the newest
+ * key of <ref>, replacing the oldest one if the ring is full. Returns 0 on
+ * success, otherwise non-zero with an error message in <err>. This is only
+ * called from the main thread, but handshakes running in workers at the same
+ * time may read the ring, see ssl_sock_get_tlskey().
+ */
+int ssl_sock_update_tlskey(struct tls_keys_ref *ref, const char *b64, char **err)
+{
+	struct tls_sess_key key;
+	int next;
+
+	if (base64dec(b64, strlen(b64), (char *)&key, sizeof(key)) != sizeof(key)) {
+		memprintf(err, "a TLS ticket key must be made of %d base64-encoded bytes",
+			  (int)sizeof(key));
+		return 1;
+	}
+
+	ref->seq++;
+	__sync_synchronize();
+	next = (ref->enc_index + 1) % TLS_TICKETS_NO;
+	memcpy(&ref->keys[next], &key, sizeof(key));
+	ref->enc_index = next;
+	if (ref->nb_keys < TLS_TICKETS_NO)
+		ref->nb_keys++;
+	__sync_synchronize();
+	ref->seq++;
+	return 0;
+}
+
+/* Returns the TLS ticket keys reference designated by <reference>, which is
+ * either "#<id>" or the name of the file the keys were loaded from, or NULL
+ * if not found.
+ */
+struct tls_keys_ref *tlskeys_ref_lookup(const char *reference)
+{
+	struct tls_keys_ref *ref;
+	char *end;
+	int id;
+
+	if (*reference == '#') {
+		id = strtol(reference + 1, &end, 10);
+		if (!reference[1] || *end)
+			return NULL;
+		list_for_each_entry(ref, &tlskeys_reference, list)
+			if (ref->unique_id == id)
+				return ref;
+		return NULL;
+	}
+
+	list_for_each_entry(ref, &tlskeys_reference, list)
+		if (strcmp(ref->filename, reference) == 0)
+			return ref;
+	return NULL;
+}
+
+/* Loads the TLS ticket keys from file <path>, one base64-encoded key per
+ * line, the last one being the newest. Empty lines and lines starting with
+ * '#' are ignored. Only the last TLS_TICKETS_NO keys are kept. Returns the
+ * new reference, or NULL with an error message in <err>.
+ */
+static struct tls_keys_ref *ssl_sock_load_tlskeys(const char *path, char **err)
+{
+	struct tls_keys_ref *ref;
+	char line[512], *p;
+	int linenum = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		memprintf(err, "unable to open TLS ticket keys file '%s'", path);
+		return NULL;
+	}
+
+	ref = calloc(1, sizeof(*ref));
+	if (!ref) {
+		memprintf(err, "out of memory");
+		goto out_close;
+	}
+	ref->enc_index = TLS_TICKETS_NO - 1;
+
+	while (fgets(line, sizeof(line), f)) {
+		linenum++;
+		for (p = line + strlen(line); p > line && isspace((unsigned char)p[-1]); p--)
+			;
+		*p = 0;
+		for (p = line; isspace((unsigned char)*p); p++)
+			;
+		if (!*p || *p == '#')
+			continue;
+
+		if (ssl_sock_update_tlskey(ref, p, err)) {
+			memprintf(err, "%s at line %d of file '%s'", *err, linenum, path);
+			goto out_free;
+		}
+	}
+
+	if (!ref->nb_keys) {
+		memprintf(err, "no TLS ticket key found in file '%s'", path);
+		goto out_free;
+	}
+
+	ref->filename = strdup(path);
+	ref->unique_id = LIST_ISEMPTY(&tlskeys_reference) ? 0 :
+		LIST_PREV(&tlskeys_reference, struct tls_keys_ref *, list)->unique_id + 1;
+	LIST_ADDQ(&tlskeys_reference, &ref->list);
+	fclose(f);
+	return ref;
+
+ out_free:
+	free(ref);
+ out_close:
+	fclose(f);
+	return NULL;
+}
+
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+static int ssl_sock_switch_lazy_ctx(SSL *ssl, struct lazy_cert *lc);
+
 /* Sets the SSL ctx of <ssl> to match the advertised server name. Returns a
  * warning when no match is found, which implies the default (first) cert
- * will keep being used.
+ * will keep being used. This may run in a handshake worker thread, so the
+ * name is lowercased into a local buffer and not into the trash. Names longer
+ * than a DNS name cannot match any certificate.
  */
 static int ssl_sock_switchctx_cbk(SSL *ssl, int *al, struct bind_conf *s)
 {
 	const char *servername;
 	const char *wildp = NULL;
 	struct ebmb_node *node, *n;
+	struct sni_ctx *sni;
+	char name[256];
 	int i;
 	(void)al; /* shut gcc stupid warning */
 
@@ -278,17 +534,20 @@ static int ssl_sock_switchctx_cbk(SSL *ssl, int *al, struct bind_conf *s)
 			SSL_TLSEXT_ERR_NOACK);
 	}
 
-	for (i = 0; i < trash.size; i++) {
-		if (!servername[i])
-			break;
-		trash.str[i] = tolower(servername[i]);
-		if (!wildp && (trash.str[i] == '.'))
-			wildp = &trash.str[i];
+	for (i = 0; servername[i]; i++) {
+		if (i >= sizeof(name) - 1) {
+			return (s->strict_sni ?
+				SSL_TLSEXT_ERR_ALERT_FATAL :
+				SSL_TLSEXT_ERR_ALERT_WARNING);
+		}
+		name[i] = tolower(servername[i]);
+		if (!wildp && (name[i] == '.'))
+			wildp = &name[i];
 	}
-	trash.str[i] = 0;
+	name[i] = 0;
 
 	/* lookup in full qualified names */
-	node = ebst_lookup(&s->sni_ctx, trash.str);
+	node = ebst_lookup(&s->sni_ctx, name);
 
 	/* lookup a not neg filter */
 	for (n = node; n; n = ebmb_next_dup(n)) {
@@ -307,8 +566,18 @@ static int ssl_sock_switchctx_cbk(SSL *ssl, int *al, struct bind_conf *s)
 			SSL_TLSEXT_ERR_ALERT_WARNING);
 	}
 
-	/* switch ctx */
-	SSL_set_SSL_CTX(ssl, container_of(node, struct sni_ctx, name)->ctx);
+	sni = container_of(node, struct sni_ctx, name);
+	if (!sni->lazy) {
+		/* switch ctx */
+		SSL_set_SSL_CTX(ssl, sni->ctx);
+		return SSL_TLSEXT_ERR_OK;
+	}
+
+	if (!ssl_sock_switch_lazy_ctx(ssl, sni->lazy)) {
+		return (s->strict_sni ?
+			SSL_TLSEXT_ERR_ALERT_FATAL :
+			SSL_TLSEXT_ERR_ALERT_WARNING);
+	}
 	return SSL_TLSEXT_ERR_OK;
 }
 #endif /* SSL_CTRL_SET_TLSEXT_HOSTNAME */
@@ -387,7 +656,10 @@ end:
 }
 #endif
 
-static int ssl_sock_add_cert_sni(SSL_CTX *ctx, struct bind_conf *s, char *name, int order)
+/* Indexes <name> in the SNI trees of bind_conf <s>, pointing either to <ctx>
+ * or to the lazily loaded certificate <lc>. Returns the next order.
+ */
+static int ssl_sock_add_cert_sni(SSL_CTX *ctx, struct lazy_cert *lc, struct bind_conf *s, char *name, int order)
 {
 	struct sni_ctx *sc;
 	int wild = 0, neg = 0;
@@ -411,6 +683,7 @@ static int ssl_sock_add_cert_sni(SSL_CTX *ctx, struct bind_conf *s, char *name,
 			sc->name.key[j] = tolower(name[j]);
 		sc->name.key[len] = 0;
 		sc->ctx = ctx;
+		sc->lazy = lc;
 		sc->order = order++;
 		sc->neg = neg;
 		if (wild)
@@ -421,15 +694,13 @@ static int ssl_sock_add_cert_sni(SSL_CTX *ctx, struct bind_conf *s, char *name,
 	return order;
 }
 
-/* Loads a certificate key and CA chain from a file. Returns 0 on error, -1 if
- * an early error happens and the caller must call SSL_CTX_free() by itelf.
+/* Indexes certificate <x> in the SNI trees of bind_conf <s> under the names
+ * in <sni_filter> if any, otherwise under its subjectAltNames and its CN.
+ * Returns the number of names indexed.
  */
-static int ssl_sock_load_cert_chain_file(SSL_CTX *ctx, const char *file, struct bind_conf *s, char **sni_filter, int fcount)
+static int ssl_sock_add_cert_names(X509 *x, SSL_CTX *ctx, struct lazy_cert *lc, struct bind_conf *s, char **sni_filter, int fcount)
 {
-	BIO *in;
-	X509 *x = NULL, *ca;
-	int i, err;
-	int ret = -1;
+	int i;
 	int order = 0;
 	X509_NAME *xname;
 	char *str;
@@ -437,20 +708,9 @@ static int ssl_sock_load_cert_chain_file(SSL_CTX *ctx, const char *file, struct
 	STACK_OF(GENERAL_NAME) *names;
 #endif
 
-	in = BIO_new(BIO_s_file());
-	if (in == NULL)
-		goto end;
-
-	if (BIO_read_filename(in, file) <= 0)
-		goto end;
-
-	x = PEM_read_bio_X509_AUX(in, NULL, ctx->default_passwd_callback, ctx->default_passwd_callback_userdata);
-	if (x == NULL)
-		goto end;
-
 	if (fcount) {
 		while (fcount--)
-			order = ssl_sock_add_cert_sni(ctx, s, sni_filter[fcount], order);
+			order = ssl_sock_add_cert_sni(ctx, lc, s, sni_filter[fcount], order);
 	}
 	else {
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
@@ -460,7 +720,7 @@ static int ssl_sock_load_cert_chain_file(SSL_CTX *ctx, const char *file, struct
 				GENERAL_NAME *name = sk_GENERAL_NAME_value(names, i);
 				if (name->type == GEN_DNS) {
 					if (ASN1_STRING_to_UTF8((unsigned char **)&str, name->d.dNSName) >= 0) {
-						order = ssl_sock_add_cert_sni(ctx, s, str, order);
+						order = ssl_sock_add_cert_sni(ctx, lc, s, str, order);
 						OPENSSL_free(str);
 					}
 				}
@@ -473,11 +733,39 @@ static int ssl_sock_load_cert_chain_file(SSL_CTX *ctx, const char *file, struct
 		while ((i = X509_NAME_get_index_by_NID(xname, NID_commonName, i)) != -1) {
 			X509_NAME_ENTRY *entry = X509_NAME_get_entry(xname, i);
 			if (ASN1_STRING_to_UTF8((unsigned char **)&str, entry->value) >= 0) {
-				order = ssl_sock_add_cert_sni(ctx, s, str, order);
+				order = ssl_sock_add_cert_sni(ctx, lc, s, str, order);
 				OPENSSL_free(str);
 			}
 		}
 	}
+	return order;
+}
+
+/* Loads a certificate key and CA chain from a file. Returns 0 on error, -1 if
+ * an early error happens and the caller must call SSL_CTX_free() by itelf.
+ * The certificate's names are not indexed when <s> is NULL, in which case
+ * the caller always remains responsible for the SSL_CTX.
+ */
+static int ssl_sock_load_cert_chain_file(SSL_CTX *ctx, const char *file, struct bind_conf *s, char **sni_filter, int fcount)
+{
+	BIO *in;
+	X509 *x = NULL, *ca;
+	int err;
+	int ret = -1;
+
+	in = BIO_new(BIO_s_file());
+	if (in == NULL)
+		goto end;
+
+	if (BIO_read_filename(in, file) <= 0)
+		goto end;
+
+	x = PEM_read_bio_X509_AUX(in, NULL, ctx->default_passwd_callback, ctx->default_passwd_callback_userdata);
+	if (x == NULL)
+		goto end;
+
+	if (s)
+		ssl_sock_add_cert_names(x, ctx, NULL, s, sni_filter, fcount);
 
 	ret = 0; /* the caller must not free the SSL_CTX argument anymore */
 	if (!SSL_CTX_use_certificate(ctx, x))
@@ -512,53 +800,516 @@ end:
 	return ret;
 }
 
-static int ssl_sock_load_cert_file(const char *path, struct bind_conf *bind_conf, struct proxy *curproxy, char **sni_filter, int fcount, char **err)
+#if (defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB && !defined OPENSSL_NO_OCSP)
+/* all the OCSP responses, indexed by certificate id. The lock protects the
+ * tree and the responses, since lazily loaded certificates may insert their
+ * entry from a handshake worker while the CLI looks one up, and the stapling
+ * callback may copy a response in a worker while the CLI replaces it.
+ */
+static struct eb_root cert_ocsp_tree = EB_ROOT_UNIQUE;
+static pthread_mutex_t cert_ocsp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Stapling callback. It only hands a copy of the preloaded response to
+ * OpenSSL, which takes ownership of the buffer. Nothing is stapled if the
+ * response has expired. The copy is made under cert_ocsp_lock since the
+ * response may be replaced from the CLI while this runs in a worker.
+ */
+static int ssl_sock_ocsp_stapling_cbk(SSL *ssl, void *arg)
+{
+	struct certificate_ocsp *ocsp = arg;
+	struct chunk *resp;
+	char *ssl_buf = NULL;
+	int len = 0;
+
+	if (!ocsp)
+		return SSL_TLSEXT_ERR_NOACK;
+
+	pthread_mutex_lock(&cert_ocsp_lock);
+	resp = ocsp->response;
+	if (resp && (!ocsp->expire || ocsp->expire >= now.tv_sec)) {
+		len = resp->len;
+		ssl_buf = OPENSSL_malloc(len);
+		if (ssl_buf)
+			memcpy(ssl_buf, resp->str, len);
+	}
+	pthread_mutex_unlock(&cert_ocsp_lock);
+
+	if (!ssl_buf)
+		return SSL_TLSEXT_ERR_NOACK;
+
+	SSL_set_tlsext_status_ocsp_resp(ssl, ssl_buf, len);
+	return SSL_TLSEXT_ERR_OK;
+}
+
+/* Checks the DER-encoded OCSP response <der> and installs it. If <ocsp> is
+ * NULL, the response must contain a single certificate status, which is used
+ * to look the certificate up, otherwise the status for certificate id <cid>
+ * is used. Only successful responses reporting a good or revoked status and
+ * which are currently valid are accepted. Returns 0 on success, otherwise
+ * non-zero with an error message in <err>. Must be called with cert_ocsp_lock
+ * held.
+ */
+static int ssl_sock_load_ocsp_response(struct chunk *der, struct certificate_ocsp *ocsp, OCSP_CERTID *cid, char **err)
+{
+	OCSP_RESPONSE *resp;
+	OCSP_BASICRESP *bs = NULL;
+	OCSP_SINGLERESP *sr;
+	ASN1_GENERALIZEDTIME *thisupd, *nextupd;
+	const unsigned char *p = (const unsigned char *)der->str;
+	unsigned char key[OCSP_MAX_CERTID_ASN1_LENGTH], *k;
+	struct ebmb_node *node;
+	struct chunk *new;
+	int status, reason, idx;
+	long expire = 0;
+	int ret = 1;
+
+	resp = d2i_OCSP_RESPONSE(NULL, &p, der->len);
+	if (!resp) {
+		memprintf(err, "unable to parse OCSP response");
+		goto out;
+	}
+
+	if (OCSP_response_status(resp) != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+		memprintf(err, "OCSP response status not successful");
+		goto out;
+	}
+
+	bs = OCSP_response_get1_basic(resp);
+	if (!bs) {
+		memprintf(err, "failed to get basic response from OCSP response");
+		goto out;
+	}
+
+	if (cid) {
+		idx = OCSP_resp_find(bs, cid, -1);
+		if (idx < 0) {
+			memprintf(err, "OCSP response does not concern this certificate");
+			goto out;
+		}
+	}
+	else {
+		if (OCSP_resp_count(bs) != 1) {
+			memprintf(err, "OCSP response must contain exactly one certificate status");
+			goto out;
+		}
+		idx = 0;
+	}
+	sr = OCSP_resp_get0(bs, idx);
+
+	if (!ocsp) {
+		/* find the certificate this response is for */
+		k = key;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+		cid = (OCSP_CERTID *)OCSP_SINGLERESP_get0_id(sr);
+#else
+		cid = sr->certId;
+#endif
+		if (i2d_OCSP_CERTID(cid, NULL) > sizeof(key)) {
+			memprintf(err, "OCSP certificate id too large");
+			goto out;
+		}
+		memset(key, 0, sizeof(key));
+		i2d_OCSP_CERTID(cid, &k);
+		node = ebmb_lookup(&cert_ocsp_tree, key, sizeof(key));
+		if (!node) {
+			memprintf(err, "OCSP response does not concern any loaded certificate");
+			goto out;
+		}
+		ocsp = ebmb_entry(node, struct certificate_ocsp, key);
+	}
+
+	status = OCSP_single_get0_status(sr, &reason, NULL, &thisupd, &nextupd);
+	if (status != V_OCSP_CERTSTATUS_GOOD && status != V_OCSP_CERTSTATUS_REVOKED) {
+		memprintf(err, "OCSP response reports an unknown certificate status");
+		goto out;
+	}
+
+	if (!OCSP_check_validity(thisupd, nextupd, OCSP_MAX_RESPONSE_TIME_SKEW, -1)) {
+		memprintf(err, "OCSP response is not valid at this date");
+		goto out;
+	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+	if (nextupd) {
+		int days, secs;
+
+		if (!ASN1_TIME_diff(&days, &secs, NULL, nextupd)) {
+			memprintf(err, "OCSP response has an invalid next update date");
+			goto out;
+		}
+		expire = now.tv_sec + days * 86400L + secs;
+	}
+#endif
+
+	new = malloc(sizeof(*new) + der->len);
+	if (!new) {
+		memprintf(err, "out of memory");
+		goto out;
+	}
+	new->str = (char *)(new + 1);
+	new->size = new->len = der->len;
+	memcpy(new->str, der->str, der->len);
+
+	free(ocsp->response);
+	ocsp->response = new;
+	ocsp->expire = expire;
+	ret = 0;
+ out:
+	if (bs)
+		OCSP_BASICRESP_free(bs);
+	if (resp)
+		OCSP_RESPONSE_free(resp);
+	ERR_clear_error();
+	return ret;
+}
+
+/* Installs the DER-encoded OCSP response <der> received on the CLI for the
+ * certificate it designates. Returns 0 on success, otherwise non-zero with
+ * an error message in <err>.
+ */
+int ssl_sock_update_ocsp_response(struct chunk *der, char **err)
+{
+	int ret;
+
+	pthread_mutex_lock(&cert_ocsp_lock);
+	ret = ssl_sock_load_ocsp_response(der, NULL, NULL, err);
+	pthread_mutex_unlock(&cert_ocsp_lock);
+	return ret;
+}
+
+/* Loads the OCSP response stored in DER format in file "<cert_path>.ocsp"
+ * for the certificate of <ctx>, whose issuer must be part of the chain, and
+ * enables stapling on <ctx>. Returns 0 on success, 1 if there is no such
+ * file, or -1 with an error message in <err> if the response is invalid.
+ */
+static int ssl_sock_load_ocsp(SSL_CTX *ctx, const char *cert_path, char **err)
+{
+	struct certificate_ocsp *ocsp = NULL;
+	struct ebmb_node *node;
+	OCSP_CERTID *cid = NULL;
+	X509 *x, *issuer = NULL;
+	SSL *ssl = NULL;
+	unsigned char *k;
+	char *path = NULL;
+	struct chunk der;
+	struct stat st;
+	int fd = -1;
+	int i, ret = -1;
+
+	der.str = NULL;
+	memprintf(&path, "%s.ocsp", cert_path);
+	if (!path) {
+		memprintf(err, "out of memory");
+		goto out;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		ret = 1;
+		goto out;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size <= 0 || st.st_size > global.tune.bufsize) {
+		memprintf(err, "invalid OCSP response file '%s'", path);
+		goto out;
+	}
+
+	der.size = der.len = st.st_size;
+	der.str = malloc(der.len);
+	if (!der.str || read(fd, der.str, der.len) != der.len) {
+		memprintf(err, "unable to read OCSP response file '%s'", path);
+		goto out;
+	}
+
+	/* the leaf certificate is only reachable through an SSL */
+	ssl = SSL_new(ctx);
+	x = ssl ? SSL_get_certificate(ssl) : NULL;
+	if (!x) {
+		memprintf(err, "no certificate found for OCSP response '%s'", path);
+		goto out;
+	}
+
+	for (i = 0; i < sk_X509_num(ctx->extra_certs); i++) {
+		issuer = sk_X509_value(ctx->extra_certs, i);
+		if (X509_check_issued(issuer, x) == X509_V_OK)
+			break;
+		issuer = NULL;
+	}
+
+	if (!issuer) {
+		memprintf(err, "issuer of the certificate not found in the chain for OCSP response '%s'", path);
+		goto out;
+	}
+
+	cid = OCSP_cert_to_id(NULL, x, issuer);
+	if (!cid || i2d_OCSP_CERTID(cid, NULL) > OCSP_MAX_CERTID_ASN1_LENGTH) {
+		memprintf(err, "unable to build the OCSP certificate id for '%s'", path);
+		goto out;
+	}
+
+	ocsp = calloc(1, sizeof(*ocsp));
+	if (!ocsp) {
+		memprintf(err, "out of memory");
+		goto out;
+	}
+
+	k = ocsp->key_data;
+	i2d_OCSP_CERTID(cid, &k);
+
+	/* The same certificate may be loaded several times, or loaded again
+	 * after a lazy eviction. The known response is kept then, since it
+	 * may have been updated from the CLI. A new entry is only kept if its
+	 * response could be loaded.
+	 */
+	pthread_mutex_lock(&cert_ocsp_lock);
+	node = ebmb_insert(&cert_ocsp_tree, &ocsp->key, OCSP_MAX_CERTID_ASN1_LENGTH);
+	if (node != &ocsp->key) {
+		free(ocsp);
+		ocsp = ebmb_entry(node, struct certificate_ocsp, key);
+	}
+	else if (ssl_sock_load_ocsp_response(&der, ocsp, cid, err)) {
+		ebmb_delete(&ocsp->key);
+		free(ocsp);
+		pthread_mutex_unlock(&cert_ocsp_lock);
+		memprintf(err, "%s in file '%s'", *err, path);
+		goto out;
+	}
+	pthread_mutex_unlock(&cert_ocsp_lock);
+
+	SSL_CTX_set_tlsext_status_cb(ctx, ssl_sock_ocsp_stapling_cbk);
+	SSL_CTX_set_tlsext_status_arg(ctx, ocsp);
+	ret = 0;
+ out:
+	if (cid)
+		OCSP_CERTID_free(cid);
+	if (ssl)
+		SSL_free(ssl);
+	if (fd >= 0)
+		close(fd);
+	free(der.str);
+	free(path);
+	return ret;
+}
+#endif
+
+/* Builds the SSL_CTX of the certificate file <path> and indexes it in the SNI
+ * trees of bind_conf <s>. Returns the context, or NULL on error with <err>
+ * filled. When <s> is NULL, the names are not indexed and the context is
+ * released on error, otherwise it is only released with the trees.
+ */
+static SSL_CTX *ssl_sock_new_cert_ctx(const char *path, struct bind_conf *s, char **sni_filter, int fcount, char **err)
 {
 	int ret;
 	SSL_CTX *ctx;
+#if (defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB && !defined OPENSSL_NO_OCSP)
+	char *ocsp_err = NULL;
+#endif
 
 	ctx = SSL_CTX_new(SSLv23_server_method());
 	if (!ctx) {
 		memprintf(err, "%sunable to allocate SSL context for cert '%s'.\n",
 		          err && *err ? *err : "", path);
-		return 1;
+		return NULL;
 	}
 
 	if (SSL_CTX_use_PrivateKey_file(ctx, path, SSL_FILETYPE_PEM) <= 0) {
 		memprintf(err, "%sunable to load SSL private key from PEM file '%s'.\n",
 		          err && *err ? *err : "", path);
 		SSL_CTX_free(ctx);
-		return 1;
+		return NULL;
 	}
 
-	ret = ssl_sock_load_cert_chain_file(ctx, path, bind_conf, sni_filter, fcount);
+	ret = ssl_sock_load_cert_chain_file(ctx, path, s, sni_filter, fcount);
 	if (ret <= 0) {
 		memprintf(err, "%sunable to load SSL certificate from PEM file '%s'.\n",
 		          err && *err ? *err : "", path);
-		if (ret < 0) /* serious error, must do that ourselves */
+		if (ret < 0 || !s) /* serious error, must do that ourselves */
 			SSL_CTX_free(ctx);
-		return 1;
+		return NULL;
 	}
 
+	/* unless <s> is NULL, we must not free the SSL_CTX anymore below,
+	 * since it's already in the tree, so it will be discovered and
+	 * cleaned in time.
+	 */
 	if (SSL_CTX_check_private_key(ctx) <= 0) {
 		memprintf(err, "%sinconsistencies between private key and certificate loaded from PEM file '%s'.\n",
 		          err && *err ? *err : "", path);
-		return 1;
+		goto fail;
 	}
 
-	/* we must not free the SSL_CTX anymore below, since it's already in
-	 * the tree, so it will be discovered and cleaned in time.
-	 */
 #ifndef OPENSSL_NO_DH
 	ret = ssl_sock_load_dh_params(ctx, path);
 	if (ret < 0) {
 		if (err)
 			memprintf(err, "%sunable to load DH parameters from file '%s'.\n",
 				  *err ? *err : "", path);
+		goto fail;
+	}
+#endif
+
+#if (defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB && !defined OPENSSL_NO_OCSP)
+	/* staple the response found in "<path>.ocsp" if any */
+	if (ssl_sock_load_ocsp(ctx, path, &ocsp_err) < 0) {
+		memprintf(err, "%s%s.\n", err && *err ? *err : "", ocsp_err);
+		free(ocsp_err);
+		goto fail;
+	}
+#endif
+	return ctx;
+
+ fail:
+	if (!s)
+		SSL_CTX_free(ctx);
+	return NULL;
+}
+
+#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+/* Only indexes the names of the certificate file <path> in the SNI trees of
+ * <bind_conf>, its SSL_CTX will be built on first use. Only the leaf
+ * certificate is parsed here, which is much cheaper than loading the key and
+ * the chain. Returns 0 on success, 1 on error with <err> filled.
+ */
+static int ssl_sock_index_cert_file(const char *path, struct bind_conf *bind_conf, char **sni_filter, int fcount, char **err)
+{
+	struct lazy_cert *lc;
+	BIO *in;
+	X509 *x = NULL;
+	int len = strlen(path);
+	int ret = 1;
+
+	lc = calloc(1, sizeof(*lc) + len + 1);
+	if (!lc) {
+		memprintf(err, "%sout of memory while indexing cert '%s'.\n",
+		          err && *err ? *err : "", path);
 		return 1;
 	}
+
+	in = BIO_new(BIO_s_file());
+	if (!in || BIO_read_filename(in, path) <= 0 ||
+	    !(x = PEM_read_bio_X509_AUX(in, NULL, NULL, NULL))) {
+		memprintf(err, "%sunable to load SSL certificate from PEM file '%s'.\n",
+		          err && *err ? *err : "", path);
+		free(lc);
+		goto end;
+	}
+
+	LIST_INIT(&lc->lru);
+	lc->bind_conf = bind_conf;
+	memcpy(lc->path, path, len + 1);
+
+	/* a certificate without any name can never be selected */
+	if (ssl_sock_add_cert_names(x, NULL, lc, bind_conf, sni_filter, fcount))
+		lazy_certs.indexed++;
+	else
+		free(lc);
+	ret = 0;
+ end:
+	if (x)
+		X509_free(x);
+	if (in)
+		BIO_free(in);
+	return ret;
+}
+
+/* Switches <ssl> to the SSL_CTX of the lazily loaded certificate <lc>,
+ * building it if it is not resident. Returns non-zero on success, or 0 if the
+ * context cannot be built. The least recently used contexts are released
+ * above "tune.ssl.lazy-certs" resident ones, sessions still using them keep
+ * their own reference. A certificate which failed to load is not retried.
+ *
+ * This may run in handshake workers. The context is built outside of
+ * <lazy_certs_lock> so that the file accesses do not block the other workers,
+ * and if several of them build the same one, only the first one is kept.
+ */
+static int ssl_sock_switch_lazy_ctx(SSL *ssl, struct lazy_cert *lc)
+{
+	struct lazy_cert *old;
+	SSL_CTX *ctx;
+	char *err = NULL;
+	int ret;
+
+	pthread_mutex_lock(&lazy_certs_lock);
+	if (lc->ctx) {
+		LIST_DEL(&lc->lru);
+		LIST_ADD(&lazy_certs_lru, &lc->lru);
+	}
+	else if (!lc->failed) {
+		pthread_mutex_unlock(&lazy_certs_lock);
+
+		ctx = ssl_sock_new_cert_ctx(lc->path, NULL, NULL, 0, &err);
+		free(err);
+		if (ctx && ssl_sock_prepare_ctx(lc->bind_conf, ctx, NULL) != 0) {
+			SSL_CTX_free(ctx);
+			ctx = NULL;
+		}
+
+		pthread_mutex_lock(&lazy_certs_lock);
+		if (lc->ctx || lc->failed) {
+			/* another worker was faster */
+			if (ctx)
+				SSL_CTX_free(ctx);
+		}
+		else if (!ctx) {
+			lc->failed = 1;
+			lazy_certs.failures++;
+		}
+		else {
+			lc->ctx = ctx;
+			LIST_ADD(&lazy_certs_lru, &lc->lru);
+			lazy_certs.loads++;
+			if (++lazy_certs.resident > global.tune.ssl_lazy_certs) {
+				old = LIST_PREV(&lazy_certs_lru, struct lazy_cert *, lru);
+				LIST_DEL(&old->lru);
+				LIST_INIT(&old->lru);
+				SSL_CTX_free(old->ctx);
+				old->ctx = NULL;
+				lazy_certs.resident--;
+				lazy_certs.evictions++;
+			}
+		}
+	}
+
+	/* the context may be evicted as soon as the lock is released, but
+	 * the SSL holds its own reference once switched.
+	 */
+	ret = lc->ctx != NULL;
+	if (ret)
+		SSL_set_SSL_CTX(ssl, lc->ctx);
+	pthread_mutex_unlock(&lazy_certs_lock);
+	return ret;
+}
+
+/* Releases the lazily loaded certificate <lc> and its context if resident */
+static void ssl_sock_free_lazy_cert(struct lazy_cert *lc)
+{
+	if (lc->ctx) {
+		LIST_DEL(&lc->lru);
+		SSL_CTX_free(lc->ctx);
+		lazy_certs.resident--;
+	}
+	lazy_certs.indexed--;
+	free(lc);
+}
+#endif /* SSL_CTRL_SET_TLSEXT_HOSTNAME */
+
+static int ssl_sock_load_cert_file(const char *path, struct bind_conf *bind_conf, struct proxy *curproxy, char **sni_filter, int fcount, char **err)
+{
+	SSL_CTX *ctx;
+
+#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+	/* The first certificate is the default one and is always loaded. A
+	 * configuration check always loads everything to validate the files.
+	 */
+	if (global.tune.ssl_lazy_certs && bind_conf->default_ctx &&
+	    !(global.mode & MODE_CHECK))
+		return ssl_sock_index_cert_file(path, bind_conf, sni_filter, fcount, err);
 #endif
 
+	ctx = ssl_sock_new_cert_ctx(path, bind_conf, sni_filter, fcount, err);
+	if (!ctx)
+		return 1;
+
 #ifndef SSL_CTRL_SET_TLSEXT_HOSTNAME
 	if (bind_conf->default_ctx) {
 		memprintf(err, "%sthis version of openssl cannot load multiple SSL certificates.\n",
@@ -589,6 +1340,10 @@ int ssl_sock_load_cert(char *path, struct bind_conf *bind_conf, struct proxy *cu
 		*end = 0;
 
 	while ((de = readdir(dir))) {
+		end = strrchr(de->d_name, '.');
+		if (end && strcmp(end, ".ocsp") == 0)
+			continue; /* OCSP responses are loaded with their certificate */
+
 		snprintf(fp, sizeof(fp), "%s/%s", path, de->d_name);
 		if (stat(fp, &buf) != 0) {
 			memprintf(err, "%sunable to stat SSL certificate from file '%s' : %s.\n",
@@ -724,6 +1479,13 @@ int ssl_sock_load_cert_list_file(char *file, struct bind_conf *bind_conf, struct
 #ifndef SSL_MODE_RELEASE_BUFFERS                        /* needs OpenSSL >= 1.0.0 */
 #define SSL_MODE_RELEASE_BUFFERS 0
 #endif
+
+/* Applies the settings of <bind_conf> to <ctx> and returns the number of
+ * errors. <curproxy> is NULL when the context of a lazily loaded certificate
+ * is built at run time, possibly in a handshake worker. Nothing is reported
+ * then and the random generator is not initialized, since the same settings
+ * were already applied without error to the default context at boot.
+ */
 int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, SSL_CTX *ctx, struct proxy *curproxy)
 {
 	int cfgerr = 0;
@@ -742,7 +1504,7 @@ int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, SSL_CTX *ctx, struct proxy
 		SSL_MODE_RELEASE_BUFFERS;
 
 	/* Make sure openssl opens /dev/urandom before the chroot */
-	if (!ssl_initialize_random()) {
+	if (curproxy && !ssl_initialize_random()) {
 		Alert("OpenSSL random data generator initialization failed.\n");
 		cfgerr++;
 	}
@@ -788,16 +1550,18 @@ int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, SSL_CTX *ctx, struct proxy
 		if (bind_conf->ca_file) {
 			/* load CAfile to verify */
 			if (!SSL_CTX_load_verify_locations(ctx, bind_conf->ca_file, NULL)) {
-				Alert("Proxy '%s': unable to load CA file '%s' for bind '%s' at [%s:%d].\n",
-				      curproxy->id, bind_conf->ca_file, bind_conf->arg, bind_conf->file, bind_conf->line);
+				if (curproxy)
+					Alert("Proxy '%s': unable to load CA file '%s' for bind '%s' at [%s:%d].\n",
+					      curproxy->id, bind_conf->ca_file, bind_conf->arg, bind_conf->file, bind_conf->line);
 				cfgerr++;
 			}
 			/* set CA names fo client cert request, function returns void */
 			SSL_CTX_set_client_CA_list(ctx, SSL_load_client_CA_file(bind_conf->ca_file));
 		}
 		else {
-			Alert("Proxy '%s': verify is enabled but no CA file specified for bind '%s' at [%s:%d].\n",
-			      curproxy->id, bind_conf->arg, bind_conf->file, bind_conf->line);
+			if (curproxy)
+				Alert("Proxy '%s': verify is enabled but no CA file specified for bind '%s' at [%s:%d].\n",
+				      curproxy->id, bind_conf->arg, bind_conf->file, bind_conf->line);
 			cfgerr++;
 		}
 #ifdef X509_V_FLAG_CRL_CHECK
@@ -805,8 +1569,9 @@ int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, SSL_CTX *ctx, struct proxy
 			X509_STORE *store = SSL_CTX_get_cert_store(ctx);
 
 			if (!store || !X509_STORE_load_locations(store, bind_conf->crl_file, NULL)) {
-				Alert("Proxy '%s': unable to configure CRL file '%s' for bind '%s' at [%s:%d].\n",
-				      curproxy->id, bind_conf->ca_file, bind_conf->arg, bind_conf->file, bind_conf->line);
+				if (curproxy)
+					Alert("Proxy '%s': unable to configure CRL file '%s' for bind '%s' at [%s:%d].\n",
+					      curproxy->id, bind_conf->ca_file, bind_conf->arg, bind_conf->file, bind_conf->line);
 				cfgerr++;
 			}
 			else {
@@ -823,14 +1588,20 @@ int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, SSL_CTX *ctx, struct proxy
 	shared_context_set_cache(ctx);
 	if (bind_conf->ciphers &&
 	    !SSL_CTX_set_cipher_list(ctx, bind_conf->ciphers)) {
-		Alert("Proxy '%s': unable to set SSL cipher list to '%s' for bind '%s' at [%s:%d].\n",
-		curproxy->id, bind_conf->ciphers, bind_conf->arg, bind_conf->file, bind_conf->line);
+		if (curproxy)
+			Alert("Proxy '%s': unable to set SSL cipher list to '%s' for bind '%s' at [%s:%d].\n",
+			curproxy->id, bind_conf->ciphers, bind_conf->arg, bind_conf->file, bind_conf->line);
 		cfgerr++;
 	}
 
 	SSL_CTX_set_info_callback(ctx, ssl_sock_infocbk);
 	SSL_CTX_set_msg_callback(ctx, ssl_sock_msgcbk);
 
+#ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
+	if (bind_conf->keys_ref)
+		SSL_CTX_set_tlsext_ticket_key_cb(ctx, ssl_tlsext_ticket_key_cb);
+#endif
+
 #ifdef OPENSSL_NPN_NEGOTIATED
 	if (bind_conf->npn_str)
 		SSL_CTX_set_next_protos_advertised_cb(ctx, ssl_sock_advertise_npn_protos, bind_conf);
@@ -851,9 +1622,10 @@ int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, SSL_CTX *ctx, struct proxy
 
 		i = OBJ_sn2nid(bind_conf->ecdhe ? bind_conf->ecdhe : ECDHE_DEFAULT_CURVE);
 		if (!i || ((ecdh = EC_KEY_new_by_curve_name(i)) == NULL)) {
-			Alert("Proxy '%s': unable to set elliptic named curve to '%s' for bind '%s' at [%s:%d].\n",
-			      curproxy->id, bind_conf->ecdhe ? bind_conf->ecdhe : ECDHE_DEFAULT_CURVE,
-			      bind_conf->arg, bind_conf->file, bind_conf->line);
+			if (curproxy)
+				Alert("Proxy '%s': unable to set elliptic named curve to '%s' for bind '%s' at [%s:%d].\n",
+				      curproxy->id, bind_conf->ecdhe ? bind_conf->ecdhe : ECDHE_DEFAULT_CURVE,
+				      bind_conf->arg, bind_conf->file, bind_conf->line);
 			cfgerr++;
 		}
 		else {
@@ -989,6 +1761,74 @@ static int ssl_sock_srv_verifycbk(int ok, X509_STORE_CTX *ctx)
 	return ok;
 }
 
+/* Returns a session to resume on a new connection to server <srv>, or NULL if
+ * none is known, and sets <slot> to its entry in the server's session cache.
+ * The entries are offered in turn so that a session the server does not know
+ * anymore only costs one full handshake before being replaced. Expired
+ * sessions, including sessions whose ticket has expired, are released.
+ */
+static SSL_SESSION *ssl_sock_srv_get_session(struct server *srv, int *slot)
+{
+	SSL_SESSION *sess;
+	long expire;
+	int n, i;
+
+	for (n = 0; n < srv->ssl_ctx.sess_nb; n++) {
+		i = srv->ssl_ctx.sess_idx++ % srv->ssl_ctx.sess_nb;
+		sess = srv->ssl_ctx.sess[i];
+		if (!sess)
+			continue;
+
+		expire = SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess);
+#ifndef OPENSSL_NO_TLSEXT
+		if (sess->tlsext_tick && sess->tlsext_tick_lifetime_hint &&
+		    SSL_SESSION_get_time(sess) + (long)sess->tlsext_tick_lifetime_hint < expire)
+			expire = SSL_SESSION_get_time(sess) + sess->tlsext_tick_lifetime_hint;
+#endif
+		if (expire <= date.tv_sec) {
+			SSL_SESSION_free(sess);
+			srv->ssl_ctx.sess[i] = NULL;
+			continue;
+		}
+		*slot = i;
+		return sess;
+	}
+	return NULL;
+}
+
+/* Updates the session cache of server <srv> after a successful handshake on
+ * <conn>, to which the session in cache entry <slot> was offered if <slot> is
+ * not negative. A new session replaces the offered one, which the server did
+ * not accept, or fills an empty entry, or replaces the next one. A resumed
+ * session is stored again when the server renewed its ticket, since OpenSSL
+ * then creates a new session.
+ */
+static void ssl_sock_srv_set_session(struct server *srv, struct connection *conn, int slot)
+{
+	SSL_SESSION *sess = SSL_get_session(conn->xprt_ctx);
+	int i;
+
+	if (SSL_session_reused(conn->xprt_ctx)) {
+		srv->counters.ssl_reused++;
+		if (slot < 0 || srv->ssl_ctx.sess[slot] == sess)
+			return;
+	}
+	else
+		srv->counters.ssl_full++;
+
+	if (slot < 0) {
+		for (i = 0; i < srv->ssl_ctx.sess_nb; i++) {
+			if (!srv->ssl_ctx.sess[i])
+				break;
+		}
+		slot = (i < srv->ssl_ctx.sess_nb) ? i : srv->ssl_ctx.sess_idx % srv->ssl_ctx.sess_nb;
+	}
+
+	if (srv->ssl_ctx.sess[slot])
+		SSL_SESSION_free(srv->ssl_ctx.sess[slot]);
+	srv->ssl_ctx.sess[slot] = SSL_get1_session(conn->xprt_ctx);
+}
+
 /* prepare ssl context from servers options. Returns an error count */
 int ssl_sock_prepare_srv_ctx(struct server *srv, struct proxy *curproxy)
 {
@@ -1010,7 +1850,17 @@ int ssl_sock_prepare_srv_ctx(struct server *srv, struct proxy *curproxy)
 	}
 
 	 /* Initiate SSL context for current server */
-	srv->ssl_ctx.reused_sess = NULL;
+	if (!srv->ssl_ctx.sess_nb)
+		srv->ssl_ctx.sess_nb = SRV_SSL_SESS_CACHE;
+	srv->ssl_ctx.sess = calloc(srv->ssl_ctx.sess_nb, sizeof(*srv->ssl_ctx.sess));
+	if (!srv->ssl_ctx.sess) {
+		Alert("config : %s '%s', server '%s': unable to allocate the SSL session cache.\n",
+		      proxy_type_str(curproxy), curproxy->id,
+		      srv->id);
+		cfgerr++;
+		return cfgerr;
+	}
+
 	if (srv->use_ssl)
 		srv->xprt = &ssl_sock;
 	if (srv->check.use_ssl)
@@ -1154,7 +2004,10 @@ int ssl_sock_prepare_all_ctx(struct bind_conf *bind_conf, struct proxy *px)
 	node = ebmb_first(&bind_conf->sni_ctx);
 	while (node) {
 		sni = ebmb_entry(node, struct sni_ctx, name);
-		if (!sni->order) /* only initialize the CTX on its first occurrence */
+		/* only initialize the CTX on its first occurrence, lazily
+		 * loaded ones are initialized when they are built.
+		 */
+		if (!sni->order && sni->ctx)
 			err += ssl_sock_prepare_ctx(bind_conf, sni->ctx, px);
 		node = ebmb_next(node);
 	}
@@ -1162,7 +2015,10 @@ int ssl_sock_prepare_all_ctx(struct bind_conf *bind_conf, struct proxy *px)
 	node = ebmb_first(&bind_conf->sni_w_ctx);
 	while (node) {
 		sni = ebmb_entry(node, struct sni_ctx, name);
-		if (!sni->order) /* only initialize the CTX on its first occurrence */
+		/* only initialize the CTX on its first occurrence, lazily
+		 * loaded ones are initialized when they are built.
+		 */
+		if (!sni->order && sni->ctx)
 			err += ssl_sock_prepare_ctx(bind_conf, sni->ctx, px);
 		node = ebmb_next(node);
 	}
@@ -1185,8 +2041,14 @@ void ssl_sock_free_all_ctx(struct bind_conf *bind_conf)
 		sni = ebmb_entry(node, struct sni_ctx, name);
 		back = ebmb_next(node);
 		ebmb_delete(node);
-		if (!sni->order) /* only free the CTX on its first occurrence */
-			SSL_CTX_free(sni->ctx);
+		if (!sni->order) { /* only free the CTX on its first occurrence */
+#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+			if (sni->lazy)
+				ssl_sock_free_lazy_cert(sni->lazy);
+			else
+#endif
+				SSL_CTX_free(sni->ctx);
+		}
 		free(sni);
 		node = back;
 	}
@@ -1196,8 +2058,14 @@ void ssl_sock_free_all_ctx(struct bind_conf *bind_conf)
 		sni = ebmb_entry(node, struct sni_ctx, name);
 		back = ebmb_next(node);
 		ebmb_delete(node);
-		if (!sni->order) /* only free the CTX on its first occurrence */
-			SSL_CTX_free(sni->ctx);
+		if (!sni->order) { /* only free the CTX on its first occurrence */
+#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+			if (sni->lazy)
+				ssl_sock_free_lazy_cert(sni->lazy);
+			else
+#endif
+				SSL_CTX_free(sni->ctx);
+		}
 		free(sni);
 		node = back;
 	}
@@ -1228,6 +2096,9 @@ static int ssl_sock_init(struct connection *conn)
 	/* If it is in client mode initiate SSL session
 	   in connect state otherwise accept state */
 	if (objt_server(conn->target)) {
+		SSL_SESSION *sess;
+		int slot;
+
 		/* Alloc a new SSL session ctx */
 		conn->xprt_ctx = SSL_new(objt_server(conn->target)->ssl_ctx.ctx);
 		if (!conn->xprt_ctx) {
@@ -1236,8 +2107,9 @@ static int ssl_sock_init(struct connection *conn)
 		}
 
 		SSL_set_connect_state(conn->xprt_ctx);
-		if (objt_server(conn->target)->ssl_ctx.reused_sess)
-			SSL_set_session(conn->xprt_ctx, objt_server(conn->target)->ssl_ctx.reused_sess);
+		sess = ssl_sock_srv_get_session(objt_server(conn->target), &slot);
+		if (sess && SSL_set_session(conn->xprt_ctx, sess))
+			conn->xprt_st |= SSL_SOCK_SESS_SLOT_TO_ST(slot);
 
 		/* set fd on SSL session context */
 		SSL_set_fd(conn->xprt_ctx, conn->t.sock.fd);
@@ -1281,6 +2153,240 @@ static int ssl_sock_init(struct connection *conn)
 }
 
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/* OpenSSL before 1.1.0 relies on the application to provide its locks once it
+ * is used by more than one thread.
+ */
+static pthread_mutex_t *ssl_async_locks;
+
+static void ssl_async_locking_cbk(int mode, int n, const char *file, int line)
+{
+	if (mode & CRYPTO_LOCK)
+		pthread_mutex_lock(&ssl_async_locks[n]);
+	else
+		pthread_mutex_unlock(&ssl_async_locks[n]);
+}
+
+static void ssl_async_threadid_cbk(CRYPTO_THREADID *id)
+{
+	CRYPTO_THREADID_set_numeric(id, (unsigned long)pthread_self());
+}
+#endif
+
+/* Handshake worker thread. It picks jobs from the work queue, runs one step
+ * of the handshake (which is where the private key operations happen), then
+ * passes the job back to the main thread through the done queue, and wakes
+ * it up through the pipe if it was not already notified.
+ */
+static void *ssl_async_worker(void *arg)
+{
+	struct ssl_async_job *job;
+	int wake;
+
+	pthread_mutex_lock(&ssl_async.lock);
+	while (1) {
+		while (LIST_ISEMPTY(&ssl_async.queue))
+			pthread_cond_wait(&ssl_async.work, &ssl_async.lock);
+
+		job = LIST_NEXT(&ssl_async.queue, struct ssl_async_job *, list);
+		LIST_DEL(&job->list);
+		job->state = SSL_ASYNC_RUNNING;
+		pthread_mutex_unlock(&ssl_async.lock);
+
+		errno = 0;
+		job->ret = SSL_do_handshake(job->ssl);
+		job->err = (job->ret == 1) ? SSL_ERROR_NONE : SSL_get_error(job->ssl, job->ret);
+		job->errnum = errno;
+		/* the error stack is per-thread, the main thread won't see it */
+		ERR_clear_error();
+
+		pthread_mutex_lock(&ssl_async.lock);
+		wake = LIST_ISEMPTY(&ssl_async.done);
+		LIST_ADDQ(&ssl_async.done, &job->list);
+		job->state = SSL_ASYNC_READY;
+		pthread_cond_broadcast(&ssl_async.idle);
+
+		if (wake) {
+			pthread_mutex_unlock(&ssl_async.lock);
+			/* a full pipe is fine, it will be drained anyway */
+			if (write(ssl_async.pipe[1], "", 1) < 0) { }
+			pthread_mutex_lock(&ssl_async.lock);
+		}
+	}
+	return NULL;
+}
+
+/* I/O handler of the wake-up pipe, called by the poller in the main thread.
+ * Each finished job is marked DONE and its connection's I/O handler is called
+ * so that ssl_sock_handshake() picks the result and continues as if it had
+ * performed the step itself. Jobs are dequeued one at a time and without the
+ * lock held, since processing a connection may close other ones.
+ */
+static int ssl_async_io_handler(int fd)
+{
+	char buf[64];
+	struct ssl_async_job *job;
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	fd_cant_recv(fd);
+
+	while (1) {
+		pthread_mutex_lock(&ssl_async.lock);
+		if (LIST_ISEMPTY(&ssl_async.done)) {
+			pthread_mutex_unlock(&ssl_async.lock);
+			break;
+		}
+		job = LIST_NEXT(&ssl_async.done, struct ssl_async_job *, list);
+		LIST_DEL(&job->list);
+		job->state = SSL_ASYNC_DONE;
+		pthread_mutex_unlock(&ssl_async.lock);
+
+		conn_fd_handler(job->conn->t.sock.fd);
+	}
+	return 0;
+}
+
+/* Starts the handshake workers of the current process. It must be called
+ * after the fork() since threads do not survive it. Returns 0 on success, or
+ * -1 if handshakes have to be performed inline.
+ */
+static int ssl_async_start()
+{
+	sigset_t set, old;
+	pthread_t thr;
+	int i;
+
+	if (ssl_async.started)
+		return ssl_async.started > 0 ? 0 : -1;
+
+	ssl_async.started = -1;
+	pool2_ssl_async = create_pool("ssl_async", sizeof(struct ssl_async_job), MEM_F_SHARED);
+	if (!pool2_ssl_async)
+		goto fail;
+
+	if (pipe(ssl_async.pipe) < 0)
+		goto fail;
+
+	fcntl(ssl_async.pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(ssl_async.pipe[1], F_SETFL, O_NONBLOCK);
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	ssl_async_locks = calloc(CRYPTO_num_locks(), sizeof(*ssl_async_locks));
+	if (!ssl_async_locks)
+		goto fail_pipe;
+	for (i = 0; i < CRYPTO_num_locks(); i++)
+		pthread_mutex_init(&ssl_async_locks[i], NULL);
+	CRYPTO_THREADID_set_callback(ssl_async_threadid_cbk);
+	CRYPTO_set_locking_callback(ssl_async_locking_cbk);
+#endif
+
+	/* signals must only be delivered to the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	for (i = 0; i < global.tune.ssl_hs_workers; i++) {
+		if (pthread_create(&thr, NULL, ssl_async_worker, NULL) != 0)
+			break;
+		pthread_detach(thr);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (!i) {
+		/* no worker at all, the locks remain harmless */
+		goto fail_pipe;
+	}
+
+	if (i < global.tune.ssl_hs_workers)
+		Warning("Could only start %d SSL handshake workers out of %d.\n",
+			i, global.tune.ssl_hs_workers);
+
+	fdtab[ssl_async.pipe[0]].owner = NULL;
+	fdtab[ssl_async.pipe[0]].iocb = ssl_async_io_handler;
+	fd_insert(ssl_async.pipe[0]);
+	fd_want_recv(ssl_async.pipe[0]);
+	ssl_async.started = 1;
+	return 0;
+
+ fail_pipe:
+	close(ssl_async.pipe[0]);
+	close(ssl_async.pipe[1]);
+ fail:
+	Warning("Unable to start the SSL handshake workers, handshakes will be performed inline.\n");
+	return -1;
+}
+
+/* Performs one handshake step of <conn> in a worker thread. Returns -1 when
+ * the step was queued or is still in progress, in which case polling is
+ * disabled on the connection until the result is reported. Otherwise the
+ * return value of SSL_do_handshake() is returned, the result of
+ * SSL_get_error() is stored into <err> and errno is restored as the worker
+ * saw it, so that the caller may interprete the result as usual.
+ */
+static int ssl_async_handshake(struct connection *conn, int *err)
+{
+	struct ssl_async_job *job;
+	int ret;
+
+	job = SSL_get_ex_data(conn->xprt_ctx, ssl_async_idx);
+	if (job) {
+		/* only the main thread switches a job to DONE */
+		if (job->state != SSL_ASYNC_DONE)
+			goto wait;
+
+		ret = job->ret;
+		*err = job->err;
+		errno = job->errnum;
+		SSL_set_ex_data(conn->xprt_ctx, ssl_async_idx, NULL);
+		pool_free2(pool2_ssl_async, job);
+		return ret;
+	}
+
+	if (ssl_async_start() < 0 || (job = pool_alloc2(pool2_ssl_async)) == NULL) {
+		ret = SSL_do_handshake(conn->xprt_ctx);
+		if (ret != 1)
+			*err = SSL_get_error(conn->xprt_ctx, ret);
+		return ret;
+	}
+
+	job->conn  = conn;
+	job->ssl   = conn->xprt_ctx;
+	job->state = SSL_ASYNC_QUEUED;
+	SSL_set_ex_data(conn->xprt_ctx, ssl_async_idx, job);
+
+	pthread_mutex_lock(&ssl_async.lock);
+	LIST_ADDQ(&ssl_async.queue, &job->list);
+	pthread_cond_signal(&ssl_async.work);
+	pthread_mutex_unlock(&ssl_async.lock);
+
+ wait:
+	/* the worker owns the socket for now */
+	__conn_sock_stop_both(conn);
+	return -1;
+}
+
+/* Detaches the pending handshake job from SSL context <ssl> before it is
+ * released. A job being processed cannot be interrupted, so we wait for the
+ * worker to finish it, which is bounded by one handshake step.
+ */
+static void ssl_async_cancel(SSL *ssl)
+{
+	struct ssl_async_job *job;
+
+	job = SSL_get_ex_data(ssl, ssl_async_idx);
+	if (!job)
+		return;
+
+	pthread_mutex_lock(&ssl_async.lock);
+	while (job->state == SSL_ASYNC_RUNNING)
+		pthread_cond_wait(&ssl_async.idle, &ssl_async.lock);
+	if (job->state != SSL_ASYNC_DONE)
+		LIST_DEL(&job->list);
+	pthread_mutex_unlock(&ssl_async.lock);
+
+	SSL_set_ex_data(ssl, ssl_async_idx, NULL);
+	pool_free2(pool2_ssl_async, job);
+}
+
 /* This is the callback which is used when an SSL handshake is pending. It
  * updates the FD status if it wants some polling before being called again.
  * It returns 0 if it fails in a fatal way or needs to poll to go further,
@@ -1289,7 +2395,7 @@ static int ssl_sock_init(struct connection *conn)
  */
 int ssl_sock_handshake(struct connection *conn, unsigned int flag)
 {
-	int ret;
+	int ret, err = SSL_ERROR_NONE;
 
 	if (!conn_ctrl_ready(conn))
 		return 0;
@@ -1379,10 +2485,21 @@ int ssl_sock_handshake(struct connection *conn, unsigned int flag)
 		goto reneg_ok;
 	}
 
-	ret = SSL_do_handshake(conn->xprt_ctx);
+	if (global.tune.ssl_hs_workers && objt_listener(conn->target)) {
+		/* the private key operations are offloaded to the workers */
+		ret = ssl_async_handshake(conn, &err);
+		if (ret < 0)
+			return 0;
+	}
+	else {
+		ret = SSL_do_handshake(conn->xprt_ctx);
+		if (ret != 1)
+			err = SSL_get_error(conn->xprt_ctx, ret);
+	}
+
 	if (ret != 1) {
 		/* handshake did not complete, let's find why */
-		ret = SSL_get_error(conn->xprt_ctx, ret);
+		ret = err;
 
 		if (ret == SSL_ERROR_WANT_WRITE) {
 			/* SSL handshake needs to write, L4 connection may not be ready */
@@ -1445,15 +2562,9 @@ int ssl_sock_handshake(struct connection *conn, unsigned int flag)
 reneg_ok:
 
 	/* Handshake succeeded */
-	if (objt_server(conn->target)) {
-		if (!SSL_session_reused(conn->xprt_ctx)) {
-			/* check if session was reused, if not store current session on server for reuse */
-			if (objt_server(conn->target)->ssl_ctx.reused_sess)
-				SSL_SESSION_free(objt_server(conn->target)->ssl_ctx.reused_sess);
-
-			objt_server(conn->target)->ssl_ctx.reused_sess = SSL_get1_session(conn->xprt_ctx);
-		}
-	}
+	if (objt_server(conn->target))
+		ssl_sock_srv_set_session(objt_server(conn->target), conn,
+					 SSL_SOCK_ST_TO_SESS_SLOT(conn->xprt_st));
 
 	/* The connection is now established at both layers, it's time to leave */
 	conn->flags &= ~(flag | CO_FL_WAIT_L4_CONN | CO_FL_WAIT_L6_CONN);
@@ -1463,10 +2574,15 @@ reneg_ok:
 	/* Clear openssl global errors stack */
 	ERR_clear_error();
 
-	/* free resumed session if exists */
-	if (objt_server(conn->target) && objt_server(conn->target)->ssl_ctx.reused_sess) {
-		SSL_SESSION_free(objt_server(conn->target)->ssl_ctx.reused_sess);
-		objt_server(conn->target)->ssl_ctx.reused_sess = NULL;
+	/* free the session we tried to resume, if it is still in the cache */
+	if (objt_server(conn->target) && SSL_SOCK_ST_TO_SESS_SLOT(conn->xprt_st) >= 0) {
+		struct server *srv = objt_server(conn->target);
+		int slot = SSL_SOCK_ST_TO_SESS_SLOT(conn->xprt_st);
+
+		if (srv->ssl_ctx.sess[slot] && srv->ssl_ctx.sess[slot] == SSL_get_session(conn->xprt_ctx)) {
+			SSL_SESSION_free(srv->ssl_ctx.sess[slot]);
+			srv->ssl_ctx.sess[slot] = NULL;
+		}
 	}
 
 	/* Fail on all other handshake errors */
@@ -1579,6 +2695,58 @@ static int ssl_sock_to_buf(struct connection *conn, struct buffer *buf, int coun
 }
 
 
+/* Returns the maximum number of bytes to pass to SSL_write() at once on <conn>,
+ * or 0 for no limit. With dynamic record sizing, each burst starts with
+ * records fitting in a single TCP segment so that the client can decipher
+ * them as they arrive, then switches to the "tune.ssl.maxrecord" limit once
+ * "tune.ssl.dyn-record-threshold" bytes were sent. A burst begins after
+ * "tune.idletimer" without any write. The limit is never lowered while a
+ * blocked write is pending, since it must be retried with as many data.
+ */
+static inline int ssl_sock_max_record(struct connection *conn)
+{
+	struct ssl_dyn_record *dr;
+
+	if (!global.tune.ssl_dyn_rec_threshold)
+		return global.tune.ssl_max_record;
+
+	dr = SSL_get_ex_data(conn->xprt_ctx, ssl_dyn_rec_idx);
+	if (!dr) {
+		dr = pool_alloc2(pool2_ssl_dyn_rec);
+		if (!dr)
+			return global.tune.ssl_max_record;
+		dr->sent = 0;
+		dr->last = now_ms;
+		SSL_set_ex_data(conn->xprt_ctx, ssl_dyn_rec_idx, dr);
+	}
+	else if (!(conn->xprt_st & SSL_SOCK_SEND_BLOCKED) &&
+		 tick_is_expired(tick_add(dr->last, global.tune.idle_timer), now_ms))
+		dr->sent = 0;
+
+	if (dr->sent < global.tune.ssl_dyn_rec_threshold &&
+	    (!global.tune.ssl_max_record || global.tune.ssl_max_record > SSL_DYN_RECORD_SIZE))
+		return SSL_DYN_RECORD_SIZE;
+
+	return global.tune.ssl_max_record;
+}
+
+/* Accounts for <bytes> sent on <conn> in the current burst */
+static inline void ssl_sock_dyn_record_sent(struct connection *conn, int bytes)
+{
+	struct ssl_dyn_record *dr;
+
+	if (!global.tune.ssl_dyn_rec_threshold)
+		return;
+
+	dr = SSL_get_ex_data(conn->xprt_ctx, ssl_dyn_rec_idx);
+	if (!dr)
+		return;
+
+	if (dr->sent < global.tune.ssl_dyn_rec_threshold)
+		dr->sent += bytes;
+	dr->last = now_ms;
+}
+
 /* Send all pending bytes from buffer <buf> to connection <conn>'s socket.
  * <flags> may contain some CO_SFL_* flags to hint the system about other
  * pending data for example, but this flag is ignored at the moment.
@@ -1591,7 +2759,7 @@ static int ssl_sock_to_buf(struct connection *conn, struct buffer *buf, int coun
  */
 static int ssl_sock_from_buf(struct connection *conn, struct buffer *buf, int flags)
 {
-	int ret, try, done;
+	int ret, try, done, max;
 
 	done = 0;
 
@@ -1611,8 +2779,8 @@ static int ssl_sock_from_buf(struct connection *conn, struct buffer *buf, int fl
 
 		if (!(flags & CO_SFL_STREAMER) &&
 		    !(conn->xprt_st & SSL_SOCK_SEND_UNLIMITED) &&
-		    global.tune.ssl_max_record && try > global.tune.ssl_max_record) {
-			try = global.tune.ssl_max_record;
+		    (max = ssl_sock_max_record(conn)) && try > max) {
+			try = max;
 		}
 		else {
 			/* we need to keep the information about the fact that
@@ -1629,7 +2797,8 @@ static int ssl_sock_from_buf(struct connection *conn, struct buffer *buf, int fl
 			goto out_error;
 		}
 		if (ret > 0) {
-			conn->xprt_st &= ~SSL_SOCK_SEND_UNLIMITED;
+			conn->xprt_st &= ~(SSL_SOCK_SEND_UNLIMITED | SSL_SOCK_SEND_BLOCKED);
+			ssl_sock_dyn_record_sent(conn, ret);
 
 			buf->o -= ret;
 			done += ret;
@@ -1643,6 +2812,7 @@ static int ssl_sock_from_buf(struct connection *conn, struct buffer *buf, int fl
 				break;
 		}
 		else {
+			conn->xprt_st |= SSL_SOCK_SEND_BLOCKED;
 			ret = SSL_get_error(conn->xprt_ctx, ret);
 			if (ret == SSL_ERROR_WANT_WRITE) {
 				if (SSL_renegotiate_pending(conn->xprt_ctx)) {
@@ -1677,6 +2847,13 @@ static int ssl_sock_from_buf(struct connection *conn, struct buffer *buf, int fl
 static void ssl_sock_close(struct connection *conn) {
 
 	if (conn->xprt_ctx) {
+		if (ssl_async.started > 0)
+			ssl_async_cancel(conn->xprt_ctx);
+		if (global.tune.ssl_dyn_rec_threshold) {
+			struct ssl_dyn_record *dr = SSL_get_ex_data(conn->xprt_ctx, ssl_dyn_rec_idx);
+
+			pool_free2(pool2_ssl_dyn_rec, dr);
+		}
 		SSL_free(conn->xprt_ctx);
 		conn->xprt_ctx = NULL;
 		sslconns--;
@@ -2846,6 +4023,9 @@ static int bind_parse_ciphers(char **args, int cur_arg, struct proxy *px, struct
 static int bind_parse_crt(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
 {
 	char path[MAXPATHLEN];
+	char *file = args[cur_arg + 1];
+	struct timeval start, stop;
+	int ret;
 
 	if (!*args[cur_arg + 1]) {
 		memprintf(err, "'%s' : missing certificate location", args[cur_arg]);
@@ -2858,13 +4038,15 @@ static int bind_parse_crt(char **args, int cur_arg, struct proxy *px, struct bin
 			return ERR_ALERT | ERR_FATAL;
 		}
 		snprintf(path, sizeof(path), "%s/%s",  global.crt_base, args[cur_arg + 1]);
-		if (ssl_sock_load_cert(path, conf, px, err) > 0)
-			return ERR_ALERT | ERR_FATAL;
-
-		return 0;
+		file = path;
 	}
 
-	if (ssl_sock_load_cert(args[cur_arg + 1], conf, px, err) > 0)
+	gettimeofday(&start, NULL);
+	ret = ssl_sock_load_cert(file, conf, px, err);
+	gettimeofday(&stop, NULL);
+	lazy_certs.load_time += tv_ms_elapsed(&start, &stop);
+
+	if (ret > 0)
 		return ERR_ALERT | ERR_FATAL;
 
 	return 0;
@@ -2873,12 +4055,20 @@ static int bind_parse_crt(char **args, int cur_arg, struct proxy *px, struct bin
 /* parse the "crt-list" bind keyword */
 static int bind_parse_crt_list(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
 {
+	struct timeval start, stop;
+	int ret;
+
 	if (!*args[cur_arg + 1]) {
 		memprintf(err, "'%s' : missing certificate location", args[cur_arg]);
 		return ERR_ALERT | ERR_FATAL;
 	}
 
-	if (ssl_sock_load_cert_list_file(args[cur_arg + 1], conf, px, err) > 0) {
+	gettimeofday(&start, NULL);
+	ret = ssl_sock_load_cert_list_file(args[cur_arg + 1], conf, px, err);
+	gettimeofday(&stop, NULL);
+	lazy_certs.load_time += tv_ms_elapsed(&start, &stop);
+
+	if (ret > 0) {
 		memprintf(err, "'%s' : %s", args[cur_arg], *err);
 		return ERR_ALERT | ERR_FATAL;
 	}
@@ -3020,6 +4210,32 @@ static int bind_parse_no_tls_tickets(char **args, int cur_arg, struct proxy *px,
 }
 
 
+/* parse the "tls-ticket-keys" bind keyword */
+static int bind_parse_tls_ticket_keys(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+#ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
+	if (!*args[cur_arg + 1]) {
+		if (err)
+			memprintf(err, "'%s' : missing TLS ticket keys file path", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	conf->keys_ref = tlskeys_ref_lookup(args[cur_arg + 1]);
+	if (!conf->keys_ref)
+		conf->keys_ref = ssl_sock_load_tlskeys(args[cur_arg + 1], err);
+	if (!conf->keys_ref) {
+		if (err)
+			memprintf(err, "'%s' : %s", args[cur_arg], *err);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	return 0;
+#else
+	if (err)
+		memprintf(err, "'%s' : library does not support TLS ticket keys callback", args[cur_arg]);
+	return ERR_ALERT | ERR_FATAL;
+#endif
+}
+
 /* parse the "no-sslv3" bind keyword */
 static int bind_parse_no_sslv3(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
 {
@@ -3357,6 +4573,27 @@ static int srv_parse_ssl(char **args, int *cur_arg, struct proxy *px, struct ser
 	return 0;
 }
 
+/* parse the "ssl-sess-cache" server keyword */
+static int srv_parse_ssl_sess_cache(char **args, int *cur_arg, struct proxy *px, struct server *newsrv, char **err)
+{
+	int nb;
+
+	if (!*args[*cur_arg + 1]) {
+		memprintf(err, "'%s' : missing number of sessions", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	nb = atoi(args[*cur_arg + 1]);
+	if (nb < 1 || nb > SRV_SSL_SESS_CACHE_MAX) {
+		memprintf(err, "'%s' : expects a number of sessions between 1 and %d",
+			  args[*cur_arg], SRV_SSL_SESS_CACHE_MAX);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	newsrv->ssl_ctx.sess_nb = nb;
+	return 0;
+}
+
 /* parse the "verify" server keyword */
 static int srv_parse_verify(char **args, int *cur_arg, struct proxy *px, struct server *newsrv, char **err)
 {
@@ -3484,6 +4721,7 @@ static struct bind_kw_list bind_kws = { "SSL", { }, {
 	{ "no-tls-tickets",        bind_parse_no_tls_tickets, 0 }, /* disable session resumption tickets */
 	{ "ssl",                   bind_parse_ssl,            0 }, /* enable SSL processing */
 	{ "strict-sni",            bind_parse_strict_sni,     0 }, /* refuse negotiation if sni doesn't match a certificate */
+	{ "tls-ticket-keys",       bind_parse_tls_ticket_keys, 1 }, /* set file to load TLS ticket keys from */
 	{ "verify",                bind_parse_verify,         1 }, /* set SSL verify method */
 	{ "npn",                   bind_parse_npn,            1 }, /* set NPN supported protocols */
 	{ NULL, NULL, 0 },
@@ -3512,6 +4750,7 @@ static struct srv_kw_list srv_kws = { "SSL", { }, {
 	{ "no-tlsv12",             srv_parse_no_tlsv12,      0, 0 }, /* disable TLSv12 */
 	{ "no-tls-tickets",        srv_parse_no_tls_tickets, 0, 0 }, /* disable session resumption tickets */
 	{ "ssl",                   srv_parse_ssl,            0, 0 }, /* enable SSL processing */
+	{ "ssl-sess-cache",        srv_parse_ssl_sess_cache, 1, 0 }, /* number of sessions kept for resumption */
 	{ "verify",                srv_parse_verify,         1, 0 }, /* set SSL verify method */
 	{ "verifyhost",            srv_parse_verifyhost,     1, 0 }, /* require that SSL cert verifies for hostname */
 	{ NULL, NULL, 0, 0 },
@@ -3546,6 +4785,9 @@ static void __ssl_sock_init(void)
 		global.connect_default_ciphers = strdup(global.connect_default_ciphers);
 
 	SSL_library_init();
+	ssl_async_idx = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+	ssl_dyn_rec_idx = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+	pool2_ssl_dyn_rec = create_pool("ssl_dyn_rec", sizeof(struct ssl_dyn_record), MEM_F_SHARED);
 	cm = SSL_COMP_get_compression_methods();
 	sk_SSL_COMP_zero(cm);
 	sample_register_fetches(&sample_fetch_keywords);
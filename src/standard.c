@@ -1106,6 +1106,32 @@ int url2sa(const char *url, int ulen, struct sockaddr_storage *addr, struct spli
 	return -1;
 }
 
+/* Converts the IPv4 address <addr> to its dotted-quad representation into
+ * <dst> which must be at least INET_ADDRSTRLEN bytes long, and returns a
+ * pointer to the trailing zero. It is much faster than inet_ntop().
+ */
+char *ipv4_to_str(const struct in_addr *addr, char *dst)
+{
+	const unsigned char *byte = (const unsigned char *)&addr->s_addr;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		unsigned int n = byte[i];
+
+		if (n >= 100) {
+			*dst++ = '0' + n / 100;
+			n %= 100;
+			*dst++ = '0' + n / 10;
+		}
+		else if (n >= 10)
+			*dst++ = '0' + n / 10;
+		*dst++ = '0' + n % 10;
+		*dst++ = '.';
+	}
+	*--dst = '\0';
+	return dst;
+}
+
 /* Tries to convert a sockaddr_storage address to text form. Upon success, the
  * address family is returned so that it's easy for the caller to adapt to the
  * output format. Zero is returned if the address family is not supported. -1
@@ -11,6 +11,7 @@
  */
 
 #include <string.h>
+#include <time.h>
 
 #include <common/config.h>
 #include <common/memory.h>
@@ -19,6 +20,9 @@
 #include <common/time.h>
 #include <eb32tree.h>
 
+#include <types/global.h>
+
+#include <proto/obj_type.h>
 #include <proto/proxy.h>
 #include <proto/session.h>
 #include <proto/task.h>
@@ -36,6 +40,29 @@ static struct eb_root timers;      /* sorted timers tree */
 static struct eb_root rqueue;      /* tree constituting the run queue */
 static unsigned int rqueue_ticks;  /* insertion count */
 
+/* The timer wheel. A bit is set in the map of a level for each slot which may
+ * contain tasks, and <last> holds the index of the last slot processed at each
+ * level. Slot indexes are dates shifted by the level's shift, which wrap with
+ * the date.
+ */
+static struct list timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static unsigned int timer_wheel_map[TIMER_WHEEL_LEVELS];
+static unsigned int timer_wheel_last[TIMER_WHEEL_LEVELS];
+
+struct task_class_stats task_classes[TASK_CLASSES];  /* per-class scheduling stats */
+static unsigned int task_classes_active;              /* classes seen during the last pass */
+
+const char *task_class_names[TASK_CLASSES] = {
+	[TASK_CL_SESSION] = "session",
+	[TASK_CL_APPLET]  = "applet",
+	[TASK_CL_CHECK]   = "check",
+	[TASK_CL_PEERS]   = "peers",
+	[TASK_CL_OTHER]   = "other",
+};
+
+#define TW_SHIFT(lvl)         (TIMER_WHEEL_RES + (lvl) * TIMER_WHEEL_BITS)
+#define TW_MASK(lvl)          (~0U >> TW_SHIFT(lvl))
+
 /* Puts the task <t> in run queue at a position depending on t->nice. <t> is
  * returned. The nice value assigns boosts in 32th of the run queue size. A
  * nice value of -1024 sets the task to -run_queue*32, while a nice value of
@@ -67,6 +94,138 @@ struct task *__task_wakeup(struct task *t)
 	return t;
 }
 
+/* Appends task <task> to the timer wheel slot matching its expiration date.
+ * Returns 0 if it expires too soon or too late for the wheel, in which case
+ * it must be queued in the tree.
+ */
+static inline int __task_queue_wheel(struct task *task)
+{
+	unsigned int lvl, idx, slot;
+
+	if ((int)(task->expire - now_ms) < (2 << TIMER_WHEEL_RES))
+		return 0;
+
+	for (lvl = 0; lvl < TIMER_WHEEL_LEVELS; lvl++) {
+		idx = (unsigned int)task->expire >> TW_SHIFT(lvl);
+		if (((idx - ((unsigned int)now_ms >> TW_SHIFT(lvl))) & TW_MASK(lvl)) >= TIMER_WHEEL_SLOTS)
+			continue;
+
+		slot = idx & (TIMER_WHEEL_SLOTS - 1);
+		LIST_ADDQ(&timer_wheel[lvl][slot], &task->wl);
+		timer_wheel_map[lvl] |= 1U << slot;
+		task->wq.key = idx << TW_SHIFT(lvl);
+		return 1;
+	}
+	return 0;
+}
+
+/* Moves the tasks of the timer wheel slots which began since the last call to
+ * their next place, which is a lower level, the tree for the ones about to
+ * expire, or nowhere for the ones which do not expire anymore. Levels are
+ * processed from the highest one so that tasks cascade down in a single call.
+ * A slot is detached before being processed since its tasks may be requeued
+ * into it when the wheel was not visited for a whole turn.
+ */
+static void wheel_move_tasks()
+{
+	struct list slot_tasks;
+	struct list *head;
+	struct task *task, *back;
+	unsigned int lvl, cur, n, slot;
+
+	for (lvl = TIMER_WHEEL_LEVELS; lvl-- > 0; ) {
+		cur = (unsigned int)now_ms >> TW_SHIFT(lvl);
+		n = (cur - timer_wheel_last[lvl]) & TW_MASK(lvl);
+		if (!n)
+			continue;
+
+		timer_wheel_last[lvl] = cur;
+		if (n > TIMER_WHEEL_SLOTS)
+			n = TIMER_WHEEL_SLOTS;
+
+		while (n--) {
+			slot = (cur - n) & (TIMER_WHEEL_SLOTS - 1);
+			if (!(timer_wheel_map[lvl] & (1U << slot)))
+				continue;
+
+			timer_wheel_map[lvl] &= ~(1U << slot);
+			head = &timer_wheel[lvl][slot];
+			if (LIST_ISEMPTY(head))
+				continue;
+
+			slot_tasks.n = head->n;
+			slot_tasks.p = head->p;
+			slot_tasks.n->p = slot_tasks.p->n = &slot_tasks;
+			LIST_INIT(head);
+
+			list_for_each_entry_safe(task, back, &slot_tasks, wl) {
+				LIST_DEL(&task->wl);
+				task->wl.n = NULL;
+				if (tick_isset(task->expire))
+					__task_queue(task);
+			}
+		}
+	}
+}
+
+/* Returns the date at which the first non-empty timer wheel slot begins, or
+ * TICK_ETERNITY if the wheel is empty. The slots emptied by task deletions
+ * are only cleared from the maps here.
+ */
+static int wheel_next_date()
+{
+	unsigned int lvl, map, pos, slot, dist, date;
+	int next = TICK_ETERNITY;
+
+	for (lvl = 0; lvl < TIMER_WHEEL_LEVELS; lvl++) {
+		while ((map = timer_wheel_map[lvl])) {
+			/* rotate the map to start right after the last slot */
+			pos = (timer_wheel_last[lvl] + 1) & (TIMER_WHEEL_SLOTS - 1);
+			if (pos)
+				map = (map >> pos) | (map << (TIMER_WHEEL_SLOTS - pos));
+			dist = flsnz((int)(map & -map)) - 1;
+			slot = (pos + dist) & (TIMER_WHEEL_SLOTS - 1);
+
+			if (LIST_ISEMPTY(&timer_wheel[lvl][slot])) {
+				timer_wheel_map[lvl] &= ~(1U << slot);
+				continue;
+			}
+
+			date = (timer_wheel_last[lvl] + 1 + dist) << TW_SHIFT(lvl);
+			next = tick_first(next, date ? date : 1);
+			break;
+		}
+	}
+	return next;
+}
+
+/* Returns a monotonic date in nanoseconds, used to measure the time spent in
+ * tasks.
+ */
+static inline unsigned long long task_clock_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Returns the class task <t> is accounted in. Sessions running an applet are
+ * accounted apart from the other ones, since the applet may be attached late.
+ */
+static inline int task_class(struct task *t)
+{
+	struct session *s;
+
+	if (t->class != TASK_CL_SESSION || t->process != process_session)
+		return t->class;
+
+	s = t->context;
+	if (objt_appctx(s->si[0].end) || objt_appctx(s->si[1].end))
+		return TASK_CL_APPLET;
+	return TASK_CL_SESSION;
+}
+
 /*
  * __task_queue()
  *
@@ -93,6 +252,9 @@ void __task_queue(struct task *task)
 		return;
 #endif
 
+	if ((global.tune.options & GTUNE_USE_TIMER_WHEEL) && __task_queue_wheel(task))
+		return;
+
 	if (likely(last_timer &&
 		   last_timer->node.bit < 0 &&
 		   last_timer->key == task->wq.key &&
@@ -124,6 +286,9 @@ void wake_expired_tasks(int *next)
 	struct task *task;
 	struct eb32_node *eb;
 
+	/* first bring the timers which are about to expire into the tree */
+	wheel_move_tasks();
+
 	eb = eb32_lookup_ge(&timers, now_ms - TIMER_LOOK_BACK);
 	while (1) {
 		if (unlikely(!eb)) {
@@ -138,7 +303,7 @@ void wake_expired_tasks(int *next)
 
 		if (likely(tick_is_lt(now_ms, eb->key))) {
 			/* timer not expired yet, revisit it later */
-			*next = eb->key;
+			*next = tick_first(eb->key, wheel_next_date());
 			return;
 		}
 
@@ -158,13 +323,13 @@ void wake_expired_tasks(int *next)
 		 * the same place, before <eb>, so we have to check if this happens,
 		 * and adjust <eb>, otherwise we may skip it which is not what we want.
 		 * We may also not requeue the task (and not point eb at it) if its
-		 * expiration time is not set.
+		 * expiration time is not set, nor if it went to the timer wheel.
 		 */
 		if (!tick_is_expired(task->expire, now_ms)) {
 			if (!tick_isset(task->expire))
 				continue;
 			__task_queue(task);
-			if (!eb || eb->key > task->wq.key)
+			if (task->wq.node.leaf_p && (!eb || eb->key > task->wq.key))
 				eb = &task->wq;
 			continue;
 		}
@@ -172,7 +337,7 @@ void wake_expired_tasks(int *next)
 	}
 
 	/* We have found no task to expire in any tree */
-	*next = TICK_ETERNITY;
+	*next = wheel_next_date();
 	return;
 }
 
@@ -184,6 +349,12 @@ void wake_expired_tasks(int *next)
  * 200 max in any case, so that general latency remains low and so that task
  * positions have a chance to be considered.
  *
+ * The time spent in each task is accounted to its class. When fair scheduling
+ * is enabled, the classes which were active during the previous pass share the
+ * time budget according to their weights, and the tasks of a class which has
+ * consumed its share are left in the run queue for the next pass, where they
+ * will be the first ones considered.
+ *
  * The function adjusts <next> if a new event is closer.
  */
 void process_runnable_tasks(int *next)
@@ -191,7 +362,10 @@ void process_runnable_tasks(int *next)
 	struct task *t;
 	struct eb32_node *eb;
 	unsigned int max_processed;
-	int expire;
+	unsigned long long start, stop;
+	unsigned long long spent[TASK_CLASSES], limit[TASK_CLASSES];
+	unsigned int active, deferred, weights;
+	int expire, cl;
 
 	run_queue_cur = run_queue; /* keep a copy for reporting */
 	nb_tasks_cur = nb_tasks;
@@ -206,7 +380,25 @@ void process_runnable_tasks(int *next)
 	if (likely(niced_tasks))
 		max_processed = (max_processed + 3) / 4;
 
+	if (global.tune.sched_budget) {
+		weights = 0;
+		for (cl = 0; cl < TASK_CLASSES; cl++) {
+			if (task_classes_active & (1 << cl))
+				weights += global.tune.sched_weight[cl];
+		}
+
+		for (cl = 0; cl < TASK_CLASSES; cl++) {
+			spent[cl] = 0;
+			limit[cl] = ~0ULL;
+			if (weights && (task_classes_active & (1 << cl)))
+				limit[cl] = (unsigned long long)global.tune.sched_budget * 1000ULL *
+					global.tune.sched_weight[cl] / weights;
+		}
+	}
+
+	active = deferred = 0;
 	expire = *next;
+	start = task_clock_ns();
 	eb = eb32_lookup_ge(&rqueue, rqueue_ticks - TIMER_LOOK_BACK);
 	while (max_processed--) {
 		/* Note: this loop is one of the fastest code path in
@@ -224,9 +416,24 @@ void process_runnable_tasks(int *next)
 				break;
 		}
 
-		/* detach the task from the queue */
 		t = eb32_entry(eb, struct task, rq);
 		eb = eb32_next(eb);
+
+		cl = task_class(t);
+		active |= 1 << cl;
+		if (global.tune.sched_budget && spent[cl] >= limit[cl]) {
+			/* this class has consumed its share, the task will
+			 * wait for next pass. Stop once only such tasks are
+			 * left.
+			 */
+			task_classes[cl].deferred++;
+			max_processed++;
+			if (++deferred >= run_queue)
+				break;
+			continue;
+		}
+
+		/* detach the task from the queue */
 		__task_unlink_rq(t);
 
 		t->state |= TASK_RUNNING;
@@ -239,6 +446,13 @@ void process_runnable_tasks(int *next)
 		else
 			t = t->process(t);
 
+		stop = task_clock_ns();
+		task_classes[cl].calls++;
+		task_classes[cl].cpu_ns += stop - start;
+		if (global.tune.sched_budget)
+			spent[cl] += stop - start;
+		start = stop;
+
 		if (likely(t != NULL)) {
 			t->state &= ~TASK_RUNNING;
 			if (t->expire) {
@@ -254,18 +468,59 @@ void process_runnable_tasks(int *next)
 			}
 		}
 	}
+	task_classes_active = active;
 	*next = expire;
 }
 
 /* perform minimal intializations, report 0 in case of error, 1 if OK. */
 int init_task()
 {
+	int lvl, slot;
+
 	memset(&timers, 0, sizeof(timers));
 	memset(&rqueue, 0, sizeof(rqueue));
+	for (lvl = 0; lvl < TIMER_WHEEL_LEVELS; lvl++) {
+		for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+			LIST_INIT(&timer_wheel[lvl][slot]);
+		timer_wheel_map[lvl] = 0;
+		timer_wheel_last[lvl] = (unsigned int)now_ms >> TW_SHIFT(lvl);
+	}
 	pool2_task = create_pool("task", sizeof(struct task), MEM_F_SHARED);
 	return pool2_task != NULL;
 }
 
+/* Returns the task class matching <name>, or -1 if unknown. */
+int task_class_lookup(const char *name)
+{
+	int cl;
+
+	for (cl = 0; cl < TASK_CLASSES; cl++) {
+		if (strcmp(name, task_class_names[cl]) == 0)
+			return cl;
+	}
+	return -1;
+}
+
+/* Dumps the scheduling statistics of all task classes into the trash. */
+void dump_task_classes_to_trash()
+{
+	int cl;
+
+	chunk_printf(&trash, "Fair scheduling: %s",
+		     global.tune.sched_budget ? "enabled" : "disabled");
+	if (global.tune.sched_budget)
+		chunk_appendf(&trash, ", budget %u us per loop", global.tune.sched_budget);
+	chunk_appendf(&trash, "\n");
+
+	for (cl = 0; cl < TASK_CLASSES; cl++) {
+		chunk_appendf(&trash, "  - %-8s weight %-4u : %llu calls, %llu us, %llu ns/call, %llu deferred\n",
+			      task_class_names[cl], global.tune.sched_weight[cl],
+			      task_classes[cl].calls, task_classes[cl].cpu_ns / 1000,
+			      task_classes[cl].calls ? task_classes[cl].cpu_ns / task_classes[cl].calls : 0,
+			      task_classes[cl].deferred);
+	}
+}
+
 /*
  * Local variables:
  *  c-indent-level: 8
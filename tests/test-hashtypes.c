@@ -0,0 +1,185 @@
+/*
+ * Hash types comparison : map-based, consistent and maglev. For each of them,
+ * it reports the lookup throughput, the spread of a set of keys over the
+ * servers, and the ratio of keys which move to another server when one server
+ * goes down then up again, compared to the ideal ratio (the keys of the failed
+ * server only).
+ *
+ * See tests/README to build it.
+ *
+ * Usage : test-hashtypes [<servers> [<keys>]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <common/standard.h>
+#include <common/time.h>
+
+#include <types/global.h>
+
+#include <proto/backend.h>
+#include <proto/lb_chash.h>
+#include <proto/lb_maglev.h>
+#include <proto/lb_map.h>
+#include <proto/proxy.h>
+
+static struct proxy px;
+static struct server *srv;
+static struct server **before;
+static int nbsrv = 50, nbkeys = 1000000;
+
+/* prepares a backend of <nbsrv> servers with hash type <type> */
+static void init_backend(int type)
+{
+	int i;
+
+	init_new_proxy(&px);
+	px.id = "bench";
+	px.lbprm.algo = BE_LB_ALGO_SH | type;
+	px.lbprm.wmult = 1;
+	px.lbprm.wdiv = 1;
+	for (i = nbsrv - 1; i >= 0; i--) {
+		memset(&srv[i], 0, sizeof(srv[i]));
+		srv[i].obj_type = OBJ_TYPE_SERVER;
+		srv[i].proxy = &px;
+		srv[i].puid = i + 1;
+		srv[i].state = SRV_RUNNING;
+		srv[i].uweight = 1;
+		srv[i].next = px.srv;
+		px.srv = &srv[i];
+	}
+
+	if (type == BE_LB_HASH_CONS) {
+		px.lbprm.algo |= BE_LB_LKUP_CHTREE;
+		chash_init_server_tree(&px);
+	}
+	else if (type == BE_LB_HASH_MAGLEV) {
+		px.lbprm.algo |= BE_LB_LKUP_MGLEV;
+		maglev_init_server_table(&px);
+	}
+	else {
+		px.lbprm.algo |= BE_LB_LKUP_MAP;
+		init_server_map(&px);
+	}
+}
+
+static inline struct server *lookup(unsigned int hash)
+{
+	switch (px.lbprm.algo & BE_LB_LKUP) {
+	case BE_LB_LKUP_CHTREE:
+		return chash_get_server_hash(&px, hash);
+	case BE_LB_LKUP_MGLEV:
+		return maglev_get_server_hash(&px, hash);
+	default:
+		return map_get_server_hash(&px, hash);
+	}
+}
+
+/* changes the state of server <s> as the health checks would do */
+static void set_state(struct server *s, int up)
+{
+	if (up) {
+		s->state |= SRV_RUNNING;
+		px.lbprm.set_server_status_up(s);
+	}
+	else {
+		s->state &= ~SRV_RUNNING;
+		px.lbprm.set_server_status_down(s);
+	}
+}
+
+/* runs the tests on hash type <type> and reports the results */
+static void run(const char *name, int type)
+{
+	struct timespec start, stop;
+	struct server *victim;
+	unsigned long long sum = 0;
+	double elapsed;
+	int *count;
+	int min, max, moved_down, moved_up, lost;
+	int i, loops;
+
+	init_backend(type);
+	count = calloc(nbsrv, sizeof(*count));
+
+	/* lookup throughput on already hashed keys */
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+	for (loops = 0; loops < 10; loops++)
+		for (i = 0; i < nbkeys; i++)
+			sum += (long)lookup(full_hash(i));
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stop);
+	elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+	/* spread of the keys */
+	for (i = 0; i < nbkeys; i++) {
+		before[i] = lookup(full_hash(i));
+		count[before[i] - srv]++;
+	}
+	min = max = count[0];
+	for (i = 1; i < nbsrv; i++) {
+		if (count[i] < min)
+			min = count[i];
+		if (count[i] > max)
+			max = count[i];
+	}
+
+	/* remapping when the server at the middle goes down then up */
+	victim = &srv[nbsrv / 2];
+	set_state(victim, 0);
+	moved_down = lost = 0;
+	for (i = 0; i < nbkeys; i++) {
+		struct server *s = lookup(full_hash(i));
+
+		if (before[i] == victim)
+			lost++;
+		else if (s != before[i])
+			moved_down++;
+	}
+
+	set_state(victim, 1);
+	moved_up = 0;
+	for (i = 0; i < nbkeys; i++)
+		if (lookup(full_hash(i)) != before[i])
+			moved_up++;
+
+	printf("%-10s : %6.1f Mlookups/s, keys/server min/max vs avg : %.3f / %.3f, "
+	       "moved on down/up : %.2f%% / %.2f%% (ideal %.2f%%)\n",
+	       name, 10.0 * nbkeys / elapsed / 1e6,
+	       (double)min * nbsrv / nbkeys, (double)max * nbsrv / nbkeys,
+	       100.0 * (moved_down + lost) / nbkeys, 100.0 * moved_up / nbkeys,
+	       100.0 * lost / nbkeys);
+
+	free(count);
+	if (!sum)
+		printf("\n"); /* don't let the compiler drop the lookups */
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		nbsrv = atoi(argv[1]);
+	if (argc > 2)
+		nbkeys = atoi(argv[2]);
+
+	if (nbsrv < 2 || nbkeys < 1) {
+		fprintf(stderr, "Usage: %s [<servers> [<keys>]]\n", argv[0]);
+		exit(1);
+	}
+
+	srv = calloc(nbsrv, sizeof(*srv));
+	before = calloc(nbkeys, sizeof(*before));
+	if (!srv || !before) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	tv_update_date(-1, 1);
+	printf("%d servers, %d keys\n", nbsrv, nbkeys);
+	run("map-based", BE_LB_HASH_MAP);
+	run("consistent", BE_LB_HASH_CONS);
+	run("maglev", BE_LB_HASH_MAGLEV);
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Recovery test for the "leastlatency" load balancing algorithm. A farm of
+ * servers all responding in 5 ms receives a few requests per millisecond.
+ * After one second, the first server delivers a single 5 second response,
+ * which makes it avoided. Since it does not receive any request anymore, its
+ * average may only decay with time, until it gets traffic again. The first
+ * server's average and share of the requests are reported every second, and
+ * the program fails if the server never recovers.
+ *
+ * See tests/README to build it.
+ *
+ * Usage : test-latency [<servers> [<reqs/ms> [<seconds>]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/time.h>
+
+#include <types/global.h>
+
+#include <proto/backend.h>
+#include <proto/lb_fwlc.h>
+#include <proto/proxy.h>
+#include <proto/server.h>
+
+#define RESP_TIME   5     /* normal response time in ms */
+#define SPIKE_TIME  5000  /* response time of the slow response in ms */
+#define SPIKE_DATE  1000  /* date of the slow response in ms */
+
+static struct proxy px;
+static struct server *srv;
+
+/* pending requests, all ending RESP_TIME ms after they start */
+static struct req {
+	struct server *srv;
+	unsigned int end;
+} *reqs;
+static int nbreqs, req_head, req_tail;
+
+/* prepares a backend of <nbsrv> servers using the leastlatency algorithm */
+static void init_backend(int nbsrv)
+{
+	int i;
+
+	init_new_proxy(&px);
+	px.id = "bench";
+	px.mode = PR_MODE_HTTP;
+	px.lbprm.algo = BE_LB_ALGO_LL | BE_LB_LKUP_LCTREE;
+	px.lbprm.wmult = 1;
+	for (i = nbsrv - 1; i >= 0; i--) {
+		srv[i].obj_type = OBJ_TYPE_SERVER;
+		srv[i].proxy = &px;
+		srv[i].state = SRV_RUNNING;
+		srv[i].uweight = 1;
+		srv[i].next = px.srv;
+		px.srv = &srv[i];
+	}
+	fwlc_init_server_tree(&px);
+}
+
+static void start_request(void)
+{
+	struct server *s = fwlc_get_next_server(&px, NULL);
+
+	s->served++;
+	px.lbprm.server_take_conn(s);
+	reqs[req_tail].srv = s;
+	reqs[req_tail].end = now_ms + RESP_TIME;
+	req_tail = (req_tail + 1) % nbreqs;
+}
+
+/* ends all requests due at the current date */
+static void end_requests(void)
+{
+	while (req_head != req_tail && reqs[req_head].end == now_ms) {
+		struct server *s = reqs[req_head].srv;
+
+		s->served--;
+		px.lbprm.server_drop_conn(s);
+		srv_update_latency(s, 0, RESP_TIME);
+		req_head = (req_head + 1) % nbreqs;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int nbsrv = 4, rate = 4, seconds = 15;
+	int total = 0, picked = 0, recovered = -1;
+	int ms, i;
+
+	if (argc > 1)
+		nbsrv = atoi(argv[1]);
+	if (argc > 2)
+		rate = atoi(argv[2]);
+	if (argc > 3)
+		seconds = atoi(argv[3]);
+
+	if (nbsrv < 2 || rate < 1 || seconds < 2) {
+		fprintf(stderr, "Usage: %s [<servers> [<reqs/ms> [<seconds>]]]\n", argv[0]);
+		exit(1);
+	}
+
+	nbreqs = rate * (RESP_TIME + 1) + 1;
+	srv = calloc(nbsrv, sizeof(*srv));
+	reqs = calloc(nbreqs, sizeof(*reqs));
+	if (!srv || !reqs) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	now_ms = 1;
+	init_backend(nbsrv);
+	printf("%d servers, %d reqs/ms, %d ms responses, one %d ms response at %d ms\n",
+	       nbsrv, rate, RESP_TIME, SPIKE_TIME, SPIKE_DATE);
+	printf("  time  srv1 avg  srv1 share\n");
+
+	for (ms = 1; ms <= seconds * 1000; ms++) {
+		now_ms = ms;
+		end_requests();
+
+		if (ms == SPIKE_DATE)
+			srv_update_latency(&srv[0], 0, SPIKE_TIME);
+
+		for (i = 0; i < rate; i++) {
+			start_request();
+			total++;
+			if (reqs[(req_tail + nbreqs - 1) % nbreqs].srv == &srv[0]) {
+				picked++;
+				if (ms > SPIKE_DATE && recovered < 0)
+					recovered = ms - SPIKE_DATE;
+			}
+		}
+
+		if (ms % 1000 == 0) {
+			printf("%5ds  %6u ms  %9.1f%%\n", ms / 1000,
+			       srv_ewma_now(&srv[0], srv[0].ewma_rtime) / SRV_EWMA_SCALE,
+			       picked * 100.0 / total);
+			total = picked = 0;
+		}
+	}
+
+	if (recovered < 0) {
+		printf("server 1 never recovered\n");
+		return 1;
+	}
+	printf("server 1 received traffic again %d ms after the slow response\n", recovered);
+	return 0;
+}
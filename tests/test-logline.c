@@ -0,0 +1,160 @@
+/*
+ * Log line generation benchmark. It first checks that a few formats mixing
+ * texts and separators produce the expected lines, then it builds the default
+ * HTTP log format for a fake session as many times as possible for a few
+ * seconds and reports the number of log lines produced per second.
+ * See tests/README to build it.
+ *
+ * Usage : test-logline [<seconds> [<log-format>]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include <common/time.h>
+
+#include <types/global.h>
+
+#include <proto/log.h>
+#include <proto/obj_type.h>
+#include <proto/proxy.h>
+
+static struct proxy px;
+static struct listener li;
+static struct server srv;
+static struct connection cli_conn, srv_conn;
+static struct channel req, rep;
+static struct session sess;
+static char line[MAX_SYSLOG_LEN];
+
+static void init_session(void)
+{
+	struct sockaddr_in *sin;
+
+	sin = (struct sockaddr_in *)&cli_conn.addr.from;
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(51234);
+	inet_pton(AF_INET, "192.168.10.25", &sin->sin_addr);
+	sin = (struct sockaddr_in *)&cli_conn.addr.to;
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(80);
+	inet_pton(AF_INET, "10.0.0.1", &sin->sin_addr);
+	cli_conn.obj_type = OBJ_TYPE_CONN;
+	cli_conn.flags = CO_FL_ADDR_FROM_SET | CO_FL_ADDR_TO_SET;
+
+	srv_conn = cli_conn;
+	sin = (struct sockaddr_in *)&srv_conn.addr.to;
+	inet_pton(AF_INET, "10.0.1.12", &sin->sin_addr);
+	sin->sin_port = htons(8080);
+
+	srv.obj_type = OBJ_TYPE_SERVER;
+	srv.id = "srv12";
+	srv.cur_sess = 17;
+
+	sess.fe = sess.be = &px;
+	sess.listener = &li;
+	sess.target = &srv.obj_type;
+	sess.req = &req;
+	sess.rep = &rep;
+	sess.si[0].end = &cli_conn.obj_type;
+	sess.si[1].end = &srv_conn.obj_type;
+	sess.si[1].conn_retries = px.conn_retries;
+	req.prod = rep.cons = &sess.si[0];
+	req.cons = rep.prod = &sess.si[1];
+
+	sess.uniq_id = 1234;
+	sess.txn.status = 200;
+	sess.txn.uri = "GET /static/images/logo.png?version=12 HTTP/1.1";
+	sess.logs.tv_accept = sess.logs.accept_date = date;
+	sess.logs.tv_request = sess.logs.tv_accept;
+	sess.logs.tv_request.tv_usec += 3000;
+	sess.logs.t_queue = 3;
+	sess.logs.t_connect = 4;
+	sess.logs.t_data = 25;
+	sess.logs.t_close = 27;
+	sess.logs.bytes_in = 512;
+	sess.logs.bytes_out = 18426;
+}
+
+/* Formats whose texts and separators are merged when parsed, and the exact
+ * lines they must produce. A '%' followed by a blank is a text ending with a
+ * space, which must still be followed by the separator's space.
+ */
+static const struct {
+	const char *fmt;
+	const char *expected;
+} checks[] = {
+	{ "x%  %ci",         "x%  192.168.10.25" },
+	{ "x%    %ci",       "x%  192.168.10.25" },
+	{ "a b   c",         "a b c" },
+	{ "  a %ci  b ",     "a 192.168.10.25 b " },
+	{ "%ci  %ci",        "192.168.10.25 192.168.10.25" },
+	{ "[%ci]:%cp  %ST",  "[192.168.10.25]:51234 200" },
+};
+
+/* Returns the number of formats which do not produce the expected line */
+static int run_checks(void)
+{
+	struct list fmt;
+	int len, i, err = 0;
+
+	for (i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+		LIST_INIT(&fmt);
+		parse_logformat_string(checks[i].fmt, &px, &fmt, 0, SMP_VAL_FE_LOG_END, "bench", 0);
+		len = build_logline(&sess, line, sizeof(line), &fmt);
+		if (len != strlen(checks[i].expected) || memcmp(line, checks[i].expected, len) != 0) {
+			printf("format '%s' : got '%.*s', expected '%s'\n",
+			       checks[i].fmt, len, line, checks[i].expected);
+			err++;
+		}
+	}
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	struct timeval start, stop;
+	unsigned long long lines = 0;
+	int duration = 3;
+	char *fmt = default_http_log_format;
+	double elapsed;
+	int len = 0;
+	int i;
+
+	if (argc > 1)
+		duration = atoi(argv[1]);
+	if (argc > 2)
+		fmt = argv[2];
+
+	tv_update_date(-1, 1);
+	init_new_proxy(&px);
+	px.id = "public";
+	px.mode = PR_MODE_HTTP;
+	px.conn_retries = 3;
+	px.conf.args.file = "bench";
+	px.conf.args.ctx = ARGC_LOG;
+	init_session();
+	if (run_checks())
+		return 1;
+
+	parse_logformat_string(fmt, &px, &px.logformat, LOG_OPT_MANDATORY, SMP_VAL_FE_LOG_END, "bench", 0);
+
+	gettimeofday(&start, NULL);
+	do {
+		for (i = 0; i < 10000; i++) {
+			/* the date changes once per second in real life */
+			sess.logs.accept_date.tv_usec = (sess.logs.accept_date.tv_usec + 997) % 1000000;
+			len = build_logline(&sess, line, sizeof(line), &px.logformat);
+		}
+		lines += i;
+		gettimeofday(&stop, NULL);
+	} while (stop.tv_sec - start.tv_sec < duration);
+
+	elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_usec - start.tv_usec) / 1000000.0;
+	printf("%.*s\n", len, line);
+	printf("%llu lines in %.3f s : %.0f lines/s\n", lines, elapsed, lines / elapsed);
+	return 0;
+}
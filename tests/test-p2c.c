@@ -0,0 +1,183 @@
+/*
+ * Load balancing simulator comparing the "random" (power of two choices) and
+ * "leastconn" algorithms. A fixed number of concurrent connections is spread
+ * over a farm of servers. At each step, one connection picked at random ends
+ * and a new one is assigned by the algorithm. The load spread is measured as
+ * the average over all steps of the highest and lowest number of connections
+ * per server relative to the ideal one, and the CPU cost as the time spent
+ * per step. The connection which ends is drawn with a cheap generator so that
+ * the measured time is mostly spent in the algorithms.
+ *
+ * Since a single process always has an exact view of the servers' load,
+ * leastconn spreads the load more evenly here, while "random" is expected to
+ * cost less per connection since it does not maintain any tree.
+ *
+ * See tests/README to build it.
+ *
+ * Usage : test-p2c [<servers> [<conns/server> [<steps>]]]
+ * Half of the servers have weight 1 and the other half weight 3.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <common/time.h>
+
+#include <types/global.h>
+
+#include <proto/backend.h>
+#include <proto/lb_fwlc.h>
+#include <proto/lb_p2c.h>
+#include <proto/proxy.h>
+
+static struct proxy px;
+static struct server *srv;
+static struct server **conn;
+static int nbsrv = 1000, nbconn, steps = 10000000;
+static unsigned int rnd;
+
+/* returns a random connection index, using a 32-bit xorshift */
+static inline int random_conn(void)
+{
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	return ((unsigned long long)rnd * nbconn) >> 32;
+}
+
+/* prepares a backend of <nbsrv> servers with the LB algorithm <algo> */
+static void init_backend(int algo)
+{
+	int i;
+
+	init_new_proxy(&px);
+	px.id = "bench";
+	px.lbprm.algo = algo;
+	px.lbprm.wmult = 1;
+	for (i = nbsrv - 1; i >= 0; i--) {
+		memset(&srv[i], 0, sizeof(srv[i]));
+		srv[i].obj_type = OBJ_TYPE_SERVER;
+		srv[i].proxy = &px;
+		srv[i].state = SRV_RUNNING;
+		srv[i].uweight = (i & 1) ? 3 : 1;
+		srv[i].next = px.srv;
+		px.srv = &srv[i];
+	}
+
+	if ((algo & BE_LB_PARM) == BE_LB_CB_P2C) {
+		px.lbprm.algo |= BE_LB_LKUP_P2CARR;
+		p2c_init_server_array(&px);
+	}
+	else {
+		px.lbprm.algo |= BE_LB_LKUP_LCTREE;
+		fwlc_init_server_tree(&px);
+	}
+}
+
+static inline struct server *pick(void)
+{
+	if ((px.lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_P2CARR)
+		return p2c_get_next_server(&px, NULL);
+	return fwlc_get_next_server(&px, NULL);
+}
+
+static inline void take(struct server *s)
+{
+	s->served++;
+	if (px.lbprm.server_take_conn)
+		px.lbprm.server_take_conn(s);
+}
+
+static inline void drop(struct server *s)
+{
+	s->served--;
+	if (px.lbprm.server_drop_conn)
+		px.lbprm.server_drop_conn(s);
+}
+
+/* runs the simulation for algorithm <algo> and reports the results */
+static void run(const char *name, int algo)
+{
+	struct timespec start, stop;
+	double min_sum = 0, max_sum = 0, elapsed;
+	int totw = 0, samples = 0;
+	int step, i;
+
+	init_backend(algo);
+	for (i = 0; i < nbsrv; i++)
+		totw += srv[i].uweight;
+
+	srandom(1);
+	rnd = 1;
+	for (i = 0; i < nbconn; i++) {
+		conn[i] = pick();
+		take(conn[i]);
+	}
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+	for (step = 0; step < steps; step++) {
+		i = random_conn();
+		drop(conn[i]);
+		conn[i] = pick();
+		take(conn[i]);
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stop);
+	elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+	/* measure the spread on a few thousand steps only, as it is expensive */
+	for (step = 0; step < 2000; step++) {
+		double min = 1e9, max = 0, load;
+
+		i = random_conn();
+		drop(conn[i]);
+		conn[i] = pick();
+		take(conn[i]);
+
+		for (i = 0; i < nbsrv; i++) {
+			load = (double)srv[i].served * totw / srv[i].uweight / nbconn;
+			if (load < min)
+				min = load;
+			if (load > max)
+				max = load;
+		}
+		min_sum += min;
+		max_sum += max;
+		samples++;
+	}
+
+	printf("%-10s : %6.1f ns/conn, load min/max vs ideal : %.3f / %.3f\n",
+	       name, elapsed * 1e9 / steps, min_sum / samples, max_sum / samples);
+}
+
+int main(int argc, char **argv)
+{
+	int per_srv = 10;
+
+	if (argc > 1)
+		nbsrv = atoi(argv[1]);
+	if (argc > 2)
+		per_srv = atoi(argv[2]);
+	if (argc > 3)
+		steps = atoi(argv[3]);
+
+	if (nbsrv < 2 || per_srv < 1 || steps < 1) {
+		fprintf(stderr, "Usage: %s [<servers> [<conns/server> [<steps>]]]\n", argv[0]);
+		exit(1);
+	}
+
+	nbconn = nbsrv * per_srv;
+	srv = calloc(nbsrv, sizeof(*srv));
+	conn = calloc(nbconn, sizeof(*conn));
+	if (!srv || !conn) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	tv_update_date(-1, 1);
+	printf("%d servers, %d connections, %d steps\n", nbsrv, nbconn, steps);
+	run("leastconn", BE_LB_ALGO_LC);
+	run("random", BE_LB_ALGO_P2C);
+	return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Timer queue benchmark measuring the cost of requeuing a task in the wait
+ * queue depending on the number of tasks it holds, with and without the timer
+ * wheel. Tasks get a random timeout between 1 and 60 seconds, which is the
+ * typical case of client and server timeouts. At each step, one task picked at
+ * random has its timeout pushed forward and is requeued, as happens when some
+ * activity is detected on a connection. The date advances by one millisecond
+ * every 100 steps, and expired tasks are requeued with a new timeout.
+ *
+ * See tests/README to build it.
+ *
+ * Usage : test-timers [<steps>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <common/time.h>
+
+#include <types/global.h>
+
+#include <proto/task.h>
+
+static struct task **tasks;
+static int steps = 10000000;
+
+static int woken;
+
+/* sets a new random timeout on task <t> and requeues it */
+static inline void requeue(struct task *t)
+{
+	t->expire = tick_add(now_ms, 1000 + random() % 59000);
+	task_unlink_wq(t);
+	task_queue(t);
+}
+
+/* called for expired tasks, which are given a new timeout */
+static struct task *expired_process(struct task *t)
+{
+	t->expire = tick_add(now_ms, 1000 + random() % 59000);
+	woken++;
+	return t;
+}
+
+/* runs the benchmark on <nbtasks> tasks and reports the cost per step */
+static void run(int nbtasks, int wheel)
+{
+	struct timespec start, stop;
+	double elapsed;
+	int step, next, i;
+
+	if (wheel)
+		global.tune.options |= GTUNE_USE_TIMER_WHEEL;
+	else
+		global.tune.options &= ~GTUNE_USE_TIMER_WHEEL;
+
+	now_ms = 1;
+	woken = 0;
+	init_task();
+	srandom(1);
+	for (i = 0; i < nbtasks; i++) {
+		tasks[i] = task_new();
+		tasks[i]->process = expired_process;
+		requeue(tasks[i]);
+	}
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+	for (step = 0; step < steps; step++) {
+		requeue(tasks[random() % nbtasks]);
+		if (step % 100)
+			continue;
+
+		now_ms = tick_add(now_ms, 1);
+		wake_expired_tasks(&next);
+		while (run_queue)
+			process_runnable_tasks(&next);
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stop);
+	elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+	for (i = 0; i < nbtasks; i++) {
+		task_delete(tasks[i]);
+		task_free(tasks[i]);
+	}
+
+	printf("%8d tasks, %-5s : %6.1f ns/step, %d expired\n",
+	       nbtasks, wheel ? "wheel" : "tree", elapsed * 1e9 / steps, woken);
+}
+
+int main(int argc, char **argv)
+{
+	int nbtasks;
+
+	if (argc > 1)
+		steps = atoi(argv[1]);
+
+	if (steps < 1) {
+		fprintf(stderr, "Usage: %s [<steps>]\n", argv[0]);
+		exit(1);
+	}
+
+	tasks = calloc(1000000, sizeof(*tasks));
+	if (!tasks) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	printf("%d steps\n", steps);
+	for (nbtasks = 1000; nbtasks <= 1000000; nbtasks *= 10) {
+		run(nbtasks, 0);
+		run(nbtasks, 1);
+	}
+	return 0;
+}